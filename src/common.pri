@@ -15,7 +15,13 @@ QT += \
 # the unit tests need to provide a custom QNAM and uses a different database directory
 HEADERS += $$PWD/common/socialdnetworkaccessmanager_p.h
 !contains(DEFINES, 'SOCIALD_TEST_DEFINE') {
-    SOURCES += $$PWD/common/socialdnetworkaccessmanager_p.cpp
+    HEADERS += \
+        $$PWD/common/socialdnetworkscheduler_p.h \
+        $$PWD/common/socialdvalidatorcache_p.h
+    SOURCES += \
+        $$PWD/common/socialdnetworkaccessmanager_p.cpp \
+        $$PWD/common/socialdnetworkscheduler_p.cpp \
+        $$PWD/common/socialdvalidatorcache_p.cpp
     DEFINES += 'PRIVILEGED_DATA_DIR=\'\"/home/nemo/.local/share/system/privileged/\"\''
 }
 
@@ -26,12 +32,26 @@ INCLUDEPATH += . $$PWD/common/
 
 HEADERS += \
     $$PWD/common/buteosyncfw_p.h \
+    $$PWD/common/socialdavatarscheduler_p.h \
+    $$PWD/common/socialdavatarstore_p.h \
     $$PWD/common/socialdbuteoplugin.h \
+    $$PWD/common/socialdfieldprojection_p.h \
+    $$PWD/common/socialdjsonstreamparser_p.h \
+    $$PWD/common/socialdsynccheckpoints_p.h \
+    $$PWD/common/socialdsyncstats_p.h \
+    $$PWD/common/socialdtimeoutwheel_p.h \
     $$PWD/common/socialnetworksyncadaptor.h \
     $$PWD/common/trace.h
 
 SOURCES += \
+    $$PWD/common/socialdavatarscheduler_p.cpp \
+    $$PWD/common/socialdavatarstore_p.cpp \
     $$PWD/common/socialdbuteoplugin.cpp \
+    $$PWD/common/socialdfieldprojection_p.cpp \
+    $$PWD/common/socialdjsonstreamparser_p.cpp \
+    $$PWD/common/socialdsynccheckpoints_p.cpp \
+    $$PWD/common/socialdsyncstats_p.cpp \
+    $$PWD/common/socialdtimeoutwheel_p.cpp \
     $$PWD/common/socialnetworksyncadaptor.cpp
 
 contains(DEFINES, 'SOCIALD_USE_QTPIM') {
@@ -0,0 +1,492 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+
+#include "socialdavatarscheduler_p.h"
+#include "trace.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QJsonArray>
+#include <QtNetwork/QNetworkReply>
+
+#define SOCIALD_AVATAR_INITIAL_WINDOW 2
+#define SOCIALD_AVATAR_MAXIMUM_WINDOW 8
+#define SOCIALD_AVATAR_BACKOFF_MSECS 2000
+#define SOCIALD_AVATAR_MAXIMUM_BACKOFF_MSECS (2 * 60 * 1000)
+#define SOCIALD_AVATAR_SYNC_BUDGET_MSECS (10 * 60 * 1000)
+#define SOCIALD_AVATAR_DATA_COMPLETE_BUDGET_MSECS (60 * 1000)
+#define SOCIALD_AVATAR_IN_FLIGHT_GRACE_MSECS (30 * 1000)
+#define SOCIALD_AVATAR_USAGE_THRESHOLD 90 // percent
+
+static const char *AVATAR_ACCOUNT_ID_KEY = "avatar_account_id";
+
+namespace {
+    QString avatarQueueFileName()
+    {
+        return QString::fromLatin1("%1/%2/avatarqueue.ini")
+                .arg(QString::fromLatin1(PRIVILEGED_DATA_DIR))
+                .arg(QString::fromLatin1(SYNC_DATABASE_DIR));
+    }
+
+    // Retry-After is either a number of seconds or an HTTP date.
+    qint64 retryAfterMsecs(const QByteArray &retryAfter)
+    {
+        bool ok = false;
+        qint64 seconds = retryAfter.trimmed().toLongLong(&ok);
+        if (ok) {
+            return seconds * 1000;
+        }
+
+        QDateTime date = QDateTime::fromString(QString::fromLatin1(retryAfter.trimmed()), Qt::RFC2822Date);
+        return date.isValid() ? qMax<qint64>(0, QDateTime::currentDateTimeUtc().msecsTo(date)) : 0;
+    }
+
+    // Facebook reports the usage of its rate limits as percentages in the
+    // X-App-Usage and X-Business-Use-Case-Usage headers.
+    int usagePercent(const QJsonValue &value, qint64 *regainMsecs)
+    {
+        int retn = 0;
+        if (value.isArray()) {
+            foreach (const QJsonValue &element, value.toArray()) {
+                retn = qMax(retn, usagePercent(element, regainMsecs));
+            }
+        } else if (value.isObject()) {
+            QJsonObject object = value.toObject();
+            for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it) {
+                if (it.key() == QLatin1String("call_count")
+                        || it.key() == QLatin1String("total_time")
+                        || it.key() == QLatin1String("total_cputime")) {
+                    retn = qMax(retn, it.value().toInt());
+                } else if (it.key() == QLatin1String("estimated_time_to_regain_access")) {
+                    *regainMsecs = qMax<qint64>(*regainMsecs, it.value().toInt() * 60 * 1000);
+                } else {
+                    retn = qMax(retn, usagePercent(it.value(), regainMsecs));
+                }
+            }
+        }
+        return retn;
+    }
+}
+
+SocialdAvatarScheduler::SocialdAvatarScheduler(const QString &serviceName, const QString &dataType, QObject *parent)
+    : QObject(parent)
+    , m_settings(avatarQueueFileName(), QSettings::IniFormat)
+    , m_prefix(QString::fromLatin1("%1-%2").arg(serviceName).arg(dataType))
+    , m_resumeAt(0)
+    , m_window(SOCIALD_AVATAR_INITIAL_WINDOW)
+    , m_windowSuccesses(0)
+    , m_throttleCount(0)
+    , m_dispatchScheduled(false)
+    , m_aborted(false)
+{
+    m_clock.start();
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(dispatch()));
+}
+
+SocialdAvatarScheduler::~SocialdAvatarScheduler()
+{
+    m_settings.sync();
+}
+
+QString SocialdAvatarScheduler::downloadKey(int accountId, const QString &url)
+{
+    return QString::fromLatin1("%1/%2").arg(accountId).arg(url);
+}
+
+bool SocialdAvatarScheduler::isActive(int accountId) const
+{
+    return m_active.contains(accountId);
+}
+
+bool SocialdAvatarScheduler::hasInFlight(int accountId) const
+{
+    for (QHash<QString, Download>::const_iterator it = m_inFlight.constBegin(); it != m_inFlight.constEnd(); ++it) {
+        if (it.value().accountId == accountId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+ * \internal
+ * Queues the download of \a url.  A download which is already queued or
+ * in flight for the account is not queued again.
+ */
+void SocialdAvatarScheduler::enqueue(int accountId, const QString &url, const QVariantMap &metadata)
+{
+    QString key = downloadKey(accountId, url);
+    if (m_queuedKeys.contains(key) || m_inFlight.contains(key)) {
+        return;
+    }
+
+    Download download;
+    download.accountId = accountId;
+    download.url = url;
+    download.metadata = metadata;
+    download.metadata.insert(AVATAR_ACCOUNT_ID_KEY, accountId);
+    if (m_aborted) {
+        saveDeferred(accountId, QList<Download>() << download);
+        return;
+    }
+
+    m_queued[accountId].append(download);
+    m_queuedKeys.insert(key);
+    if (!m_accounts.contains(accountId)) {
+        m_accounts.append(accountId);
+    }
+
+    if (!m_active.contains(accountId)) {
+        m_active.insert(accountId);
+        m_deadlines.insert(accountId, m_clock.elapsed() + SOCIALD_AVATAR_SYNC_BUDGET_MSECS);
+        emit started(accountId);
+    }
+    scheduleDispatch();
+}
+
+/*!
+ * \internal
+ * Queues the downloads of the account which were deferred by its
+ * previous sync.
+ */
+void SocialdAvatarScheduler::restoreDeferred(int accountId)
+{
+    // a new sync has started.
+    m_aborted = false;
+
+    const QString key = QString::fromLatin1("%1/%2/queue").arg(m_prefix).arg(accountId);
+    QVariantList deferred = m_settings.value(key).toList();
+    if (deferred.isEmpty()) {
+        return;
+    }
+
+    m_settings.remove(key);
+    m_settings.sync();
+    SOCIALD_LOG_DEBUG("restoring" << deferred.size() << "deferred avatar downloads for account" << accountId);
+    foreach (const QVariant &variant, deferred) {
+        QVariantMap download = variant.toMap();
+        enqueue(accountId, download.value(QStringLiteral("url")).toString(),
+                download.value(QStringLiteral("metadata")).toMap());
+    }
+}
+
+/*!
+ * \internal
+ * Gives the remaining downloads of the account a short time budget, as
+ * the sync of the account is only waiting for them.
+ */
+void SocialdAvatarScheduler::setDataComplete(int accountId)
+{
+    if (!m_active.contains(accountId)) {
+        return;
+    }
+
+    qint64 deadline = m_clock.elapsed() + SOCIALD_AVATAR_DATA_COMPLETE_BUDGET_MSECS;
+    m_deadlines.insert(accountId, qMin(deadline, m_deadlines.value(accountId, deadline)));
+    scheduleDispatch();
+}
+
+void SocialdAvatarScheduler::removeAll(int accountId)
+{
+    foreach (const Download &download, m_queued.take(accountId)) {
+        m_queuedKeys.remove(downloadKey(accountId, download.url));
+    }
+    m_accounts.removeAll(accountId);
+    abandonInFlight(accountId, 0);
+
+    m_settings.remove(QString::fromLatin1("%1/%2").arg(m_prefix).arg(accountId));
+    m_settings.sync();
+    checkFinished(accountId);
+}
+
+/*!
+ * \internal
+ * Defers the queued and in-flight downloads of every account to its next
+ * sync, aborting the requests which are in flight, so that an aborted
+ * sync does not wait for them.  The finished() signal is emitted for
+ * each account which had downloads.  Downloads which are queued after
+ * this are deferred immediately, until restoreDeferred() is called by
+ * the next sync.
+ */
+void SocialdAvatarScheduler::deferAll()
+{
+    m_aborted = true;
+    foreach (int accountId, m_active.toList()) {
+        defer(accountId, true);
+    }
+}
+
+/*!
+ * \internal
+ * Records the response to the download request \a reply, which must be
+ * called by the image downloader when it creates the request.
+ */
+void SocialdAvatarScheduler::watchReply(const QString &url, const QVariantMap &metadata, QNetworkReply *reply)
+{
+    QString key = downloadKey(metadata.value(AVATAR_ACCOUNT_ID_KEY).toInt(), url);
+    reply->setProperty("avatarDownloadKey", key);
+    m_replies.insert(key, reply);
+    connect(reply, SIGNAL(finished()), this, SLOT(replyFinished()));
+}
+
+/*!
+ * \internal
+ * Stops tracking the in-flight downloads of the account, appending them
+ * to \a downloads if it is not null, and aborts their requests.
+ */
+void SocialdAvatarScheduler::abandonInFlight(int accountId, QList<Download> *downloads)
+{
+    QList<QPointer<QNetworkReply> > replies;
+    QHash<QString, Download>::iterator it = m_inFlight.begin();
+    while (it != m_inFlight.end()) {
+        if (it.value().accountId == accountId) {
+            if (downloads) {
+                downloads->append(it.value());
+            }
+            m_responses.remove(it.key());
+            replies.append(m_replies.take(it.key()));
+            it = m_inFlight.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // the downloader reports the aborted requests as failed, which are
+    // ignored as they are no longer in flight.
+    foreach (const QPointer<QNetworkReply> &reply, replies) {
+        if (reply) {
+            disconnect(reply.data(), SIGNAL(finished()), this, SLOT(replyFinished()));
+            reply->abort();
+        }
+    }
+}
+
+void SocialdAvatarScheduler::replyFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    QString key = reply->property("avatarDownloadKey").toString();
+    m_replies.remove(key);
+    if (!m_inFlight.contains(key)) {
+        return;
+    }
+
+    Response response;
+    response.status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    response.etag = reply->rawHeader("ETag");
+    response.lastModified = reply->rawHeader("Last-Modified");
+    m_responses.insert(key, response);
+
+    qint64 retryAfter = retryAfterMsecs(reply->rawHeader("Retry-After"));
+    if (response.status == 429 || response.status == 503) {
+        m_throttleCount++;
+        qint64 backoff = retryAfter > 0
+                ? retryAfter
+                : qMin<qint64>(SOCIALD_AVATAR_BACKOFF_MSECS << qMin(m_throttleCount - 1, 16),
+                               SOCIALD_AVATAR_MAXIMUM_BACKOFF_MSECS);
+        SOCIALD_LOG_INFO("avatar downloads throttled by" << reply->url().host() << "with status" << response.status <<
+                         "- backing off for" << backoff << "msecs");
+        decreaseWindow(backoff);
+        return;
+    }
+
+    // the service may report that it is about to throttle requests.
+    qint64 regainMsecs = 0;
+    int usage = 0;
+    foreach (const QByteArray &header, QList<QByteArray>() << "X-App-Usage" << "X-Business-Use-Case-Usage") {
+        QByteArray value = reply->rawHeader(header);
+        if (!value.isEmpty()) {
+            usage = qMax(usage, usagePercent(QJsonDocument::fromJson(value).object(), &regainMsecs));
+        }
+    }
+    if (usage >= SOCIALD_AVATAR_USAGE_THRESHOLD || regainMsecs > 0) {
+        SOCIALD_LOG_DEBUG("avatar download rate limit usage at" << usage << "percent for" << reply->url().host());
+        decreaseWindow(qMax(retryAfter, regainMsecs));
+    } else if (response.status >= 200 && response.status < 400) {
+        m_throttleCount = 0;
+        increaseWindow();
+    }
+}
+
+void SocialdAvatarScheduler::downloadFinished(const QString &url, const QString &path, const QVariantMap &metadata)
+{
+    int accountId = metadata.value(AVATAR_ACCOUNT_ID_KEY).toInt();
+    QString key = downloadKey(accountId, url);
+    QHash<QString, Download>::iterator it = m_inFlight.find(key);
+    if (it == m_inFlight.end()) {
+        // the download was abandoned, and will be retried by the next sync.
+        return;
+    }
+
+    Download download = it.value();
+    m_inFlight.erase(it);
+    Response response = m_responses.take(key);
+    if (response.status == 429 || response.status == 503) {
+        // retry the download once the backoff period has passed.
+        m_queued[accountId].prepend(download);
+        m_queuedKeys.insert(key);
+        if (!m_accounts.contains(accountId)) {
+            m_accounts.prepend(accountId);
+        }
+    } else {
+        QVariantMap responseMetadata = metadata;
+        responseMetadata.remove(AVATAR_ACCOUNT_ID_KEY);
+        responseMetadata.insert(SOCIALD_AVATAR_STATUS_KEY, response.status);
+        responseMetadata.insert(SOCIALD_AVATAR_ETAG_KEY, response.etag);
+        responseMetadata.insert(SOCIALD_AVATAR_LAST_MODIFIED_KEY, response.lastModified);
+        emit imageDownloaded(url, path, responseMetadata);
+    }
+
+    checkFinished(accountId);
+    scheduleDispatch();
+}
+
+void SocialdAvatarScheduler::scheduleDispatch()
+{
+    if (!m_dispatchScheduled) {
+        m_dispatchScheduled = true;
+        QMetaObject::invokeMethod(this, "dispatch", Qt::QueuedConnection);
+    }
+}
+
+void SocialdAvatarScheduler::increaseWindow()
+{
+    if (++m_windowSuccesses >= m_window) {
+        m_windowSuccesses = 0;
+        m_window = qMin(m_window + 1, SOCIALD_AVATAR_MAXIMUM_WINDOW);
+    }
+}
+
+void SocialdAvatarScheduler::decreaseWindow(qint64 backoff)
+{
+    qint64 now = m_clock.elapsed();
+    if (now < m_resumeAt) {
+        // the downloads which were in flight when the service started
+        // throttling are part of the same event.
+        m_resumeAt = qMax(m_resumeAt, now + backoff);
+        return;
+    }
+
+    m_window = qMax(1, m_window / 2);
+    m_windowSuccesses = 0;
+    m_resumeAt = now + backoff;
+}
+
+/*!
+ * \internal
+ * Saves the queued downloads of the account (and also those which are in
+ * flight, whose requests are aborted, if \a abandon is true) to be
+ * restored by the next sync.
+ */
+void SocialdAvatarScheduler::defer(int accountId, bool abandon)
+{
+    QList<Download> downloads = m_queued.take(accountId);
+    m_accounts.removeAll(accountId);
+    if (abandon) {
+        abandonInFlight(accountId, &downloads);
+    }
+
+    if (!downloads.isEmpty()) {
+        saveDeferred(accountId, downloads);
+        SOCIALD_LOG_INFO("deferred" << downloads.size() << "avatar downloads for account" << accountId << "to the next sync");
+    }
+
+    checkFinished(accountId);
+}
+
+void SocialdAvatarScheduler::saveDeferred(int accountId, const QList<Download> &downloads)
+{
+    const QString key = QString::fromLatin1("%1/%2/queue").arg(m_prefix).arg(accountId);
+    QVariantList deferred = m_settings.value(key).toList();
+    foreach (const Download &download, downloads) {
+        m_queuedKeys.remove(downloadKey(accountId, download.url));
+        QVariantMap metadata = download.metadata;
+        metadata.remove(AVATAR_ACCOUNT_ID_KEY);
+        QVariantMap variant;
+        variant.insert(QStringLiteral("url"), download.url);
+        variant.insert(QStringLiteral("metadata"), metadata);
+        deferred.append(variant);
+    }
+    m_settings.setValue(key, deferred);
+    m_settings.sync();
+}
+
+void SocialdAvatarScheduler::checkFinished(int accountId)
+{
+    if (m_active.contains(accountId) && !m_queued.contains(accountId) && !hasInFlight(accountId)) {
+        m_active.remove(accountId);
+        m_deadlines.remove(accountId);
+        emit finished(accountId);
+    }
+}
+
+void SocialdAvatarScheduler::dispatch()
+{
+    m_dispatchScheduled = false;
+    const qint64 now = m_clock.elapsed();
+
+    // the downloads which don't fit in the budget of their account are deferred,
+    // so that they never hold up the completion of the sync.
+    foreach (int accountId, m_deadlines.keys()) {
+        qint64 deadline = m_deadlines.value(accountId);
+        if (now >= deadline + SOCIALD_AVATAR_IN_FLIGHT_GRACE_MSECS) {
+            defer(accountId, true);
+        } else if (m_queued.contains(accountId) && (now >= deadline || m_resumeAt >= deadline)) {
+            defer(accountId, false);
+        }
+    }
+
+    // start the queued downloads within the window, taking turns between accounts.
+    while (now >= m_resumeAt && m_inFlight.size() < m_window && !m_accounts.isEmpty()) {
+        int accountId = m_accounts.takeFirst();
+        QList<Download> &queue(m_queued[accountId]);
+        Download next = queue.takeFirst();
+        if (queue.isEmpty()) {
+            m_queued.remove(accountId);
+        } else {
+            m_accounts.append(accountId);
+        }
+
+        QString key = downloadKey(accountId, next.url);
+        m_queuedKeys.remove(key);
+        m_inFlight.insert(key, next);
+        emit download(next.url, next.metadata);
+    }
+
+    // wake up at the end of the backoff period, or at the next deadline.
+    qint64 wakeAt = -1;
+    if (!m_accounts.isEmpty() && now < m_resumeAt) {
+        wakeAt = m_resumeAt;
+    }
+    for (QHash<int, qint64>::const_iterator it = m_deadlines.constBegin(); it != m_deadlines.constEnd(); ++it) {
+        qint64 deadline = m_queued.contains(it.key()) ? it.value() : it.value() + SOCIALD_AVATAR_IN_FLIGHT_GRACE_MSECS;
+        if (wakeAt < 0 || deadline < wakeAt) {
+            wakeAt = deadline;
+        }
+    }
+    if (wakeAt >= 0) {
+        m_timer.start(static_cast<int>(qMax<qint64>(0, wakeAt - now)));
+    } else {
+        m_timer.stop();
+    }
+}
@@ -0,0 +1,136 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+
+#ifndef SOCIALD_AVATARSCHEDULER_P_H
+#define SOCIALD_AVATARSCHEDULER_P_H
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QVariantMap>
+#include <QtCore/QList>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QSettings>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QPointer>
+
+class QNetworkReply;
+
+// the response to a download, added to the metadata of imageDownloaded()
+#define SOCIALD_AVATAR_STATUS_KEY QStringLiteral("avatar_status")
+#define SOCIALD_AVATAR_ETAG_KEY QStringLiteral("avatar_etag")
+#define SOCIALD_AVATAR_LAST_MODIFIED_KEY QStringLiteral("avatar_last_modified")
+
+/*
+ * Schedules the avatar downloads of a contact sync adaptor.  Downloads
+ * are started (via the download() signal, connected to the image
+ * downloader's queue()) within a window which grows by one for each
+ * window of successful downloads, and is halved when the service
+ * signals that it is throttling requests, in which case no downloads
+ * are started until the backoff period has passed.  Throttled downloads
+ * are retried.
+ *
+ * The downloads of an account must finish before the sync of the account
+ * completes, so they have a time budget which is tightened once the
+ * contact data has been stored (see setDataComplete()).  Downloads which
+ * do not fit in the budget are deferred to the next sync of the account.
+ *
+ * The started() and finished() signals are emitted when an account gets
+ * its first download and when it has none left, so that the sync adaptor
+ * can hold a single semaphore for them.  When the sync is aborted, the
+ * remaining downloads of every account, and those queued by the handlers
+ * which still run, are deferred (see deferAll()).
+ */
+class SocialdAvatarScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    SocialdAvatarScheduler(const QString &serviceName, const QString &dataType, QObject *parent = 0);
+    ~SocialdAvatarScheduler();
+
+    bool isActive(int accountId) const;
+    void enqueue(int accountId, const QString &url, const QVariantMap &metadata);
+    void restoreDeferred(int accountId);
+    void setDataComplete(int accountId);
+    void removeAll(int accountId);
+    void deferAll();
+    void watchReply(const QString &url, const QVariantMap &metadata, QNetworkReply *reply);
+
+public Q_SLOTS:
+    void downloadFinished(const QString &url, const QString &path, const QVariantMap &metadata);
+
+Q_SIGNALS:
+    void download(const QString &url, const QVariantMap &metadata);
+    void imageDownloaded(const QString &url, const QString &path, const QVariantMap &metadata);
+    void started(int accountId);
+    void finished(int accountId);
+
+private Q_SLOTS:
+    void dispatch();
+    void replyFinished();
+
+private:
+    struct Download {
+        int accountId;
+        QString url;
+        QVariantMap metadata;
+    };
+    struct Response {
+        Response() : status(0) {}
+        int status;
+        QByteArray etag;
+        QByteArray lastModified;
+    };
+
+    static QString downloadKey(int accountId, const QString &url);
+    void scheduleDispatch();
+    void increaseWindow();
+    void decreaseWindow(qint64 backoff);
+    void defer(int accountId, bool abandon);
+    void saveDeferred(int accountId, const QList<Download> &downloads);
+    void checkFinished(int accountId);
+    bool hasInFlight(int accountId) const;
+    void abandonInFlight(int accountId, QList<Download> *downloads);
+
+    QSettings m_settings;
+    QString m_prefix;
+    QList<int> m_accounts; // accounts with queued downloads, in round-robin order
+    QHash<int, QList<Download> > m_queued;
+    QSet<QString> m_queuedKeys; // account and url
+    QHash<QString, Download> m_inFlight; // account and url -> download
+    QHash<QString, Response> m_responses; // account and url -> response
+    QHash<QString, QPointer<QNetworkReply> > m_replies; // account and url -> reply
+    QHash<int, qint64> m_deadlines;
+    QSet<int> m_active;
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+    qint64 m_resumeAt;
+    int m_window;
+    int m_windowSuccesses;
+    int m_throttleCount; // consecutive throttled responses
+    bool m_dispatchScheduled;
+    bool m_aborted; // downloads are deferred until the next sync
+};
+
+#endif // SOCIALD_AVATARSCHEDULER_P_H
@@ -0,0 +1,372 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+
+#include "socialdavatarstore_p.h"
+#include "trace.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSet>
+#include <QtNetwork/QNetworkRequest>
+
+#include <utime.h>
+
+// blobs younger than this may have been stored by another process
+// which has not yet written its reference.
+#define SOCIALD_AVATAR_STORE_GRACE_PERIOD_SECS 3600
+
+namespace {
+    QString avatarsDirectory()
+    {
+        return QString::fromLatin1("%1/%2/avatars")
+                .arg(QString::fromLatin1(PRIVILEGED_DATA_DIR))
+                .arg(QString::fromLatin1(SYNC_DATABASE_DIR));
+    }
+
+    QString avatarsFileName()
+    {
+        return QString::fromLatin1("%1/%2/avatars.ini")
+                .arg(QString::fromLatin1(PRIVILEGED_DATA_DIR))
+                .arg(QString::fromLatin1(SYNC_DATABASE_DIR));
+    }
+
+    QString encodedIdentifier(const QString &identifier)
+    {
+        // identifiers are arbitrary, and may contain '/'.
+        return QString::fromLatin1(identifier.toUtf8().toHex());
+    }
+
+    QString blobFileName(const QString &downloadedFile)
+    {
+        QFile file(downloadedFile);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return QString();
+        }
+
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        while (!file.atEnd()) {
+            hash.addData(file.read(64 * 1024));
+        }
+
+        QString suffix = QFileInfo(downloadedFile).suffix();
+        return QString::fromLatin1(hash.result().toHex())
+                + (suffix.isEmpty() ? QString() : QStringLiteral(".") + suffix);
+    }
+}
+
+SocialdAvatarStore::SocialdAvatarStore(const QString &serviceName, const QString &dataType)
+    : m_settings(avatarsFileName(), QSettings::IniFormat)
+    , m_prefix(QString::fromLatin1("%1-%2").arg(serviceName).arg(dataType))
+{
+}
+
+SocialdAvatarStore::~SocialdAvatarStore()
+{
+    flush();
+}
+
+QString SocialdAvatarStore::group(int accountId) const
+{
+    return QString::fromLatin1("%1/%2").arg(m_prefix).arg(accountId);
+}
+
+QString SocialdAvatarStore::referenceGroup(int accountId, const QString &identifier) const
+{
+    return QString::fromLatin1("%1/%2").arg(group(accountId)).arg(encodedIdentifier(identifier));
+}
+
+// Reads through the changes which haven't been flushed yet.
+QVariant SocialdAvatarStore::value(const QString &key) const
+{
+    QHash<QString, QVariant>::const_iterator it = m_pendingValues.constFind(key);
+    if (it != m_pendingValues.constEnd()) {
+        return it.value();
+    }
+
+    foreach (const QString &removed, m_pendingRemovals) {
+        if (key == removed || key.startsWith(removed + QLatin1Char('/'))) {
+            return QVariant();
+        }
+    }
+
+    return m_settings.value(key);
+}
+
+void SocialdAvatarStore::setValue(const QString &key, const QVariant &value)
+{
+    m_pendingValues.insert(key, value);
+}
+
+void SocialdAvatarStore::remove(const QString &prefix)
+{
+    QHash<QString, QVariant>::iterator it = m_pendingValues.begin();
+    while (it != m_pendingValues.end()) {
+        if (it.key() == prefix || it.key().startsWith(prefix + QLatin1Char('/'))) {
+            it = m_pendingValues.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (!m_pendingRemovals.contains(prefix)) {
+        m_pendingRemovals.append(prefix);
+    }
+}
+
+/*!
+ * \internal
+ * Writes the changes to the references made since the last flush().
+ */
+void SocialdAvatarStore::flush()
+{
+    if (m_pendingValues.isEmpty() && m_pendingRemovals.isEmpty()) {
+        return;
+    }
+
+    // values set after a removal have been kept, so the removals go first.
+    foreach (const QString &removed, m_pendingRemovals) {
+        m_settings.remove(removed);
+    }
+    for (QHash<QString, QVariant>::const_iterator it = m_pendingValues.constBegin();
+         it != m_pendingValues.constEnd(); ++it) {
+        m_settings.setValue(it.key(), it.value());
+    }
+    m_pendingValues.clear();
+    m_pendingRemovals.clear();
+    m_settings.sync();
+}
+
+/*!
+ * \internal
+ * Returns the path of the image referenced by \a identifier, or an empty
+ * string if there is no reference or its image is missing.
+ */
+QString SocialdAvatarStore::imageFile(int accountId, const QString &identifier) const
+{
+    QString image = value(referenceGroup(accountId, identifier) + QStringLiteral("/image")).toString();
+    if (image.isEmpty()) {
+        return QString();
+    }
+
+    QString path = avatarsDirectory() + QLatin1Char('/') + image;
+    return QFile::exists(path) ? path : QString();
+}
+
+QString SocialdAvatarStore::sourceUrl(int accountId, const QString &identifier) const
+{
+    return value(referenceGroup(accountId, identifier) + QStringLiteral("/url")).toString();
+}
+
+QByteArray SocialdAvatarStore::etag(int accountId, const QString &identifier) const
+{
+    return value(referenceGroup(accountId, identifier) + QStringLiteral("/etag")).toByteArray();
+}
+
+/*!
+ * \internal
+ * Makes \a request conditional on the validators of the stored image, if
+ * the image is still available.  A 304 response should be handled with
+ * revalidate().
+ */
+void SocialdAvatarStore::prepareRequest(int accountId, const QString &identifier, QNetworkRequest *request) const
+{
+    if (imageFile(accountId, identifier).isEmpty()) {
+        return;
+    }
+
+    const QString prefix = referenceGroup(accountId, identifier);
+    QByteArray etag = value(prefix + QStringLiteral("/etag")).toByteArray();
+    QByteArray lastModified = value(prefix + QStringLiteral("/lastModified")).toByteArray();
+    if (!etag.isEmpty()) {
+        request->setRawHeader("If-None-Match", etag);
+    }
+    if (!lastModified.isEmpty()) {
+        request->setRawHeader("If-Modified-Since", lastModified);
+    }
+}
+
+// Moves the downloaded file into the store, unless an identical image is
+// already stored, and returns the file name of the image.
+QString SocialdAvatarStore::storeImage(const QString &downloadedFile)
+{
+    QString image = blobFileName(downloadedFile);
+    if (image.isEmpty()) {
+        SOCIALD_LOG_ERROR("unable to read downloaded avatar" << downloadedFile);
+        return QString();
+    }
+
+    QDir().mkpath(avatarsDirectory());
+    QString path = avatarsDirectory() + QLatin1Char('/') + image;
+    if (QFile::exists(path)) {
+        if (QFileInfo(downloadedFile).canonicalFilePath() != QFileInfo(path).canonicalFilePath()) {
+            QFile::remove(downloadedFile);
+        }
+    } else if (!QFile::rename(downloadedFile, path)) {
+        // the download may be on another filesystem.
+        if (!QFile::copy(downloadedFile, path)) {
+            SOCIALD_LOG_ERROR("unable to store avatar" << downloadedFile << "as" << path);
+            return QString();
+        }
+        QFile::remove(downloadedFile);
+    }
+
+    // neither a renamed nor a shared image has a recent modification time,
+    // which would protect it from the garbage collection of another process
+    // until the reference to it has been written.
+    utime(QFile::encodeName(path).constData(), 0);
+    return image;
+}
+
+void SocialdAvatarStore::setReference(const QString &prefix, const QString &image, const QString &sourceUrl,
+                                      const QByteArray &etag, const QByteArray &lastModified)
+{
+    setValue(prefix + QStringLiteral("/image"), image);
+    setValue(prefix + QStringLiteral("/url"), sourceUrl);
+    setValue(prefix + QStringLiteral("/etag"), etag);
+    setValue(prefix + QStringLiteral("/lastModified"), lastModified);
+}
+
+/*!
+ * \internal
+ * Moves \a downloadedFile into the store and points the reference at it.
+ * If an identical image is already stored, the downloaded file is removed
+ * and the existing image is shared instead.  Returns the path of the
+ * stored image, or an empty string on failure.
+ */
+QString SocialdAvatarStore::store(int accountId, const QString &identifier, const QString &downloadedFile,
+                                  const QString &sourceUrl, const QByteArray &etag,
+                                  const QByteArray &lastModified)
+{
+    QString image = storeImage(downloadedFile);
+    if (image.isEmpty()) {
+        return QString();
+    }
+
+    const QString prefix = referenceGroup(accountId, identifier);
+    remove(prefix + QStringLiteral("/staged"));
+    setReference(prefix, image, sourceUrl, etag, lastModified);
+    return avatarsDirectory() + QLatin1Char('/') + image;
+}
+
+/*!
+ * \internal
+ * Moves \a downloadedFile into the store as store() does, but the reference
+ * keeps its current image (and validators) until commit() is called, once
+ * the contact has been saved with the returned image.  The staged image is
+ * not removed by collectGarbage() meanwhile.
+ */
+QString SocialdAvatarStore::stage(int accountId, const QString &identifier, const QString &downloadedFile,
+                                  const QString &sourceUrl, const QByteArray &etag,
+                                  const QByteArray &lastModified)
+{
+    QString image = storeImage(downloadedFile);
+    if (image.isEmpty()) {
+        return QString();
+    }
+
+    setReference(referenceGroup(accountId, identifier) + QStringLiteral("/staged"),
+                 image, sourceUrl, etag, lastModified);
+    return avatarsDirectory() + QLatin1Char('/') + image;
+}
+
+/*!
+ * \internal
+ * Points the reference at its staged image, if any.
+ */
+void SocialdAvatarStore::commit(int accountId, const QString &identifier)
+{
+    const QString prefix = referenceGroup(accountId, identifier);
+    const QString staged = prefix + QStringLiteral("/staged");
+    QString image = value(staged + QStringLiteral("/image")).toString();
+    if (image.isEmpty()) {
+        return;
+    }
+
+    setReference(prefix, image,
+                 value(staged + QStringLiteral("/url")).toString(),
+                 value(staged + QStringLiteral("/etag")).toByteArray(),
+                 value(staged + QStringLiteral("/lastModified")).toByteArray());
+    remove(staged);
+}
+
+/*!
+ * \internal
+ * Records that the stored image is still current, as the source of the
+ * reference responded with 304 Not Modified for \a sourceUrl.
+ */
+bool SocialdAvatarStore::revalidate(int accountId, const QString &identifier, const QString &sourceUrl)
+{
+    if (imageFile(accountId, identifier).isEmpty()) {
+        return false;
+    }
+
+    setValue(referenceGroup(accountId, identifier) + QStringLiteral("/url"), sourceUrl);
+    return true;
+}
+
+void SocialdAvatarStore::release(int accountId, const QString &identifier)
+{
+    remove(referenceGroup(accountId, identifier));
+}
+
+void SocialdAvatarStore::releaseAll(int accountId)
+{
+    remove(group(accountId));
+}
+
+/*!
+ * \internal
+ * Removes the stored images which are no longer referenced by any service
+ * or account.  Returns the number of images which were removed.
+ */
+int SocialdAvatarStore::collectGarbage()
+{
+    // pick up the references written by other processes.
+    flush();
+    m_settings.sync();
+
+    // staged images are referenced too, as "<reference>/staged/image".
+    QSet<QString> referenced;
+    foreach (const QString &key, m_settings.allKeys()) {
+        if (key.endsWith(QStringLiteral("/image"))) {
+            referenced.insert(m_settings.value(key).toString());
+        }
+    }
+
+    int removed = 0;
+    const QDateTime threshold = QDateTime::currentDateTimeUtc().addSecs(-SOCIALD_AVATAR_STORE_GRACE_PERIOD_SECS);
+    QDir directory(avatarsDirectory());
+    foreach (const QFileInfo &info, directory.entryInfoList(QDir::Files)) {
+        if (referenced.contains(info.fileName()) || info.lastModified().toUTC() > threshold) {
+            continue;
+        }
+        if (QFile::remove(info.filePath())) {
+            removed++;
+        }
+    }
+
+    SOCIALD_LOG_DEBUG("removed" << removed << "unreferenced avatars of" << referenced.size());
+    return removed;
+}
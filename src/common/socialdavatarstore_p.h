@@ -0,0 +1,104 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+
+#ifndef SOCIALD_AVATARSTORE_P_H
+#define SOCIALD_AVATARSTORE_P_H
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QSettings>
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QVariant>
+
+class QNetworkRequest;
+
+/*
+ * A content-addressed store of contact avatar images, shared by the
+ * contact sync adaptors of every service and account.  Each image is
+ * stored once, in a file named by the hash of its content, however many
+ * contacts reference it.
+ *
+ * A reference is identified by account and by an identifier chosen by
+ * the sync adaptor (eg, a contact guid).  It records the image and the
+ * url it was downloaded from, along with the validators of that download
+ * (the service's photo etag, or the ETag / Last-Modified response
+ * headers) so that a refresh can be skipped or made conditional.
+ *
+ * An image downloaded during a sync is first staged: the reference keeps
+ * its previous image until the contact which uses the new one has been
+ * saved, at which point the adaptor commits it.  Until then, both images
+ * count as referenced.
+ *
+ * The reference count of an image is the number of references to it.
+ * Every reference is a separate entry, so that adaptors running in
+ * different processes never overwrite each other's counts.  Images which
+ * are no longer referenced are removed by collectGarbage().
+ *
+ * Changes to the references are kept in memory until flush(), which the
+ * adaptors call once per account at the end of its sync, as rewriting the
+ * whole file for every avatar is quadratic in the number of contacts.
+ * Images stored meanwhile are protected from the garbage collection of
+ * other processes by their modification time.
+ */
+class SocialdAvatarStore
+{
+public:
+    SocialdAvatarStore(const QString &serviceName, const QString &dataType);
+    ~SocialdAvatarStore();
+
+    QString imageFile(int accountId, const QString &identifier) const;
+    QString sourceUrl(int accountId, const QString &identifier) const;
+    QByteArray etag(int accountId, const QString &identifier) const;
+    void prepareRequest(int accountId, const QString &identifier, QNetworkRequest *request) const;
+
+    QString store(int accountId, const QString &identifier, const QString &downloadedFile,
+                  const QString &sourceUrl, const QByteArray &etag = QByteArray(),
+                  const QByteArray &lastModified = QByteArray());
+    QString stage(int accountId, const QString &identifier, const QString &downloadedFile,
+                  const QString &sourceUrl, const QByteArray &etag = QByteArray(),
+                  const QByteArray &lastModified = QByteArray());
+    void commit(int accountId, const QString &identifier);
+    bool revalidate(int accountId, const QString &identifier, const QString &sourceUrl);
+    void release(int accountId, const QString &identifier);
+    void releaseAll(int accountId);
+
+    void flush();
+    int collectGarbage();
+
+private:
+    QString group(int accountId) const;
+    QString referenceGroup(int accountId, const QString &identifier) const;
+    QString storeImage(const QString &downloadedFile);
+    void setReference(const QString &prefix, const QString &image, const QString &sourceUrl,
+                      const QByteArray &etag, const QByteArray &lastModified);
+    QVariant value(const QString &key) const;
+    void setValue(const QString &key, const QVariant &value);
+    void remove(const QString &prefix);
+
+    QSettings m_settings;
+    QString m_prefix;
+    QHash<QString, QVariant> m_pendingValues;
+    QStringList m_pendingRemovals;
+};
+
+#endif // SOCIALD_AVATARSTORE_P_H
@@ -38,6 +38,27 @@
 
 namespace {
     static const QString SyncProfileTemplatesKey = QStringLiteral("sync_profile_templates");
+    // unless set to false on a template profile, all of its accounts are
+    // synced concurrently by this plugin instance.  The sociald.All sync
+    // relies on this to know when the sync of a data type has finished
+    // (and so, e.g., to sync the Signon profile first), so it is also the
+    // default for template profiles stored before the key was added.
+    // The per-account profiles keep their own schedules, so an account
+    // whose per-account sync is running is skipped, and a per-account sync
+    // doesn't start while a multi-account sync of its template is running.
+    static const QString MultiAccountSyncKey = QStringLiteral("multi_account_sync");
+    // the names of the profiles which the sync daemon is currently syncing.
+    QStringList runningSyncProfiles()
+    {
+        QDBusMessage message = QDBusMessage::createMethodCall(
+                "com.meego.msyncd", "/synchronizer", "com.meego.msyncd", "runningSyncs");
+        QDBusMessage reply = QDBusConnection::sessionBus().call(message);
+        if (reply.type() != QDBusMessage::ReplyMessage || reply.arguments().isEmpty()) {
+            SOCIALD_LOG_ERROR("unable to query the running syncs:" << reply.errorMessage());
+            return QStringList();
+        }
+        return reply.arguments().first().toStringList();
+    }
     static QString SyncProfileIdKey(const QString &templateProfileName)
     {
         return QStringLiteral("%1/%2").arg(templateProfileName).arg(Buteo::KEY_PROFILE_ID);
@@ -118,6 +139,7 @@ SocialdButeoPlugin::SocialdButeoPlugin(const QString& pluginName,
     , m_socialServiceName(socialServiceName)
     , m_dataTypeName(dataTypeName)
     , m_profileAccountId(0)
+    , m_abortReason(Buteo::SyncResults::NO_ERROR)
 {
 }
 
@@ -148,9 +170,12 @@ bool SocialdButeoPlugin::startSync()
 {
     // if the profile being triggered is the template profile, then we
     // need to ensure that the appropriate per-account profiles exist.
-    if (m_profileAccountId == 0) {
+    if (m_profileAccountId == 0 && profile().boolKey(MultiAccountSyncKey, true)) {
+        return startMultiAccountSync();
+    } else if (m_profileAccountId == 0) {
         QList<Buteo::SyncProfile*> perAccountProfiles = ensurePerAccountSyncProfilesExist();
         m_socialNetworkSyncAdaptor->setAccountSyncProfile(NULL);
+        m_socialNetworkSyncAdaptor->setAccountSyncProfiles(QList<Buteo::SyncProfile*>());
 
         // we need to trigger sync with each profile separately,
         // or (due to scheduling/etc) another plugin instance might
@@ -162,8 +187,13 @@ bool SocialdButeoPlugin::startSync()
             message.setArguments(QVariantList() << perAccountProfile->name());
             QDBusConnection::sessionBus().asyncCall(message);
         }
+    } else if (multiAccountSyncRunning()) {
+        SOCIALD_LOG_INFO("not syncing" << m_dataTypeName << "from" << m_socialServiceName <<
+                         "for account" << m_profileAccountId << ": it is being synced by its template profile");
+        return false;
     } else {
         m_socialNetworkSyncAdaptor->setAccountSyncProfile(profile().clone());
+        m_socialNetworkSyncAdaptor->setAccountSyncProfiles(QList<Buteo::SyncProfile*>());
     }
 
     // now perform sync.  Note that for the template profile case, this will
@@ -187,9 +217,88 @@ bool SocialdButeoPlugin::startSync()
     return false;
 }
 
-void SocialdButeoPlugin::abortSync(Sync::SyncStatus)
+// Syncs every enabled per-account profile of the template profile
+// in this plugin instance, rather than triggering a separate sync
+// (and so a separate plugin instance) for each of them.
+bool SocialdButeoPlugin::startMultiAccountSync()
 {
-    // TODO
+    if (!m_socialNetworkSyncAdaptor || !m_socialNetworkSyncAdaptor->enabled()) {
+        SOCIALD_LOG_DEBUG("no enabled" << m_socialServiceName << "sync adaptor for" << m_dataTypeName);
+        return false;
+    }
+
+    if (m_socialNetworkSyncAdaptor->status() != SocialNetworkSyncAdaptor::Inactive) {
+        SOCIALD_LOG_DEBUG(m_socialServiceName << "sync adaptor for" <<
+                          m_dataTypeName << "is still busy with last sync");
+        return false;
+    }
+
+    QList<Buteo::SyncProfile*> perAccountProfiles = ensurePerAccountSyncProfilesExist();
+    QList<Buteo::SyncProfile*> enabledProfiles;
+    QList<int> accountIds;
+    const QStringList runningProfiles = runningSyncProfiles();
+    m_accountProfileNames.clear();
+    foreach (Buteo::SyncProfile *perAccountProfile, perAccountProfiles) {
+        if (!perAccountProfile->isEnabled()) {
+            delete perAccountProfile;
+            continue;
+        }
+        int accountId = perAccountProfile->key(Buteo::KEY_ACCOUNT_ID).toInt();
+        if (runningProfiles.contains(perAccountProfile->name())) {
+            // the account is already being synced by its own plugin instance.
+            SOCIALD_LOG_INFO("skipping account" << accountId << "as its" <<
+                             perAccountProfile->name() << "sync is running");
+            delete perAccountProfile;
+            continue;
+        }
+        m_accountProfileNames.insert(accountId, perAccountProfile->name());
+        enabledProfiles.append(perAccountProfile);
+        accountIds.append(accountId);
+    }
+
+    if (accountIds.isEmpty()) {
+        SOCIALD_LOG_DEBUG("no enabled" << m_dataTypeName << "sync profiles for" << m_socialServiceName);
+        updateResults(Buteo::SyncResults(QDateTime::currentDateTime(), Buteo::SyncResults::SYNC_RESULT_SUCCESS, Buteo::SyncResults::NO_ERROR));
+        emit success(getProfileName(), QString("%1 update succeeded").arg(getProfileName()));
+        return true;
+    }
+
+    SOCIALD_LOG_DEBUG("performing sync of" << m_dataTypeName <<
+                      "from" << m_socialServiceName <<
+                      "for accounts" << accountIds);
+    m_socialNetworkSyncAdaptor->setAccountSyncProfile(NULL);
+    m_socialNetworkSyncAdaptor->setAccountSyncProfiles(enabledProfiles);
+    m_socialNetworkSyncAdaptor->syncAccounts(m_dataTypeName, accountIds);
+    return true;
+}
+
+// Returns true if this is a per-account profile, and its template
+// profile is running a multi-account sync (which includes this account).
+bool SocialdButeoPlugin::multiAccountSyncRunning()
+{
+    const QString profileName = profile().name();
+    const QString templateProfileName = profileName.left(profileName.lastIndexOf(QLatin1Char('-')));
+    if (templateProfileName.isEmpty() || !runningSyncProfiles().contains(templateProfileName)) {
+        return false;
+    }
+
+    Buteo::SyncProfile *templateProfile = m_profileManager.syncProfile(templateProfileName);
+    bool multiAccountSync = templateProfile && templateProfile->boolKey(MultiAccountSyncKey, true);
+    delete templateProfile;
+    return multiAccountSync;
+}
+
+void SocialdButeoPlugin::abortSync(Sync::SyncStatus status)
+{
+    if (m_socialNetworkSyncAdaptor
+            && m_socialNetworkSyncAdaptor->status() == SocialNetworkSyncAdaptor::Busy) {
+        SOCIALD_LOG_INFO("aborting sync of" << m_dataTypeName << "from" << m_socialServiceName <<
+                         "for account" << m_profileAccountId << "with status" << status);
+        m_abortReason = status == Sync::SYNC_CONNECTION_ERROR
+                      ? Buteo::SyncResults::CONNECTION_ERROR
+                      : Buteo::SyncResults::ABORTED;
+        m_socialNetworkSyncAdaptor->abortSync();
+    }
 }
 
 bool SocialdButeoPlugin::cleanUp()
@@ -213,12 +322,13 @@ Buteo::SyncResults SocialdButeoPlugin::getSyncResults() const
     return m_syncResults;
 }
 
-void SocialdButeoPlugin::connectivityStateChanged(Sync::ConnectivityType, bool)
+void SocialdButeoPlugin::connectivityStateChanged(Sync::ConnectivityType type, bool state)
 {
-    // TODO, see TransportTracker.cpp:149
-    // Sync::CONNECTIVITY_INTERNET, true|false
-    // Kill all ongoing on false
-    // "Free" single shot sync on wlan?
+    // the outstanding requests cannot succeed once the connection is lost,
+    // so cancel them rather than waiting for them to time out.
+    if (type == Sync::CONNECTIVITY_INTERNET && !state) {
+        abortSync(Sync::SYNC_CONNECTION_ERROR);
+    }
 }
 
 void SocialdButeoPlugin::syncStatusChanged()
@@ -226,10 +336,41 @@ void SocialdButeoPlugin::syncStatusChanged()
     if (m_socialNetworkSyncAdaptor) {
         SocialNetworkSyncAdaptor::Status syncStatus = m_socialNetworkSyncAdaptor->status();
         // Busy change comes when sync starts -> let's ignore that.
-        if (syncStatus == SocialNetworkSyncAdaptor::Inactive) {
+        if (syncStatus == SocialNetworkSyncAdaptor::Inactive && m_socialNetworkSyncAdaptor->syncAborted()) {
+            // whatever was retrieved before the abort has been stored.
+            Buteo::SyncResults::MinorCode reason = m_abortReason == Buteo::SyncResults::NO_ERROR
+                                                 ? Buteo::SyncResults::ABORTED
+                                                 : m_abortReason;
+            m_abortReason = Buteo::SyncResults::NO_ERROR;
+            m_accountProfileNames.clear();
+            updateResults(Buteo::SyncResults(QDateTime::currentDateTime(), Buteo::SyncResults::SYNC_RESULT_FAILED, reason));
+            emit error(getProfileName(), QString("%1 update aborted").arg(getProfileName()), Buteo::SyncResults::SYNC_RESULT_FAILED);
+        } else if (syncStatus == SocialNetworkSyncAdaptor::Inactive && !m_accountProfileNames.isEmpty()) {
+            // a multi-account sync has finished; record the result of each account.
+            QList<int> failedAccounts = m_socialNetworkSyncAdaptor->failedAccounts();
+            QDateTime now = QDateTime::currentDateTime();
+            foreach (int accountId, m_accountProfileNames.keys()) {
+                bool failed = failedAccounts.contains(accountId);
+                m_profileManager.saveSyncResults(m_accountProfileNames.value(accountId),
+                        Buteo::SyncResults(now,
+                                           failed ? Buteo::SyncResults::SYNC_RESULT_FAILED : Buteo::SyncResults::SYNC_RESULT_SUCCESS,
+                                           failed ? Buteo::SyncResults::ABORTED : Buteo::SyncResults::NO_ERROR));
+            }
+            m_accountProfileNames.clear();
+            if (failedAccounts.isEmpty()) {
+                updateResults(Buteo::SyncResults(now, Buteo::SyncResults::SYNC_RESULT_SUCCESS, Buteo::SyncResults::NO_ERROR));
+                emit success(getProfileName(), QString("%1 update succeeded").arg(getProfileName()));
+            } else {
+                SOCIALD_LOG_INFO("sync of" << m_dataTypeName << "from" << m_socialServiceName <<
+                                 "failed for accounts" << failedAccounts);
+                updateResults(Buteo::SyncResults(now, Buteo::SyncResults::SYNC_RESULT_FAILED, Buteo::SyncResults::ABORTED));
+                emit error(getProfileName(), QString("%1 update failed").arg(getProfileName()), Buteo::SyncResults::SYNC_RESULT_FAILED);
+            }
+        } else if (syncStatus == SocialNetworkSyncAdaptor::Inactive) {
             updateResults(Buteo::SyncResults(QDateTime::currentDateTime(), Buteo::SyncResults::SYNC_RESULT_SUCCESS, Buteo::SyncResults::NO_ERROR));
             emit success(getProfileName(), QString("%1 update succeeded").arg(getProfileName()));
         } else if (syncStatus != SocialNetworkSyncAdaptor::Busy) {
+            m_accountProfileNames.clear();
             updateResults(Buteo::SyncResults(QDateTime::currentDateTime(), Buteo::SyncResults::SYNC_RESULT_FAILED, Buteo::SyncResults::ABORTED));
             emit error(getProfileName(), QString("%1 update failed").arg(getProfileName()), Buteo::SyncResults::SYNC_RESULT_FAILED);
         }
@@ -23,6 +23,8 @@
 #define SOCIALDBUTEOPLUGIN_H
 
 #include <QtCore/qglobal.h>
+#include <QtCore/QMap>
+#include <QtCore/QString>
 #include "buteosyncfw_p.h"
 
 #if defined(OUT_OF_PROCESS_PLUGIN)
@@ -69,6 +71,8 @@ protected:
     QList<Buteo::SyncProfile*> ensurePerAccountSyncProfilesExist();
 
 private:
+    bool startMultiAccountSync();
+    bool multiAccountSyncRunning();
     void updateResults(const Buteo::SyncResults &results);
     Buteo::SyncResults m_syncResults;
     Buteo::ProfileManager m_profileManager;
@@ -76,6 +80,8 @@ private:
     QString m_socialServiceName;
     QString m_dataTypeName;
     int m_profileAccountId;
+    QMap<int, QString> m_accountProfileNames;
+    Buteo::SyncResults::MinorCode m_abortReason;
 };
 
 #endif // SOCIALDBUTEOPLUGIN_H
@@ -0,0 +1,227 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+
+#include "socialdfieldprojection_p.h"
+#include "trace.h"
+
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonValue>
+
+SocialdFieldProjection::SocialdFieldProjection(const Entry *table, const ReadField *readFields)
+    : m_table(table)
+    , m_readFields(readFields)
+{
+    for (const Entry *entry = m_table; entry->endpoint; ++entry) {
+        if (qstrcmp(entry->parameter, "fields") == 0) {
+            int pos = 0;
+            m_selectors.insert(QLatin1String(entry->endpoint),
+                               parseSelector(QLatin1String(entry->value), &pos));
+        }
+    }
+
+    foreach (const QString &field, unselectedReadFields()) {
+        SOCIALD_LOG_ERROR("field projection omits field which is read:" << field);
+    }
+}
+
+SocialdFieldProjection::~SocialdFieldProjection()
+{
+}
+
+// Parses a comma separated list of members, each of which may be followed
+// by a nested list in parentheses (Google) or braces (Graph API).
+SocialdFieldProjection::Selector SocialdFieldProjection::parseSelector(const QString &fields, int *pos)
+{
+    Selector selector;
+    QString name;
+    while (*pos < fields.length()) {
+        const QChar c = fields.at((*pos)++);
+        if (c == QLatin1Char('(') || c == QLatin1Char('{')) {
+            selector.members.insert(name.trimmed(), parseSelector(fields, pos));
+            name.clear();
+        } else if (c == QLatin1Char(')') || c == QLatin1Char('}')) {
+            break;
+        } else if (c == QLatin1Char(',')) {
+            if (!name.trimmed().isEmpty()) {
+                selector.members.insert(name.trimmed(), Selector());
+            }
+            name.clear();
+        } else {
+            name.append(c);
+        }
+    }
+    if (!name.trimmed().isEmpty()) {
+        selector.members.insert(name.trimmed(), Selector());
+    }
+    return selector;
+}
+
+/*!
+ * \internal
+ * Appends the projection parameters of the given endpoint to the query,
+ * unless the query already has them.
+ */
+void SocialdFieldProjection::apply(const QString &endpoint, QList<QPair<QString, QString> > *queryItems) const
+{
+    for (const Entry *entry = m_table; entry->endpoint; ++entry) {
+        if (endpoint != QLatin1String(entry->endpoint)) {
+            continue;
+        }
+        const QString parameter = QLatin1String(entry->parameter);
+        bool present = false;
+        for (int i = 0; i < queryItems->size() && !present; ++i) {
+            present = queryItems->at(i).first == parameter;
+        }
+        if (!present) {
+            queryItems->append(qMakePair(parameter, QString(QLatin1String(entry->value))));
+        }
+    }
+}
+
+QString SocialdFieldProjection::fields(const QString &endpoint) const
+{
+    for (const Entry *entry = m_table; entry->endpoint; ++entry) {
+        if (endpoint == QLatin1String(entry->endpoint) && qstrcmp(entry->parameter, "fields") == 0) {
+            return QLatin1String(entry->value);
+        }
+    }
+    return QString();
+}
+
+/*!
+ * \internal
+ * Checks that the given reply object (the object which the fields
+ * selector of the endpoint applies to) contains only selected members,
+ * and logs those which were not.  Returns the number of such members.
+ */
+int SocialdFieldProjection::validate(const QString &endpoint, const QJsonObject &object) const
+{
+    QHash<QString, Selector>::const_iterator it = m_selectors.constFind(endpoint);
+    if (it == m_selectors.constEnd()) {
+        return 0;
+    }
+    return validate(endpoint, QString(), it.value(), object);
+}
+
+int SocialdFieldProjection::validate(const QString &endpoint, const QString &path,
+                                     const Selector &selector, const QJsonObject &object)
+{
+    if (selector.members.isEmpty()) {
+        return 0;
+    }
+
+    int unselected = 0;
+    for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it) {
+        QHash<QString, Selector>::const_iterator member = selector.members.constFind(it.key());
+        if (member == selector.members.constEnd()) {
+            SOCIALD_LOG_DEBUG("reply from" << endpoint << "contains unselected field" << (path + it.key()));
+            unselected++;
+            continue;
+        }
+
+        const QString memberPath = path + it.key() + QLatin1Char('.');
+        if (it.value().isObject()) {
+            unselected += validate(endpoint, memberPath, member.value(), it.value().toObject());
+        } else if (it.value().isArray()) {
+            foreach (const QJsonValue &element, it.value().toArray()) {
+                if (element.isObject()) {
+                    unselected += validate(endpoint, memberPath, member.value(), element.toObject());
+                }
+            }
+        }
+    }
+    return unselected;
+}
+
+/*!
+ * \internal
+ * Returns the reply object with only the members which the fields
+ * selector of the endpoint selects, as the service would return it.
+ */
+QJsonObject SocialdFieldProjection::project(const QString &endpoint, const QJsonObject &object) const
+{
+    QHash<QString, Selector>::const_iterator it = m_selectors.constFind(endpoint);
+    if (it == m_selectors.constEnd()) {
+        return object;
+    }
+    return project(it.value(), object);
+}
+
+QJsonObject SocialdFieldProjection::project(const Selector &selector, const QJsonObject &object)
+{
+    if (selector.members.isEmpty()) {
+        return object;
+    }
+
+    QJsonObject retn;
+    for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it) {
+        QHash<QString, Selector>::const_iterator member = selector.members.constFind(it.key());
+        if (member == selector.members.constEnd()) {
+            continue;
+        }
+
+        if (it.value().isObject()) {
+            retn.insert(it.key(), project(member.value(), it.value().toObject()));
+        } else if (it.value().isArray()) {
+            QJsonArray elements;
+            foreach (const QJsonValue &element, it.value().toArray()) {
+                elements.append(element.isObject() ? QJsonValue(project(member.value(), element.toObject())) : element);
+            }
+            retn.insert(it.key(), elements);
+        } else {
+            retn.insert(it.key(), it.value());
+        }
+    }
+    return retn;
+}
+
+/*!
+ * \internal
+ * Returns the read fields (as "endpoint:path") which the fields selector
+ * of their endpoint does not select.  Fields of endpoints without a
+ * fields selector are always returned by the service.
+ */
+QStringList SocialdFieldProjection::unselectedReadFields() const
+{
+    QStringList unselected;
+    for (const ReadField *field = m_readFields; field && field->endpoint; ++field) {
+        QHash<QString, Selector>::const_iterator it = m_selectors.constFind(QLatin1String(field->endpoint));
+        if (it == m_selectors.constEnd()) {
+            continue;
+        }
+
+        const Selector *selector = &it.value();
+        foreach (const QString &member, QString(QLatin1String(field->path)).split(QLatin1Char('.'))) {
+            if (selector->members.isEmpty()) {
+                break; // every member below this one is selected.
+            }
+            QHash<QString, Selector>::const_iterator child = selector->members.constFind(member);
+            if (child == selector->members.constEnd()) {
+                unselected.append(QString::fromLatin1("%1:%2").arg(QLatin1String(field->endpoint))
+                                                             .arg(QLatin1String(field->path)));
+                break;
+            }
+            selector = &child.value();
+        }
+    }
+    return unselected;
+}
@@ -0,0 +1,94 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+
+
+#ifndef SOCIALD_FIELDPROJECTION_P_H
+#define SOCIALD_FIELDPROJECTION_P_H
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QHash>
+#include <QtCore/QJsonObject>
+
+/*
+ * Applies a sync adaptor's table of query parameters which restrict the
+ * replies of each endpoint to what its reply handlers read: a "fields"
+ * selector for the Graph and Google APIs, or flags such as
+ * include_entities for Twitter.
+ *
+ * A "fields" selector (eg "nextPageToken,items(id,summary)") is also
+ * used to validate the replies: validate() reports any member of a
+ * reply object which was not selected, which means that the service
+ * ignored the selector.
+ *
+ * The adaptor also lists the members which its reply handlers read
+ * (eg "items.start.dateTime").  unselectedReadFields() returns those
+ * which the selector of their endpoint omits, and which the service
+ * would therefore never return; they are logged on construction.
+ *
+ * project() reduces a reply object to the members which the service
+ * returns for the selector.  The unit tests run the reply handlers over
+ * replies reduced this way and check what is stored, so that a selector
+ * cannot silently drop data which is synced.
+ */
+class SocialdFieldProjection
+{
+public:
+    struct Entry {
+        const char *endpoint;
+        const char *parameter;
+        const char *value;
+    };
+
+    struct ReadField {
+        const char *endpoint;
+        const char *path; // member names separated by '.'
+    };
+
+    // the tables are terminated by an entry with a null endpoint.
+    SocialdFieldProjection(const Entry *table, const ReadField *readFields = 0);
+    ~SocialdFieldProjection();
+
+    void apply(const QString &endpoint, QList<QPair<QString, QString> > *queryItems) const;
+    QString fields(const QString &endpoint) const;
+    int validate(const QString &endpoint, const QJsonObject &object) const;
+    QJsonObject project(const QString &endpoint, const QJsonObject &object) const;
+    QStringList unselectedReadFields() const;
+
+private:
+    struct Selector {
+        QHash<QString, Selector> members; // empty if every member is selected
+    };
+
+    static Selector parseSelector(const QString &fields, int *pos);
+    static int validate(const QString &endpoint, const QString &path,
+                        const Selector &selector, const QJsonObject &object);
+    static QJsonObject project(const Selector &selector, const QJsonObject &object);
+
+    const Entry *m_table;
+    const ReadField *m_readFields;
+    QHash<QString, Selector> m_selectors;
+};
+
+#endif // SOCIALD_FIELDPROJECTION_P_H
@@ -0,0 +1,225 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+#include "socialdjsonstreamparser_p.h"
+#include "trace.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonParseError>
+#include <QtNetwork/QNetworkReply>
+
+SocialdJsonStreamParser::SocialdJsonStreamParser(QNetworkReply *reply, const QString &arrayKey)
+    : QObject(reply)
+    , m_reply(reply)
+    , m_arrayKey(arrayKey.toUtf8())
+    , m_scanPos(0)
+    , m_segmentStart(0)
+    , m_keyStart(-1)
+    , m_elementStart(-1)
+    , m_depth(0)
+    , m_arrayDepth(-1)
+    , m_elementCount(0)
+    , m_parseUsecs(0)
+    , m_inString(false)
+    , m_escaped(false)
+    , m_expectKey(false)
+    , m_inArray(false)
+    , m_arrayDone(false)
+    , m_error(false)
+    , m_finished(false)
+{
+    connect(m_reply, SIGNAL(readyRead()), this, SLOT(readyReadHandler()));
+}
+
+/*!
+ * \internal
+ * Returns the stream parser which was attached to the given \a reply,
+ * or null if the reply is not being parsed incrementally.
+ */
+SocialdJsonStreamParser *SocialdJsonStreamParser::parser(QNetworkReply *reply)
+{
+    return reply ? reply->findChild<SocialdJsonStreamParser*>(QString(), Qt::FindDirectChildrenOnly) : 0;
+}
+
+QNetworkReply *SocialdJsonStreamParser::reply() const
+{
+    return m_reply;
+}
+
+void SocialdJsonStreamParser::readyReadHandler()
+{
+    addData(m_reply->readAll());
+}
+
+void SocialdJsonStreamParser::addData(const QByteArray &chunk)
+{
+    if (chunk.isEmpty() || m_finished) {
+        return;
+    }
+
+    m_buffer.append(chunk);
+    scan();
+}
+
+/*!
+ * \internal
+ * Consumes any data remaining in the reply, and returns the top-level
+ * object of the reply with the streamed array left empty.  If the
+ * streamed array is the top-level array, an empty object is returned.
+ * \a ok is set to false if the reply could not be parsed.
+ */
+QJsonObject SocialdJsonStreamParser::finish(bool *ok)
+{
+    if (!m_finished) {
+        addData(m_reply->readAll());
+        m_finished = true;
+        m_buffer.clear();
+    }
+
+    QElapsedTimer parseTimer;
+    parseTimer.start();
+    QJsonParseError parseError;
+    QJsonDocument envelope = QJsonDocument::fromJson(m_envelope, &parseError);
+    m_parseUsecs += parseTimer.nsecsElapsed() / 1000;
+    *ok = !m_error && parseError.error == QJsonParseError::NoError
+            && (m_arrayKey.isEmpty() ? envelope.isArray() : envelope.isObject());
+    return *ok ? envelope.object() : QJsonObject();
+}
+
+/*!
+ * \internal
+ * Returns the raw data of the reply outside of the streamed array (eg,
+ * the whole of an error response), for diagnostics.
+ */
+QByteArray SocialdJsonStreamParser::envelopeData() const
+{
+    return m_envelope;
+}
+
+void SocialdJsonStreamParser::scan()
+{
+    QElapsedTimer parseTimer;
+    parseTimer.start();
+    const char *data = m_buffer.constData();
+    const int size = m_buffer.size();
+
+    for (int i = m_scanPos; i < size; ++i) {
+        const char c = data[i];
+        if (m_inString) {
+            if (m_escaped) {
+                m_escaped = false;
+            } else if (c == '\\') {
+                m_escaped = true;
+            } else if (c == '"') {
+                m_inString = false;
+                if (m_keyStart >= 0) {
+                    m_currentKey = m_buffer.mid(m_keyStart, i - m_keyStart);
+                    m_keyStart = -1;
+                }
+            }
+            continue;
+        }
+
+        switch (c) {
+            case '"': {
+                m_inString = true;
+                if (m_expectKey && !m_inArray && m_depth == 1) {
+                    m_keyStart = i + 1;
+                    m_expectKey = false;
+                }
+            }   break;
+            case '{': {
+                if (m_inArray && m_depth == m_arrayDepth) {
+                    m_elementStart = i;
+                }
+                if (++m_depth == 1) {
+                    m_expectKey = true;
+                }
+            }   break;
+            case '[': {
+                ++m_depth;
+                if (!m_inArray && !m_arrayDone
+                        && (m_arrayKey.isEmpty() ? m_depth == 1 : (m_depth == 2 && m_currentKey == m_arrayKey))) {
+                    // everything up to and including the opening bracket belongs to the envelope.
+                    m_envelope.append(data + m_segmentStart, i + 1 - m_segmentStart);
+                    m_inArray = true;
+                    m_arrayDepth = m_depth;
+                }
+            }   break;
+            case '}': {
+                --m_depth;
+                if (m_inArray && m_depth == m_arrayDepth && m_elementStart >= 0) {
+                    QJsonParseError parseError;
+                    QJsonDocument element = QJsonDocument::fromJson(
+                            QByteArray::fromRawData(data + m_elementStart, i + 1 - m_elementStart), &parseError);
+                    m_elementStart = -1;
+                    if (parseError.error != QJsonParseError::NoError || !element.isObject()) {
+                        SOCIALD_LOG_ERROR("unable to parse streamed json element:" << parseError.errorString());
+                        m_error = true;
+                    } else {
+                        ++m_elementCount;
+                        m_parseUsecs += parseTimer.nsecsElapsed() / 1000;
+                        emit elementParsed(element.object());
+                        parseTimer.restart();
+                    }
+                }
+            }   break;
+            case ']': {
+                if (m_inArray && m_depth == m_arrayDepth) {
+                    m_inArray = false;
+                    m_arrayDone = true;
+                    m_segmentStart = i;
+                }
+                --m_depth;
+            }   break;
+            case ',': {
+                if (!m_inArray && m_depth == 1) {
+                    m_expectKey = true;
+                }
+            }   break;
+            default: break;
+        }
+    }
+
+    // retain only the bytes of a partially received element or key.
+    int keep = size;
+    if (m_elementStart >= 0) {
+        keep = m_elementStart;
+    }
+    if (m_keyStart >= 0 && m_keyStart < keep) {
+        keep = m_keyStart;
+    }
+    if (!m_inArray) {
+        m_envelope.append(data + m_segmentStart, keep - m_segmentStart);
+    }
+
+    m_buffer.remove(0, keep);
+    m_scanPos = m_buffer.size();
+    m_segmentStart = 0;
+    if (m_elementStart >= 0) {
+        m_elementStart -= keep;
+    }
+    if (m_keyStart >= 0) {
+        m_keyStart -= keep;
+    }
+    m_parseUsecs += parseTimer.nsecsElapsed() / 1000;
+}
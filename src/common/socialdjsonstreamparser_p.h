@@ -0,0 +1,97 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+#ifndef SOCIALD_JSONSTREAMPARSER_P_H
+#define SOCIALD_JSONSTREAMPARSER_P_H
+
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QJsonObject>
+
+class QNetworkReply;
+
+/*
+ * Incrementally decodes a JSON reply as it arrives from the network.
+ *
+ * Each object element of the streamed array is decoded as soon as its
+ * closing brace has been received, and is emitted via elementParsed().
+ * The streamed array is either the value of the given top-level key
+ * (eg, the "data" array of a Facebook Graph API response) or, if no
+ * key is given, the top-level array itself (eg, a Twitter timeline).
+ *
+ * Everything outside of the streamed array (eg, the "paging" object)
+ * is retained, and returned by finish() once the reply has completed.
+ * Only the bytes of a partially received element are buffered, so the
+ * full reply document is never held in memory.
+ *
+ * The parser is owned by the reply it is attached to.
+ */
+class SocialdJsonStreamParser : public QObject
+{
+    Q_OBJECT
+
+public:
+    SocialdJsonStreamParser(QNetworkReply *reply, const QString &arrayKey);
+
+    static SocialdJsonStreamParser *parser(QNetworkReply *reply);
+
+    QNetworkReply *reply() const;
+    void addData(const QByteArray &chunk);
+    QJsonObject finish(bool *ok);
+    QByteArray envelopeData() const;
+
+    int elementCount() const { return m_elementCount; }
+    bool hasError() const { return m_error; }
+    qint64 parseUsecs() const { return m_parseUsecs; }
+
+Q_SIGNALS:
+    void elementParsed(const QJsonObject &element);
+
+private Q_SLOTS:
+    void readyReadHandler();
+
+private:
+    void scan();
+
+    QNetworkReply *m_reply;
+    QByteArray m_arrayKey;
+    QByteArray m_buffer;
+    QByteArray m_envelope;
+    QByteArray m_currentKey;
+    int m_scanPos;
+    int m_segmentStart;
+    int m_keyStart;
+    int m_elementStart;
+    int m_depth;
+    int m_arrayDepth;
+    int m_elementCount;
+    qint64 m_parseUsecs; // excluding the elementParsed() handlers
+    bool m_inString;
+    bool m_escaped;
+    bool m_expectKey;
+    bool m_inArray;
+    bool m_arrayDone;
+    bool m_error;
+    bool m_finished;
+};
+
+#endif // SOCIALD_JSONSTREAMPARSER_P_H
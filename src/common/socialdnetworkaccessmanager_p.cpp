@@ -20,11 +20,14 @@
  ****************************************************************************/
 
 #include "socialdnetworkaccessmanager_p.h"
+#include "socialdnetworkscheduler_p.h"
 
-/* The default implementation is just a normal QNetworkAccessManager */
+/* The default implementation queues requests with the network scheduler,
+   which dispatches them via a normal QNetworkAccessManager */
 
 SocialdNetworkAccessManager::SocialdNetworkAccessManager(QObject *parent)
     : QNetworkAccessManager(parent)
+    , m_scheduler(new SocialdNetworkScheduler(this))
 {
 }
 
@@ -32,6 +35,19 @@ QNetworkReply *SocialdNetworkAccessManager::createRequest(
                                  QNetworkAccessManager::Operation op,
                                  const QNetworkRequest &req,
                                  QIODevice *outgoingData)
+{
+    return m_scheduler->enqueue(op, req, outgoingData);
+}
+
+void SocialdNetworkAccessManager::commitValidators(QNetworkReply *reply)
+{
+    m_scheduler->commitValidators(reply);
+}
+
+QNetworkReply *SocialdNetworkAccessManager::createNetworkRequest(
+                                 QNetworkAccessManager::Operation op,
+                                 const QNetworkRequest &req,
+                                 QIODevice *outgoingData)
 {
     return QNetworkAccessManager::createRequest(op, req, outgoingData);
 }
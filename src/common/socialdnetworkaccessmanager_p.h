@@ -23,18 +23,54 @@
 #define SOCIALD_QNAMFACTORY_P_H
 
 #include <QNetworkAccessManager>
+#include <QNetworkRequest>
+
+class SocialdNetworkScheduler;
 
 class SocialdNetworkAccessManager : public QNetworkAccessManager
 {
     Q_OBJECT
 
 public:
+    // Requests are dispatched in priority order.  The priority of a request
+    // is read from the RequestPriorityAttribute of the request (DataPriority
+    // if unset), and requests of the same priority are dispatched round-robin
+    // across the "accountId" property values of the returned replies.
+    enum RequestPriority {
+        MetadataPriority = 0,   // auth / account / collection metadata
+        DataPriority,           // pages of synced data
+        UpsyncPriority,         // local changes being written to the server
+        MediaPriority,          // avatars, images and other bulk downloads
+        RequestPriorityCount
+    };
+
+    static const QNetworkRequest::Attribute RequestPriorityAttribute
+            = static_cast<QNetworkRequest::Attribute>(QNetworkRequest::User + 1);
+
+    // Opt-in for GET requests whose results the adaptor keeps between syncs.
+    // The ETag / Last-Modified validators of the previous response are sent
+    // with the request, and an unchanged resource results in an empty reply
+    // with HTTP status 304 (see SocialNetworkSyncAdaptor::isUnchangedReply()).
+    // The validators of a response are only stored by commitValidators(),
+    // once the adaptor has successfully handled the response.
+    static const QNetworkRequest::Attribute ConditionalRequestAttribute
+            = static_cast<QNetworkRequest::Attribute>(QNetworkRequest::User + 2);
+
     SocialdNetworkAccessManager(QObject *parent = 0);
 
+    void commitValidators(QNetworkReply *reply);
+
 protected:
     QNetworkReply *createRequest(QNetworkAccessManager::Operation op,
                                  const QNetworkRequest &req,
                                  QIODevice *outgoingData = 0);
+
+private:
+    QNetworkReply *createNetworkRequest(QNetworkAccessManager::Operation op,
+                                        const QNetworkRequest &req,
+                                        QIODevice *outgoingData);
+    SocialdNetworkScheduler *m_scheduler;
+    friend class SocialdNetworkScheduler;
 };
 
-#endif
\ No newline at end of file
+#endif
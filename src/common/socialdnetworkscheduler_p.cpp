@@ -0,0 +1,376 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+#include "socialdnetworkscheduler_p.h"
+#include "trace.h"
+
+#include <QtCore/QMetaObject>
+
+namespace {
+    // The maximum number of requests of a given priority which may be in
+    // flight to a single host.  QNetworkAccessManager itself will not open
+    // more than six connections per host, so the higher priorities may use
+    // all of them, while the lower priorities leave some headroom free.
+    const int PerHostLimits[SocialdNetworkAccessManager::RequestPriorityCount] = {
+        6,  // MetadataPriority
+        6,  // DataPriority
+        4,  // UpsyncPriority
+        2   // MediaPriority
+    };
+
+    const QNetworkRequest::Attribute ForwardedAttributes[] = {
+        QNetworkRequest::HttpStatusCodeAttribute,
+        QNetworkRequest::HttpReasonPhraseAttribute,
+        QNetworkRequest::RedirectionTargetAttribute,
+        QNetworkRequest::ConnectionEncryptedAttribute,
+        QNetworkRequest::SourceIsFromCacheAttribute,
+        QNetworkRequest::HttpPipeliningWasUsedAttribute
+    };
+}
+
+SocialdQueuedNetworkReply::SocialdQueuedNetworkReply(QNetworkAccessManager::Operation op,
+                                                     const QNetworkRequest &req,
+                                                     QIODevice *outgoingData,
+                                                     SocialdNetworkScheduler *scheduler)
+    : QNetworkReply(scheduler->parent())
+    , m_scheduler(scheduler)
+    , m_networkReply(0)
+    , m_outgoingData(outgoingData)
+    , m_ignoreSslErrors(false)
+{
+    setOperation(op);
+    setRequest(req);
+    setUrl(req.url());
+    open(QIODevice::ReadOnly);
+}
+
+SocialdQueuedNetworkReply::~SocialdQueuedNetworkReply()
+{
+    if (m_scheduler) {
+        m_scheduler->remove(this);
+    }
+
+    if (m_networkReply) {
+        disconnect(m_networkReply, 0, this, 0);
+        if (!m_networkReply->isFinished()) {
+            m_networkReply->abort();
+        }
+        m_networkReply->deleteLater();
+    }
+}
+
+void SocialdQueuedNetworkReply::abort()
+{
+    if (m_networkReply) {
+        // the network reply will emit error() and finished(), which we forward.
+        m_networkReply->abort();
+        return;
+    }
+
+    if (!isFinished()) {
+        if (m_scheduler) {
+            m_scheduler->remove(this);
+        }
+        setError(QNetworkReply::OperationCanceledError, QStringLiteral("Operation canceled"));
+        setFinished(true);
+        emit error(QNetworkReply::OperationCanceledError);
+        emit finished();
+    }
+}
+
+void SocialdQueuedNetworkReply::ignoreSslErrors()
+{
+    if (m_networkReply) {
+        m_networkReply->ignoreSslErrors();
+    } else {
+        m_ignoreSslErrors = true;
+    }
+}
+
+bool SocialdQueuedNetworkReply::isSequential() const
+{
+    return true;
+}
+
+qint64 SocialdQueuedNetworkReply::bytesAvailable() const
+{
+    return QNetworkReply::bytesAvailable() + (m_networkReply ? m_networkReply->bytesAvailable() : 0);
+}
+
+QIODevice *SocialdQueuedNetworkReply::outgoingData() const
+{
+    return m_outgoingData;
+}
+
+bool SocialdQueuedNetworkReply::isStarted() const
+{
+    return m_networkReply != 0;
+}
+
+void SocialdQueuedNetworkReply::start(QNetworkReply *networkReply)
+{
+    m_networkReply = networkReply;
+    connect(m_networkReply, SIGNAL(metaDataChanged()), this, SLOT(networkReplyMetaDataChanged()));
+    connect(m_networkReply, SIGNAL(readyRead()), this, SLOT(networkReplyReadyRead()));
+    connect(m_networkReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(networkReplyError(QNetworkReply::NetworkError)));
+    connect(m_networkReply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(networkReplySslErrors(QList<QSslError>)));
+    connect(m_networkReply, SIGNAL(finished()), this, SLOT(networkReplyFinished()));
+    connect(m_networkReply, SIGNAL(downloadProgress(qint64,qint64)), this, SIGNAL(downloadProgress(qint64,qint64)));
+    connect(m_networkReply, SIGNAL(uploadProgress(qint64,qint64)), this, SIGNAL(uploadProgress(qint64,qint64)));
+    if (m_ignoreSslErrors) {
+        m_networkReply->ignoreSslErrors();
+    }
+
+    emit started();
+}
+
+qint64 SocialdQueuedNetworkReply::readData(char *data, qint64 maxSize)
+{
+    if (!m_networkReply) {
+        return isFinished() ? -1 : 0;
+    }
+
+    qint64 bytesRead = m_networkReply->read(data, maxSize);
+    if (bytesRead <= 0) {
+        return isFinished() ? -1 : 0;
+    }
+    return bytesRead;
+}
+
+void SocialdQueuedNetworkReply::copyMetaData()
+{
+    foreach (const QNetworkReply::RawHeaderPair &header, m_networkReply->rawHeaderPairs()) {
+        setRawHeader(header.first, header.second);
+    }
+
+    const int attributeCount = sizeof(ForwardedAttributes) / sizeof(ForwardedAttributes[0]);
+    for (int i = 0; i < attributeCount; ++i) {
+        QVariant value = m_networkReply->attribute(ForwardedAttributes[i]);
+        if (value.isValid()) {
+            setAttribute(ForwardedAttributes[i], value);
+        }
+    }
+}
+
+void SocialdQueuedNetworkReply::networkReplyMetaDataChanged()
+{
+    copyMetaData();
+    emit metaDataChanged();
+}
+
+void SocialdQueuedNetworkReply::networkReplyReadyRead()
+{
+    emit readyRead();
+}
+
+void SocialdQueuedNetworkReply::networkReplyError(QNetworkReply::NetworkError code)
+{
+    setError(code, m_networkReply->errorString());
+    emit error(code);
+}
+
+void SocialdQueuedNetworkReply::networkReplySslErrors(const QList<QSslError> &errors)
+{
+    emit sslErrors(errors);
+}
+
+void SocialdQueuedNetworkReply::networkReplyFinished()
+{
+    copyMetaData();
+    setFinished(true);
+    emit readChannelFinished();
+    emit finished();
+}
+
+SocialdNetworkScheduler::SocialdNetworkScheduler(SocialdNetworkAccessManager *manager)
+    : QObject(manager)
+    , m_manager(manager)
+    , m_validatorCache(0)
+    , m_dispatchScheduled(false)
+{
+}
+
+SocialdNetworkScheduler::~SocialdNetworkScheduler()
+{
+    delete m_validatorCache;
+}
+
+/*!
+ * \internal
+ * Queues the given request and returns the reply for it.  The request
+ * is started from the event loop, at which point the sync adaptor will
+ * have set the "accountId" property of the reply which is used to
+ * share the available capacity fairly between accounts.
+ */
+QNetworkReply *SocialdNetworkScheduler::enqueue(QNetworkAccessManager::Operation op,
+                                                const QNetworkRequest &req,
+                                                QIODevice *outgoingData)
+{
+    SocialdQueuedNetworkReply *reply = new SocialdQueuedNetworkReply(op, req, outgoingData, this);
+    m_incoming.append(reply);
+    scheduleDispatch();
+    return reply;
+}
+
+void SocialdNetworkScheduler::remove(SocialdQueuedNetworkReply *reply)
+{
+    m_incoming.removeAll(reply);
+    for (int priority = 0; priority < SocialdNetworkAccessManager::RequestPriorityCount; ++priority) {
+        PriorityQueue &queue = m_queues[priority];
+        QHash<int, QList<SocialdQueuedNetworkReply*> >::iterator it = queue.replies.begin();
+        while (it != queue.replies.end()) {
+            it.value().removeAll(reply);
+            if (it.value().isEmpty()) {
+                queue.accounts.removeAll(it.key());
+                it = queue.replies.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void SocialdNetworkScheduler::scheduleDispatch()
+{
+    if (!m_dispatchScheduled) {
+        m_dispatchScheduled = true;
+        QMetaObject::invokeMethod(this, "dispatch", Qt::QueuedConnection);
+    }
+}
+
+void SocialdNetworkScheduler::sortIncoming()
+{
+    foreach (SocialdQueuedNetworkReply *reply, m_incoming) {
+        bool ok = false;
+        int priority = reply->request().attribute(SocialdNetworkAccessManager::RequestPriorityAttribute).toInt(&ok);
+        if (!ok || priority < 0 || priority >= SocialdNetworkAccessManager::RequestPriorityCount) {
+            priority = SocialdNetworkAccessManager::DataPriority;
+        }
+
+        int accountId = reply->property("accountId").toInt();
+        PriorityQueue &queue = m_queues[priority];
+        if (!queue.replies.contains(accountId)) {
+            queue.accounts.append(accountId);
+        }
+        queue.replies[accountId].append(reply);
+    }
+    m_incoming.clear();
+}
+
+bool SocialdNetworkScheduler::hasCapacity(const QString &host, int priority) const
+{
+    return m_inFlight.value(host) < PerHostLimits[priority];
+}
+
+void SocialdNetworkScheduler::dispatch()
+{
+    m_dispatchScheduled = false;
+    sortIncoming();
+
+    // start the highest priority request for which the host has capacity,
+    // taking turns between the accounts with requests of that priority.
+    bool started = true;
+    while (started) {
+        started = false;
+        for (int priority = 0; priority < SocialdNetworkAccessManager::RequestPriorityCount && !started; ++priority) {
+            PriorityQueue &queue = m_queues[priority];
+            for (int i = 0; i < queue.accounts.size() && !started; ++i) {
+                int accountId = queue.accounts.at(i);
+                QList<SocialdQueuedNetworkReply*> &pending(queue.replies[accountId]);
+                for (int j = 0; j < pending.size(); ++j) {
+                    if (hasCapacity(pending.at(j)->url().host(), priority)) {
+                        SocialdQueuedNetworkReply *reply = pending.takeAt(j);
+                        queue.accounts.removeAt(i);
+                        if (pending.isEmpty()) {
+                            queue.replies.remove(accountId);
+                        } else {
+                            queue.accounts.append(accountId);
+                        }
+                        start(reply, priority);
+                        started = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void SocialdNetworkScheduler::start(SocialdQueuedNetworkReply *reply, int priority)
+{
+    QString host = reply->url().host();
+    QNetworkRequest request = reply->request();
+    QString validatorKey;
+    if (reply->operation() == QNetworkAccessManager::GetOperation
+            && request.attribute(SocialdNetworkAccessManager::ConditionalRequestAttribute).toBool()) {
+        if (!m_validatorCache) {
+            m_validatorCache = new SocialdValidatorCache;
+        }
+        validatorKey = SocialdValidatorCache::cacheKey(reply->property("accountId").toInt(), reply->url());
+        m_validatorCache->prepareRequest(validatorKey, &request);
+    }
+
+    QNetworkReply *networkReply = m_manager->createNetworkRequest(reply->operation(), request, reply->outgoingData());
+    if (!networkReply) {
+        SOCIALD_LOG_ERROR("unable to start request to" << host);
+        reply->abort();
+        return;
+    }
+
+    m_inFlight[host] += 1;
+    m_networkReplyHosts.insert(networkReply, host);
+    if (!validatorKey.isEmpty()) {
+        // the validators are only stored once the adaptor has handled the response.
+        reply->setProperty("validatorKey", validatorKey);
+    }
+    connect(networkReply, SIGNAL(finished()), this, SLOT(networkReplyFinished()));
+    connect(networkReply, SIGNAL(destroyed(QObject*)), this, SLOT(networkReplyFinished()));
+    SOCIALD_LOG_TRACE("starting request with priority" << priority << "to" << host << "in flight:" << m_inFlight.value(host));
+    reply->start(networkReply);
+}
+
+/*!
+ * \internal
+ * Stores the validators of the response to a conditional request, so that
+ * the next request for the resource is only answered if it has changed.
+ */
+void SocialdNetworkScheduler::commitValidators(QNetworkReply *reply)
+{
+    QString validatorKey = reply->property("validatorKey").toString();
+    if (!validatorKey.isEmpty() && m_validatorCache) {
+        m_validatorCache->updateValidators(validatorKey, reply);
+    }
+}
+
+void SocialdNetworkScheduler::networkReplyFinished()
+{
+    QHash<QObject*, QString>::iterator it = m_networkReplyHosts.find(sender());
+    if (it == m_networkReplyHosts.end()) {
+        return;
+    }
+
+    QString host = it.value();
+    m_networkReplyHosts.erase(it);
+    if (--m_inFlight[host] <= 0) {
+        m_inFlight.remove(host);
+    }
+    scheduleDispatch();
+}
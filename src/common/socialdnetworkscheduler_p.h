@@ -0,0 +1,131 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+#ifndef SOCIALD_NETWORKSCHEDULER_P_H
+#define SOCIALD_NETWORKSCHEDULER_P_H
+
+#include "socialdnetworkaccessmanager_p.h"
+#include "socialdvalidatorcache_p.h"
+
+#include <QtCore/QObject>
+#include <QtCore/QList>
+#include <QtCore/QHash>
+#include <QtCore/QPointer>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QSslError>
+
+class SocialdNetworkScheduler;
+
+/*
+ * The reply which is returned to the sync adaptors by the
+ * SocialdNetworkAccessManager.  The request is queued until the
+ * scheduler starts it, after which all data and signals of the
+ * underlying network reply are forwarded.
+ */
+class SocialdQueuedNetworkReply : public QNetworkReply
+{
+    Q_OBJECT
+    Q_PROPERTY(bool started READ isStarted NOTIFY started)
+
+public:
+    SocialdQueuedNetworkReply(QNetworkAccessManager::Operation op,
+                              const QNetworkRequest &req,
+                              QIODevice *outgoingData,
+                              SocialdNetworkScheduler *scheduler);
+    ~SocialdQueuedNetworkReply();
+
+    void abort();
+    void ignoreSslErrors();
+    bool isSequential() const;
+    qint64 bytesAvailable() const;
+
+    void start(QNetworkReply *networkReply);
+    bool isStarted() const;
+    QIODevice *outgoingData() const;
+
+Q_SIGNALS:
+    void started();
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+
+private Q_SLOTS:
+    void networkReplyMetaDataChanged();
+    void networkReplyReadyRead();
+    void networkReplyError(QNetworkReply::NetworkError code);
+    void networkReplySslErrors(const QList<QSslError> &errors);
+    void networkReplyFinished();
+
+private:
+    void copyMetaData();
+
+    QPointer<SocialdNetworkScheduler> m_scheduler;
+    QPointer<QNetworkReply> m_networkReply;
+    QIODevice *m_outgoingData;
+    bool m_ignoreSslErrors;
+};
+
+/*
+ * Queues the requests of a SocialdNetworkAccessManager, and dispatches
+ * them in priority order while limiting the number of requests which
+ * are in flight to any single host.  Lower priority requests may only
+ * use part of the per-host capacity, so that the requests which a sync
+ * is actually waiting on are never stuck behind bulk traffic.
+ */
+class SocialdNetworkScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    SocialdNetworkScheduler(SocialdNetworkAccessManager *manager);
+    ~SocialdNetworkScheduler();
+
+    QNetworkReply *enqueue(QNetworkAccessManager::Operation op,
+                           const QNetworkRequest &req,
+                           QIODevice *outgoingData);
+    void remove(SocialdQueuedNetworkReply *reply);
+    void commitValidators(QNetworkReply *reply);
+
+private Q_SLOTS:
+    void dispatch();
+    void networkReplyFinished();
+
+private:
+    struct PriorityQueue {
+        QList<int> accounts; // round-robin order
+        QHash<int, QList<SocialdQueuedNetworkReply*> > replies;
+    };
+
+    void scheduleDispatch();
+    void sortIncoming();
+    bool hasCapacity(const QString &host, int priority) const;
+    void start(SocialdQueuedNetworkReply *reply, int priority);
+
+    SocialdNetworkAccessManager *m_manager;
+    QList<SocialdQueuedNetworkReply*> m_incoming;
+    PriorityQueue m_queues[SocialdNetworkAccessManager::RequestPriorityCount];
+    QHash<QString, int> m_inFlight; // host to number of requests in flight
+    QHash<QObject*, QString> m_networkReplyHosts;
+    SocialdValidatorCache *m_validatorCache;
+    bool m_dispatchScheduled;
+};
+
+#endif // SOCIALD_NETWORKSCHEDULER_P_H
@@ -0,0 +1,194 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+
+#include "socialdsynccheckpoints_p.h"
+#include "trace.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+
+namespace {
+    QString checkpointsDirectory()
+    {
+        return QString::fromLatin1("%1/%2/checkpoints")
+                .arg(QString::fromLatin1(PRIVILEGED_DATA_DIR))
+                .arg(QString::fromLatin1(SYNC_DATABASE_DIR));
+    }
+
+    QString checkpointsFileName()
+    {
+        return QString::fromLatin1("%1/%2/checkpoints.ini")
+                .arg(QString::fromLatin1(PRIVILEGED_DATA_DIR))
+                .arg(QString::fromLatin1(SYNC_DATABASE_DIR));
+    }
+
+    QString encodedKey(const QString &key)
+    {
+        // keys are arbitrary identifiers, which may contain '/'.
+        return QString::fromLatin1(key.toUtf8().toHex());
+    }
+}
+
+SocialdSyncCheckpoints::SocialdSyncCheckpoints(const QString &serviceName, const QString &dataType)
+    : m_settings(checkpointsFileName(), QSettings::IniFormat)
+    , m_prefix(QString::fromLatin1("%1-%2").arg(serviceName).arg(dataType))
+{
+}
+
+SocialdSyncCheckpoints::~SocialdSyncCheckpoints()
+{
+    m_settings.sync();
+}
+
+QString SocialdSyncCheckpoints::group(int accountId) const
+{
+    return QString::fromLatin1("%1/%2").arg(m_prefix).arg(accountId);
+}
+
+QString SocialdSyncCheckpoints::pagesFileName(int accountId, const QString &key) const
+{
+    QByteArray hash = QCryptographicHash::hash(group(accountId).toUtf8() + '/' + key.toUtf8(),
+                                               QCryptographicHash::Sha1).toHex();
+    return QString::fromLatin1("%1/%2.pages").arg(checkpointsDirectory()).arg(QString::fromLatin1(hash));
+}
+
+QStringList SocialdSyncCheckpoints::keys(int accountId) const
+{
+    QSettings &settings(const_cast<QSettings&>(m_settings));
+    settings.beginGroup(group(accountId));
+    QStringList encodedKeys = settings.childGroups();
+    settings.endGroup();
+
+    QStringList retn;
+    foreach (const QString &encoded, encodedKeys) {
+        retn.append(QString::fromUtf8(QByteArray::fromHex(encoded.toLatin1())));
+    }
+    return retn;
+}
+
+bool SocialdSyncCheckpoints::contains(int accountId, const QString &key) const
+{
+    return m_settings.contains(QString::fromLatin1("%1/%2/cursor").arg(group(accountId)).arg(encodedKey(key)));
+}
+
+QVariantMap SocialdSyncCheckpoints::cursor(int accountId, const QString &key) const
+{
+    return m_settings.value(QString::fromLatin1("%1/%2/cursor").arg(group(accountId)).arg(encodedKey(key))).toMap();
+}
+
+/*!
+ * \internal
+ * Returns the pages which were saved with the checkpoint, in the order
+ * in which they were saved.  Any data which was appended to the pages
+ * file after the checkpoint was last saved successfully is ignored.
+ */
+QList<QByteArray> SocialdSyncCheckpoints::pages(int accountId, const QString &key) const
+{
+    const QString prefix = QString::fromLatin1("%1/%2").arg(group(accountId)).arg(encodedKey(key));
+    const int count = m_settings.value(prefix + QStringLiteral("/pageCount")).toInt();
+    QList<QByteArray> retn;
+    if (count == 0) {
+        return retn;
+    }
+
+    QFile file(pagesFileName(accountId, key));
+    if (!file.open(QIODevice::ReadOnly)) {
+        SOCIALD_LOG_ERROR("unable to read checkpoint pages from" << file.fileName());
+        return retn;
+    }
+
+    QDataStream stream(&file);
+    for (int i = 0; i < count; ++i) {
+        QByteArray page;
+        stream >> page;
+        if (stream.status() != QDataStream::Ok) {
+            SOCIALD_LOG_ERROR("checkpoint pages file" << file.fileName() << "is truncated");
+            return QList<QByteArray>();
+        }
+        retn.append(page);
+    }
+    return retn;
+}
+
+int SocialdSyncCheckpoints::pageCount(int accountId, const QString &key) const
+{
+    return m_settings.value(QString::fromLatin1("%1/%2/pageCount").arg(group(accountId)).arg(encodedKey(key))).toInt();
+}
+
+/*!
+ * \internal
+ * Appends \a newPages to the pages of the checkpoint and replaces its
+ * cursor.  The cursor is only updated once the pages have been written,
+ * so that a saved cursor never refers to pages which were lost.
+ */
+bool SocialdSyncCheckpoints::save(int accountId, const QString &key, const QVariantMap &cursor,
+                                  const QList<QByteArray> &newPages)
+{
+    const QString prefix = QString::fromLatin1("%1/%2").arg(group(accountId)).arg(encodedKey(key));
+    int count = m_settings.value(prefix + QStringLiteral("/pageCount")).toInt();
+    qint64 size = count > 0 ? m_settings.value(prefix + QStringLiteral("/pagesSize")).toLongLong() : 0;
+
+    if (!newPages.isEmpty()) {
+        QDir().mkpath(checkpointsDirectory());
+        // truncating to the saved size discards anything left behind by a failed write.
+        QFile file(pagesFileName(accountId, key));
+        if (!file.open(QIODevice::ReadWrite) || !file.resize(size) || !file.seek(size)) {
+            SOCIALD_LOG_ERROR("unable to write checkpoint pages to" << file.fileName());
+            return false;
+        }
+
+        QDataStream stream(&file);
+        foreach (const QByteArray &page, newPages) {
+            stream << page;
+        }
+        if (stream.status() != QDataStream::Ok || !file.flush()) {
+            SOCIALD_LOG_ERROR("unable to write checkpoint pages to" << file.fileName());
+            return false;
+        }
+        count += newPages.size();
+        size = file.pos();
+    }
+
+    m_settings.setValue(prefix + QStringLiteral("/cursor"), cursor);
+    m_settings.setValue(prefix + QStringLiteral("/pageCount"), count);
+    m_settings.setValue(prefix + QStringLiteral("/pagesSize"), size);
+    m_settings.sync();
+    return m_settings.status() == QSettings::NoError;
+}
+
+void SocialdSyncCheckpoints::remove(int accountId, const QString &key)
+{
+    m_settings.remove(QString::fromLatin1("%1/%2").arg(group(accountId)).arg(encodedKey(key)));
+    m_settings.sync();
+    QFile::remove(pagesFileName(accountId, key));
+}
+
+void SocialdSyncCheckpoints::removeAll(int accountId)
+{
+    foreach (const QString &key, keys(accountId)) {
+        QFile::remove(pagesFileName(accountId, key));
+    }
+    m_settings.remove(group(accountId));
+    m_settings.sync();
+}
@@ -0,0 +1,70 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+
+#ifndef SOCIALD_SYNCCHECKPOINTS_P_H
+#define SOCIALD_SYNCCHECKPOINTS_P_H
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QSettings>
+#include <QtCore/QVariantMap>
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+
+/*
+ * Persists the progress of paged fetches, so that a sync which was
+ * interrupted (by a timeout, an abort or the process exiting) can
+ * resume from the last completed page rather than from the first.
+ *
+ * A checkpoint is identified by account and by a key chosen by the
+ * sync adaptor (eg, an album or calendar id).  It consists of a cursor
+ * (whatever the adaptor needs to request the next page) and the pages
+ * which have already been completed, as opaque blobs.  Pages are
+ * appended to a separate file, so that saving a checkpoint costs only
+ * the size of the new page, whatever the number of completed pages.
+ */
+class SocialdSyncCheckpoints
+{
+public:
+    SocialdSyncCheckpoints(const QString &serviceName, const QString &dataType);
+    ~SocialdSyncCheckpoints();
+
+    QStringList keys(int accountId) const;
+    bool contains(int accountId, const QString &key) const;
+    QVariantMap cursor(int accountId, const QString &key) const;
+    QList<QByteArray> pages(int accountId, const QString &key) const;
+    int pageCount(int accountId, const QString &key) const;
+
+    bool save(int accountId, const QString &key, const QVariantMap &cursor,
+              const QList<QByteArray> &newPages = QList<QByteArray>());
+    void remove(int accountId, const QString &key);
+    void removeAll(int accountId);
+
+private:
+    QString group(int accountId) const;
+    QString pagesFileName(int accountId, const QString &key) const;
+
+    QSettings m_settings;
+    QString m_prefix;
+};
+
+#endif // SOCIALD_SYNCCHECKPOINTS_P_H
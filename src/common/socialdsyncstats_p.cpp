@@ -0,0 +1,300 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+
+#include "socialdsyncstats_p.h"
+#include "socialdjsonstreamparser_p.h"
+#include "trace.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QLockFile>
+#include <QtNetwork/QNetworkReply>
+#include <QtDBus/QDBusConnection>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SOCIALD_SYNC_STATS_HISTORY 20               // records returned by records()
+#define SOCIALD_SYNC_STATS_FILE_MAX_SIZE 1048576    // bytes, before the file is rotated
+#define SOCIALD_SYNC_STATS_LOCK_TIMEOUT 1000        // msecs to wait for another process rotating the file
+
+namespace {
+    QString statsFileName()
+    {
+        return QString::fromLatin1("%1/%2/syncstats.jsonl")
+                .arg(QString::fromLatin1(PRIVILEGED_DATA_DIR))
+                .arg(QString::fromLatin1(SYNC_DATABASE_DIR));
+    }
+}
+
+SocialdSyncStats::SocialdSyncStats(const QString &serviceName, const QString &dataType, QObject *parent)
+    : QObject(parent)
+    , m_serviceName(serviceName)
+    , m_dataType(dataType)
+    , m_objectPath(QString::fromLatin1("/sociald/stats/%1/%2").arg(serviceName).arg(dataType))
+{
+    m_clock.start();
+
+    // several plugin instances for the same data type may be loaded in the
+    // same process; only the first one is published, the others still
+    // append their records to the file.
+    if (!QDBusConnection::sessionBus().registerObject(m_objectPath, this, QDBusConnection::ExportScriptableSlots)) {
+        SOCIALD_LOG_DEBUG("unable to publish sync statistics at" << m_objectPath);
+        m_objectPath.clear();
+    }
+}
+
+SocialdSyncStats::~SocialdSyncStats()
+{
+    if (!m_objectPath.isEmpty()) {
+        QDBusConnection::sessionBus().unregisterObject(m_objectPath);
+    }
+}
+
+SocialdSyncStats::Record &SocialdSyncStats::record(int accountId)
+{
+    QMap<int, Record>::iterator it = m_records.find(accountId);
+    if (it == m_records.end()) {
+        it = m_records.insert(accountId, Record());
+        it->started = QDateTime::currentDateTimeUtc();
+        it->startedAt = m_clock.elapsed();
+    }
+    return it.value();
+}
+
+void SocialdSyncStats::semaphoreChanged(int accountId, int value)
+{
+    Record &r(record(accountId));
+    if (value > r.peakQueueDepth) {
+        r.peakQueueDepth = value;
+    }
+}
+
+void SocialdSyncStats::requestStarted(int accountId, QNetworkReply *reply)
+{
+    if (!reply || m_replies.contains(reply)) {
+        return;
+    }
+
+    Record &r(record(accountId));
+    if (r.firstRequestAt < 0) {
+        r.firstRequestAt = m_clock.elapsed();
+    }
+    r.requests += 1;
+
+    ReplyTraffic traffic;
+    traffic.accountId = accountId;
+    m_replies.insert(reply, traffic);
+    connect(reply, SIGNAL(downloadProgress(qint64,qint64)), this, SLOT(replyDownloadProgress(qint64,qint64)));
+    connect(reply, SIGNAL(uploadProgress(qint64,qint64)), this, SLOT(replyUploadProgress(qint64,qint64)));
+    connect(reply, SIGNAL(destroyed(QObject*)), this, SLOT(replyDestroyed(QObject*)));
+}
+
+void SocialdSyncStats::requestFinished(QNetworkReply *reply)
+{
+    if (m_replies.contains(reply)) {
+        // a streamed reply has been parsed as it arrived, and finished
+        // by its finished() handler before the reply timeout is removed.
+        SocialdJsonStreamParser *parser = SocialdJsonStreamParser::parser(reply);
+        if (parser) {
+            addParseTime(m_replies.value(reply).accountId, parser->parseUsecs());
+        }
+        finishRequest(reply, reply->error() != QNetworkReply::NoError || reply->property("isError").toBool());
+    }
+}
+
+void SocialdSyncStats::finishRequest(QObject *reply, bool failed)
+{
+    ReplyTraffic traffic = m_replies.take(reply);
+    Record &r(record(traffic.accountId));
+    r.bytesReceived += traffic.received;
+    r.bytesSent += traffic.sent;
+    r.lastReplyAt = m_clock.elapsed();
+    if (failed) {
+        r.failedRequests += 1;
+    }
+    disconnect(reply, 0, this, 0);
+}
+
+void SocialdSyncStats::replyDownloadProgress(qint64 received, qint64)
+{
+    QHash<QObject*, ReplyTraffic>::iterator it = m_replies.find(sender());
+    if (it != m_replies.end() && received > it->received) {
+        it->received = received;
+    }
+}
+
+void SocialdSyncStats::replyUploadProgress(qint64 sent, qint64)
+{
+    QHash<QObject*, ReplyTraffic>::iterator it = m_replies.find(sender());
+    if (it != m_replies.end() && sent > it->sent) {
+        it->sent = sent;
+    }
+}
+
+void SocialdSyncStats::replyDestroyed(QObject *reply)
+{
+    // not every finished() handler removes the reply timeout.
+    if (m_replies.contains(reply)) {
+        finishRequest(reply, false);
+    }
+}
+
+void SocialdSyncStats::addParseTime(int accountId, qint64 usecs)
+{
+    record(accountId).parseUsecs += usecs;
+}
+
+void SocialdSyncStats::addStoreTime(int accountId, qint64 usecs)
+{
+    record(accountId).storeUsecs += usecs;
+}
+
+void SocialdSyncStats::accountFinished(int accountId)
+{
+    record(accountId).finishedAt = m_clock.elapsed();
+}
+
+/*!
+ * \internal
+ * Completes the records of the sync run which has just finished, and
+ * publishes them.  \a cleanupUsecs is the time spent in the final
+ * cleanup of the adaptor, which is shared by all of the synced accounts.
+ */
+void SocialdSyncStats::publish(qint64 cleanupUsecs, bool aborted)
+{
+    const qint64 now = m_clock.elapsed();
+    QList<QJsonObject> published;
+    QMap<int, Record>::const_iterator it = m_records.constBegin();
+    for ( ; it != m_records.constEnd(); ++it) {
+        const Record &r(it.value());
+        const qint64 finishedAt = r.finishedAt >= 0 ? r.finishedAt : now;
+
+        QJsonObject phases;
+        phases.insert(QStringLiteral("totalMsecs"), static_cast<double>(now - r.startedAt));
+        phases.insert(QStringLiteral("networkMsecs"), r.firstRequestAt >= 0 && r.lastReplyAt >= 0
+                                                      ? static_cast<double>(r.lastReplyAt - r.firstRequestAt)
+                                                      : 0.0);
+        phases.insert(QStringLiteral("finalizeMsecs"), static_cast<double>(now - finishedAt));
+
+        QJsonObject json;
+        json.insert(QStringLiteral("service"), m_serviceName);
+        json.insert(QStringLiteral("dataType"), m_dataType);
+        json.insert(QStringLiteral("accountId"), it.key());
+        json.insert(QStringLiteral("started"), r.started.toString(Qt::ISODate));
+        json.insert(QStringLiteral("aborted"), aborted);
+        json.insert(QStringLiteral("phases"), phases);
+        json.insert(QStringLiteral("requests"), r.requests);
+        json.insert(QStringLiteral("failedRequests"), r.failedRequests);
+        json.insert(QStringLiteral("bytesReceived"), static_cast<double>(r.bytesReceived));
+        json.insert(QStringLiteral("bytesSent"), static_cast<double>(r.bytesSent));
+        json.insert(QStringLiteral("parseUsecs"), static_cast<double>(r.parseUsecs));
+        json.insert(QStringLiteral("storeUsecs"), static_cast<double>(r.storeUsecs));
+        json.insert(QStringLiteral("cleanupUsecs"), static_cast<double>(cleanupUsecs));
+        json.insert(QStringLiteral("peakQueueDepth"), r.peakQueueDepth);
+        published.append(json);
+
+        SOCIALD_LOG_DEBUG("sync statistics:" << QJsonDocument(json).toJson(QJsonDocument::Compact).constData());
+    }
+
+    m_records.clear();
+    appendToFile(published);
+}
+
+void SocialdSyncStats::appendToFile(const QList<QJsonObject> &records)
+{
+    if (records.isEmpty()) {
+        return;
+    }
+
+    const QString fileName = statsFileName();
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    if (QFileInfo(fileName).size() > SOCIALD_SYNC_STATS_FILE_MAX_SIZE) {
+        // the plugins of other data types may be rotating it at the same time.
+        QLockFile lock(fileName + QStringLiteral(".lock"));
+        if (lock.tryLock(SOCIALD_SYNC_STATS_LOCK_TIMEOUT)
+                && QFileInfo(fileName).size() > SOCIALD_SYNC_STATS_FILE_MAX_SIZE) {
+            QFile::remove(fileName + QStringLiteral(".old"));
+            QFile::rename(fileName, fileName + QStringLiteral(".old"));
+        }
+    }
+
+    // each record is appended with a single write, so that the records
+    // of concurrent plugin processes are never interleaved.
+    int fd = ::open(QFile::encodeName(fileName).constData(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        SOCIALD_LOG_ERROR("unable to write sync statistics to" << fileName);
+        return;
+    }
+
+    foreach (const QJsonObject &json, records) {
+        QByteArray line = QJsonDocument(json).toJson(QJsonDocument::Compact) + '\n';
+        if (::write(fd, line.constData(), line.size()) != line.size()) {
+            SOCIALD_LOG_ERROR("unable to write sync statistics to" << fileName);
+            break;
+        }
+    }
+    ::close(fd);
+}
+
+// Returns the last \a count records of this adaptor in the given file.
+QList<QJsonObject> SocialdSyncStats::readRecords(const QString &fileName, int count) const
+{
+    QList<QJsonObject> recent;
+    QFile file(fileName);
+    if (count <= 0 || !file.open(QIODevice::ReadOnly)) {
+        return recent;
+    }
+
+    while (!file.atEnd()) {
+        // a record which is still being written is not valid json yet.
+        QJsonObject json = QJsonDocument::fromJson(file.readLine()).object();
+        if (json.value(QStringLiteral("service")).toString() == m_serviceName
+                && json.value(QStringLiteral("dataType")).toString() == m_dataType) {
+            recent.append(json);
+            if (recent.size() > count) {
+                recent.removeFirst();
+            }
+        }
+    }
+    return recent;
+}
+
+/*!
+ * \internal
+ * Returns the most recent sync records of this adaptor, as a JSON array.
+ */
+QString SocialdSyncStats::records() const
+{
+    const QString fileName = statsFileName();
+    QList<QJsonObject> recent = readRecords(fileName, SOCIALD_SYNC_STATS_HISTORY);
+    recent = readRecords(fileName + QStringLiteral(".old"), SOCIALD_SYNC_STATS_HISTORY - recent.size()) + recent;
+
+    QJsonArray array;
+    foreach (const QJsonObject &json, recent) {
+        array.append(json);
+    }
+    return QString::fromUtf8(QJsonDocument(array).toJson(QJsonDocument::Compact));
+}
@@ -0,0 +1,115 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+
+#ifndef SOCIALD_SYNCSTATS_P_H
+#define SOCIALD_SYNCSTATS_P_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QString>
+#include <QtCore/QDateTime>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QJsonObject>
+
+class QNetworkReply;
+
+/*
+ * Records where the time of each sync goes, per account: the wall time
+ * of the network and store phases, the number of requests, the bytes
+ * sent and received, the time spent parsing replies and storing data
+ * locally, and the peak number of outstanding operations.
+ *
+ * Once a sync run has finished, one record per synced account is
+ * appended to a JSON-lines file (syncstats.jsonl, in the sync database
+ * directory).  The plugins of every data type append to this file from
+ * their own processes, each record with a single write.  While a plugin
+ * is loaded, the most recent records of its data type are available over
+ * D-Bus at /sociald/stats/<service>/<dataType> via the records() method,
+ * which reads them back from the file, so that they include the syncs
+ * run by earlier plugin processes.
+ */
+class SocialdSyncStats : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.nemomobile.sociald.SyncStats")
+
+public:
+    SocialdSyncStats(const QString &serviceName, const QString &dataType, QObject *parent = 0);
+    ~SocialdSyncStats();
+
+    void semaphoreChanged(int accountId, int value);
+    void requestStarted(int accountId, QNetworkReply *reply);
+    void requestFinished(QNetworkReply *reply);
+    void addParseTime(int accountId, qint64 usecs);
+    void addStoreTime(int accountId, qint64 usecs);
+    void accountFinished(int accountId);
+    void publish(qint64 cleanupUsecs, bool aborted);
+
+public Q_SLOTS:
+    Q_SCRIPTABLE QString records() const;
+
+private Q_SLOTS:
+    void replyDownloadProgress(qint64 received, qint64 total);
+    void replyUploadProgress(qint64 sent, qint64 total);
+    void replyDestroyed(QObject *reply);
+
+private:
+    struct Record {
+        Record() : startedAt(0), finishedAt(-1), firstRequestAt(-1), lastReplyAt(-1)
+                 , requests(0), failedRequests(0), bytesReceived(0), bytesSent(0)
+                 , parseUsecs(0), storeUsecs(0), peakQueueDepth(0) {}
+        QDateTime started;
+        qint64 startedAt;
+        qint64 finishedAt;
+        qint64 firstRequestAt;
+        qint64 lastReplyAt;
+        int requests;
+        int failedRequests;
+        qint64 bytesReceived;
+        qint64 bytesSent;
+        qint64 parseUsecs;
+        qint64 storeUsecs;
+        int peakQueueDepth;
+    };
+    struct ReplyTraffic {
+        ReplyTraffic() : accountId(0), received(0), sent(0) {}
+        int accountId;
+        qint64 received;
+        qint64 sent;
+    };
+
+    Record &record(int accountId);
+    void finishRequest(QObject *reply, bool failed);
+    void appendToFile(const QList<QJsonObject> &records);
+    QList<QJsonObject> readRecords(const QString &fileName, int count) const;
+
+    QString m_serviceName;
+    QString m_dataType;
+    QString m_objectPath;
+    QMap<int, Record> m_records;
+    QHash<QObject*, ReplyTraffic> m_replies;
+    QElapsedTimer m_clock;
+};
+
+#endif // SOCIALD_SYNCSTATS_P_H
@@ -0,0 +1,312 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+#include "socialdtimeoutwheel_p.h"
+#include "trace.h"
+
+#include <QtCore/QSettings>
+#include <QtCore/QStringList>
+#include <QtCore/QUrl>
+#include <QtNetwork/QNetworkReply>
+
+#include <algorithm>
+
+#define SOCIALD_TIMEOUT_WHEEL_TICK 1000         // ms per slot
+#define SOCIALD_TIMEOUT_WHEEL_SLOTS 64
+#define SOCIALD_REPLY_TIMEOUT_DEFAULT 60000     // used until enough latencies are known
+#define SOCIALD_REPLY_TIMEOUT_MIN 10000
+#define SOCIALD_REPLY_TIMEOUT_MAX 120000
+#define SOCIALD_REPLY_TIMEOUT_FACTOR 4          // deadline is p99 latency * factor
+#define SOCIALD_REPLY_LATENCY_MIN_SAMPLES 5
+#define SOCIALD_REPLY_LATENCY_MAX_SAMPLES 64
+
+namespace {
+    QString latenciesFileName()
+    {
+        return QString::fromLatin1("%1/%2/latencies.ini")
+                .arg(QString::fromLatin1(PRIVILEGED_DATA_DIR))
+                .arg(QString::fromLatin1(SYNC_DATABASE_DIR));
+    }
+
+    // endpoints contain '/', which QSettings treats as a group separator.
+    QString encodedEndpoint(const QString &endpoint)
+    {
+        return QString::fromLatin1(endpoint.toUtf8().toHex());
+    }
+}
+
+SocialdTimeoutWheel::SocialdTimeoutWheel(QObject *parent)
+    : QObject(parent)
+    , m_slots(SOCIALD_TIMEOUT_WHEEL_SLOTS)
+    , m_current(0)
+{
+    m_timer.setInterval(SOCIALD_TIMEOUT_WHEEL_TICK);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(tick()));
+    m_clock.start();
+}
+
+SocialdTimeoutWheel::~SocialdTimeoutWheel()
+{
+    saveLatencies();
+}
+
+/*!
+ * \internal
+ * Loads the latencies observed for the endpoint by previous syncs, as
+ * each sync usually runs in a process of its own.
+ */
+SocialdTimeoutWheel::Latencies &SocialdTimeoutWheel::latencies(const QString &endpoint)
+{
+    QHash<QString, Latencies>::iterator it = m_latencies.find(endpoint);
+    if (it != m_latencies.end()) {
+        return it.value();
+    }
+
+    Latencies &retn(m_latencies[endpoint]);
+    QSettings settings(latenciesFileName(), QSettings::IniFormat);
+    const QStringList samples = settings.value(encodedEndpoint(endpoint)).toStringList();
+    foreach (const QString &sample, samples.mid(qMax(0, samples.size() - SOCIALD_REPLY_LATENCY_MAX_SAMPLES))) {
+        bool ok = false;
+        int latency = sample.toInt(&ok);
+        if (ok && latency >= 0) {
+            retn.samples.append(latency);
+        }
+    }
+    updateDeadline(endpoint, &retn);
+    return retn;
+}
+
+/*!
+ * \internal
+ * Stores the samples of the endpoints which were used by this sync,
+ * oldest first.  Only those endpoints are written so that concurrent
+ * syncs of other data types don't overwrite each other's samples.
+ */
+void SocialdTimeoutWheel::saveLatencies()
+{
+    if (m_changedEndpoints.isEmpty()) {
+        return;
+    }
+
+    QSettings settings(latenciesFileName(), QSettings::IniFormat);
+    foreach (const QString &endpoint, m_changedEndpoints) {
+        const Latencies &latencies(m_latencies[endpoint]);
+        QStringList samples;
+        for (int i = 0; i < latencies.samples.size(); ++i) {
+            samples.append(QString::number(latencies.samples.at((latencies.next + i) % latencies.samples.size())));
+        }
+        settings.setValue(encodedEndpoint(endpoint), samples);
+    }
+    settings.sync();
+    if (settings.status() != QSettings::NoError) {
+        SOCIALD_LOG_ERROR("unable to store reply latencies to" << settings.fileName());
+    }
+    m_changedEndpoints.clear();
+}
+
+/*!
+ * \internal
+ * Returns the endpoint of the reply, which is the host and path of
+ * its url with any path segments which look like identifiers replaced.
+ */
+QString SocialdTimeoutWheel::endpoint(QNetworkReply *reply)
+{
+    QUrl url = reply->url();
+    QStringList segments = url.path().split(QLatin1Char('/'), QString::SkipEmptyParts);
+    for (int i = 0; i < segments.size(); ++i) {
+        const QString &segment(segments.at(i));
+        for (int j = 0; j < segment.size(); ++j) {
+            if (segment.at(j).isDigit() || segment.at(j) == QLatin1Char('@')) {
+                segments[i] = QStringLiteral("*");
+                break;
+            }
+        }
+    }
+
+    return url.host() + QLatin1Char('/') + segments.join(QLatin1Char('/'));
+}
+
+int SocialdTimeoutWheel::deadline(const QString &endpoint)
+{
+    int retn = latencies(endpoint).deadline;
+    return retn > 0 ? retn : SOCIALD_REPLY_TIMEOUT_DEFAULT;
+}
+
+int SocialdTimeoutWheel::outstanding() const
+{
+    return m_entries.size();
+}
+
+/*!
+ * \internal
+ * Returns every reply which is being tracked, including those which
+ * are still queued and so have not been armed yet.
+ */
+QList<QNetworkReply*> SocialdTimeoutWheel::replies() const
+{
+    QList<QNetworkReply*> retn;
+    QHash<QObject*, Entry>::const_iterator it = m_entries.constBegin();
+    for ( ; it != m_entries.constEnd(); ++it) {
+        retn.append(it->reply);
+    }
+    return retn;
+}
+
+void SocialdTimeoutWheel::arm(int accountId, QNetworkReply *reply)
+{
+    if (!reply || m_entries.contains(reply)) {
+        return;
+    }
+
+    Entry entry;
+    entry.reply = reply;
+    entry.accountId = accountId;
+    entry.endpoint = endpoint(reply);
+    connect(reply, SIGNAL(destroyed(QObject*)), this, SLOT(replyDestroyed(QObject*)));
+
+    QVariant started = reply->property("started");
+    if (started.isValid() && !started.toBool()) {
+        // still queued in the network access manager; arm once it starts.
+        m_entries.insert(reply, entry);
+        connect(reply, SIGNAL(started()), this, SLOT(replyStarted()));
+        return;
+    }
+
+    insert(&(m_entries[reply] = entry));
+}
+
+void SocialdTimeoutWheel::disarm(QNetworkReply *reply)
+{
+    QHash<QObject*, Entry>::iterator it = m_entries.find(reply);
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    if (it->slot >= 0) {
+        m_slots[it->slot].remove(reply);
+        if (reply->error() == QNetworkReply::NoError) {
+            recordLatency(it->endpoint, static_cast<int>(m_clock.elapsed() - it->armedAt));
+        }
+    }
+
+    disconnect(reply, 0, this, 0);
+    m_entries.erase(it);
+    if (m_entries.isEmpty()) {
+        m_timer.stop();
+    }
+}
+
+void SocialdTimeoutWheel::insert(Entry *entry)
+{
+    // one extra tick, as the current tick may be about to elapse.
+    int ticks = (deadline(entry->endpoint) + SOCIALD_TIMEOUT_WHEEL_TICK - 1) / SOCIALD_TIMEOUT_WHEEL_TICK + 1;
+    entry->slot = (m_current + ticks) % SOCIALD_TIMEOUT_WHEEL_SLOTS;
+    entry->rounds = (ticks - 1) / SOCIALD_TIMEOUT_WHEEL_SLOTS;
+    entry->armedAt = m_clock.elapsed();
+    m_slots[entry->slot].insert(entry->reply);
+
+    if (!m_timer.isActive()) {
+        m_timer.start();
+    }
+}
+
+void SocialdTimeoutWheel::tick()
+{
+    m_current = (m_current + 1) % SOCIALD_TIMEOUT_WHEEL_SLOTS;
+
+    QList<Entry> expired;
+    QSet<QObject*> &bucket(m_slots[m_current]);
+    QSet<QObject*>::iterator it = bucket.begin();
+    while (it != bucket.end()) {
+        Entry &entry(m_entries[*it]);
+        if (entry.rounds > 0) {
+            --entry.rounds;
+            ++it;
+        } else {
+            expired.append(entry);
+            m_entries.remove(*it);
+            it = bucket.erase(it);
+        }
+    }
+
+    if (m_entries.isEmpty()) {
+        m_timer.stop();
+    }
+
+    foreach (const Entry &entry, expired) {
+        // a timeout is not a latency sample: it only says that the reply
+        // took longer than the deadline, and counting it would push the
+        // deadline of an unreachable endpoint up to the maximum.
+        disconnect(entry.reply, 0, this, 0);
+        emit timedOut(entry.reply, entry.accountId);
+    }
+}
+
+void SocialdTimeoutWheel::replyStarted()
+{
+    QHash<QObject*, Entry>::iterator it = m_entries.find(sender());
+    if (it != m_entries.end() && it->slot < 0) {
+        insert(&it.value());
+    }
+}
+
+void SocialdTimeoutWheel::replyDestroyed(QObject *reply)
+{
+    QHash<QObject*, Entry>::iterator it = m_entries.find(reply);
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    if (it->slot >= 0) {
+        m_slots[it->slot].remove(reply);
+    }
+    m_entries.erase(it);
+    if (m_entries.isEmpty()) {
+        m_timer.stop();
+    }
+}
+
+void SocialdTimeoutWheel::recordLatency(const QString &endpoint, int latency)
+{
+    Latencies &latencies(this->latencies(endpoint));
+    if (latencies.samples.size() < SOCIALD_REPLY_LATENCY_MAX_SAMPLES) {
+        latencies.samples.append(latency);
+    } else {
+        latencies.samples[latencies.next] = latency;
+        latencies.next = (latencies.next + 1) % SOCIALD_REPLY_LATENCY_MAX_SAMPLES;
+    }
+
+    m_changedEndpoints.insert(endpoint);
+    updateDeadline(endpoint, &latencies);
+}
+
+void SocialdTimeoutWheel::updateDeadline(const QString &endpoint, Latencies *latencies)
+{
+    if (latencies->samples.size() >= SOCIALD_REPLY_LATENCY_MIN_SAMPLES) {
+        QVector<int> sorted(latencies->samples);
+        int p99 = qMax(0, (sorted.size() * 99 + 99) / 100 - 1);
+        std::nth_element(sorted.begin(), sorted.begin() + p99, sorted.end());
+        latencies->deadline = qBound(SOCIALD_REPLY_TIMEOUT_MIN,
+                                     sorted.at(p99) * SOCIALD_REPLY_TIMEOUT_FACTOR,
+                                     SOCIALD_REPLY_TIMEOUT_MAX);
+        SOCIALD_LOG_TRACE("reply deadline for" << endpoint << "is now" << latencies->deadline << "ms");
+    }
+}
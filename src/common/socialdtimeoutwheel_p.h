@@ -0,0 +1,109 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+#ifndef SOCIALD_TIMEOUTWHEEL_P_H
+#define SOCIALD_TIMEOUTWHEEL_P_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QString>
+
+class QNetworkReply;
+
+/*
+ * Tracks the timeouts of the outstanding network replies of a sync
+ * adaptor with a single coarse-grained timer wheel.  Arming and
+ * disarming a timeout are constant time operations.
+ *
+ * The timeout of a reply is derived from the latency previously
+ * observed for the same endpoint (host and path, with identifiers
+ * removed from the path), so that dead connections are detected
+ * quickly while slow endpoints still get enough time.  Only replies
+ * which finish successfully are sampled; a timed out reply says
+ * nothing about how long the endpoint would have taken.  The samples
+ * are stored on destruction and loaded again by later syncs, as the
+ * wheel normally lives no longer than a single sync.
+ *
+ * Replies which are queued by the SocialdNetworkAccessManager are
+ * only armed once they have been started.
+ */
+class SocialdTimeoutWheel : public QObject
+{
+    Q_OBJECT
+
+public:
+    SocialdTimeoutWheel(QObject *parent = 0);
+    ~SocialdTimeoutWheel();
+
+    void arm(int accountId, QNetworkReply *reply);
+    void disarm(QNetworkReply *reply);
+    int outstanding() const;
+    QList<QNetworkReply*> replies() const;
+    int deadline(const QString &endpoint);
+
+    static QString endpoint(QNetworkReply *reply);
+
+Q_SIGNALS:
+    void timedOut(QNetworkReply *reply, int accountId);
+
+private Q_SLOTS:
+    void tick();
+    void replyStarted();
+    void replyDestroyed(QObject *reply);
+
+private:
+    struct Entry {
+        Entry() : reply(0), accountId(0), slot(-1), rounds(0), armedAt(0) {}
+        QNetworkReply *reply;
+        QString endpoint;
+        int accountId;
+        int slot;
+        int rounds;
+        qint64 armedAt;
+    };
+    struct Latencies {
+        Latencies() : next(0), deadline(0) {}
+        QVector<int> samples;
+        int next;
+        int deadline;
+    };
+
+    void insert(Entry *entry);
+    void recordLatency(const QString &endpoint, int latency);
+    Latencies &latencies(const QString &endpoint);
+    void updateDeadline(const QString &endpoint, Latencies *latencies);
+    void saveLatencies();
+
+    QVector<QSet<QObject*> > m_slots;
+    QHash<QObject*, Entry> m_entries;
+    QHash<QString, Latencies> m_latencies;
+    QSet<QString> m_changedEndpoints;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    int m_current;
+};
+
+#endif // SOCIALD_TIMEOUTWHEEL_P_H
@@ -0,0 +1,92 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+#include "socialdvalidatorcache_p.h"
+#include "trace.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QUrlQuery>
+#include <QtNetwork/QNetworkReply>
+
+namespace {
+    QString validatorsFileName()
+    {
+        return QString::fromLatin1("%1/%2/validators.ini")
+                .arg(QString::fromLatin1(PRIVILEGED_DATA_DIR))
+                .arg(QString::fromLatin1(SYNC_DATABASE_DIR));
+    }
+}
+
+SocialdValidatorCache::SocialdValidatorCache()
+    : m_settings(validatorsFileName(), QSettings::IniFormat)
+{
+}
+
+SocialdValidatorCache::~SocialdValidatorCache()
+{
+    m_settings.sync();
+}
+
+QString SocialdValidatorCache::cacheKey(int accountId, const QUrl &url)
+{
+    // the access token changes frequently, and must not be persisted anyway.
+    QUrl strippedUrl(url);
+    QUrlQuery query(strippedUrl);
+    query.removeAllQueryItems(QStringLiteral("access_token"));
+    query.removeAllQueryItems(QStringLiteral("key"));
+    strippedUrl.setQuery(query);
+
+    QByteArray hash = QCryptographicHash::hash(strippedUrl.toEncoded(), QCryptographicHash::Sha1).toHex();
+    return QString::fromLatin1("%1/%2").arg(accountId).arg(QString::fromLatin1(hash));
+}
+
+void SocialdValidatorCache::prepareRequest(const QString &key, QNetworkRequest *request) const
+{
+    QByteArray etag = m_settings.value(key + QStringLiteral("/etag")).toByteArray();
+    QByteArray lastModified = m_settings.value(key + QStringLiteral("/lastModified")).toByteArray();
+    if (!etag.isEmpty()) {
+        request->setRawHeader("If-None-Match", etag);
+    }
+    if (!lastModified.isEmpty()) {
+        request->setRawHeader("If-Modified-Since", lastModified);
+    }
+}
+
+void SocialdValidatorCache::updateValidators(const QString &key, QNetworkReply *reply)
+{
+    if (reply->error() != QNetworkReply::NoError
+            || reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 200) {
+        // a 304 leaves the validators as they are, and we never
+        // want to validate against a failed response.
+        return;
+    }
+
+    QByteArray etag = reply->rawHeader("ETag");
+    QByteArray lastModified = reply->rawHeader("Last-Modified");
+    if (etag.isEmpty() && lastModified.isEmpty()) {
+        m_settings.remove(key);
+        return;
+    }
+
+    m_settings.setValue(key + QStringLiteral("/etag"), etag);
+    m_settings.setValue(key + QStringLiteral("/lastModified"), lastModified);
+    SOCIALD_LOG_TRACE("stored validators for" << reply->url().host() << ":" << etag << lastModified);
+}
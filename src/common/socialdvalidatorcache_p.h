@@ -0,0 +1,53 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+#ifndef SOCIALD_VALIDATORCACHE_P_H
+#define SOCIALD_VALIDATORCACHE_P_H
+
+#include <QtCore/QString>
+#include <QtCore/QSettings>
+#include <QtCore/QUrl>
+#include <QtNetwork/QNetworkRequest>
+
+class QNetworkReply;
+
+/*
+ * Stores the ETag and Last-Modified validators of successful responses
+ * to conditional requests, keyed by account and by request url (with
+ * any access token removed), so that subsequent requests for the same
+ * resource can be sent with If-None-Match / If-Modified-Since headers.
+ */
+class SocialdValidatorCache
+{
+public:
+    SocialdValidatorCache();
+    ~SocialdValidatorCache();
+
+    static QString cacheKey(int accountId, const QUrl &url);
+
+    void prepareRequest(const QString &key, QNetworkRequest *request) const;
+    void updateValidators(const QString &key, QNetworkReply *reply);
+
+private:
+    QSettings m_settings;
+};
+
+#endif // SOCIALD_VALIDATORCACHE_P_H
@@ -21,9 +21,12 @@
 
 #include "socialnetworksyncadaptor.h"
 #include "socialdnetworkaccessmanager_p.h"
+#include "socialdtimeoutwheel_p.h"
+#include "socialdsyncstats_p.h"
 #include "trace.h"
 
 #include <QtCore/QJsonDocument>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QTimer>
 #include <QtSql/QSqlDatabase>
 #include <QtSql/QSqlQuery>
@@ -43,6 +46,9 @@
 // libsocialcache
 #include <socialnetworksyncdatabase.h>
 
+// how long the handlers of aborted replies are given to release their semaphores
+#define SOCIALD_ABORT_GRACE_PERIOD 5000
+
 namespace {
     QStringList validDataTypesInitialiser()
     {
@@ -69,13 +75,29 @@ SocialNetworkSyncAdaptor::SocialNetworkSyncAdaptor(const QString &serviceName,
     , m_accountSyncProfile(NULL)
     , m_syncDb(new SocialNetworkSyncDatabase())
     , m_status(SocialNetworkSyncAdaptor::Invalid)
+    , m_enabled(false)
+    , m_syncAborted(false)
+    , m_multiAccountSync(false)
+    , m_dispatchingAccounts(false)
     , m_serviceName(serviceName)
+    , m_replyTimeouts(new SocialdTimeoutWheel(this))
+    , m_syncStats(new SocialdSyncStats(serviceName, dataTypeName(dataType), this))
 {
+    connect(m_replyTimeouts, SIGNAL(timedOut(QNetworkReply*,int)),
+            this, SLOT(timeoutReply(QNetworkReply*,int)));
 }
 
 SocialNetworkSyncAdaptor::~SocialNetworkSyncAdaptor()
 {
+    // make sure that any queued sync timestamps hit the disk.
+    commitSyncTimestamps();
+    m_syncDb->wait();
+    if (m_syncDb->writeStatus() != AbstractSocialCacheDatabase::Finished) {
+        SOCIALD_LOG_ERROR("unable to store sync timestamps for" << m_serviceName << dataTypeName(m_dataType));
+    }
+
     delete m_accountSyncProfile;
+    qDeleteAll(m_accountSyncProfiles);
     delete m_syncDb;
 }
 
@@ -86,6 +108,29 @@ void SocialNetworkSyncAdaptor::setAccountSyncProfile(Buteo::SyncProfile* perAcco
     m_accountSyncProfile = perAccountSyncProfile;
 }
 
+// Used with syncAccounts(); the profiles are looked up by their account id.
+void SocialNetworkSyncAdaptor::setAccountSyncProfiles(const QList<Buteo::SyncProfile*> &perAccountSyncProfiles)
+{
+    qDeleteAll(m_accountSyncProfiles);
+    m_accountSyncProfiles.clear();
+    foreach (Buteo::SyncProfile *perAccountSyncProfile, perAccountSyncProfiles) {
+        int accountId = perAccountSyncProfile->key(Buteo::KEY_ACCOUNT_ID).toInt();
+        delete m_accountSyncProfiles.value(accountId);
+        m_accountSyncProfiles.insert(accountId, perAccountSyncProfile);
+    }
+}
+
+/*!
+ * \internal
+ * Returns the sync profile of the given account, or the profile which
+ * was set with setAccountSyncProfile() if there is no such profile.
+ * The returned profile may be null.
+ */
+Buteo::SyncProfile *SocialNetworkSyncAdaptor::accountSyncProfile(int accountId) const
+{
+    return m_accountSyncProfiles.value(accountId, m_accountSyncProfile);
+}
+
 SocialNetworkSyncAdaptor::Status SocialNetworkSyncAdaptor::status() const
 {
     return m_status;
@@ -171,29 +216,74 @@ void SocialNetworkSyncAdaptor::finalize(int accountId)
     Returns the last sync timestamp for the given service, account and data type.
     If data from prior to this timestamp is received in subsequent requests, it does not need to be synced.
     This function will return an invalid QDateTime if no synchronisation has occurred.
+
+    Timestamps which have been read or updated during the lifetime of the
+    adaptor are served from memory, so that queued (uncommitted) updates
+    are visible and the database is only queried once per account.
 */
 QDateTime SocialNetworkSyncAdaptor::lastSyncTimestamp(const QString &serviceName,
                                                       const QString &dataType,
                                                       int accountId) const
 {
-    return m_syncDb->lastSyncTimestamp(serviceName, dataType, accountId);
+    const QString key = syncTimestampKey(serviceName, dataType, accountId);
+    QHash<QString, QDateTime>::const_iterator it = m_syncTimestamps.constFind(key);
+    if (it != m_syncTimestamps.constEnd()) {
+        return it.value();
+    }
+
+    QDateTime timestamp = m_syncDb->lastSyncTimestamp(serviceName, dataType, accountId);
+    m_syncTimestamps.insert(key, timestamp);
+    return timestamp;
 }
 
 /*!
     \internal
     Updates the last sync timestamp for the given service, account and data type to the given \a timestamp.
+
+    The update is queued, and all of the queued updates are written to the
+    database in a single transaction by commitSyncTimestamps() when the
+    sync run finishes.
 */
-bool SocialNetworkSyncAdaptor::updateLastSyncTimestamp(const QString &serviceName,
+void SocialNetworkSyncAdaptor::updateLastSyncTimestamp(const QString &serviceName,
                                                        const QString &dataType,
                                                        int accountId,
                                                        const QDateTime &timestamp)
 {
-    // Workaround
-    // TODO: do better, with a queue
-    m_syncDb->addSyncTimestamp(serviceName, dataType, accountId, timestamp);
+    const QString key = syncTimestampKey(serviceName, dataType, accountId);
+    m_syncTimestamps.insert(key, timestamp);
+
+    PendingSyncTimestamp pending;
+    pending.serviceName = serviceName;
+    pending.dataType = dataType;
+    pending.accountId = accountId;
+    pending.timestamp = timestamp;
+    m_pendingSyncTimestamps.insert(key, pending);
+}
+
+/*!
+    \internal
+    Writes any queued sync timestamps to the database.  The write
+    is performed asynchronously by the database's worker thread;
+    the destructor waits for it to complete.
+*/
+void SocialNetworkSyncAdaptor::commitSyncTimestamps()
+{
+    if (m_pendingSyncTimestamps.isEmpty()) {
+        return;
+    }
+
+    foreach (const PendingSyncTimestamp &pending, m_pendingSyncTimestamps) {
+        m_syncDb->addSyncTimestamp(pending.serviceName, pending.dataType, pending.accountId, pending.timestamp);
+    }
+    SOCIALD_LOG_DEBUG("committing" << m_pendingSyncTimestamps.size() << "sync timestamps for" <<
+                      m_serviceName << dataTypeName(m_dataType));
+    m_pendingSyncTimestamps.clear();
     m_syncDb->commit();
-    m_syncDb->wait();
-    return m_syncDb->writeStatus() == AbstractSocialCacheDatabase::Finished;
+}
+
+QString SocialNetworkSyncAdaptor::syncTimestampKey(const QString &serviceName, const QString &dataType, int accountId)
+{
+    return QStringLiteral("%1:%2:%3").arg(serviceName, dataType, QString::number(accountId));
 }
 
 /*!
@@ -213,6 +303,14 @@ QList<int> SocialNetworkSyncAdaptor::syncedAccounts(const QString &dataType)
 void SocialNetworkSyncAdaptor::setStatus(Status status)
 {
     if (m_status != status) {
+        if (status == SocialNetworkSyncAdaptor::Busy) {
+            // a new sync run is starting.
+            m_syncAborted = false;
+            m_discardedAccounts.clear();
+            if (!m_multiAccountSync) {
+                m_failedAccounts.clear();
+            }
+        }
         m_status = status;
         emit statusChanged();
     }
@@ -244,22 +342,103 @@ void SocialNetworkSyncAdaptor::setInitialActive(bool enabled)
  */
 void SocialNetworkSyncAdaptor::setFinishedInactive()
 {
+    QElapsedTimer cleanupTimer;
+    cleanupTimer.start();
     finalCleanup();
+    commitSyncTimestamps();
+    m_syncStats->publish(cleanupTimer.nsecsElapsed() / 1000, m_syncAborted);
     SOCIALD_LOG_INFO("Finished" << m_serviceName << SocialNetworkSyncAdaptor::dataTypeName(m_dataType) <<
                      "sync at:" << QDateTime::currentDateTime().toString(Qt::ISODate));
     setStatus(SocialNetworkSyncAdaptor::Inactive);
+    m_multiAccountSync = false;
+}
+
+/*!
+ * \internal
+ * Should be called by any specific sync adapter when the
+ * sync with the given account has failed.  When several
+ * accounts are being synced by syncAccounts(), the sync
+ * of the other accounts continues, and the failure is
+ * reported via failedAccounts() once they have finished.
+ */
+void SocialNetworkSyncAdaptor::setAccountError(int accountId)
+{
+    m_failedAccounts.insert(accountId);
+    if (!m_multiAccountSync) {
+        setStatus(SocialNetworkSyncAdaptor::Error);
+    }
+}
+
+/*!
+ * \internal
+ * Syncs all of the given accounts concurrently.  The accounts share
+ * this adaptor's account manager, network connections and databases,
+ * rather than each sync requiring a separate plugin instance.
+ *
+ * The adaptor is Busy until the sync of every account has finished,
+ * after which failedAccounts() returns the accounts whose sync failed.
+ */
+void SocialNetworkSyncAdaptor::syncAccounts(const QString &dataType, const QList<int> &accountIds)
+{
+    m_failedAccounts.clear();
+    m_multiAccountSync = true;
+
+    // don't finish until the sync of every account has been started,
+    // even if the first accounts fail (or finish) synchronously.
+    m_dispatchingAccounts = true;
+    foreach (int accountId, accountIds) {
+        sync(dataType, accountId);
+    }
+    m_dispatchingAccounts = false;
+
+    if (allSemaphoresAreZero()) {
+        if (m_status == SocialNetworkSyncAdaptor::Busy) {
+            setFinishedInactive();
+        } else {
+            // no sync could be started.
+            m_multiAccountSync = false;
+            setStatus(accountIds.isEmpty() ? SocialNetworkSyncAdaptor::Inactive : SocialNetworkSyncAdaptor::Error);
+        }
+    }
+}
+
+QList<int> SocialNetworkSyncAdaptor::failedAccounts() const
+{
+    return m_failedAccounts.toList();
+}
+
+bool SocialNetworkSyncAdaptor::allSemaphoresAreZero() const
+{
+    foreach (int sv, m_accountSyncSemaphores) {
+        if (sv != 0) {
+            return false;
+        }
+    }
+    return true;
 }
 
 void SocialNetworkSyncAdaptor::incrementSemaphore(int accountId)
 {
+    if (m_discardedAccounts.contains(accountId)) {
+        SOCIALD_LOG_DEBUG("ignoring late operation for discarded sync of account" << accountId);
+        return;
+    }
+
     int semaphoreValue = m_accountSyncSemaphores.value(accountId);
     semaphoreValue += 1;
     m_accountSyncSemaphores.insert(accountId, semaphoreValue);
+    m_syncStats->semaphoreChanged(accountId, semaphoreValue);
     SOCIALD_LOG_DEBUG("incremented busy semaphore for account" << accountId << "to:" << semaphoreValue);
 }
 
 void SocialNetworkSyncAdaptor::decrementSemaphore(int accountId)
 {
+    if (m_discardedAccounts.contains(accountId)) {
+        // the handler of an operation which outlived the abort grace period.
+        SOCIALD_LOG_DEBUG("ignoring late operation for discarded sync of account" << accountId);
+        return;
+    }
+
     if (!m_accountSyncSemaphores.contains(accountId)) {
         SOCIALD_LOG_ERROR("no such semaphore for account" << accountId);
         return;
@@ -273,9 +452,13 @@ void SocialNetworkSyncAdaptor::decrementSemaphore(int accountId)
         return;
     }
     m_accountSyncSemaphores.insert(accountId, semaphoreValue);
+    m_syncStats->semaphoreChanged(accountId, semaphoreValue);
 
     if (semaphoreValue == 0) {
+        QElapsedTimer finalizeTimer;
+        finalizeTimer.start();
         finalize(accountId);
+        m_syncStats->addStoreTime(accountId, finalizeTimer.nsecsElapsed() / 1000);
 
         // With the newer implementation, in finalize we can rereaise semaphores,
         // so if after calling finalize, the semaphore count is not the same anymore,
@@ -285,37 +468,111 @@ void SocialNetworkSyncAdaptor::decrementSemaphore(int accountId)
         }
 
         // finished all outstanding sync requests for this account.
-        // update the sync time in the global sociald database.
-        updateLastSyncTimestamp(m_serviceName,
-                                SocialNetworkSyncAdaptor::dataTypeName(m_dataType), accountId,
-                                QDateTime::currentDateTime().toTimeSpec(Qt::UTC));
+        m_syncStats->accountFinished(accountId);
+
+        // update the sync time in the global sociald database,
+        // unless the sync was aborted, in which case some of the
+        // changes since the last sync were not retrieved.
+        if (!m_syncAborted) {
+            updateLastSyncTimestamp(m_serviceName,
+                                    SocialNetworkSyncAdaptor::dataTypeName(m_dataType), accountId,
+                                    QDateTime::currentDateTime().toTimeSpec(Qt::UTC));
+        }
 
         // if all outstanding requests for all accounts have finished,
         // then update our status to Inactive / ready to handle more sync requests.
-        bool allAreZero = true;
-        QList<int> semaphores = m_accountSyncSemaphores.values();
-        foreach (int sv, semaphores) {
-            if (sv != 0) {
-                allAreZero = false;
-                break;
-            }
-        }
-
-        if (allAreZero) {
+        if (allSemaphoresAreZero() && !m_dispatchingAccounts) {
             setFinishedInactive(); // Finished!
         }
     }
 }
 
-void SocialNetworkSyncAdaptor::timeoutReply()
+/*!
+ * \internal
+ * Aborts the sync which is in progress.  Every outstanding network
+ * reply is aborted immediately, which causes its finished() handler
+ * to treat it as failed and to release the semaphore of its account,
+ * so that the adaptor returns to the Inactive status without waiting
+ * for the replies to time out.  Requests which are not tracked by the
+ * reply timeouts are aborted by abortRequests().  Whatever was retrieved
+ * before the abort is still stored, but the last sync timestamps are
+ * not updated.
+ */
+void SocialNetworkSyncAdaptor::abortSync()
 {
-    QTimer *timer = qobject_cast<QTimer*>(sender());
-    QNetworkReply *reply = timer->property("networkReply").value<QNetworkReply*>();
-    int accountId = timer->property("accountId").toInt();
+    if (m_status != SocialNetworkSyncAdaptor::Busy || m_syncAborted) {
+        return;
+    }
+
+    QList<QNetworkReply*> replies = m_replyTimeouts->replies();
+    SOCIALD_LOG_INFO("Aborting" << m_serviceName << SocialNetworkSyncAdaptor::dataTypeName(m_dataType) <<
+                     "sync with" << replies.size() << "outstanding requests");
+    m_syncAborted = true;
+    foreach (QNetworkReply *reply, replies) {
+        reply->abort();
+    }
+    abortRequests();
+
+    if (m_status == SocialNetworkSyncAdaptor::Busy) {
+        // some operations (eg, signon requests) cannot be aborted.
+        QTimer::singleShot(SOCIALD_ABORT_GRACE_PERIOD, this, SLOT(abortGracePeriodExpired()));
+    }
+}
+
+bool SocialNetworkSyncAdaptor::syncAborted() const
+{
+    return m_syncAborted;
+}
+
+/*!
+ * \internal
+ * Called by abortSync() to abort the requests which the adaptor makes
+ * without setupReplyTimeout(), such as avatar downloads.  Their handlers
+ * must still release the semaphores they hold.
+ */
+void SocialNetworkSyncAdaptor::abortRequests()
+{
+}
+
+void SocialNetworkSyncAdaptor::abortGracePeriodExpired()
+{
+    if (!m_syncAborted || m_status != SocialNetworkSyncAdaptor::Busy) {
+        return;
+    }
+
+    SOCIALD_LOG_ERROR("outstanding operations did not finish after abort of" << m_serviceName <<
+                      SocialNetworkSyncAdaptor::dataTypeName(m_dataType) << "sync, discarding them");
+    // finish each account normally, so that whatever was retrieved is
+    // stored by finalize(), as it would be if its replies had finished.
+    QList<int> busyAccounts;
+    QMap<int, int>::const_iterator it = m_accountSyncSemaphores.constBegin();
+    for ( ; it != m_accountSyncSemaphores.constEnd(); ++it) {
+        if (it.value() > 0) {
+            busyAccounts.append(it.key());
+        }
+    }
+    foreach (int accountId, busyAccounts) {
+        m_accountSyncSemaphores.insert(accountId, 1);
+        decrementSemaphore(accountId);
+    }
+
+    // the handlers of the discarded operations may still run later, and
+    // must not release the semaphores (or raise them again, which finalize
+    // may have done) of an account which has already been finalized.
+    foreach (int accountId, busyAccounts) {
+        m_accountSyncSemaphores.insert(accountId, 0);
+        m_discardedAccounts.insert(accountId);
+    }
+
+    if (m_status == SocialNetworkSyncAdaptor::Busy && allSemaphoresAreZero()) {
+        setFinishedInactive();
+    }
+}
 
+void SocialNetworkSyncAdaptor::timeoutReply(QNetworkReply *reply, int accountId)
+{
     SOCIALD_LOG_ERROR("network request timed out while performing sync with account" << accountId);
 
-    m_networkReplyTimeouts[accountId].remove(reply);
     reply->setProperty("isError", QVariant::fromValue<bool>(true));
     reply->finished(); // invoke finished, so that the error handling there decrements the semaphore etc.
     reply->disconnect();
@@ -324,31 +581,43 @@ void SocialNetworkSyncAdaptor::timeoutReply()
 void SocialNetworkSyncAdaptor::setupReplyTimeout(int accountId, QNetworkReply *reply)
 {
     // this function should be called whenever a new network request is performed.
-    QTimer *timer = new QTimer(this);
-    timer->setSingleShot(true);
-    timer->setInterval(60000);
-    timer->setProperty("accountId", accountId);
-    timer->setProperty("networkReply", QVariant::fromValue<QNetworkReply*>(reply));
-    connect(timer, SIGNAL(timeout()), this, SLOT(timeoutReply()));
-    timer->start();
-    m_networkReplyTimeouts[accountId].insert(reply, timer);
+    m_replyTimeouts->arm(accountId, reply);
+    m_syncStats->requestStarted(accountId, reply);
+    if (m_syncAborted) {
+        // a handler issued a new request after the sync was aborted.
+        // Abort it once the caller has finished setting it up.
+        QMetaObject::invokeMethod(reply, "abort", Qt::QueuedConnection);
+    }
 }
 
 void SocialNetworkSyncAdaptor::removeReplyTimeout(int accountId, QNetworkReply *reply)
 {
     // this function should be called by the finished() handler for the reply.
-    QTimer *timer = m_networkReplyTimeouts[accountId].value(reply);
-    if (!reply) {
-        return;
-    }
+    Q_UNUSED(accountId)
+    m_replyTimeouts->disarm(reply);
+    m_syncStats->requestFinished(reply);
+}
 
-    delete timer;
-    m_networkReplyTimeouts[accountId].remove(reply);
+/*!
+ * \internal
+ * Records the time spent parsing the data of a reply.  The replies are
+ * parsed by their finished() (or error()) handlers, so the time is
+ * recorded against the account of the reply which is the sender.
+ */
+void SocialNetworkSyncAdaptor::addReplyParseTime(qint64 usecs)
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    if (reply) {
+        m_syncStats->addParseTime(reply->property("accountId").toInt(), usecs);
+    }
 }
 
 QJsonObject SocialNetworkSyncAdaptor::parseJsonObjectReplyData(const QByteArray &replyData, bool *ok)
 {
+    QElapsedTimer parseTimer;
+    parseTimer.start();
     QJsonDocument jsonDocument = QJsonDocument::fromJson(replyData);
+    addReplyParseTime(parseTimer.nsecsElapsed() / 1000);
     *ok = !jsonDocument.isEmpty();
     if (*ok && jsonDocument.isObject()) {
         return jsonDocument.object();
@@ -359,7 +628,10 @@ QJsonObject SocialNetworkSyncAdaptor::parseJsonObjectReplyData(const QByteArray
 
 QJsonArray SocialNetworkSyncAdaptor::parseJsonArrayReplyData(const QByteArray &replyData, bool *ok)
 {
+    QElapsedTimer parseTimer;
+    parseTimer.start();
     QJsonDocument jsonDocument = QJsonDocument::fromJson(replyData);
+    addReplyParseTime(parseTimer.nsecsElapsed() / 1000);
     *ok = !jsonDocument.isEmpty();
     if (*ok && jsonDocument.isArray()) {
         return jsonDocument.array();
@@ -368,6 +640,31 @@ QJsonArray SocialNetworkSyncAdaptor::parseJsonArrayReplyData(const QByteArray &r
     return QJsonArray();
 }
 
+/*!
+ * \internal
+ * Returns true if the reply is the response to a conditional request
+ * (see SocialdNetworkAccessManager::ConditionalRequestAttribute) for a
+ * resource which has not changed since it was last retrieved.
+ * Such a reply has no content.
+ */
+bool SocialNetworkSyncAdaptor::isUnchangedReply(QNetworkReply *reply)
+{
+    return reply->error() == QNetworkReply::NoError
+            && reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304;
+}
+
+/*!
+ * \internal
+ * Stores the validators of the response to a conditional request.  This
+ * must only be called once the response has been successfully handled,
+ * as the next request for the resource will then be answered with 304
+ * if it has not changed, and the response will not be handled again.
+ */
+void SocialNetworkSyncAdaptor::commitValidators(QNetworkReply *reply)
+{
+    static_cast<SocialdNetworkAccessManager*>(m_networkAccessManager)->commitValidators(reply);
+}
+
 /*
     Valid data types are data types which are known to the API.
     Note that just because a data type is valid does not mean
@@ -28,13 +28,16 @@
 #include <QtCore/QJsonObject>
 #include <QtCore/QJsonArray>
 #include <QtCore/QMap>
+#include <QtCore/QHash>
 #include <QtCore/QList>
+#include <QtCore/QSet>
 
 #include "buteosyncfw_p.h"
 
 class QSqlDatabase;
 class QNetworkAccessManager;
-class QTimer;
+class SocialdTimeoutWheel;
+class SocialdSyncStats;
 class QNetworkReply;
 class SocialNetworkSyncDatabase;
 
@@ -83,12 +86,17 @@ public:
 
     virtual QString syncServiceName() const = 0;
     void setAccountSyncProfile(Buteo::SyncProfile* perAccountSyncProfile);
+    void setAccountSyncProfiles(const QList<Buteo::SyncProfile*> &perAccountSyncProfiles);
 
     Status status() const;
     bool enabled() const;
     QString serviceName() const;
     virtual void sync(const QString &dataType, int accountId = 0);
+    void syncAccounts(const QString &dataType, const QList<int> &accountIds);
+    QList<int> failedAccounts() const;
     virtual void purgeDataForOldAccount(int accountId, PurgeMode mode = SyncPurge) = 0;
+    void abortSync();
+    bool syncAborted() const;
 
 Q_SIGNALS:
     void statusChanged();
@@ -100,12 +108,16 @@ protected:
     virtual void finalize(int accountId);
     QDateTime lastSyncTimestamp(const QString &serviceName, const QString &dataType,
                                 int accountId) const;
-    bool updateLastSyncTimestamp(const QString &serviceName, const QString &dataType,
+    void updateLastSyncTimestamp(const QString &serviceName, const QString &dataType,
                                  int accountId, const QDateTime &timestamp);
+    void commitSyncTimestamps();
     QList<int> syncedAccounts(const QString &dataType);
     void setStatus(Status status);
     void setInitialActive(bool enabled);
     void setFinishedInactive();
+    virtual void setAccountError(int accountId);
+    virtual void abortRequests();
+    Buteo::SyncProfile *accountSyncProfile(int accountId) const;
 
     // Semaphore system
     void incrementSemaphore(int accountId);
@@ -116,8 +128,10 @@ protected:
     void removeReplyTimeout(int accountId, QNetworkReply *reply);
 
     // Parsing methods
-    static QJsonObject parseJsonObjectReplyData(const QByteArray &replyData, bool *ok);
-    static QJsonArray parseJsonArrayReplyData(const QByteArray &replyData, bool *ok);
+    QJsonObject parseJsonObjectReplyData(const QByteArray &replyData, bool *ok);
+    QJsonArray parseJsonArrayReplyData(const QByteArray &replyData, bool *ok);
+    static bool isUnchangedReply(QNetworkReply *reply);
+    void commitValidators(QNetworkReply *reply);
 
     const SocialNetworkSyncAdaptor::DataType m_dataType;
     Accounts::Manager * const m_accountManager;
@@ -125,15 +139,37 @@ protected:
     Buteo::SyncProfile *m_accountSyncProfile;
 
 protected Q_SLOTS:
-    virtual void timeoutReply();
+    virtual void timeoutReply(QNetworkReply *reply, int accountId);
+
+private Q_SLOTS:
+    void abortGracePeriodExpired();
 
 private:
+    struct PendingSyncTimestamp {
+        QString serviceName;
+        QString dataType;
+        int accountId;
+        QDateTime timestamp;
+    };
+    static QString syncTimestampKey(const QString &serviceName, const QString &dataType, int accountId);
+    void addReplyParseTime(qint64 usecs);
+    bool allSemaphoresAreZero() const;
+
     SocialNetworkSyncDatabase *m_syncDb;
+    mutable QHash<QString, QDateTime> m_syncTimestamps;
+    QMap<QString, PendingSyncTimestamp> m_pendingSyncTimestamps;
     SocialNetworkSyncAdaptor::Status m_status;
     bool m_enabled;
+    bool m_syncAborted;
+    bool m_multiAccountSync;
+    bool m_dispatchingAccounts;
+    QSet<int> m_failedAccounts;
+    QSet<int> m_discardedAccounts;
+    QMap<int, Buteo::SyncProfile*> m_accountSyncProfiles;
     QString m_serviceName;
     QMap<int, int> m_accountSyncSemaphores;
-    QMap<int, QMap<QNetworkReply*, QTimer *> > m_networkReplyTimeouts;
+    SocialdTimeoutWheel *m_replyTimeouts;
+    SocialdSyncStats *m_syncStats;
 };
 
 #endif // SOCIALNETWORKSYNCADAPTOR_H
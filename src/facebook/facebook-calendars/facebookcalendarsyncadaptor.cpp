@@ -80,8 +80,12 @@ QString FacebookCalendarSyncAdaptor::syncServiceName() const
 
 void FacebookCalendarSyncAdaptor::sync(const QString &dataTypeString, int accountId)
 {
-    m_storageNeedsSave = false;
-    m_storage->open(); // we close it in finalCleanup()
+    // when several accounts are synced in one run, the storage is
+    // opened (and later saved) once for all of them.
+    if (status() != SocialNetworkSyncAdaptor::Busy) {
+        m_storageNeedsSave = false;
+        m_storage->open(); // we close it in finalCleanup()
+    }
     FacebookDataTypeSyncAdaptor::sync(dataTypeString, accountId);
 }
 
@@ -179,8 +183,8 @@ void FacebookCalendarSyncAdaptor::requestEvents(int accountId, const QString &ac
     Q_UNUSED(until);
     Q_UNUSED(pagingToken);
 
-    int sinceSpan = m_accountSyncProfile
-            ? m_accountSyncProfile->key(Buteo::KEY_SYNC_SINCE_DAYS_PAST, QStringLiteral("30")).toInt()
+    int sinceSpan = accountSyncProfile(accountId)
+            ? accountSyncProfile(accountId)->key(Buteo::KEY_SYNC_SINCE_DAYS_PAST, QStringLiteral("30")).toInt()
             : 30;
     uint startTime = QDateTime::currentDateTimeUtc().addDays(sinceSpan * -1).toTime_t();
     QList<QPair<QString, QString> > queryItems;
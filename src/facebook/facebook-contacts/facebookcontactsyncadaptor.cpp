@@ -21,6 +21,8 @@
 
 #include "facebookcontactsyncadaptor.h"
 #include "constants_p.h"
+#include "socialdjsonstreamparser_p.h"
+#include "socialdnetworkaccessmanager_p.h"
 #include "trace.h"
 
 #include <QtCore/QPair>
@@ -127,17 +129,52 @@ public:
         ContactPicture,
         ContactCover
     };
-    explicit FacebookContactImageDownloader();
+    FacebookContactImageDownloader(QNetworkAccessManager *networkAccessManager,
+                                   SocialdAvatarStore *avatarStore, SocialdAvatarScheduler *scheduler);
     static QString staticOutputFile(const QString &url, const QVariantMap &data);
+    static QString avatarIdentifier(const QString &fbuid, int type);
 protected:
+    QNetworkReply *createReply(const QString &url, const QVariantMap &metadata);
     QString outputFile(const QString &url, const QVariantMap &data) const;
+private:
+    QNetworkAccessManager *m_networkAccessManager; // the adaptor's, so that avatars are scheduled behind its requests
+    SocialdAvatarStore *m_avatarStore;
+    SocialdAvatarScheduler *m_scheduler;
 };
 
-FacebookContactImageDownloader::FacebookContactImageDownloader()
+FacebookContactImageDownloader::FacebookContactImageDownloader(QNetworkAccessManager *networkAccessManager,
+                                                               SocialdAvatarStore *avatarStore,
+                                                               SocialdAvatarScheduler *scheduler)
     : AbstractImageDownloader()
+    , m_networkAccessManager(networkAccessManager)
+    , m_avatarStore(avatarStore)
+    , m_scheduler(scheduler)
 {
 }
 
+QString FacebookContactImageDownloader::avatarIdentifier(const QString &fbuid, int type)
+{
+    return QString::fromLatin1("%1-%2").arg(fbuid).arg(type);
+}
+
+QNetworkReply *FacebookContactImageDownloader::createReply(const QString &url, const QVariantMap &metadata)
+{
+    // if an image is stored for the avatar, only download it again if it has changed.
+    int accountId = metadata.value(ACCOUNT_ID_KEY).toInt();
+    QNetworkRequest request(url);
+    m_avatarStore->prepareRequest(accountId,
+                                  avatarIdentifier(metadata.value(IDENTIFIER_KEY).toString(),
+                                                   metadata.value(TYPE_KEY).toInt()),
+                                  &request);
+    request.setAttribute(SocialdNetworkAccessManager::RequestPriorityAttribute, SocialdNetworkAccessManager::MediaPriority);
+    QNetworkReply *reply = m_networkAccessManager->get(request);
+    if (reply) {
+        reply->setProperty("accountId", accountId);
+        m_scheduler->watchReply(url, metadata, reply);
+    }
+    return reply;
+}
+
 QString FacebookContactImageDownloader::staticOutputFile(const QString &url, const QVariantMap &data)
 {
     // We create the file identifier by appending the type to the real identifier
@@ -162,6 +199,10 @@ QString FacebookContactImageDownloader::outputFile(const QString &url,
 FacebookContactSyncAdaptor::FacebookContactSyncAdaptor(QObject *parent)
     : FacebookDataTypeSyncAdaptor(SocialNetworkSyncAdaptor::Contacts, parent)
     , m_contactManager(aggregatingContactManager(this))
+    , m_avatarScheduler(new SocialdAvatarScheduler(QLatin1String("facebook"),
+                                                   SocialNetworkSyncAdaptor::dataTypeName(SocialNetworkSyncAdaptor::Contacts),
+                                                   this))
+    , m_avatarStore(QLatin1String("facebook"), SocialNetworkSyncAdaptor::dataTypeName(SocialNetworkSyncAdaptor::Contacts))
 {
     setInitialActive(false);
     if (!m_contactManager) {
@@ -169,9 +210,17 @@ FacebookContactSyncAdaptor::FacebookContactSyncAdaptor(QObject *parent)
         return;
     }
 
-    m_workerObject = new FacebookContactImageDownloader();
+    m_workerObject = new FacebookContactImageDownloader(m_networkAccessManager, &m_avatarStore, m_avatarScheduler);
+    connect(m_avatarScheduler, &SocialdAvatarScheduler::download,
+            m_workerObject, &AbstractImageDownloader::queue);
     connect(m_workerObject, &AbstractImageDownloader::imageDownloaded,
+            m_avatarScheduler, &SocialdAvatarScheduler::downloadFinished);
+    connect(m_avatarScheduler, &SocialdAvatarScheduler::imageDownloaded,
             this, &FacebookContactSyncAdaptor::slotImageDownloaded);
+    connect(m_avatarScheduler, &SocialdAvatarScheduler::started,
+            this, &FacebookContactSyncAdaptor::avatarDownloadsStarted);
+    connect(m_avatarScheduler, &SocialdAvatarScheduler::finished,
+            this, &FacebookContactSyncAdaptor::avatarDownloadsFinished);
 
     setInitialActive(true);
 }
@@ -205,6 +254,11 @@ void FacebookContactSyncAdaptor::beginSync(int accountId, const QString &accessT
 {
     // clear our cache lists if necessary.
     m_remoteContacts[accountId].clear();
+    m_queuedAvatarDownloads[accountId].clear();
+    m_downloadedAvatars[accountId].clear();
+
+    // resume the avatar downloads which didn't fit in the previous sync.
+    m_avatarScheduler->restoreDeferred(accountId);
 
     // begin requesting data.
     requestData(accountId, accessToken);
@@ -255,6 +309,10 @@ void FacebookContactSyncAdaptor::requestData(int accountId, const QString &acces
         connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsHandler(QList<QSslError>)));
         connect(reply, SIGNAL(finished()), this, SLOT(friendsFinishedHandler()));
 
+        // parse each friend as soon as it has been received.
+        SocialdJsonStreamParser *parser = new SocialdJsonStreamParser(reply, QLatin1String("data"));
+        connect(parser, SIGNAL(elementParsed(QJsonObject)), this, SLOT(friendParsedHandler(QJsonObject)));
+
         // we're requesting data.  Increment the semaphore so that we know we're still busy.
         incrementSemaphore(accountId);
         setupReplyTimeout(accountId, reply);
@@ -273,40 +331,26 @@ void FacebookContactSyncAdaptor::friendsFinishedHandler()
     QString accessToken = reply->property("accessToken").toString();
     QString continuationRequest = reply->property("continuationRequest").toString();
     QDateTime lastSync = reply->property("lastSyncTimestamp").toDateTime();
-    QByteArray replyData = reply->readAll();
+
+    // the friends have already been parsed by friendParsedHandler() as they arrived,
+    // but they are only kept if the whole reply was received.
+    bool ok = false;
+    SocialdJsonStreamParser *parser = SocialdJsonStreamParser::parser(reply);
+    QJsonObject parsed = parser->finish(&ok);
+    int friendCount = parser->elementCount();
+    QByteArray envelopeData = parser->envelopeData();
+    QList<QContact> friends = m_parsedFriends.take(reply);
     disconnect(reply);
     reply->deleteLater();
     removeReplyTimeout(accountId, reply);
 
-    bool ok = false;
-    QJsonObject parsed = parseJsonObjectReplyData(replyData, &ok);
     if (!isError && ok && parsed.contains(QLatin1String("data"))) {
         // we expect "data" and possibly "paging"
-        QJsonArray data = parsed.value(QLatin1String("data")).toArray();
+        m_remoteContacts[accountId].append(friends);
         QJsonObject paging = parsed.value(QLatin1String("paging")).toObject(); // may not exist, if no more results.
 
-        if (!data.size()) {
+        if (!friendCount) {
             SOCIALD_LOG_DEBUG("no more friends received for account" << accountId);
-        } else {
-            // for each friend, retrieve the detailed information.
-            for (int i = 0; i < data.size(); ++i) {
-                QJsonObject currFriend = data.at(i).toObject();
-                QString friendId = currFriend.value(QLatin1String("id")).toString();
-                QString friendName = currFriend.value(QLatin1String("name")).toString();
-                if (friendId.isEmpty()) {
-                    // strange error.  ignore this entry.
-                    SOCIALD_LOG_DEBUG("strange entry in friends data list for account" << accountId <<
-                                      ":" << friendId << friendName << "with keys:" << currFriend.keys());
-                    continue;
-                }
-
-                // parse detailed information.  Note that we batch up the saves.
-                bool needsSaving = false;
-                QContact parsedContact = parseContactDetails(currFriend, accountId, &needsSaving);
-                if (needsSaving) {
-                    m_remoteContacts[accountId].append(parsedContact);
-                }
-            }
         }
 
         // paging if we need to retrieve more friends
@@ -329,13 +373,39 @@ void FacebookContactSyncAdaptor::friendsFinishedHandler()
                           QLatin1String("error occurred during friends request with account %1; got: %2") :
                           QLatin1String("unable to parse friends data from request with account %1; got: %2");
 
-        SOCIALD_LOG_ERROR(message.arg(accountId).arg(QString::fromLatin1(replyData.constData())));
+        SOCIALD_LOG_ERROR(message.arg(accountId).arg(QString::fromUtf8(envelopeData)));
     }
 
     // we're finished this request.  Decrement our busy semaphore.
     decrementSemaphore(accountId);
 }
 
+void FacebookContactSyncAdaptor::friendParsedHandler(const QJsonObject &currFriend)
+{
+    SocialdJsonStreamParser *parser = qobject_cast<SocialdJsonStreamParser*>(sender());
+    QNetworkReply *reply = parser->reply();
+    if (reply->property("isError").toBool()) {
+        return;
+    }
+
+    int accountId = reply->property("accountId").toInt();
+    QString friendId = currFriend.value(QLatin1String("id")).toString();
+    QString friendName = currFriend.value(QLatin1String("name")).toString();
+    if (friendId.isEmpty()) {
+        // strange error.  ignore this entry.
+        SOCIALD_LOG_DEBUG("strange entry in friends data list for account" << accountId <<
+                          ":" << friendId << friendName << "with keys:" << currFriend.keys());
+        return;
+    }
+
+    // parse detailed information.  Note that we batch up the saves.
+    bool needsSaving = false;
+    QContact parsedContact = parseContactDetails(currFriend, accountId, &needsSaving);
+    if (needsSaving) {
+        m_parsedFriends[reply].append(parsedContact);
+    }
+}
+
 #define SAVE_DETAIL(detail)                 \
     do {                                    \
         *needsSaving = true;                \
@@ -503,18 +573,15 @@ QContact FacebookContactSyncAdaptor::parseContactDetails(const QJsonObject &blob
                     QContactAvatar contactAvatar = avatar;
                     REMOVE_DETAIL(contactAvatar);
                 } else {
-                    QVariantMap data;
-                    data.insert(IDENTIFIER_KEY, fbuid);
-                    data.insert(TYPE_KEY, FacebookContactImageDownloader::ContactCover);
-                    data.insert(ACCOUNT_ID_KEY, accountId);
-                    QString avatarFileName = FacebookContactImageDownloader::staticOutputFile(cover, data);
-                    if (!QFile::exists(avatarFileName)) {
-                        m_queuedAvatarDownloads[accountId].append(qMakePair<QString, QVariantMap>(cover, data));
-                    }
-
+                    QString avatarFile = avatarFileName(accountId, fbuid, FacebookContactImageDownloader::ContactCover, cover);
                     QContactAvatar contactAvatar = avatar;
-                    contactAvatar.setImageUrl(avatarFileName);
-                    SAVE_DETAIL(contactAvatar);
+                    if (avatarFile.isEmpty()) {
+                        // it will be added again once the image has been downloaded.
+                        REMOVE_DETAIL(contactAvatar);
+                    } else {
+                        contactAvatar.setImageUrl(avatarFile);
+                        SAVE_DETAIL(contactAvatar);
+                    }
                 }
             } else if (avatar.value(QContactAvatar__FieldAvatarMetadata) == QLatin1String("picture")) {
                 foundPicture = true;
@@ -523,52 +590,37 @@ QContact FacebookContactSyncAdaptor::parseContactDetails(const QJsonObject &blob
                     QContactAvatar contactAvatar = avatar;
                     REMOVE_DETAIL(contactAvatar);
                 } else {
-                    QVariantMap data;
-                    data.insert(IDENTIFIER_KEY, fbuid);
-                    data.insert(TYPE_KEY, FacebookContactImageDownloader::ContactPicture);
-                    data.insert(ACCOUNT_ID_KEY, accountId);
-                    QString avatarFileName = FacebookContactImageDownloader::staticOutputFile(picture, data);
-                    if (!QFile::exists(avatarFileName)) {
-                        m_queuedAvatarDownloads[accountId].append(qMakePair<QString, QVariantMap>(picture, data));
-                    }
-
+                    QString avatarFile = avatarFileName(accountId, fbuid, FacebookContactImageDownloader::ContactPicture, picture);
                     QContactAvatar contactAvatar = avatar;
-                    contactAvatar.setImageUrl(avatarFileName);
-                    SAVE_DETAIL(contactAvatar);
+                    if (avatarFile.isEmpty()) {
+                        // it will be added again once the image has been downloaded.
+                        REMOVE_DETAIL(contactAvatar);
+                    } else {
+                        contactAvatar.setImageUrl(avatarFile);
+                        SAVE_DETAIL(contactAvatar);
+                    }
                 }
             }
         }
         if (!foundCover && !cover.isEmpty()) {
-            QVariantMap data;
-            data.insert(IDENTIFIER_KEY, fbuid);
-            data.insert(TYPE_KEY, FacebookContactImageDownloader::ContactCover);
-            data.insert(ACCOUNT_ID_KEY, accountId);
-            QString avatarFileName = FacebookContactImageDownloader::staticOutputFile(cover, data);
-            if (!QFile::exists(avatarFileName)) {
-                m_queuedAvatarDownloads[accountId].append(qMakePair<QString, QVariantMap>(cover, data));
+            // if the image has yet to be downloaded, it will be added once it has been.
+            QString avatarFile = avatarFileName(accountId, fbuid, FacebookContactImageDownloader::ContactCover, cover);
+            if (!avatarFile.isEmpty()) {
+                QContactAvatar contactAvatar;
+                contactAvatar.setImageUrl(avatarFile);
+                contactAvatar.setValue(QContactAvatar__FieldAvatarMetadata, QLatin1String("cover"));
+                SAVE_DETAIL(contactAvatar);
             }
-
-            // needs to be updated.  we set the value to be the (future) image filename.
-            QContactAvatar contactAvatar;
-            contactAvatar.setImageUrl(avatarFileName);
-            contactAvatar.setValue(QContactAvatar__FieldAvatarMetadata, QLatin1String("cover"));
-            SAVE_DETAIL(contactAvatar);
         }
         if (!foundPicture && !picture.isEmpty()) {
-            QVariantMap data;
-            data.insert(IDENTIFIER_KEY, fbuid);
-            data.insert(TYPE_KEY, FacebookContactImageDownloader::ContactPicture);
-            data.insert(ACCOUNT_ID_KEY, accountId);
-            QString avatarFileName = FacebookContactImageDownloader::staticOutputFile(picture, data);
-            if (!QFile::exists(avatarFileName)) {
-                m_queuedAvatarDownloads[accountId].append(qMakePair<QString, QVariantMap>(picture, data));
+            // if the image has yet to be downloaded, it will be added once it has been.
+            QString avatarFile = avatarFileName(accountId, fbuid, FacebookContactImageDownloader::ContactPicture, picture);
+            if (!avatarFile.isEmpty()) {
+                QContactAvatar contactAvatar;
+                contactAvatar.setImageUrl(avatarFile);
+                contactAvatar.setValue(QContactAvatar__FieldAvatarMetadata, QLatin1String("picture"));
+                SAVE_DETAIL(contactAvatar);
             }
-
-            // needs to be updated.  we set the value to be the (future) image filename.
-            QContactAvatar contactAvatar;
-            contactAvatar.setImageUrl(avatarFileName);
-            contactAvatar.setValue(QContactAvatar__FieldAvatarMetadata, QLatin1String("picture"));
-            SAVE_DETAIL(contactAvatar);
         }
 
         // nickname (username) is unique
@@ -676,14 +728,66 @@ QContact FacebookContactSyncAdaptor::newOrExistingContact(const QString &fbuid,
     return m_contactManager->contact(cids.at(0));
 }
 
+// returns the image to use for the avatar of the given type, or an empty string if
+// there is none yet.  The avatar is queued for download if the stored image is not
+// from the given url, in which case the stored image is used until it is replaced.
+QString FacebookContactSyncAdaptor::avatarFileName(int accountId, const QString &fbuid, int type, const QString &url)
+{
+    QString identifier = FacebookContactImageDownloader::avatarIdentifier(fbuid, type);
+    QString storedImage = m_avatarStore.imageFile(accountId, identifier);
+    if (!storedImage.isEmpty() && m_avatarStore.sourceUrl(accountId, identifier) == url) {
+        return storedImage;
+    }
+
+    QVariantMap data;
+    data.insert(IDENTIFIER_KEY, fbuid);
+    data.insert(TYPE_KEY, type);
+    data.insert(ACCOUNT_ID_KEY, accountId);
+    if (storedImage.isEmpty()) {
+        // adopt the image downloaded by an older version, if any.
+        QString legacyFileName = FacebookContactImageDownloader::staticOutputFile(url, data);
+        if (QFile::exists(legacyFileName)) {
+            storedImage = m_avatarStore.store(accountId, identifier, legacyFileName, url);
+            if (!storedImage.isEmpty()) {
+                return storedImage;
+            }
+        }
+    }
+
+    m_queuedAvatarDownloads[accountId].append(qMakePair<QString, QVariantMap>(url, data));
+    return storedImage;
+}
+
 void FacebookContactSyncAdaptor::slotImageDownloaded(const QString &url, const QString &path,
                                                      const QVariantMap &data)
 {
-    Q_UNUSED(url)
-    Q_UNUSED(path)
+    int accountId = data.value(ACCOUNT_ID_KEY).toInt();
+    QString identifier = FacebookContactImageDownloader::avatarIdentifier(data.value(IDENTIFIER_KEY).toString(),
+                                                                          data.value(TYPE_KEY).toInt());
+    if (data.value(SOCIALD_AVATAR_STATUS_KEY).toInt() == 304) {
+        // the stored image is still current, and the contact already uses it.
+        m_avatarStore.revalidate(accountId, identifier, url);
+    } else if (!path.isEmpty()) {
+        // an identical image may already be stored for another contact or account.
+        // the reference is committed once the contact has been saved with it.
+        QString storedImage = m_avatarStore.stage(accountId, identifier, path, url,
+                                                  data.value(SOCIALD_AVATAR_ETAG_KEY).toByteArray(),
+                                                  data.value(SOCIALD_AVATAR_LAST_MODIFIED_KEY).toByteArray());
+        if (!storedImage.isEmpty()) {
+            m_downloadedAvatars[accountId].append(qMakePair(storedImage, data));
+        }
+    }
+}
+
+void FacebookContactSyncAdaptor::avatarDownloadsStarted(int accountId)
+{
+    // the sync waits for all of the scheduled avatar downloads.
+    incrementSemaphore(accountId);
+}
 
-    // Load finished, we just decrement semaphore
-    decrementSemaphore(data.value(ACCOUNT_ID_KEY).toInt());
+void FacebookContactSyncAdaptor::avatarDownloadsFinished(int accountId)
+{
+    decrementSemaphore(accountId);
 }
 
 bool FacebookContactSyncAdaptor::remoteContactDiffersFromLocal(const QContact &remoteContact, const QContact &localContact) const
@@ -859,6 +963,10 @@ bool FacebookContactSyncAdaptor::storeToLocal(const QString &accessToken, int ac
             if (accountIds.contains(accountIdStr)) {
                 // this account used to provide this contact, but now does not.
                 accountIds.removeAll(accountIdStr);
+                m_avatarStore.release(accountId, FacebookContactImageDownloader::avatarIdentifier(
+                        lc.detail<QContactGuid>().guid(), FacebookContactImageDownloader::ContactPicture));
+                m_avatarStore.release(accountId, FacebookContactImageDownloader::avatarIdentifier(
+                        lc.detail<QContactGuid>().guid(), FacebookContactImageDownloader::ContactCover));
                 if (accountIds.isEmpty()) {
                     // no other account provides this contact, it can be removed.
                     localToRemove.append(lc.id());
@@ -892,12 +1000,13 @@ bool FacebookContactSyncAdaptor::storeToLocal(const QString &accessToken, int ac
     }
 
     // and trigger downloading of avatars for friend contacts for this account.
+    // The sync only waits a limited time for them, as the contacts are stored.
     const QList<QPair<QString, QVariantMap> > &queuedDownloads = m_queuedAvatarDownloads[accountId];
     for (int i = 0; i < queuedDownloads.size(); ++i) {
-        incrementSemaphore(accountId);
         const QPair<QString, QVariantMap> &queuedAvatarDownload = queuedDownloads[i];
-        m_workerObject->queue(queuedAvatarDownload.first, queuedAvatarDownload.second);
+        m_avatarScheduler->enqueue(accountId, queuedAvatarDownload.first, queuedAvatarDownload.second);
     }
+    m_avatarScheduler->setDataComplete(accountId);
 
     // done.
     m_queuedAvatarDownloads[accountId].clear();
@@ -907,9 +1016,71 @@ bool FacebookContactSyncAdaptor::storeToLocal(const QString &accessToken, int ac
 
 void FacebookContactSyncAdaptor::finalize(int accountId)
 {
+    // update the contacts whose avatars were downloaded during the sync.
+    QMap<QString, QContact> avatarContacts; // fbuid -> contact
+    QStringList avatarIdentifiers;
+    const QList<QPair<QString, QVariantMap> > &downloadedAvatars = m_downloadedAvatars[accountId];
+    for (int i = 0; i < downloadedAvatars.size(); ++i) {
+        const QString &avatarFile = downloadedAvatars[i].first;
+        QString fbuid = downloadedAvatars[i].second.value(IDENTIFIER_KEY).toString();
+        QLatin1String avatarType(downloadedAvatars[i].second.value(TYPE_KEY).toInt() == FacebookContactImageDownloader::ContactCover
+                                 ? "cover" : "picture");
+        if (!avatarContacts.contains(fbuid)) {
+            bool isNewContact = false;
+            QContact contact = newOrExistingContact(fbuid, &isNewContact);
+            if (isNewContact) {
+                // the contact was removed during the sync.
+                continue;
+            }
+            avatarContacts.insert(fbuid, contact);
+        }
+
+        QContact &contact(avatarContacts[fbuid]);
+        QContactAvatar contactAvatar;
+        foreach (const QContactAvatar &avatar, contact.details<QContactAvatar>()) {
+            if (avatar.value(QContactAvatar__FieldAvatarMetadata) == avatarType) {
+                contactAvatar = avatar;
+                break;
+            }
+        }
+        contactAvatar.setImageUrl(avatarFile);
+        contactAvatar.setValue(QContactAvatar__FieldAvatarMetadata, avatarType);
+        contact.saveDetail(&contactAvatar);
+        avatarIdentifiers.append(FacebookContactImageDownloader::avatarIdentifier(
+                fbuid, downloadedAvatars[i].second.value(TYPE_KEY).toInt()));
+    }
+    m_downloadedAvatars[accountId].clear();
+
+    if (avatarContacts.size()) {
+        QList<QContact> contactsToSave = avatarContacts.values();
+        if (!saveNonexportableContacts(m_contactManager, &contactsToSave)) {
+            SOCIALD_LOG_ERROR("failed to save downloaded avatars for account" << accountId << ":" << m_contactManager->error());
+        } else {
+            // the stored images may now replace the previous ones.
+            foreach (const QString &identifier, avatarIdentifiers) {
+                m_avatarStore.commit(accountId, identifier);
+            }
+        }
+    }
+    m_avatarStore.flush();
+
     SOCIALD_LOG_DEBUG("finished Facebook contacts sync for account" << accountId);
 }
 
+void FacebookContactSyncAdaptor::setAccountError(int accountId)
+{
+    // the sync of the account is now only waiting for its avatar downloads.
+    FacebookDataTypeSyncAdaptor::setAccountError(accountId);
+    m_avatarScheduler->setDataComplete(accountId);
+}
+
+void FacebookContactSyncAdaptor::abortRequests()
+{
+    // the avatar downloads are not tracked by the reply timeouts.
+    FacebookDataTypeSyncAdaptor::abortRequests();
+    m_avatarScheduler->deferAll();
+}
+
 void FacebookContactSyncAdaptor::purgeAccount(int pid)
 {
     int purgeCount = 0;
@@ -963,6 +1134,10 @@ void FacebookContactSyncAdaptor::purgeAccount(int pid)
         }
     }
 
+    // the images themselves are removed by the next garbage collection.
+    m_avatarStore.releaseAll(pid);
+    m_avatarScheduler->removeAll(pid);
+
     if (success) {
         SOCIALD_LOG_INFO("purged account" << pid <<
                          "and successfully removed" << purgeCount << "friends"
@@ -1023,6 +1198,9 @@ void FacebookContactSyncAdaptor::finalCleanup()
             purgeAccount(purgeId);
         }
     }
+
+    // fifth, remove the avatar images which are no longer referenced by any account.
+    m_avatarStore.collectGarbage();
 }
 
 #include "facebookcontactsyncadaptor.moc"
@@ -23,12 +23,15 @@
 #define FACEBOOKCONTACTSYNCADAPTOR_H
 
 #include "facebookdatatypesyncadaptor.h"
+#include "socialdavatarstore_p.h"
+#include "socialdavatarscheduler_p.h"
 
 #include <QtCore/QObject>
 #include <QtCore/QString>
 #include <QtCore/QDateTime>
 #include <QtCore/QVariantMap>
 #include <QtCore/QList>
+#include <QtCore/QHash>
 #include <QtCore/QStringList>
 #include <QtNetwork/QNetworkReply>
 #include <QtNetwork/QSslError>
@@ -58,28 +61,40 @@ protected: // implementing FacebookDataTypeSyncAdaptor interface
     void beginSync(int accountId, const QString &accessToken);
     void finalize(int accountId);
     void finalCleanup();
+    void setAccountError(int accountId);
+    void abortRequests();
+
+    // conversion of friend data, and comparison with the stored contact
+    QContact parseContactDetails(const QJsonObject &blobDetails, int accountId, bool *needsSaving);
+    bool remoteContactDiffersFromLocal(const QContact &remoteContact, const QContact &localContact) const;
 
 private:
     void requestData(int accountId, const QString &accessToken,
                      const QString &continuationRequest = QString(),
                      const QDateTime &syncTimestamp = QDateTime());
     void purgeAccount(int accountId);
+    QString avatarFileName(int accountId, const QString &fbuid, int type, const QString &url);
 
 private Q_SLOTS:
     void friendsFinishedHandler();
+    void friendParsedHandler(const QJsonObject &currFriend);
     void slotImageDownloaded(const QString &url, const QString &path, const QVariantMap &data);
+    void avatarDownloadsStarted(int accountId);
+    void avatarDownloadsFinished(int accountId);
 
 private:
     QContactManager *m_contactManager;
     FacebookContactImageDownloader *m_workerObject;
+    SocialdAvatarScheduler *m_avatarScheduler;
     QMap<int, QList<QContact> > m_remoteContacts; // accountId to contacts to save.
+    QHash<QNetworkReply*, QList<QContact> > m_parsedFriends; // kept once their reply has been validated.
     QMap<int, QList<QPair<QString, QVariantMap> > > m_queuedAvatarDownloads;
+    QMap<int, QList<QPair<QString, QVariantMap> > > m_downloadedAvatars; // stored image path and download metadata
+    SocialdAvatarStore m_avatarStore; // the avatar images of the contacts, shared with other adaptors
 
     QList<QContactId> contactIdsForGuid(const QString &fbuid);
     QContact newOrExistingContact(const QString &fbuid, bool *isNewContact);
-    QContact parseContactDetails(const QJsonObject &blobDetails, int accountId, bool *needsSaving);
     bool storeToLocal(const QString &accessToken, int accountId, int *addedCount, int *modifiedCount, int *removedCount, int *unchangedCount);
-    bool remoteContactDiffersFromLocal(const QContact &remoteContact, const QContact &localContact) const;
 };
 
 #endif // FACEBOOKCONTACTSYNCADAPTOR_H
@@ -20,6 +20,8 @@
  ****************************************************************************/
 
 #include "facebookimagesyncadaptor.h"
+#include "socialdjsonstreamparser_p.h"
+#include "socialdnetworkaccessmanager_p.h"
 #include "trace.h"
 
 #include <QtCore/QPair>
@@ -28,6 +30,8 @@
 #include <QtCore/QVariantMap>
 #include <QtCore/QByteArray>
 #include <QtCore/QUrlQuery>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
 #include <QtSql/QSqlDatabase>
 #include <QtSql/QSqlQuery>
 #include <QtSql/QSqlError>
@@ -35,6 +39,69 @@
 #include <QtNetwork/QNetworkAccessManager>
 #include <QtNetwork/QNetworkReply>
 
+namespace {
+    // the fields of each album, photo and user which the reply handlers read.
+    const SocialdFieldProjection::Entry FieldProjection[] = {
+        { "albums", "fields", "id,from{id},name,created_time,updated_time,count" },
+        { "photos", "fields", "id,picture,source,created_time,updated_time,name,images{width,height,source},width,height" },
+        { "me", "fields", "id,updated_time,name" },
+        { 0, 0, 0 }
+    };
+
+    const SocialdFieldProjection::ReadField ReadFields[] = {
+        { "albums", "id" },
+        { "albums", "from.id" },
+        { "albums", "name" },
+        { "albums", "created_time" },
+        { "albums", "updated_time" },
+        { "albums", "count" },
+        { "photos", "id" },
+        { "photos", "picture" },
+        { "photos", "source" },
+        { "photos", "created_time" },
+        { "photos", "updated_time" },
+        { "photos", "name" },
+        { "photos", "images.width" },
+        { "photos", "images.height" },
+        { "photos", "images.source" },
+        { "photos", "width" },
+        { "photos", "height" },
+        { "me", "id" },
+        { "me", "name" },
+        { "me", "updated_time" },
+        { 0, 0 }
+    };
+
+    // the Graph API accepts at most 50 requests in one batch request.
+    const int MaxGraphBatchSize = 50;
+    const QString GraphBatchSizeKey = QStringLiteral("graph_batch_size");
+
+    // the number of photos requested per page.  The photo requests of a
+    // batch share this limit, so that the batch response (which is parsed
+    // as a whole) is no larger than the response to a single request.
+    const int PhotosPageLimit = 2000;
+
+    // continuation urls contain the access token, which must not be persisted.
+    QString withoutAccessToken(const QString &continuationUrl)
+    {
+        QUrl url(continuationUrl);
+        QUrlQuery query(url);
+        query.removeAllQueryItems(QLatin1String("access_token"));
+        url.setQuery(query);
+        return url.toString();
+    }
+
+    QString withAccessToken(const QString &continuationUrl, const QString &accessToken)
+    {
+        QUrl url(continuationUrl);
+        QUrlQuery query(url);
+        query.removeAllQueryItems(QLatin1String("access_token"));
+        query.addQueryItem(QLatin1String("access_token"), accessToken);
+        url.setQuery(query);
+        return url.toString();
+    }
+}
+
 // Update the following version if database schema changes e.g. new
 // fields are added to the existing tables.
 // It will make old tables dropped and creates new ones.
@@ -47,6 +114,8 @@
 // account, it might have some problems, like data being removed while it shouldn't.
 FacebookImageSyncAdaptor::FacebookImageSyncAdaptor(QObject *parent)
     : FacebookDataTypeSyncAdaptor(SocialNetworkSyncAdaptor::Images, parent)
+    , m_checkpoints(QLatin1String("facebook"), SocialNetworkSyncAdaptor::dataTypeName(SocialNetworkSyncAdaptor::Images))
+    , m_fieldProjection(FieldProjection, ReadFields)
 {
     setInitialActive(m_db.isValid());
 }
@@ -61,14 +130,22 @@ QString FacebookImageSyncAdaptor::syncServiceName() const
     return QStringLiteral("facebook-images");
 }
 
+const SocialdFieldProjection &FacebookImageSyncAdaptor::fieldProjection() const
+{
+    return m_fieldProjection;
+}
+
 void FacebookImageSyncAdaptor::sync(const QString &dataTypeString, int accountId)
 {
     // get ready for sync
     if (!initRemovalDetectionLists(accountId)) {
         SOCIALD_LOG_ERROR("unable to initialized cached account list for account" << accountId);
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         return;
     }
+    m_batchQueue.remove(accountId);
+    m_requestedUsers.remove(accountId);
+    m_incompleteAccounts.remove(accountId);
 
     // call superclass impl.
     FacebookDataTypeSyncAdaptor::sync(dataTypeString, accountId);
@@ -79,6 +156,7 @@ void FacebookImageSyncAdaptor::purgeDataForOldAccount(int oldId, SocialNetworkSy
     m_db.purgeAccount(oldId);
     m_db.commit();
     m_db.wait();
+    m_checkpoints.removeAll(oldId);
 }
 
 void FacebookImageSyncAdaptor::beginSync(int accountId, const QString &accessToken)
@@ -92,15 +170,68 @@ void FacebookImageSyncAdaptor::beginSync(int accountId, const QString &accessTok
 
 void FacebookImageSyncAdaptor::finalize(int accountId)
 {
-    Q_UNUSED(accountId)
     // Remove albums
-    m_db.removeAlbums(m_cachedAlbums.keys());
+    const QStringList removedAlbumIds = m_cachedAlbums.take(accountId).keys();
+    m_db.removeAlbums(removedAlbumIds);
+    foreach (const QString &fbAlbumId, removedAlbumIds) {
+        m_pendingCheckpoints[accountId].remove(fbAlbumId);
+        m_checkpoints.remove(accountId, fbAlbumId);
+    }
 
     // Remove images
-    m_db.removeImages(m_removedImages);
+    m_db.removeImages(m_removedImages.take(accountId));
+    m_serverImageIds.remove(accountId);
 
     m_db.commit();
     m_db.wait();
+
+    // the checkpoints must only refer to photos which have been stored.
+    QNetworkReply *albumListReply = m_albumListReplies.take(accountId);
+    if (m_db.writeStatus() == AbstractSocialCacheDatabase::Finished) {
+        commitCheckpoints(accountId);
+        if (albumListReply && !m_incompleteAccounts.contains(accountId)) {
+            commitValidators(albumListReply);
+        }
+    } else {
+        SOCIALD_LOG_ERROR("unable to store photos for Facebook account with id" << accountId);
+    }
+    if (albumListReply) {
+        albumListReply->deleteLater();
+    }
+    m_incompleteAccounts.remove(accountId);
+    m_pendingCheckpoints.remove(accountId);
+    m_batchQueue.remove(accountId);
+    m_requestedUsers.remove(accountId);
+}
+
+void FacebookImageSyncAdaptor::commitCheckpoints(int accountId)
+{
+    QMap<QString, PendingCheckpoint> &pending(m_pendingCheckpoints[accountId]);
+    QMap<QString, PendingCheckpoint>::const_iterator it = pending.constBegin();
+    for ( ; it != pending.constEnd(); ++it) {
+        if (it->complete || it->restart) {
+            m_checkpoints.remove(accountId, it.key());
+        }
+        if (it->complete) {
+            continue;
+        }
+
+        // either the album is only partially synced, or none of its photos
+        // were retrieved; in both cases it must be resumed by the next sync,
+        // even if the album itself does not change in the meantime.
+        QVariantMap cursor;
+        cursor.insert(QStringLiteral("fbUserId"), it->fbUserId);
+        cursor.insert(QStringLiteral("nextUrl"), it->nextUrl);
+        QList<QByteArray> pages;
+        if (!it->imageIds.isEmpty()) {
+            pages.append(it->imageIds.join(QLatin1Char('\n')).toUtf8());
+        }
+        if (!m_checkpoints.save(accountId, it.key(), cursor, pages)) {
+            SOCIALD_LOG_ERROR("unable to save checkpoint for album" << it.key() <<
+                              "from Facebook account with id" << accountId);
+            m_checkpoints.remove(accountId, it.key());
+        }
+    }
 }
 
 void FacebookImageSyncAdaptor::requestData(int accountId,
@@ -108,6 +239,126 @@ void FacebookImageSyncAdaptor::requestData(int accountId,
                                            const QString &continuationUrl,
                                            const QString &fbUserId,
                                            const QString &fbAlbumId)
+{
+    if (fbAlbumId.isEmpty() || graphBatchSize(accountId) <= 1) {
+        sendRequest(accountId, accessToken, continuationUrl, fbUserId, fbAlbumId);
+        return;
+    }
+
+    // photo requests are grouped into batch requests by flushBatch().
+    BatchedRequest batched;
+    batched.continuationUrl = continuationUrl;
+    batched.fbUserId = fbUserId;
+    batched.fbAlbumId = fbAlbumId;
+    m_batchQueue[accountId].append(batched);
+}
+
+int FacebookImageSyncAdaptor::graphBatchSize(int accountId) const
+{
+    Buteo::SyncProfile *syncProfile = accountSyncProfile(accountId);
+    int batchSize = syncProfile
+                  ? syncProfile->key(GraphBatchSizeKey, QString::number(MaxGraphBatchSize)).toInt()
+                  : MaxGraphBatchSize;
+    return qMin(batchSize, MaxGraphBatchSize);
+}
+
+void FacebookImageSyncAdaptor::flushBatch(int accountId, const QString &accessToken)
+{
+    QList<BatchedRequest> queue = m_batchQueue.take(accountId);
+    int batchSize = qMax(graphBatchSize(accountId), 1);
+    while (!queue.isEmpty()) {
+        QList<BatchedRequest> requests = queue.mid(0, batchSize);
+        queue = queue.mid(requests.size());
+
+        if (requests.size() == 1) {
+            // a lone request gains nothing from being batched.
+            const BatchedRequest &request(requests.first());
+            if (request.fbAlbumId.isEmpty()) {
+                requestUser(accountId, accessToken);
+            } else {
+                sendRequest(accountId, accessToken, request.continuationUrl, request.fbUserId, request.fbAlbumId);
+            }
+            continue;
+        }
+
+        // batched requests address the Graph API relative to its root, and
+        // share the access token of the batch request.
+        int photosLimit = PhotosPageLimit / requests.size();
+        QJsonArray batch;
+        QVariantList batchedRequests;
+        foreach (const BatchedRequest &request, requests) {
+            QString relativeUrl;
+            if (!request.continuationUrl.isEmpty()) {
+                QUrl url(withoutAccessToken(request.continuationUrl));
+                QUrlQuery query(url);
+                if (query.hasQueryItem(QLatin1String("limit"))) {
+                    // the page may have been requested with the limit of a single request.
+                    query.removeAllQueryItems(QLatin1String("limit"));
+                    query.addQueryItem(QLatin1String("limit"), QString::number(photosLimit));
+                }
+                relativeUrl = url.path(QUrl::FullyEncoded).mid(1);
+                if (!query.isEmpty()) {
+                    relativeUrl += QLatin1Char('?') + query.toString(QUrl::FullyEncoded);
+                }
+            } else {
+                QList<QPair<QString, QString> > queryItems;
+                if (request.fbAlbumId.isEmpty()) {
+                    relativeUrl = QStringLiteral("me");
+                    m_fieldProjection.apply(QStringLiteral("me"), &queryItems);
+                } else {
+                    relativeUrl = QString(QLatin1String("%1/photos")).arg(request.fbAlbumId);
+                    queryItems.append(QPair<QString, QString>(QString(QLatin1String("limit")), QString::number(photosLimit)));
+                    m_fieldProjection.apply(QStringLiteral("photos"), &queryItems);
+                }
+                QUrlQuery query;
+                query.setQueryItems(queryItems);
+                relativeUrl += QLatin1Char('?') + query.toString(QUrl::FullyEncoded);
+            }
+
+            QJsonObject batchedRequest;
+            batchedRequest.insert(QStringLiteral("method"), QStringLiteral("GET"));
+            batchedRequest.insert(QStringLiteral("relative_url"), relativeUrl);
+            batch.append(batchedRequest);
+
+            QVariantMap properties;
+            properties.insert(QStringLiteral("continuationUrl"), request.continuationUrl);
+            properties.insert(QStringLiteral("fbUserId"), request.fbUserId);
+            properties.insert(QStringLiteral("fbAlbumId"), request.fbAlbumId);
+            batchedRequests.append(properties);
+        }
+
+        QByteArray postData = "access_token=" + QUrl::toPercentEncoding(accessToken)
+                            + "&include_headers=false&batch="
+                            + QUrl::toPercentEncoding(QString::fromUtf8(QJsonDocument(batch).toJson(QJsonDocument::Compact)));
+
+        QNetworkRequest request(QUrl(QStringLiteral("https://graph.facebook.com/")));
+        request.setHeader(QNetworkRequest::ContentTypeHeader, QStringLiteral("application/x-www-form-urlencoded"));
+        QNetworkReply *reply = m_networkAccessManager->post(request, postData);
+        if (reply) {
+            reply->setProperty("accountId", accountId);
+            reply->setProperty("accessToken", accessToken);
+            reply->setProperty("batchedRequests", batchedRequests);
+            connect(reply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(errorHandler(QNetworkReply::NetworkError)));
+            connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsHandler(QList<QSslError>)));
+            connect(reply, SIGNAL(finished()), this, SLOT(batchFinishedHandler()));
+
+            // we're requesting data.  Increment the semaphore so that we know we're still busy.
+            incrementSemaphore(accountId);
+            setupReplyTimeout(accountId, reply);
+            SOCIALD_LOG_DEBUG("requested batch of" << requests.size() << "requests for Facebook account with id" << accountId);
+        } else {
+            SOCIALD_LOG_ERROR("unable to request batch from Facebook account with id" << accountId);
+            clearRemovalDetectionLists(accountId); // don't perform server-side removal detection during this sync run.
+            m_incompleteAccounts.insert(accountId);
+        }
+    }
+}
+
+void FacebookImageSyncAdaptor::sendRequest(int accountId,
+                                           const QString &accessToken,
+                                           const QString &continuationUrl,
+                                           const QString &fbUserId,
+                                           const QString &fbAlbumId)
 {
     QUrl url;
     if (!continuationUrl.isEmpty()) {
@@ -129,12 +380,23 @@ void FacebookImageSyncAdaptor::requestData(int accountId,
         QList<QPair<QString, QString> > queryItems;
         QUrlQuery query(url);
         queryItems.append(QPair<QString, QString>(QString(QLatin1String("access_token")), accessToken));
-        queryItems.append(QPair<QString, QString>(QString(QLatin1String("limit")), QString(QLatin1String("2000"))));
+        queryItems.append(QPair<QString, QString>(QString(QLatin1String("limit")), QString::number(PhotosPageLimit)));
+        m_fieldProjection.apply(fbAlbumId.isEmpty() ? QStringLiteral("albums") : QStringLiteral("photos"), &queryItems);
         query.setQueryItems(queryItems);
         url.setQuery(query);
     }
 
-    QNetworkReply *reply = m_networkAccessManager->get(QNetworkRequest(url));
+    QNetworkRequest request(url);
+    if (fbAlbumId.isEmpty()) {
+        // the album list determines which photos need to be requested.
+        request.setAttribute(SocialdNetworkAccessManager::RequestPriorityAttribute, SocialdNetworkAccessManager::MetadataPriority);
+        if (continuationUrl.isEmpty() && !m_cachedAlbums.value(accountId).isEmpty()) {
+            // we have the albums from a previous sync; only fetch them if they changed.
+            request.setAttribute(SocialdNetworkAccessManager::ConditionalRequestAttribute, true);
+        }
+    }
+
+    QNetworkReply *reply = m_networkAccessManager->get(request);
     if (reply) {
         reply->setProperty("accountId", accountId);
         reply->setProperty("accessToken", accessToken);
@@ -146,6 +408,9 @@ void FacebookImageSyncAdaptor::requestData(int accountId,
         if (fbAlbumId.isEmpty()) {
             connect(reply, SIGNAL(finished()), this, SLOT(albumsFinishedHandler()));
         } else {
+            // albums can contain thousands of photos, so decode them as they arrive.
+            SocialdJsonStreamParser *parser = new SocialdJsonStreamParser(reply, QLatin1String("data"));
+            connect(parser, SIGNAL(elementParsed(QJsonObject)), this, SLOT(imageParsedHandler(QJsonObject)));
             connect(reply, SIGNAL(finished()), this, SLOT(imagesFinishedHandler()));
         }
 
@@ -154,7 +419,8 @@ void FacebookImageSyncAdaptor::requestData(int accountId,
         setupReplyTimeout(accountId, reply);
     } else {
         SOCIALD_LOG_ERROR("unable to request data from Facebook account with id" << accountId);
-        clearRemovalDetectionLists(); // don't perform server-side removal detection during this sync run.
+        clearRemovalDetectionLists(accountId); // don't perform server-side removal detection during this sync run.
+        m_incompleteAccounts.insert(accountId);
     }
 }
 
@@ -168,15 +434,38 @@ void FacebookImageSyncAdaptor::albumsFinishedHandler()
     QString fbAlbumId = reply->property("fbAlbumId").toString();
     QString continuationUrl = reply->property("continuationUrl").toString();
     QByteArray replyData = reply->readAll();
+    bool unchanged = !isError && isUnchangedReply(reply);
     disconnect(reply);
-    reply->deleteLater();
     removeReplyTimeout(accountId, reply);
+    if (!unchanged && continuationUrl.isEmpty()) {
+        // the validators of the album list are only stored once all of
+        // the albums which it lists have been synced (see finalize()).
+        delete m_albumListReplies.take(accountId);
+        m_albumListReplies.insert(accountId, reply);
+    } else {
+        reply->deleteLater();
+    }
+
+    if (unchanged) {
+        // no album has been added, removed or updated since the last sync.
+        SOCIALD_LOG_DEBUG("albums unchanged for Facebook account with id" << accountId);
+        clearRemovalDetectionLists(accountId);
+        foreach (const QString &checkpointAlbumId, m_checkpoints.keys(accountId)) {
+            resumeAlbum(accountId, accessToken,
+                        m_checkpoints.cursor(accountId, checkpointAlbumId).value(QStringLiteral("fbUserId")).toString(),
+                        checkpointAlbumId);
+        }
+        flushBatch(accountId, accessToken);
+        decrementSemaphore(accountId);
+        return;
+    }
 
     bool ok = false;
     QJsonObject parsed = parseJsonObjectReplyData(replyData, &ok);
     if (isError || !ok || !parsed.contains(QLatin1String("data"))) {
         SOCIALD_LOG_ERROR("unable to read albums response for Facebook account with id" << accountId);
-        clearRemovalDetectionLists(); // don't perform server-side removal detection during this sync run.
+        clearRemovalDetectionLists(accountId); // don't perform server-side removal detection during this sync run.
+        m_incompleteAccounts.insert(accountId);
         decrementSemaphore(accountId);
         return;
     }
@@ -195,6 +484,7 @@ void FacebookImageSyncAdaptor::albumsFinishedHandler()
             continue;
         }
 
+        m_fieldProjection.validate(QStringLiteral("albums"), albumObject);
         QString albumId = albumObject.value(QLatin1String("id")).toString();
         QString userId = albumObject.value(QLatin1String("from")).toObject().value(QLatin1String("id")).toString();
         if (!userId.isEmpty() && userId != fbUserId) {
@@ -219,10 +509,10 @@ void FacebookImageSyncAdaptor::albumsFinishedHandler()
         QDateTime createdTime = QDateTime::fromString(createdTimeStr, Qt::ISODate);
         QDateTime updatedTime = QDateTime::fromString(updatedTimeStr, Qt::ISODate);
 
-        const FacebookAlbum::ConstPtr &dbAlbum = m_cachedAlbums.value(fbAlbumId);
-        m_cachedAlbums.remove(fbAlbumId);  // Removal detection
-        if (!dbAlbum.isNull() && (dbAlbum->updatedTime() >= updatedTime
-                                  && dbAlbum->imageCount() == imageCount)) {
+        const FacebookAlbum::ConstPtr dbAlbum = m_cachedAlbums[accountId].take(fbAlbumId);  // Removal detection
+        bool interrupted = m_checkpoints.contains(accountId, fbAlbumId);
+        if (!interrupted && !dbAlbum.isNull() && (dbAlbum->updatedTime() >= updatedTime
+                                                  && dbAlbum->imageCount() == imageCount)) {
             SOCIALD_LOG_DEBUG("album with id" << albumId << "by user" << userId <<
                               "from Facebook account with id" << accountId << "doesn't need sync");
             continue;
@@ -236,7 +526,13 @@ void FacebookImageSyncAdaptor::albumsFinishedHandler()
         m_db.addAlbum(albumId, userId, createdTime, updatedTime, albumName, imageCount);
         // TODO: After successfully added an album, we should begin a new query to get the image
         // information (based on cover image id).
-        requestData(accountId, accessToken, QString(), fbUserId, fbAlbumId);
+        if (interrupted) {
+            resumeAlbum(accountId, accessToken, fbUserId, fbAlbumId);
+        } else {
+            PendingCheckpoint &pending(m_pendingCheckpoints[accountId][fbAlbumId]);
+            pending.fbUserId = fbUserId;
+            requestData(accountId, accessToken, QString(), fbUserId, fbAlbumId);
+        }
 
     }
 
@@ -249,6 +545,9 @@ void FacebookImageSyncAdaptor::albumsFinishedHandler()
         requestData(accountId, accessToken, nextUrl, fbUserId, QString());
     }
 
+    // request the photos of the albums which need to be synced.
+    flushBatch(accountId, accessToken);
+
     // Finally, reduce our semaphore.
     decrementSemaphore(accountId);
 }
@@ -262,91 +561,130 @@ void FacebookImageSyncAdaptor::imagesFinishedHandler()
     QString fbUserId = reply->property("fbUserId").toString();
     QString fbAlbumId = reply->property("fbAlbumId").toString();
     QString continuationUrl = reply->property("continuationUrl").toString();
-    QByteArray replyData = reply->readAll();
+    int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    // the photos have already been decoded by imageParsedHandler() as they arrived,
+    // but they are only stored if the whole reply was received.
+    bool ok = false;
+    SocialdJsonStreamParser *parser = SocialdJsonStreamParser::parser(reply);
+    QJsonObject parsed = parser->finish(&ok);
+    int imageCount = parser->elementCount();
+    QList<ParsedPhoto> photos = m_parsedPhotos.take(reply);
     disconnect(reply);
     reply->deleteLater();
     removeReplyTimeout(accountId, reply);
 
-    bool ok = false;
-    QJsonObject parsed = parseJsonObjectReplyData(replyData, &ok);
-    if (isError || !ok || !parsed.contains(QLatin1String("data"))) {
+    if (!isError && ok && parsed.contains(QLatin1String("data"))) {
+        foreach (const ParsedPhoto &photo, photos) {
+            storeImage(accountId, fbUserId, fbAlbumId, photo);
+        }
+    }
+    handlePhotosPage(accountId, accessToken, continuationUrl, fbUserId, fbAlbumId,
+                     !isError && ok, httpStatus, parsed, imageCount);
+    flushBatch(accountId, accessToken);
+
+    // we're finished this request.  Decrement our busy semaphore.
+    decrementSemaphore(accountId);
+}
+
+void FacebookImageSyncAdaptor::handlePhotosPage(int accountId, const QString &accessToken,
+                                                const QString &continuationUrl, const QString &fbUserId,
+                                                const QString &fbAlbumId, bool ok, int httpStatus,
+                                                const QJsonObject &parsed, int imageCount)
+{
+    if (!ok || !parsed.contains(QLatin1String("data"))) {
         SOCIALD_LOG_ERROR("unable to read photos response for Facebook account with id" << accountId);
-        clearRemovalDetectionLists(); // don't perform server-side removal detection during this sync run.
-        decrementSemaphore(accountId);
+        clearRemovalDetectionLists(accountId); // don't perform server-side removal detection during this sync run.
+        m_incompleteAccounts.insert(accountId);
+        if (httpStatus == 400 && !continuationUrl.isEmpty()) {
+            // the paging cursor is no longer valid.  Sync the album from scratch next time.
+            PendingCheckpoint &pending(m_pendingCheckpoints[accountId][fbAlbumId]);
+            pending.restart = true;
+            pending.nextUrl.clear();
+            pending.imageIds.clear();
+        }
         return;
     }
 
-    QJsonArray data = parsed.value(QLatin1String("data")).toArray();
-    if (data.size() == 0) {
+    if (imageCount == 0) {
         SOCIALD_LOG_DEBUG("album with id" << fbAlbumId << "from Facebook account with id" << accountId << "has no photos");
-        checkRemovedImages(fbAlbumId);
-        decrementSemaphore(accountId);
+        m_pendingCheckpoints[accountId][fbAlbumId].complete = true;
+        checkRemovedImages(accountId, fbAlbumId);
         return;
     }
 
-    // read the photos information
-    foreach (const QJsonValue imageValue, data) {
-        QJsonObject imageObject = imageValue.toObject();
-        if (imageObject.isEmpty()) {
-            continue;
-        }
-
-        QString photoId = imageObject.value(QLatin1String("id")).toString();
-        QString thumbnailUrl = imageObject.value(QLatin1String("picture")).toString();
-        QString imageSrcUrl = imageObject.value(QLatin1String("source")).toString();
-        QString createdTimeStr = imageObject.value(QLatin1String("created_time")).toString();
-        QString updatedTimeStr = imageObject.value(QLatin1String("updated_time")).toString();
-        QString photoName = imageObject.value(QLatin1String("name")).toString();
-
-        // Find the correct thumbnail size. The fallback will be the "picture" which usually
-        // is too small so this is sort of best guess what sizes FB might returns. We can't
-        // also hardcode the exact sizes here, because we can't be sure that certains sizes
-        // will stay for ever.
-        // TODO: we can use https://graph.facebook.com/object_id/picture?type=large
-        QJsonArray images = imageObject.value(QLatin1String("images")).toArray();
-        foreach (const QJsonValue &imageValue, images) {
-            QJsonObject image = imageValue.toObject();
-            int width = static_cast<int>(image.value(QLatin1String("width")).toDouble());
-            int height= static_cast<int>(image.value(QLatin1String("height")).toDouble());
-            if (160 <= width && width <= 350 &&
-                160 <= height && height <= 350) {
-                thumbnailUrl = image.value(QLatin1String("source")).toString();
-                break;
-            }
-        }
-
-        int width = static_cast<int>(imageObject.value(QLatin1String("width")).toDouble());
-        int height = static_cast<int>(imageObject.value(QLatin1String("height")).toDouble());
-        QDateTime createdTime = QDateTime::fromString(createdTimeStr, Qt::ISODate);
-        QDateTime updatedTime = QDateTime::fromString(updatedTimeStr, Qt::ISODate);
-
-
-        if (!m_serverImageIds[fbAlbumId].contains(photoId)) {
-            m_serverImageIds[fbAlbumId].insert(photoId);
-        }
-
-        // check if we need to sync, and write to the database.
-        if (haveAlreadyCachedImage(photoId, imageSrcUrl)) {
-            SOCIALD_LOG_DEBUG("have previously cached photo" << photoId << ":" << imageSrcUrl);
-        } else {
-            SOCIALD_LOG_DEBUG("caching new photo" << photoId << ":" << imageSrcUrl);
-            m_db.addImage(photoId, fbAlbumId, fbUserId, createdTime, updatedTime,
-                          photoName, width, height, thumbnailUrl, imageSrcUrl);
-        }
-    }
     // perform a continuation request if required.
     QJsonObject paging = parsed.value(QLatin1String("paging")).toObject();
     QString nextUrl = paging.value(QLatin1String("next")).toString();
     if (!nextUrl.isEmpty() && nextUrl != continuationUrl) {
         SOCIALD_LOG_DEBUG("performing continuation request for more photos for Facebook account with id" << accountId << ":" << nextUrl);
+        m_pendingCheckpoints[accountId][fbAlbumId].nextUrl = withoutAccessToken(nextUrl);
         requestData(accountId, accessToken, nextUrl, fbUserId, fbAlbumId);
     } else {
         // this was the laste page, check removed images
-        checkRemovedImages(fbAlbumId);
+        m_pendingCheckpoints[accountId][fbAlbumId].complete = true;
+        checkRemovedImages(accountId, fbAlbumId);
     }
+}
 
-    // we're finished this request.  Decrement our busy semaphore.
-    decrementSemaphore(accountId);
+void FacebookImageSyncAdaptor::imageParsedHandler(const QJsonObject &imageObject)
+{
+    SocialdJsonStreamParser *parser = qobject_cast<SocialdJsonStreamParser*>(sender());
+    QNetworkReply *reply = parser->reply();
+    if (reply->property("isError").toBool() || imageObject.isEmpty()) {
+        return;
+    }
+
+    m_parsedPhotos[reply].append(parsePhoto(imageObject));
+}
+
+FacebookImageSyncAdaptor::ParsedPhoto FacebookImageSyncAdaptor::parsePhoto(const QJsonObject &imageObject)
+{
+    m_fieldProjection.validate(QStringLiteral("photos"), imageObject);
+    ParsedPhoto photo;
+    photo.photoId = imageObject.value(QLatin1String("id")).toString();
+    photo.thumbnailUrl = imageObject.value(QLatin1String("picture")).toString();
+    photo.imageSrcUrl = imageObject.value(QLatin1String("source")).toString();
+    photo.name = imageObject.value(QLatin1String("name")).toString();
+    photo.createdTime = QDateTime::fromString(imageObject.value(QLatin1String("created_time")).toString(), Qt::ISODate);
+    photo.updatedTime = QDateTime::fromString(imageObject.value(QLatin1String("updated_time")).toString(), Qt::ISODate);
+
+    // Find the correct thumbnail size. The fallback will be the "picture" which usually
+    // is too small so this is sort of best guess what sizes FB might returns. We can't
+    // also hardcode the exact sizes here, because we can't be sure that certains sizes
+    // will stay for ever.
+    // TODO: we can use https://graph.facebook.com/object_id/picture?type=large
+    QJsonArray images = imageObject.value(QLatin1String("images")).toArray();
+    foreach (const QJsonValue &imageValue, images) {
+        QJsonObject image = imageValue.toObject();
+        int width = static_cast<int>(image.value(QLatin1String("width")).toDouble());
+        int height= static_cast<int>(image.value(QLatin1String("height")).toDouble());
+        if (160 <= width && width <= 350 &&
+            160 <= height && height <= 350) {
+            photo.thumbnailUrl = image.value(QLatin1String("source")).toString();
+            break;
+        }
+    }
+
+    photo.width = static_cast<int>(imageObject.value(QLatin1String("width")).toDouble());
+    photo.height = static_cast<int>(imageObject.value(QLatin1String("height")).toDouble());
+    return photo;
+}
+
+void FacebookImageSyncAdaptor::storeImage(int accountId, const QString &fbUserId, const QString &fbAlbumId,
+                                          const ParsedPhoto &photo)
+{
+    m_serverImageIds[accountId][fbAlbumId].insert(photo.photoId);
+    m_pendingCheckpoints[accountId][fbAlbumId].imageIds.append(photo.photoId);
+
+    // check if we need to sync, and write to the database.
+    if (haveAlreadyCachedImage(photo.photoId, photo.imageSrcUrl)) {
+        SOCIALD_LOG_DEBUG("have previously cached photo" << photo.photoId << ":" << photo.imageSrcUrl);
+    } else {
+        SOCIALD_LOG_DEBUG("caching new photo" << photo.photoId << ":" << photo.imageSrcUrl);
+        m_db.addImage(photo.photoId, fbAlbumId, fbUserId, photo.createdTime, photo.updatedTime,
+                      photo.name, photo.width, photo.height, photo.thumbnailUrl, photo.imageSrcUrl);
+    }
 }
 
 bool FacebookImageSyncAdaptor::haveAlreadyCachedImage(const QString &fbImageId, const QString &imageUrl)
@@ -370,25 +708,62 @@ bool FacebookImageSyncAdaptor::haveAlreadyCachedImage(const QString &fbImageId,
     return true;
 }
 
+void FacebookImageSyncAdaptor::resumeAlbum(int accountId, const QString &accessToken,
+                                           const QString &fbUserId, const QString &fbAlbumId)
+{
+    // the photos from the pages which were completed by the interrupted
+    // sync are still known to exist server-side.
+    QList<QByteArray> pages = m_checkpoints.pages(accountId, fbAlbumId);
+    foreach (const QByteArray &page, pages) {
+        foreach (const QByteArray &photoId, page.split('\n')) {
+            m_serverImageIds[accountId][fbAlbumId].insert(QString::fromUtf8(photoId));
+        }
+    }
+
+    PendingCheckpoint &pending(m_pendingCheckpoints[accountId][fbAlbumId]);
+    pending.fbUserId = fbUserId;
+    pending.nextUrl = m_checkpoints.cursor(accountId, fbAlbumId).value(QStringLiteral("nextUrl")).toString();
+    SOCIALD_LOG_DEBUG("resuming sync of album" << fbAlbumId << "from Facebook account with id" << accountId <<
+                      "after" << pages.size() << "pages:" << pending.nextUrl);
+    requestData(accountId, accessToken,
+                pending.nextUrl.isEmpty() ? QString() : withAccessToken(pending.nextUrl, accessToken),
+                fbUserId, fbAlbumId);
+}
+
 void FacebookImageSyncAdaptor::possiblyAddNewUser(const QString &fbUserId, int accountId,
                                                   const QString &accessToken)
 {
-    if (!m_db.user(fbUserId).isNull()) {
+    if (!m_db.user(fbUserId).isNull() || m_requestedUsers[accountId].contains(fbUserId)) {
         return;
     }
+    m_requestedUsers[accountId].insert(fbUserId);
 
+    if (graphBatchSize(accountId) <= 1) {
+        requestUser(accountId, accessToken);
+        return;
+    }
+
+    // the lookup is sent along with the photo requests by flushBatch().
+    BatchedRequest batched;
+    batched.fbUserId = fbUserId;
+    m_batchQueue[accountId].append(batched);
+}
+
+void FacebookImageSyncAdaptor::requestUser(int accountId, const QString &accessToken)
+{
     // We need to add the user. We call Facebook to get the informations that we
     // need and then add it to the database
-    // me?fields=updated_time,name,picture
+    // me?fields=id,updated_time,name
     QUrl url(QLatin1String("https://graph.facebook.com/me"));
     QList<QPair<QString, QString> > queryItems;
     queryItems.append(QPair<QString, QString>(QString(QLatin1String("access_token")), accessToken));
-    queryItems.append(QPair<QString, QString>(QString(QLatin1String("fields")),
-                                              QLatin1String("id,updated_time,name,picture")));
+    m_fieldProjection.apply(QStringLiteral("me"), &queryItems);
     QUrlQuery query(url);
     query.setQueryItems(queryItems);
     url.setQuery(query);
-    QNetworkReply *reply = m_networkAccessManager->get(QNetworkRequest(url));
+    QNetworkRequest request(url);
+    request.setAttribute(SocialdNetworkAccessManager::RequestPriorityAttribute, SocialdNetworkAccessManager::MetadataPriority);
+    QNetworkReply *reply = m_networkAccessManager->get(request);
     if (reply) {
         reply->setProperty("accountId", accountId);
         reply->setProperty("accessToken", accessToken);
@@ -406,23 +781,92 @@ void FacebookImageSyncAdaptor::possiblyAddNewUser(const QString &fbUserId, int a
 void FacebookImageSyncAdaptor::userFinishedHandler()
 {
     QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    bool isError = reply->property("isError").toBool();
     QByteArray replyData = reply->readAll();
     int accountId = reply->property("accountId").toInt();
     disconnect(reply);
     reply->deleteLater();
+    removeReplyTimeout(accountId, reply);
 
     bool ok = false;
     QJsonObject parsed = parseJsonObjectReplyData(replyData, &ok);
+    storeUser(accountId, !isError && ok, parsed);
+    decrementSemaphore(accountId);
+}
+
+void FacebookImageSyncAdaptor::storeUser(int accountId, bool ok, const QJsonObject &parsed)
+{
     if (!ok || !parsed.contains(QLatin1String("id"))) {
         SOCIALD_LOG_ERROR("unable to read user response for Facebook account with id" << accountId);
         return;
     }
 
+    m_fieldProjection.validate(QStringLiteral("me"), parsed);
     QString fbUserId = parsed.value(QLatin1String("id")).toString();
     QString fbName = parsed.value(QLatin1String("name")).toString();
     QString updatedStr = parsed.value(QLatin1String("updated_time")).toString();
 
     m_db.addUser(fbUserId, QDateTime::fromString(updatedStr, Qt::ISODate), fbName);
+}
+
+void FacebookImageSyncAdaptor::batchFinishedHandler()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    bool isError = reply->property("isError").toBool();
+    int accountId = reply->property("accountId").toInt();
+    QString accessToken = reply->property("accessToken").toString();
+    QVariantList batchedRequests = reply->property("batchedRequests").toList();
+    QByteArray replyData = reply->readAll();
+    disconnect(reply);
+    reply->deleteLater();
+    removeReplyTimeout(accountId, reply);
+
+    QJsonDocument document = QJsonDocument::fromJson(replyData);
+    if (isError || !document.isArray()) {
+        SOCIALD_LOG_ERROR("unable to read batch response for Facebook account with id" << accountId);
+        clearRemovalDetectionLists(accountId); // don't perform server-side removal detection during this sync run.
+        m_incompleteAccounts.insert(accountId);
+        decrementSemaphore(accountId);
+        return;
+    }
+
+    // the responses are in the order of the batched requests.  Requests
+    // which Facebook didn't get to have a null response.
+    QJsonArray responses = document.array();
+    for (int i = 0; i < batchedRequests.size(); ++i) {
+        QVariantMap properties = batchedRequests.at(i).toMap();
+        QString continuationUrl = properties.value(QStringLiteral("continuationUrl")).toString();
+        QString fbUserId = properties.value(QStringLiteral("fbUserId")).toString();
+        QString fbAlbumId = properties.value(QStringLiteral("fbAlbumId")).toString();
+
+        QJsonObject response = responses.at(i).toObject();
+        int httpStatus = static_cast<int>(response.value(QLatin1String("code")).toDouble());
+        bool ok = false;
+        QJsonObject parsed = parseJsonObjectReplyData(response.value(QLatin1String("body")).toString().toUtf8(), &ok);
+        ok = ok && httpStatus == 200;
+
+        if (fbAlbumId.isEmpty()) {
+            storeUser(accountId, ok, parsed);
+            continue;
+        }
+
+        int imageCount = 0;
+        if (ok) {
+            QJsonArray data = parsed.value(QLatin1String("data")).toArray();
+            foreach (const QJsonValue &imageValue, data) {
+                QJsonObject imageObject = imageValue.toObject();
+                if (!imageObject.isEmpty()) {
+                    storeImage(accountId, fbUserId, fbAlbumId, parsePhoto(imageObject));
+                }
+                ++imageCount;
+            }
+        }
+        handlePhotosPage(accountId, accessToken, continuationUrl, fbUserId, fbAlbumId,
+                         ok, httpStatus, parsed, imageCount);
+    }
+
+    // the continuation requests of the albums go into the next batch.
+    flushBatch(accountId, accessToken);
     decrementSemaphore(accountId);
 }
 
@@ -432,7 +876,7 @@ bool FacebookImageSyncAdaptor::initRemovalDetectionLists(int accountId)
     // Clear our internal state variables which we use to track server-side deletions.
     // We have to do it this way, as results can be spread across multiple requests
     // if Facebook returns results in paginated form.
-    clearRemovalDetectionLists();
+    clearRemovalDetectionLists(accountId);
 
     bool ok = false;
     QMap<int,QString> accounts = m_db.accounts(&ok);
@@ -446,7 +890,7 @@ bool FacebookImageSyncAdaptor::initRemovalDetectionLists(int accountId)
         foreach (const QString& albumId, allAlbumIds) {
             FacebookAlbum::ConstPtr album = m_db.album(albumId);
             if (album->fbUserId() == userId) {
-                m_cachedAlbums.insert(albumId, album);
+                m_cachedAlbums[accountId].insert(albumId, album);
             }
         }
     }
@@ -454,21 +898,21 @@ bool FacebookImageSyncAdaptor::initRemovalDetectionLists(int accountId)
     return true;
 }
 
-void FacebookImageSyncAdaptor::clearRemovalDetectionLists()
+void FacebookImageSyncAdaptor::clearRemovalDetectionLists(int accountId)
 {
-    m_cachedAlbums.clear();
-    m_serverImageIds.clear();
-    m_removedImages.clear();
+    m_cachedAlbums.remove(accountId);
+    m_serverImageIds.remove(accountId);
+    m_removedImages.remove(accountId);
 }
 
-void FacebookImageSyncAdaptor::checkRemovedImages(const QString &fbAlbumId)
+void FacebookImageSyncAdaptor::checkRemovedImages(int accountId, const QString &fbAlbumId)
 {
-    const QSet<QString> &serverImageIds = m_serverImageIds.value(fbAlbumId);
+    const QSet<QString> serverImageIds = m_serverImageIds.value(accountId).value(fbAlbumId);
     QSet<QString> cachedImageIds = m_db.imageIds(fbAlbumId).toSet();
 
     foreach (const QString &fbImageId, serverImageIds) {
         cachedImageIds.remove(fbImageId);
     }
 
-    m_removedImages.append(cachedImageIds.toList());
+    m_removedImages[accountId].append(cachedImageIds.toList());
 }
@@ -23,12 +23,15 @@
 #define FACEBOOKIMAGESYNCADAPTOR_H
 
 #include "facebookdatatypesyncadaptor.h"
+#include "socialdfieldprojection_p.h"
+#include "socialdsynccheckpoints_p.h"
 
 #include <QtCore/QObject>
 #include <QtCore/QString>
 #include <QtCore/QDateTime>
 #include <QtCore/QVariantMap>
 #include <QtCore/QList>
+#include <QtCore/QHash>
 #include <QtSql/QSqlDatabase>
 #include <QtNetwork/QNetworkAccessManager>
 #include <QtNetwork/QNetworkReply>
@@ -53,26 +56,86 @@ protected: // implementing FacebookDataTypeSyncAdaptor interface
     void beginSync(int accountId, const QString &accessToken);
     void finalize(int accountId);
 
+    const SocialdFieldProjection &fieldProjection() const;
+
 private:
     void requestData(int accountId, const QString &accessToken, const QString &continuationUrl,
                      const QString &fbUserId, const QString &fbAlbumId);
+    void sendRequest(int accountId, const QString &accessToken, const QString &continuationUrl,
+                     const QString &fbUserId, const QString &fbAlbumId);
+    void handlePhotosPage(int accountId, const QString &accessToken, const QString &continuationUrl,
+                          const QString &fbUserId, const QString &fbAlbumId, bool ok, int httpStatus,
+                          const QJsonObject &parsed, int imageCount);
+    // the fields of a photo which are stored, without the rest of its json.
+    struct ParsedPhoto {
+        ParsedPhoto() : width(0), height(0) {}
+        QString photoId;
+        QString thumbnailUrl;
+        QString imageSrcUrl;
+        QString name;
+        QDateTime createdTime;
+        QDateTime updatedTime;
+        int width;
+        int height;
+    };
+    ParsedPhoto parsePhoto(const QJsonObject &imageObject);
+    void storeImage(int accountId, const QString &fbUserId, const QString &fbAlbumId,
+                    const ParsedPhoto &photo);
     bool haveAlreadyCachedImage(const QString &fbImageId, const QString &imageUrl);
     void possiblyAddNewUser(const QString &fbUserId, int accountId, const QString &accessToken);
-
+    void requestUser(int accountId, const QString &accessToken);
+    void storeUser(int accountId, bool ok, const QJsonObject &parsed);
+    void resumeAlbum(int accountId, const QString &accessToken, const QString &fbUserId, const QString &fbAlbumId);
+    void commitCheckpoints(int accountId);
 
 private Q_SLOTS:
     void albumsFinishedHandler();
     void imagesFinishedHandler();
+    void imageParsedHandler(const QJsonObject &imageObject);
     void userFinishedHandler();
+    void batchFinishedHandler();
 
 private:
-    // for server-side removal detection.
+    // for server-side removal detection, per account as the accounts
+    // may be synced concurrently.
     bool initRemovalDetectionLists(int accountId);
-    void clearRemovalDetectionLists();
-    void checkRemovedImages(const QString &fbAlbumId);
-    QMap<QString, FacebookAlbum::ConstPtr> m_cachedAlbums;
-    QMap<QString, QSet<QString> > m_serverImageIds;
-    QStringList m_removedImages;
+    void clearRemovalDetectionLists(int accountId);
+    void checkRemovedImages(int accountId, const QString &fbAlbumId);
+    QMap<int, QMap<QString, FacebookAlbum::ConstPtr> > m_cachedAlbums;
+    QMap<int, QMap<QString, QSet<QString> > > m_serverImageIds;
+    QMap<int, QStringList> m_removedImages;
+
+    // for resuming albums whose photos were not all retrieved.
+    struct PendingCheckpoint {
+        PendingCheckpoint() : complete(false), restart(false) {}
+        QString fbUserId;
+        QString nextUrl;
+        QStringList imageIds;
+        bool complete;
+        bool restart;
+    };
+    QMap<int, QMap<QString, PendingCheckpoint> > m_pendingCheckpoints;
+    SocialdSyncCheckpoints m_checkpoints;
+    SocialdFieldProjection m_fieldProjection;
+
+    // the photos of a streamed reply, stored once the reply has been validated.
+    QHash<QNetworkReply*, QList<ParsedPhoto> > m_parsedPhotos;
+
+    // the validators of the album list are only stored if none of the
+    // requests for its albums failed.
+    QMap<int, QNetworkReply*> m_albumListReplies;
+    QSet<int> m_incompleteAccounts;
+
+    // for grouping the photo requests and user lookups into Graph batch requests.
+    struct BatchedRequest {
+        QString continuationUrl;
+        QString fbUserId;
+        QString fbAlbumId; // empty for user lookups
+    };
+    int graphBatchSize(int accountId) const;
+    void flushBatch(int accountId, const QString &accessToken);
+    QMap<int, QList<BatchedRequest> > m_batchQueue;
+    QMap<int, QSet<QString> > m_requestedUsers;
 
     FacebookImagesDatabase m_db;
 };
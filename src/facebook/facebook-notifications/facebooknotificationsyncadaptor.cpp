@@ -74,8 +74,8 @@ void FacebookNotificationSyncAdaptor::requestNotifications(int accountId, const
     queryItems.append(QPair<QString, QString>(QString(QLatin1String("locale")), QLocale::system().name()));
     QUrl url(QLatin1String("https://graph.facebook.com/me/notifications"));
     if (pagingToken.isEmpty()) {
-        int sinceSpan = m_accountSyncProfile
-                      ? m_accountSyncProfile->key(Buteo::KEY_SYNC_SINCE_DAYS_PAST, QStringLiteral("7")).toInt()
+        int sinceSpan = accountSyncProfile(accountId)
+                      ? accountSyncProfile(accountId)->key(Buteo::KEY_SYNC_SINCE_DAYS_PAST, QStringLiteral("7")).toInt()
                       : 7;
         queryItems.append(QPair<QString, QString>(QString(QLatin1String("since")),
                           QString::number(QDateTime::currentDateTime().addDays(-1 * sinceSpan).toTime_t())));
@@ -118,8 +118,8 @@ void FacebookNotificationSyncAdaptor::finishedHandler()
     removeReplyTimeout(accountId, reply);
 
     bool ok = false;
-    int sinceSpan = m_accountSyncProfile
-                  ? m_accountSyncProfile->key(Buteo::KEY_SYNC_SINCE_DAYS_PAST, QStringLiteral("7")).toInt()
+    int sinceSpan = accountSyncProfile(accountId)
+                  ? accountSyncProfile(accountId)->key(Buteo::KEY_SYNC_SINCE_DAYS_PAST, QStringLiteral("7")).toInt()
                   : 7;
     QJsonObject parsed = parseJsonObjectReplyData(replyData, &ok);
     if (!isError && ok && parsed.contains(QLatin1String("summary"))) {
@@ -20,6 +20,7 @@
  ****************************************************************************/
 
 #include "facebooksignonsyncadaptor.h"
+#include "socialdnetworkaccessmanager_p.h"
 #include "trace.h"
 
 #include <QtCore/QPair>
@@ -84,7 +85,9 @@ void FacebookSignonSyncAdaptor::beginSync(int accountId, const QString &accessTo
     QUrlQuery query(url);
     query.setQueryItems(queryItems);
     url.setQuery(query);
-    QNetworkReply *reply = m_networkAccessManager->get(QNetworkRequest(url));
+    QNetworkRequest request(url);
+    request.setAttribute(SocialdNetworkAccessManager::RequestPriorityAttribute, SocialdNetworkAccessManager::MetadataPriority);
+    QNetworkReply *reply = m_networkAccessManager->get(request);
 
     if (reply) {
         reply->setProperty("accountId", accountId);
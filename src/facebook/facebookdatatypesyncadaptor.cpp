@@ -56,19 +56,19 @@ void FacebookDataTypeSyncAdaptor::sync(const QString &dataTypeString, int accoun
     if (dataTypeString != SocialNetworkSyncAdaptor::dataTypeName(m_dataType)) {
         SOCIALD_LOG_ERROR("Facebook" << SocialNetworkSyncAdaptor::dataTypeName(m_dataType) <<
                           "sync adaptor was asked to sync" << dataTypeString);
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         return;
     }
 
     if (clientId().isEmpty()) {
         SOCIALD_LOG_ERROR("client id couldn't be retrieved for Facebook account" << accountId);
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         return;
     }
 
     setStatus(SocialNetworkSyncAdaptor::Busy);
     updateDataForAccount(accountId);
-    SOCIALD_LOG_DEBUG("successfully triggered sync with profile:" << m_accountSyncProfile->name());
+    SOCIALD_LOG_DEBUG("successfully triggered sync with profile:" << accountSyncProfile(accountId)->name());
 }
 
 void FacebookDataTypeSyncAdaptor::updateDataForAccount(int accountId)
@@ -76,7 +76,7 @@ void FacebookDataTypeSyncAdaptor::updateDataForAccount(int accountId)
     Accounts::Account *account = m_accountManager->account(accountId);
     if (!account) {
         SOCIALD_LOG_ERROR("existing account with id" << accountId << "couldn't be retrieved");
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         return;
     }
 
@@ -230,7 +230,7 @@ void FacebookDataTypeSyncAdaptor::signOnError(const SignOn::Error &error)
     account->deleteLater();
 
     // if we couldn't sign in, we can't sync with this account.
-    setStatus(SocialNetworkSyncAdaptor::Error);
+    setAccountError(accountId);
     decrementSemaphore(accountId);
 }
 
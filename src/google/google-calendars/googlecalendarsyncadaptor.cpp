@@ -20,6 +20,7 @@
  ****************************************************************************/
 
 #include "googlecalendarsyncadaptor.h"
+#include "socialdnetworkaccessmanager_p.h"
 #include "trace.h"
 
 #include <QtCore/QUrlQuery>
@@ -46,6 +47,60 @@ namespace {
 
 static int GOOGLE_CAL_SYNC_PLUGIN_VERSION = 2;
 
+// the members of the replies which the reply handlers (and jsonToKCal()) read.
+const SocialdFieldProjection::Entry FieldProjection[] = {
+    { "calendarList", "fields", "nextPageToken,items(id,summary,backgroundColor,accessRole)" },
+    { "events", "fields", "nextPageToken,nextSyncToken,updated,"
+                          "items(id,status,summary,description,location,sequence,locked,recurrence,"
+                          "start(date,dateTime),end(date,dateTime))" },
+    { 0, 0, 0 }
+};
+
+const SocialdFieldProjection::ReadField ReadFields[] = {
+    { "calendarList", "nextPageToken" },
+    { "calendarList", "items.id" },
+    { "calendarList", "items.summary" },
+    { "calendarList", "items.backgroundColor" },
+    { "calendarList", "items.accessRole" },
+    { "events", "nextPageToken" },
+    { "events", "nextSyncToken" },
+    { "events", "updated" },
+    { "events", "items.id" },
+    { "events", "items.status" },
+    { "events", "items.summary" },
+    { "events", "items.description" },
+    { "events", "items.location" },
+    { "events", "items.sequence" },
+    { "events", "items.locked" },
+    { "events", "items.recurrence" },
+    { "events", "items.start.date" },
+    { "events", "items.start.dateTime" },
+    { "events", "items.end.date" },
+    { "events", "items.end.dateTime" },
+    { 0, 0 }
+};
+
+// the Calendar API accepts at most 50 calls in one batch request.
+static const int UpsyncBatchSize = 50;
+static const char UpsyncBatchBoundary[] = "sociald_gcal_upsync_batch";
+
+// returns the index of the empty line which ends the headers starting at
+// from, and sets bodyStart to the index of the first byte after it.
+int headerBlockEnd(const QByteArray &data, int from, int *bodyStart)
+{
+    int crlf = data.indexOf("\r\n\r\n", from);
+    int lf = data.indexOf("\n\n", from);
+    if (crlf >= 0 && (lf < 0 || crlf < lf)) {
+        *bodyStart = crlf + 4;
+        return crlf;
+    }
+    if (lf >= 0) {
+        *bodyStart = lf + 2;
+        return lf;
+    }
+    return -1;
+}
+
 QString gCalEventId(KCalCore::Incidence::Ptr event)
 {
     return event->customProperty("jolla-sociald", "gcal-id");
@@ -79,42 +134,6 @@ QJsonArray recurrenceArray(KCalCore::Event::Ptr event, KCalCore::ICalFormat &ica
     return retn;
 }
 
-QJsonObject kCalToJson(KCalCore::Event::Ptr event, KCalCore::ICalFormat &icalFormat)
-{
-    QString eventId = gCalEventId(event);
-    QJsonObject start, end;
-
-    // insert the date/time and timeZone information into the Json object.
-    // note that timeZone is required for recurring events, for some reason.
-    if (event->dtStart().isDateOnly() || (event->allDay() && event->dtStart().time() == QTime(0,0,0))) {
-        start.insert(QLatin1String("date"), event->dtStart().date().toString(QDATEONLY_FORMAT));
-    } else {
-        start.insert(QLatin1String("dateTime"), event->dtStart().toString(RFC3339_FORMAT));
-        start.insert(QLatin1String("timeZone"), QJsonValue(event->dtStart().toString(KLONGTZ_FORMAT)));
-    }
-    if (event->dtEnd().isDateOnly() || (event->allDay() && event->dtEnd().time() == QTime(0,0,0))) {
-        // note: for iCal spec, allDay events need to have an end date of real-end-date+1 as end date is exclusive.
-        end.insert(QLatin1String("date"), event->dateEnd().addDays(1).toString(QDATEONLY_FORMAT));
-    } else {
-        end.insert(QLatin1String("dateTime"), event->dtEnd().toString(RFC3339_FORMAT));
-        end.insert(QLatin1String("timeZone"), QJsonValue(event->dtEnd().toString(KLONGTZ_FORMAT)));
-    }
-
-    QJsonObject retn;
-    if (!eventId.isEmpty()) retn.insert(QLatin1String("id"), eventId);
-    if (event->recurrence()) retn.insert(QLatin1String("recurrence"), recurrenceArray(event, icalFormat));
-    retn.insert(QLatin1String("summary"), event->summary());
-    retn.insert(QLatin1String("description"), event->description());
-    retn.insert(QLatin1String("location"), event->location());
-    retn.insert(QLatin1String("start"), start);
-    retn.insert(QLatin1String("end"), end);
-    retn.insert(QLatin1String("sequence"), QString::number(event->revision()+1));
-    //retn.insert(QLatin1String("locked"), event->readOnly()); // only allow locking server-side.
-    // we may wish to support locking/readonly from local side also, in the future.
-
-    return retn;
-}
-
 void extractStartAndEnd(const QJsonObject &eventData,
                         bool *startExists,
                         bool *endExists,
@@ -261,32 +280,11 @@ void extractRecurrence(const QJsonArray &recurrence, KCalCore::Event::Ptr event,
     }
 }
 
-void jsonToKCal(const QJsonObject &json, KCalCore::Event::Ptr event, KCalCore::ICalFormat &icalFormat)
+QString gcalSettingsFileName()
 {
-    KDateTime start, end;
-    bool startExists = false, endExists = false;
-    bool startIsDateOnly = false, endIsDateOnly = false;
-    bool isAllDay = false;
-    extractStartAndEnd(json, &startExists, &endExists, &startIsDateOnly, &endIsDateOnly, &isAllDay, &start, &end);
-    setGCalEventId(event, json.value(QLatin1String("id")).toVariant().toString());
-    extractRecurrence(json.value(QLatin1String("recurrence")).toArray(), event, icalFormat);
-    event->setReadOnly(json.value(QLatin1String("locked")).toVariant().toBool());
-    event->setSummary(json.value(QLatin1String("summary")).toVariant().toString());
-    event->setDescription(json.value(QLatin1String("description")).toVariant().toString());
-    event->setLocation(json.value(QLatin1String("location")).toVariant().toString());
-    event->setRevision(json.value(QLatin1String("sequence")).toVariant().toInt());
-    if (startExists) {
-        event->setDtStart(start);
-    }
-    if (endExists) {
-        event->setHasEndDate(true);
-        event->setDtEnd(end);
-    } else {
-        event->setHasEndDate(false);
-    }
-    if (isAllDay) {
-        event->setAllDay(isAllDay);
-    }
+    return QString::fromLatin1("%1/%2/gcal.ini")
+            .arg(QString::fromLatin1(PRIVILEGED_DATA_DIR))
+            .arg(QString::fromLatin1(SYNC_DATABASE_DIR));
 }
 
 // returns true if the last sync was marked as successful, and then marks the current
@@ -294,10 +292,7 @@ void jsonToKCal(const QJsonObject &json, KCalCore::Event::Ptr event, KCalCore::I
 // once sync succeeds.
 bool wasLastSyncSuccessful(int accountId)
 {
-    QString settingsFileName = QString::fromLatin1("%1/%2/gcal.ini")
-            .arg(QString::fromLatin1(PRIVILEGED_DATA_DIR))
-            .arg(QString::fromLatin1(SYNC_DATABASE_DIR));
-    QSettings settingsFile(settingsFileName, QSettings::IniFormat);
+    QSettings settingsFile(gcalSettingsFileName(), QSettings::IniFormat);
     bool retn = settingsFile.value(QString::fromLatin1("%1-success").arg(accountId), QVariant::fromValue<bool>(false)).toBool();
     settingsFile.setValue(QString::fromLatin1("%1-success").arg(accountId), QVariant::fromValue<bool>(false));
     int pluginVersion = settingsFile.value(QString::fromLatin1("%1-pluginVersion").arg(accountId), QVariant::fromValue<int>(1)).toInt();
@@ -312,16 +307,107 @@ bool wasLastSyncSuccessful(int accountId)
 
 void setLastSyncSuccessful(QList<int> accountIds)
 {
-    QString settingsFileName = QString::fromLatin1("%1/%2/gcal.ini")
-            .arg(QString::fromLatin1(PRIVILEGED_DATA_DIR))
-            .arg(QString::fromLatin1(SYNC_DATABASE_DIR));
-    QSettings settingsFile(settingsFileName, QSettings::IniFormat);
+    QSettings settingsFile(gcalSettingsFileName(), QSettings::IniFormat);
     Q_FOREACH(int accountId, accountIds) {
         settingsFile.setValue(QString::fromLatin1("%1-success").arg(accountId), QVariant::fromValue<bool>(true));
     }
     settingsFile.sync();
 }
 
+// the nextSyncToken of the last complete event listing of each calendar,
+// from which the next sync requests only the events changed since.
+QString eventSyncToken(int accountId, const QString &calendarId)
+{
+    QSettings settingsFile(gcalSettingsFileName(), QSettings::IniFormat);
+    settingsFile.beginGroup(QString::fromLatin1("%1-syncTokens").arg(accountId));
+    return settingsFile.value(calendarId).toString();
+}
+
+// an empty syncToken removes the token of the calendar.
+void setEventSyncToken(int accountId, const QString &calendarId, const QString &syncToken)
+{
+    QSettings settingsFile(gcalSettingsFileName(), QSettings::IniFormat);
+    settingsFile.beginGroup(QString::fromLatin1("%1-syncTokens").arg(accountId));
+    if (syncToken.isEmpty()) {
+        settingsFile.remove(calendarId);
+    } else {
+        settingsFile.setValue(calendarId, syncToken);
+    }
+    settingsFile.endGroup();
+    settingsFile.sync();
+}
+
+void removeEventSyncTokens(int accountId)
+{
+    QSettings settingsFile(gcalSettingsFileName(), QSettings::IniFormat);
+    settingsFile.remove(QString::fromLatin1("%1-syncTokens").arg(accountId));
+    settingsFile.sync();
+}
+
+}
+
+QJsonObject GoogleCalendarSyncAdaptor::kCalToJson(KCalCore::Event::Ptr event, KCalCore::ICalFormat &icalFormat)
+{
+    QString eventId = gCalEventId(event);
+    QJsonObject start, end;
+
+    // insert the date/time and timeZone information into the Json object.
+    // note that timeZone is required for recurring events, for some reason.
+    if (event->dtStart().isDateOnly() || (event->allDay() && event->dtStart().time() == QTime(0,0,0))) {
+        start.insert(QLatin1String("date"), event->dtStart().date().toString(QDATEONLY_FORMAT));
+    } else {
+        start.insert(QLatin1String("dateTime"), event->dtStart().toString(RFC3339_FORMAT));
+        start.insert(QLatin1String("timeZone"), QJsonValue(event->dtStart().toString(KLONGTZ_FORMAT)));
+    }
+    if (event->dtEnd().isDateOnly() || (event->allDay() && event->dtEnd().time() == QTime(0,0,0))) {
+        // note: for iCal spec, allDay events need to have an end date of real-end-date+1 as end date is exclusive.
+        end.insert(QLatin1String("date"), event->dateEnd().addDays(1).toString(QDATEONLY_FORMAT));
+    } else {
+        end.insert(QLatin1String("dateTime"), event->dtEnd().toString(RFC3339_FORMAT));
+        end.insert(QLatin1String("timeZone"), QJsonValue(event->dtEnd().toString(KLONGTZ_FORMAT)));
+    }
+
+    QJsonObject retn;
+    if (!eventId.isEmpty()) retn.insert(QLatin1String("id"), eventId);
+    if (event->recurrence()) retn.insert(QLatin1String("recurrence"), recurrenceArray(event, icalFormat));
+    retn.insert(QLatin1String("summary"), event->summary());
+    retn.insert(QLatin1String("description"), event->description());
+    retn.insert(QLatin1String("location"), event->location());
+    retn.insert(QLatin1String("start"), start);
+    retn.insert(QLatin1String("end"), end);
+    retn.insert(QLatin1String("sequence"), QString::number(event->revision()+1));
+    //retn.insert(QLatin1String("locked"), event->readOnly()); // only allow locking server-side.
+    // we may wish to support locking/readonly from local side also, in the future.
+
+    return retn;
+}
+
+void GoogleCalendarSyncAdaptor::jsonToKCal(const QJsonObject &json, KCalCore::Event::Ptr event, KCalCore::ICalFormat &icalFormat)
+{
+    KDateTime start, end;
+    bool startExists = false, endExists = false;
+    bool startIsDateOnly = false, endIsDateOnly = false;
+    bool isAllDay = false;
+    extractStartAndEnd(json, &startExists, &endExists, &startIsDateOnly, &endIsDateOnly, &isAllDay, &start, &end);
+    setGCalEventId(event, json.value(QLatin1String("id")).toVariant().toString());
+    extractRecurrence(json.value(QLatin1String("recurrence")).toArray(), event, icalFormat);
+    event->setReadOnly(json.value(QLatin1String("locked")).toVariant().toBool());
+    event->setSummary(json.value(QLatin1String("summary")).toVariant().toString());
+    event->setDescription(json.value(QLatin1String("description")).toVariant().toString());
+    event->setLocation(json.value(QLatin1String("location")).toVariant().toString());
+    event->setRevision(json.value(QLatin1String("sequence")).toVariant().toInt());
+    if (startExists) {
+        event->setDtStart(start);
+    }
+    if (endExists) {
+        event->setHasEndDate(true);
+        event->setDtEnd(end);
+    } else {
+        event->setHasEndDate(false);
+    }
+    if (isAllDay) {
+        event->setAllDay(isAllDay);
+    }
 }
 
 GoogleCalendarSyncAdaptor::GoogleCalendarSyncAdaptor(QObject *parent)
@@ -329,6 +415,8 @@ GoogleCalendarSyncAdaptor::GoogleCalendarSyncAdaptor(QObject *parent)
     , m_calendar(mKCal::ExtendedCalendar::Ptr(new mKCal::ExtendedCalendar(QLatin1String("UTC"))))
     , m_storage(mKCal::ExtendedCalendar::defaultStorage(m_calendar))
     , m_storageNeedsSave(false)
+    , m_checkpoints(QLatin1String("google"), SocialNetworkSyncAdaptor::dataTypeName(SocialNetworkSyncAdaptor::Calendars))
+    , m_fieldProjection(FieldProjection, ReadFields)
 {
     setInitialActive(m_idDb.isValid());
 }
@@ -342,23 +430,121 @@ QString GoogleCalendarSyncAdaptor::syncServiceName() const
     return QStringLiteral("google-calendars");
 }
 
+// splits a multipart/mixed batch response into the HTTP status and body
+// of each call, keyed by the index given in the Content-ID of its request.
+// Calls whose part is missing or malformed have no entry.
+QMap<int, QPair<int, QByteArray> > GoogleCalendarSyncAdaptor::parseBatchResponse(const QByteArray &contentType, const QByteArray &data)
+{
+    QMap<int, QPair<int, QByteArray> > retn;
+    int boundaryStart = contentType.indexOf("boundary=");
+    if (boundaryStart < 0) {
+        return retn;
+    }
+
+    QByteArray boundary = contentType.mid(boundaryStart + 9);
+    int boundaryEnd = boundary.indexOf(';');
+    if (boundaryEnd >= 0) {
+        boundary.truncate(boundaryEnd);
+    }
+    boundary = boundary.trimmed();
+    if (boundary.size() > 1 && boundary.startsWith('"') && boundary.endsWith('"')) {
+        boundary = boundary.mid(1, boundary.size() - 2);
+    }
+
+    const QByteArray delimiter = "--" + boundary;
+    int partStart = data.indexOf(delimiter);
+    while (partStart >= 0) {
+        partStart += delimiter.size();
+        if (data.mid(partStart, 2) == "--") {
+            break; // the closing delimiter
+        }
+        int partEnd = data.indexOf(delimiter, partStart);
+        if (partEnd < 0) {
+            break;
+        }
+        const QByteArray part = data.mid(partStart, partEnd - partStart);
+        partStart = partEnd;
+
+        // the part headers identify the call, the part body is its HTTP response.
+        int responseStart = 0;
+        int partHeadersEnd = headerBlockEnd(part, 0, &responseStart);
+        if (partHeadersEnd < 0) {
+            continue;
+        }
+        const QByteArray partHeaders = part.left(partHeadersEnd);
+        int idStart = partHeaders.indexOf("response-item-");
+        if (idStart < 0) {
+            continue;
+        }
+        idStart += 14;
+        int idEnd = idStart;
+        while (idEnd < partHeaders.size() && partHeaders.at(idEnd) >= '0' && partHeaders.at(idEnd) <= '9') {
+            ++idEnd;
+        }
+        bool ok = false;
+        int item = partHeaders.mid(idStart, idEnd - idStart).toInt(&ok);
+        if (!ok) {
+            continue;
+        }
+
+        // eg. "HTTP/1.1 200 OK"
+        int statusLineEnd = part.indexOf('\n', responseStart);
+        const QList<QByteArray> statusLine = part.mid(responseStart, statusLineEnd < 0 ? -1 : statusLineEnd - responseStart)
+                                                 .trimmed().split(' ');
+        int httpStatus = statusLine.size() > 1 ? statusLine.at(1).toInt() : 0;
+        int bodyStart = 0;
+        QByteArray body = headerBlockEnd(part, responseStart, &bodyStart) < 0
+                        ? QByteArray()
+                        : part.mid(bodyStart).trimmed();
+        retn.insert(item, qMakePair(httpStatus, body));
+    }
+
+    return retn;
+}
+
+const SocialdFieldProjection &GoogleCalendarSyncAdaptor::fieldProjection() const
+{
+    return m_fieldProjection;
+}
+
 void GoogleCalendarSyncAdaptor::sync(const QString &dataTypeString, int accountId)
 {
-    m_storageNeedsSave = false;
-    m_storage->open(); // we close it in finalCleanup()
+    openStorage();
     GoogleDataTypeSyncAdaptor::sync(dataTypeString, accountId);
 }
 
+void GoogleCalendarSyncAdaptor::openStorage()
+{
+    // when several accounts are synced in one run, the storage is
+    // opened (and later saved) once for all of them.
+    if (status() != SocialNetworkSyncAdaptor::Busy) {
+        m_storageNeedsSave = false;
+        m_storage->open(); // we close it in finalCleanup()
+    }
+}
+
 void GoogleCalendarSyncAdaptor::finalCleanup()
 {
     // commit changes to db
+    bool saved = true;
     if (m_storageNeedsSave) {
-        m_storage->save();
+        saved = m_storage->save();
     }
     m_storage->close();
     m_idDb.sync();
     m_idDb.wait();
 
+    // the notebooks now reflect the calendar lists, so later syncs
+    // need only fetch a calendar list if it has changed.
+    QMap<int, QNetworkReply*>::const_iterator it = m_calendarListReplies.constBegin();
+    for ( ; it != m_calendarListReplies.constEnd(); ++it) {
+        if (saved && m_syncSucceeded.value(it.key())) {
+            commitValidators(it.value());
+        }
+        it.value()->deleteLater();
+    }
+    m_calendarListReplies.clear();
+
     // set the success status for each of our account settings.
     QList<int> succeededAccounts;
     Q_FOREACH (int accountId, m_syncSucceeded.keys()) {
@@ -400,8 +586,10 @@ void GoogleCalendarSyncAdaptor::purgeDataForOldAccount(int oldId, SocialNetworkS
     // Delete ids from our local->remote id mapping
     m_idDb.removeEvents(oldId);
 
-    // Delete last update times
+    // Delete last update times and sync tokens
     m_idDb.removeLastUpdateTimes(oldId);
+    removeEventSyncTokens(oldId);
+    m_checkpoints.removeAll(oldId);
 
     if (mode == SocialNetworkSyncAdaptor::CleanUpPurge) {
         // and commit any changes made.
@@ -420,7 +608,8 @@ void GoogleCalendarSyncAdaptor::beginSync(int accountId, const QString &accessTo
     requestCalendars(accountId, accessToken, needCleanSync);
 }
 
-void GoogleCalendarSyncAdaptor::requestCalendars(int accountId, const QString &accessToken, bool needCleanSync, const QString &pageToken)
+void GoogleCalendarSyncAdaptor::requestCalendars(int accountId, const QString &accessToken, bool needCleanSync,
+                                                 const QString &pageToken, bool conditional)
 {
     QList<QPair<QString, QString> > queryItems;
     queryItems.append(QPair<QString, QString>(QString::fromLatin1("key"), accessToken));
@@ -428,6 +617,7 @@ void GoogleCalendarSyncAdaptor::requestCalendars(int accountId, const QString &a
         queryItems.append(QPair<QString, QString>(QString::fromLatin1("pageToken"),
                                                   pageToken));
     }
+    m_fieldProjection.apply(QStringLiteral("calendarList"), &queryItems);
 
     QUrl url(QLatin1String("https://www.googleapis.com/calendar/v3/users/me/calendarList"));
     QUrlQuery query(url);
@@ -438,6 +628,11 @@ void GoogleCalendarSyncAdaptor::requestCalendars(int accountId, const QString &a
     request.setRawHeader("GData-Version", "3.0");
     request.setRawHeader(QString(QLatin1String("Authorization")).toUtf8(),
                          QString(QLatin1String("Bearer ") + accessToken).toUtf8());
+    request.setAttribute(SocialdNetworkAccessManager::RequestPriorityAttribute, SocialdNetworkAccessManager::MetadataPriority);
+    if (conditional && !needCleanSync && pageToken.isEmpty()) {
+        // the local notebooks reflect the calendar list as of the last successful sync.
+        request.setAttribute(SocialdNetworkAccessManager::ConditionalRequestAttribute, true);
+    }
 
     QNetworkReply *reply = m_networkAccessManager->get(request);
 
@@ -448,6 +643,7 @@ void GoogleCalendarSyncAdaptor::requestCalendars(int accountId, const QString &a
         reply->setProperty("accountId", accountId);
         reply->setProperty("accessToken", accessToken);
         reply->setProperty("needCleanSync", QVariant::fromValue<bool>(needCleanSync));
+        reply->setProperty("pageToken", pageToken);
         connect(reply, SIGNAL(error(QNetworkReply::NetworkError)),
                 this, SLOT(errorHandler(QNetworkReply::NetworkError)));
         connect(reply, SIGNAL(sslErrors(QList<QSslError>)),
@@ -470,16 +666,42 @@ void GoogleCalendarSyncAdaptor::calendarsFinishedHandler()
     bool needCleanSync = reply->property("needCleanSync").toBool();
     QByteArray replyData = reply->readAll();
     bool isError = reply->property("isError").toBool();
+    bool unchanged = !isError && isUnchangedReply(reply);
+    bool firstPage = reply->property("pageToken").toString().isEmpty();
 
     disconnect(reply);
-    reply->deleteLater();
     removeReplyTimeout(accountId, reply);
+    if (!unchanged && firstPage) {
+        // the validators are only stored once the calendar list has been merged (see finalCleanup()).
+        delete m_calendarListReplies.take(accountId);
+        m_calendarListReplies.insert(accountId, reply);
+    } else {
+        reply->deleteLater();
+    }
+
+    if (unchanged) {
+        // nothing has changed server-side since the last successful sync,
+        // so there is no need to merge the calendar list into the local notebooks.
+        if (loadLocalCalendarNotebooks(accountId)) {
+            SOCIALD_LOG_DEBUG("calendar list unchanged for Google account" << accountId);
+            foreach (const QString &calendarId, m_serverCalendarIdToSummaryAndColor[accountId].keys()) {
+                requestEvents(accountId, accessToken, calendarId, needCleanSync);
+            }
+        } else {
+            // the local notebooks are missing; fetch the full calendar list.
+            requestCalendars(accountId, accessToken, needCleanSync, QString(), false);
+        }
+        decrementSemaphore(accountId);
+        return;
+    }
 
     // parse the calendars' metadata from the response.
     bool fetchingNextPage = false;
     bool ok = false;
     QJsonObject parsed = parseJsonObjectReplyData(replyData, &ok);
     if (!isError && ok) {
+        m_fieldProjection.validate(QStringLiteral("calendarList"), parsed);
+
         // first, check to see if there are more pages of calendars to fetch
         if (parsed.find(QLatin1String("nextPageToken")) != parsed.end()
                 && !parsed.value(QLatin1String("nextPageToken")).toVariant().toString().isEmpty()) {
@@ -559,6 +781,8 @@ void GoogleCalendarSyncAdaptor::updateLocalCalendarNotebooks(int accountId, cons
                 }
                 m_storage->deleteNotebook(notebook);
                 m_storageNeedsSave = true;
+                m_checkpoints.remove(accountId, currDeviceCalendarId);
+                setEventSyncToken(accountId, currDeviceCalendarId, QString());
             }
         }
     }
@@ -586,45 +810,95 @@ void GoogleCalendarSyncAdaptor::updateLocalCalendarNotebooks(int accountId, cons
     }
 }
 
+// fills the server calendar information from the local notebooks of the account.
+// returns false if the account has no local notebooks.
+bool GoogleCalendarSyncAdaptor::loadLocalCalendarNotebooks(int accountId)
+{
+    foreach (mKCal::Notebook::Ptr notebook, m_storage->notebooks()) {
+        if (notebook->pluginName().startsWith(QStringLiteral("google-"))
+                && notebook->account() == QString::number(accountId)) {
+            QPair<QString, QString> summaryAndColor(notebook->name(), notebook->color());
+            m_serverCalendarIdToSummaryAndColor[accountId].insert(notebook->pluginName().mid(7), summaryAndColor);
+        }
+    }
+
+    return !m_serverCalendarIdToSummaryAndColor[accountId].isEmpty();
+}
+
 void GoogleCalendarSyncAdaptor::requestEvents(int accountId, const QString &accessToken, const QString &calendarId,
                                               bool needCleanSync, const QString &pageToken)
 {
-    QString updatedMin = m_idDb.lastUpdateTime(calendarId, accountId);
-    if (updatedMin.isEmpty()) {
-        QDateTime buteoLastSync = lastSyncTimestamp(QLatin1String("google"),
-                                                    SocialNetworkSyncAdaptor::dataTypeName(SocialNetworkSyncAdaptor::Calendars),
-                                                    accountId).addSecs(2); // add 2 secs to avoid fs sync time issues.
-        updatedMin = buteoLastSync.toUTC().toString(Qt::ISODate);
-        SOCIALD_LOG_DEBUG("No previous update timestamp for Google account: " << accountId
-                          << ". Calendar Id: " << calendarId
-                          << ". Using previous buteo sync timestamp: " << updatedMin);
+    QString updatedMin;
+    QString syncToken = needCleanSync ? QString() : eventSyncToken(accountId, calendarId);
+    QString timeMin = QDateTime::currentDateTimeUtc().addMonths(-3).toString(Qt::ISODate);
+    QString timeMax = QDateTime::currentDateTimeUtc().addMonths(12).toString(Qt::ISODate);
+    QString nextPageToken = pageToken;
+    if (pageToken.isEmpty() && m_checkpoints.contains(accountId, calendarId)) {
+        // a previous sync was interrupted while paging through the events of this calendar.
+        // The page token is only valid for the same query, so repeat that query
+        // (including whether it was a clean sync) and reload the events already received.
+        QVariantMap cursor = m_checkpoints.cursor(accountId, calendarId);
+        nextPageToken = cursor.value(QStringLiteral("pageToken")).toString();
+        updatedMin = cursor.value(QStringLiteral("updatedMin")).toString();
+        syncToken = cursor.value(QStringLiteral("syncToken")).toString();
+        timeMin = cursor.value(QStringLiteral("timeMin")).toString();
+        timeMax = cursor.value(QStringLiteral("timeMax")).toString();
+        needCleanSync = cursor.value(QStringLiteral("needCleanSync")).toBool();
+
+        QList<QByteArray> pages = m_checkpoints.pages(accountId, calendarId);
+        foreach (const QByteArray &page, pages) {
+            QJsonArray dataList = QJsonDocument::fromJson(page).array();
+            foreach (const QJsonValue &item, dataList) {
+                m_calendarIdToEventObjects[accountId].insertMulti(calendarId, item.toObject());
+            }
+        }
+        SOCIALD_LOG_DEBUG("resuming event sync for Google account:" << accountId << ". Calendar Id:" << calendarId
+                          << "after" << pages.size() << "pages");
+    } else if (!syncToken.isEmpty()) {
+        SOCIALD_LOG_DEBUG("Using sync token for Google account:" << accountId << ". Calendar Id:" << calendarId);
     } else {
-        // server timestamp is inclusive. Add one second to exclude events updated on previous round
-        QDateTime modified = QDateTime::fromString(updatedMin, Qt::ISODate);
-        modified.setTimeSpec(Qt::UTC);
-        updatedMin = modified.addSecs(1).toString(Qt::ISODate);
-        SOCIALD_LOG_DEBUG("Previous update timestamp for Google account: "
-                          <<  accountId << ". Calendar Id: "
-                          << calendarId << ". Timestamp: " << updatedMin);
+        updatedMin = m_idDb.lastUpdateTime(calendarId, accountId);
+        if (updatedMin.isEmpty()) {
+            QDateTime buteoLastSync = lastSyncTimestamp(QLatin1String("google"),
+                                                        SocialNetworkSyncAdaptor::dataTypeName(SocialNetworkSyncAdaptor::Calendars),
+                                                        accountId).addSecs(2); // add 2 secs to avoid fs sync time issues.
+            updatedMin = buteoLastSync.toUTC().toString(Qt::ISODate);
+            SOCIALD_LOG_DEBUG("No previous update timestamp for Google account: " << accountId
+                              << ". Calendar Id: " << calendarId
+                              << ". Using previous buteo sync timestamp: " << updatedMin);
+        } else {
+            // server timestamp is inclusive. Add one second to exclude events updated on previous round
+            QDateTime modified = QDateTime::fromString(updatedMin, Qt::ISODate);
+            modified.setTimeSpec(Qt::UTC);
+            updatedMin = modified.addSecs(1).toString(Qt::ISODate);
+            SOCIALD_LOG_DEBUG("Previous update timestamp for Google account: "
+                              <<  accountId << ". Calendar Id: "
+                              << calendarId << ". Timestamp: " << updatedMin);
+        }
     }
 
     QList<QPair<QString, QString> > queryItems;
     queryItems.append(QPair<QString, QString>(QString::fromLatin1("key"),
                                               accessToken));
-    if (!needCleanSync && !updatedMin.isEmpty()) {
-        // we're doing a delta update.  We set the "since" field, and request deletions be shown.
-        queryItems.append(QPair<QString, QString>(QString::fromLatin1("updatedMin"), updatedMin));
-        queryItems.append(QPair<QString, QString>(QString::fromLatin1("showDeleted"),
-                                                  QString::fromLatin1("true")));
+    if (!needCleanSync && !syncToken.isEmpty()) {
+        // we're doing a delta update from the previous listing.  The server
+        // includes deletions, and doesn't accept the time range with a sync token.
+        queryItems.append(QPair<QString, QString>(QString::fromLatin1("syncToken"), syncToken));
+    } else {
+        if (!needCleanSync && !updatedMin.isEmpty()) {
+            // we're doing a delta update.  We set the "since" field, and request deletions be shown.
+            queryItems.append(QPair<QString, QString>(QString::fromLatin1("updatedMin"), updatedMin));
+            queryItems.append(QPair<QString, QString>(QString::fromLatin1("showDeleted"),
+                                                      QString::fromLatin1("true")));
+        }
+        queryItems.append(QPair<QString, QString>(QString::fromLatin1("timeMin"), timeMin));
+        queryItems.append(QPair<QString, QString>(QString::fromLatin1("timeMax"), timeMax));
     }
-    queryItems.append(QPair<QString, QString>(QString::fromLatin1("timeMin"),
-                                              QDateTime::currentDateTimeUtc().addMonths(-3).toString(Qt::ISODate)));
-    queryItems.append(QPair<QString, QString>(QString::fromLatin1("timeMax"),
-                                              QDateTime::currentDateTimeUtc().addMonths(12).toString(Qt::ISODate)));
-    if (!pageToken.isEmpty()) { // continuation request
+    if (!nextPageToken.isEmpty()) { // continuation request
         queryItems.append(QPair<QString, QString>(QString::fromLatin1("pageToken"),
-                                                  pageToken));
+                                                  nextPageToken));
     }
+    m_fieldProjection.apply(QStringLiteral("events"), &queryItems);
 
     QUrl url(QString::fromLatin1("https://www.googleapis.com/calendar/v3/calendars/%1/events").arg(calendarId));
     QUrlQuery query(url);
@@ -646,6 +920,11 @@ void GoogleCalendarSyncAdaptor::requestEvents(int accountId, const QString &acce
         reply->setProperty("accessToken", accessToken);
         reply->setProperty("calendarId", calendarId);
         reply->setProperty("needCleanSync", needCleanSync);
+        reply->setProperty("pageToken", nextPageToken);
+        reply->setProperty("updatedMin", updatedMin);
+        reply->setProperty("syncToken", syncToken);
+        reply->setProperty("timeMin", timeMin);
+        reply->setProperty("timeMax", timeMax);
         connect(reply, SIGNAL(error(QNetworkReply::NetworkError)),
                 this, SLOT(errorHandler(QNetworkReply::NetworkError)));
         connect(reply, SIGNAL(sslErrors(QList<QSslError>)),
@@ -670,6 +949,14 @@ void GoogleCalendarSyncAdaptor::eventsFinishedHandler()
     QString calendarId = reply->property("calendarId").toString();
     QString accessToken = reply->property("accessToken").toString();
     bool needCleanSync = reply->property("needCleanSync").toBool();
+    QString pageToken = reply->property("pageToken").toString();
+    QVariantMap query;
+    query.insert(QStringLiteral("needCleanSync"), needCleanSync);
+    query.insert(QStringLiteral("updatedMin"), reply->property("updatedMin"));
+    query.insert(QStringLiteral("syncToken"), reply->property("syncToken"));
+    query.insert(QStringLiteral("timeMin"), reply->property("timeMin"));
+    query.insert(QStringLiteral("timeMax"), reply->property("timeMax"));
+    int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
     QByteArray replyData = reply->readAll();
     bool isError = reply->property("isError").toBool();
 
@@ -677,20 +964,30 @@ void GoogleCalendarSyncAdaptor::eventsFinishedHandler()
     reply->deleteLater();
     removeReplyTimeout(accountId, reply);
 
+    if (httpStatus == 410 && !query.value(QStringLiteral("syncToken")).toString().isEmpty()) {
+        // the sync token has expired.  Google requires a full sync of the calendar.
+        SOCIALD_LOG_INFO("sync token of calendar" << calendarId << "from Google account" << accountId <<
+                         "has expired, performing clean sync");
+        setEventSyncToken(accountId, calendarId, QString());
+        m_checkpoints.remove(accountId, calendarId);
+        m_calendarIdToEventObjects[accountId].remove(calendarId);
+        requestEvents(accountId, accessToken, calendarId, true);
+        decrementSemaphore(accountId);
+        return;
+    }
+
     bool fetchingNextPage = false;
     bool ok = false;
     QString updated;
+    QString nextSyncToken;
     QJsonObject parsed = parseJsonObjectReplyData(replyData, &ok);
     if (!isError && ok) {
-        // If there are more pages of results to fetch, ensure we fetch them
-        if (parsed.find(QLatin1String("nextPageToken")) != parsed.end()
-                && !parsed.value(QLatin1String("nextPageToken")).toVariant().toString().isEmpty()) {
-            fetchingNextPage = true;
-            requestEvents(accountId, accessToken, calendarId, needCleanSync,
-                          parsed.value(QLatin1String("nextPageToken")).toVariant().toString());
-        }
+        m_fieldProjection.validate(QStringLiteral("events"), parsed);
 
+        // If there are more pages of results to fetch, ensure we fetch them
+        QString nextPageToken = parsed.value(QLatin1String("nextPageToken")).toVariant().toString();
         updated = parsed.value(QLatin1String("updated")).toVariant().toString();
+        nextSyncToken = parsed.value(QLatin1String("nextSyncToken")).toString(); // only on the last page
 
         // Parse the event list
         QJsonArray dataList = parsed.value(QLatin1String("items")).toArray();
@@ -700,11 +997,37 @@ void GoogleCalendarSyncAdaptor::eventsFinishedHandler()
             // otherwise, we queue the event for insertion into the database.
             m_calendarIdToEventObjects[accountId].insertMulti(calendarId, eventData);
         }
+
+        if (!nextPageToken.isEmpty()) {
+            // checkpoint the events received so far, so that an interrupted sync
+            // doesn't need to fetch this page again.  The calendar's "updated"
+            // timestamp of the first page is kept, as later pages may reflect
+            // changes made to events which were on the earlier pages.
+            QVariantMap cursor(query);
+            QVariantMap previousCursor = m_checkpoints.cursor(accountId, calendarId);
+            cursor.insert(QStringLiteral("pageToken"), nextPageToken);
+            cursor.insert(QStringLiteral("updated"), previousCursor.contains(QStringLiteral("updated"))
+                                                     ? previousCursor.value(QStringLiteral("updated")).toString()
+                                                     : updated);
+            m_checkpoints.save(accountId, calendarId, cursor,
+                               QList<QByteArray>() << QJsonDocument(dataList).toJson(QJsonDocument::Compact));
+
+            fetchingNextPage = true;
+            requestEvents(accountId, accessToken, calendarId, needCleanSync, nextPageToken);
+        }
     } else {
         // error occurred during request.
         SOCIALD_LOG_ERROR("unable to parse event data from request with account" << accountId << ";"
                           "got:" << QString::fromLatin1(replyData.constData()));
         m_syncSucceeded[accountId] = false;
+        if (!pageToken.isEmpty() && (httpStatus == 400 || httpStatus == 410)) {
+            // the page token has expired; fetch the calendar from the first page next time.
+            m_checkpoints.remove(accountId, calendarId);
+        }
+        // don't apply the events of the previous pages, they will be resumed by the next sync.
+        m_calendarIdToEventObjects[accountId].remove(calendarId);
+        decrementSemaphore(accountId);
+        return;
     }
 
     if (!fetchingNextPage) {
@@ -716,10 +1039,18 @@ void GoogleCalendarSyncAdaptor::eventsFinishedHandler()
                                                             SocialNetworkSyncAdaptor::dataTypeName(SocialNetworkSyncAdaptor::Calendars),
                                                             accountId).addSecs(2); // add 2 secs to avoid fs sync time issues.
 
+        if (m_checkpoints.contains(accountId, calendarId)) {
+            // the events were received over several pages (and possibly several syncs).
+            updated = m_checkpoints.cursor(accountId, calendarId).value(QStringLiteral("updated")).toString();
+            m_checkpoints.remove(accountId, calendarId);
+        }
         if (!updated.isEmpty()) {
             m_idDb.setLastUpdateTime(calendarId, accountId, updated);
             SOCIALD_LOG_ERROR("Setting updated timestamp for Google account: " << accountId << ". Calendar Id: " << calendarId << ".  Timestamp: " << updated);
         }
+        if (!nextSyncToken.isEmpty()) {
+            setEventSyncToken(accountId, calendarId, nextSyncToken);
+        }
         updateLocalCalendarNotebookEvents(accountId, accessToken, calendarId, since);
     }
 
@@ -866,17 +1197,19 @@ void GoogleCalendarSyncAdaptor::updateLocalCalendarNotebookEvents(int accountId,
                      "remote A/M/R:" << remoteAdded << "/" << remoteModified << "/" << remoteRemoved);
 
     // only upsync changes if we're doing a delta sync, and upsync is enabled
-    if (!m_accountSyncProfile || m_accountSyncProfile->syncDirection() != Buteo::SyncProfile::SYNC_DIRECTION_FROM_REMOTE) {
+    Buteo::SyncProfile *syncProfile = accountSyncProfile(accountId);
+    if (!syncProfile || syncProfile->syncDirection() != Buteo::SyncProfile::SYNC_DIRECTION_FROM_REMOTE) {
         if (since.isValid()) {
-            // And push our changes up to the server.  XXX TODO: Request Batching!
+            // And push our changes up to the server, batching them where possible.
             int localAdded = 0, localModified = 0, localRemoved = 0;
+            QList<UpsyncChange> changes;
 
             // first, push up deletions.
             Q_FOREACH (const QString &deletedGcalId, deletedMap.keys()) {
                 QString incidenceUid = deletedMap.value(deletedGcalId);
                 localRemoved++;
-                upsyncChanges(accountId, accessToken, GoogleCalendarSyncAdaptor::UpsyncDelete,
-                              incidenceUid, calendarId, deletedGcalId, QByteArray());
+                UpsyncChange change = { GoogleCalendarSyncAdaptor::UpsyncDelete, incidenceUid, deletedGcalId, QByteArray() };
+                changes.append(change);
             }
 
             // second, push up modifications.
@@ -884,8 +1217,9 @@ void GoogleCalendarSyncAdaptor::updateLocalCalendarNotebookEvents(int accountId,
                 KCalCore::Event::Ptr event = updatedMap.value(updatedGcalId);
                 if (event) {
                     localModified++;
-                    upsyncChanges(accountId, accessToken, GoogleCalendarSyncAdaptor::UpsyncModify,
-                                  event->uid(), calendarId, updatedGcalId, QJsonDocument(kCalToJson(event, m_icalFormat)).toJson());
+                    UpsyncChange change = { GoogleCalendarSyncAdaptor::UpsyncModify, event->uid(), updatedGcalId,
+                                            QJsonDocument(kCalToJson(event, m_icalFormat)).toJson() };
+                    changes.append(change);
                 }
             }
 
@@ -894,8 +1228,21 @@ void GoogleCalendarSyncAdaptor::updateLocalCalendarNotebookEvents(int accountId,
                 KCalCore::Event::Ptr event = m_calendar->event(incidence->uid());
                 if (event) {
                     localAdded++;
-                    upsyncChanges(accountId, accessToken, GoogleCalendarSyncAdaptor::UpsyncInsert,
-                                  event->uid(), calendarId, QString(), QJsonDocument(kCalToJson(event, m_icalFormat)).toJson());
+                    UpsyncChange change = { GoogleCalendarSyncAdaptor::UpsyncInsert, event->uid(), QString(),
+                                            QJsonDocument(kCalToJson(event, m_icalFormat)).toJson() };
+                    changes.append(change);
+                }
+            }
+
+            for (int i = 0; i < changes.size(); i += UpsyncBatchSize) {
+                const QList<UpsyncChange> batch = changes.mid(i, UpsyncBatchSize);
+                if (batch.size() == 1) {
+                    // no point in wrapping a single change in a batch request.
+                    const UpsyncChange &change(batch.first());
+                    upsyncChanges(accountId, accessToken, change.upsyncType, change.kcalEventId,
+                                  calendarId, change.eventId, change.eventData);
+                } else {
+                    upsyncBatch(accountId, accessToken, calendarId, batch);
                 }
             }
 
@@ -922,6 +1269,7 @@ void GoogleCalendarSyncAdaptor::upsyncChanges(int accountId, const QString &acce
                          QString(QLatin1String("Bearer ") + accessToken).toUtf8());
     request.setHeader(QNetworkRequest::ContentTypeHeader,
                       QVariant::fromValue<QString>(QString::fromLatin1("application/json")));
+    request.setAttribute(SocialdNetworkAccessManager::RequestPriorityAttribute, SocialdNetworkAccessManager::UpsyncPriority);
 
     QNetworkReply *reply = 0;
 
@@ -973,6 +1321,90 @@ void GoogleCalendarSyncAdaptor::upsyncChanges(int accountId, const QString &acce
     }
 }
 
+void GoogleCalendarSyncAdaptor::upsyncBatch(int accountId, const QString &accessToken, const QString &calendarId,
+                                            const QList<GoogleCalendarSyncAdaptor::UpsyncChange> &changes)
+{
+    // each change becomes one application/http part of a multipart/mixed request.
+    // The parts inherit the Authorization header of the batch request.
+    const QByteArray eventsPath = "/calendar/v3/calendars/" + QUrl::toPercentEncoding(calendarId) + "/events";
+    QByteArray batchData;
+    QVariantList upsyncTypes;
+    QStringList kcalEventIds;
+    for (int i = 0; i < changes.size(); ++i) {
+        const UpsyncChange &change(changes.at(i));
+        QByteArray requestLine;
+        switch (change.upsyncType) {
+            case GoogleCalendarSyncAdaptor::UpsyncInsert:
+                requestLine = "POST " + eventsPath;
+                break;
+            case GoogleCalendarSyncAdaptor::UpsyncModify:
+                requestLine = "PUT " + eventsPath + '/' + QUrl::toPercentEncoding(change.eventId);
+                break;
+            case GoogleCalendarSyncAdaptor::UpsyncDelete: // flow through
+            default:
+                requestLine = "DELETE " + eventsPath + '/' + QUrl::toPercentEncoding(change.eventId);
+                break;
+        }
+
+        batchData += "--" + QByteArray(UpsyncBatchBoundary) + "\r\n"
+                     "Content-Type: application/http\r\n"
+                     "Content-ID: <item-" + QByteArray::number(i) + ">\r\n"
+                     "\r\n"
+                   + requestLine + " HTTP/1.1\r\n";
+        if (!change.eventData.isEmpty()) {
+            batchData += "Content-Type: application/json\r\n"
+                         "Content-Length: " + QByteArray::number(change.eventData.size()) + "\r\n"
+                         "\r\n"
+                       + change.eventData + "\r\n";
+        } else {
+            batchData += "\r\n";
+        }
+
+        upsyncTypes.append(static_cast<int>(change.upsyncType));
+        kcalEventIds.append(change.kcalEventId);
+    }
+    batchData += "--" + QByteArray(UpsyncBatchBoundary) + "--\r\n";
+
+    QNetworkRequest request(QUrl(QStringLiteral("https://www.googleapis.com/batch/calendar/v3")));
+    request.setRawHeader("GData-Version", "3.0");
+    request.setRawHeader(QString(QLatin1String("Authorization")).toUtf8(),
+                         QString(QLatin1String("Bearer ") + accessToken).toUtf8());
+    request.setHeader(QNetworkRequest::ContentTypeHeader,
+                      QVariant::fromValue<QString>(QString::fromLatin1("multipart/mixed; boundary=%1")
+                                                   .arg(QLatin1String(UpsyncBatchBoundary))));
+    request.setAttribute(SocialdNetworkAccessManager::RequestPriorityAttribute, SocialdNetworkAccessManager::UpsyncPriority);
+
+    QNetworkReply *reply = m_networkAccessManager->post(request, batchData);
+
+    // we're performing a request.  Increment the semaphore so that we know we're still busy.
+    incrementSemaphore(accountId);
+
+    if (reply) {
+        reply->setProperty("accountId", accountId);
+        reply->setProperty("accessToken", accessToken);
+        reply->setProperty("calendarId", calendarId);
+        reply->setProperty("upsyncTypes", upsyncTypes);
+        reply->setProperty("kcalEventIds", kcalEventIds);
+        connect(reply, SIGNAL(error(QNetworkReply::NetworkError)),
+                this, SLOT(errorHandler(QNetworkReply::NetworkError)));
+        connect(reply, SIGNAL(sslErrors(QList<QSslError>)),
+                this, SLOT(sslErrorsHandler(QList<QSslError>)));
+        connect(reply, SIGNAL(finished()), this, SLOT(upsyncBatchFinishedHandler()));
+
+        setupReplyTimeout(accountId, reply);
+
+        SOCIALD_LOG_DEBUG("upsyncing batch of" << changes.size() << "changes" <<
+                          "to calendarId:" << calendarId <<
+                          "of account" << accountId << ":\n" <<
+                          QString::fromUtf8(batchData));
+    } else {
+        SOCIALD_LOG_ERROR("unable to request batch upsync for calendar" << calendarId <<
+                          "from Google account with id" << accountId);
+        m_syncSucceeded[accountId] = false;
+        decrementSemaphore(accountId);
+    }
+}
+
 void GoogleCalendarSyncAdaptor::upsyncFinishedHandler()
 {
     QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
@@ -993,6 +1425,57 @@ void GoogleCalendarSyncAdaptor::upsyncFinishedHandler()
     reply->deleteLater();
     removeReplyTimeout(accountId, reply);
 
+    handleUpsyncResult(accountId, upsyncType, kcalEventId, calendarId, isError, replyData);
+
+    // we're finished with this request.
+    decrementSemaphore(accountId);
+}
+
+void GoogleCalendarSyncAdaptor::upsyncBatchFinishedHandler()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    int accountId = reply->property("accountId").toInt();
+    QString calendarId = reply->property("calendarId").toString();
+    QVariantList upsyncTypes = reply->property("upsyncTypes").toList();
+    QStringList kcalEventIds = reply->property("kcalEventIds").toStringList();
+    QByteArray contentType = reply->rawHeader("Content-Type");
+    QByteArray replyData = reply->readAll();
+    bool isError = reply->property("isError").toBool();
+
+    disconnect(reply);
+    reply->deleteLater();
+    removeReplyTimeout(accountId, reply);
+
+    if (isError) {
+        // the batch as a whole failed, so none of its changes were applied.
+        SOCIALD_LOG_ERROR("error occurred while upsyncing batch of" << kcalEventIds.size() <<
+                          "calendar changes to Google account" << accountId << ";" <<
+                          "got:" << QString::fromLatin1(replyData.constData()));
+        m_syncSucceeded[accountId] = false;
+    } else {
+        // demultiplex the responses to the individual changes.
+        const QMap<int, QPair<int, QByteArray> > results = parseBatchResponse(contentType, replyData);
+        for (int i = 0; i < kcalEventIds.size(); ++i) {
+            if (!results.contains(i)) {
+                SOCIALD_LOG_ERROR("batch upsync response to Google account" << accountId <<
+                                  "is missing the result for event" << kcalEventIds.at(i));
+                m_syncSucceeded[accountId] = false;
+                continue;
+            }
+
+            const QPair<int, QByteArray> result = results.value(i);
+            handleUpsyncResult(accountId, upsyncTypes.value(i).toInt(), kcalEventIds.at(i), calendarId,
+                               result.first < 200 || result.first >= 300, result.second);
+        }
+    }
+
+    // we're finished with this request.
+    decrementSemaphore(accountId);
+}
+
+void GoogleCalendarSyncAdaptor::handleUpsyncResult(int accountId, int upsyncType, const QString &kcalEventId,
+                                                   const QString &calendarId, bool isError, const QByteArray &replyData)
+{
     // parse the calendars' metadata from the response.
     if (isError) {
         // error occurred during request.
@@ -1065,7 +1548,4 @@ void GoogleCalendarSyncAdaptor::upsyncFinishedHandler()
             }
         }
     }
-
-    // we're finished with this request.
-    decrementSemaphore(accountId);
 }
@@ -23,8 +23,12 @@
 #define GOOGLECALENDARSYNCADAPTOR_H
 
 #include "googledatatypesyncadaptor.h"
+#include "socialdfieldprojection_p.h"
+#include "socialdsynccheckpoints_p.h"
 
 #include <QtCore/QString>
+#include <QtCore/QList>
+#include <QtCore/QMap>
 #include <QtCore/QMultiMap>
 #include <QtCore/QPair>
 #include <QtCore/QJsonObject>
@@ -50,41 +54,68 @@ protected: // implementing GoogleDataTypeSyncAdaptor interface
     void purgeDataForOldAccount(int oldId, SocialNetworkSyncAdaptor::PurgeMode mode);
     void beginSync(int accountId, const QString &accessToken);
     void finalCleanup();
+    void openStorage();
+
+    // conversion between Google Calendar event resources and KCalCore events
+    static QJsonObject kCalToJson(KCalCore::Event::Ptr event, KCalCore::ICalFormat &icalFormat);
+    static void jsonToKCal(const QJsonObject &json, KCalCore::Event::Ptr event, KCalCore::ICalFormat &icalFormat);
+
+    // demultiplexing of the responses to batched upsync requests
+    static QMap<int, QPair<int, QByteArray> > parseBatchResponse(const QByteArray &contentType, const QByteArray &data);
+
+    const SocialdFieldProjection &fieldProjection() const;
 
-private:
     enum UpsyncType {
         UpsyncInsert = 1,
         UpsyncModify = 2,
         UpsyncDelete = 3
     };
+    struct UpsyncChange {
+        UpsyncType upsyncType;
+        QString kcalEventId;
+        QString eventId;
+        QByteArray eventData;
+    };
+    void upsyncBatch(int accountId, const QString &accessToken, const QString &calendarId,
+                     const QList<GoogleCalendarSyncAdaptor::UpsyncChange> &changes);
+
+private:
     void requestCalendars(int accountId, const QString &accessToken,
-                          bool needCleanSync, const QString &pageToken = QString());
+                          bool needCleanSync, const QString &pageToken = QString(),
+                          bool conditional = true);
     void requestEvents(int accountId, const QString &accessToken,
                        const QString &calendarId, bool needCleanSync,
                        const QString &pageToken = QString());
     void updateLocalCalendarNotebooks(int accountId, const QString &accessToken, bool needCleanSync);
+    bool loadLocalCalendarNotebooks(int accountId);
     void updateLocalCalendarNotebookEvents(int accountId, const QString &accessToken,
                                            const QString &calendarId, const QDateTime &since);
     void upsyncChanges(int accountId, const QString &accessToken,
                        GoogleCalendarSyncAdaptor::UpsyncType upsyncType,
                        const QString &kcalEventId, const QString &calendarId,
                        const QString &eventId,const QByteArray &eventData);
+    void handleUpsyncResult(int accountId, int upsyncType, const QString &kcalEventId,
+                            const QString &calendarId, bool isError, const QByteArray &replyData);
 
 private Q_SLOTS:
     void calendarsFinishedHandler();
     void eventsFinishedHandler();
     void upsyncFinishedHandler();
+    void upsyncBatchFinishedHandler();
 
 private:
     QMap<int, QMap<QString, QPair<QString, QString> > > m_serverCalendarIdToSummaryAndColor;
     QMap<int, QMultiMap<QString, QJsonObject> > m_calendarIdToEventObjects;
     QMap<int, bool> m_syncSucceeded;
+    QMap<int, QNetworkReply*> m_calendarListReplies; // first page, whose validators are stored once merged
 
     mKCal::ExtendedCalendar::Ptr m_calendar;
     mKCal::ExtendedStorage::Ptr m_storage;
     mutable KCalCore::ICalFormat m_icalFormat;
     bool m_storageNeedsSave;
 
+    SocialdSyncCheckpoints m_checkpoints; // per calendar, for resuming event paging
+    SocialdFieldProjection m_fieldProjection;
     GoogleCalendarDatabase m_idDb; // solely for local-deletion-upsync support
 };
 
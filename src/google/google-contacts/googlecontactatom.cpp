@@ -26,6 +26,109 @@
 #include "googlecontactatom.h"
 #include <LogMacros.h>
 
+#include <QtEndian>
+
+GoogleContactXmlElements::GoogleContactXmlElements()
+{
+}
+
+bool GoogleContactXmlElements::isEmpty() const
+{
+    return mElements.isEmpty();
+}
+
+int GoogleContactXmlElements::count() const
+{
+    return mElements.size();
+}
+
+QByteArray GoogleContactXmlElements::at(int i) const
+{
+    const Element &element(mElements.at(i));
+    return element.buffer.mid(element.position, element.length);
+}
+
+void GoogleContactXmlElements::append(const QByteArray &buffer, int position, int length)
+{
+    if (length > 0) {
+        Element element;
+        element.buffer = buffer;
+        element.position = position;
+        element.length = length;
+        mElements.append(element);
+    }
+}
+
+void GoogleContactXmlElements::append(const QByteArray &element)
+{
+    append(element, 0, element.size());
+}
+
+void GoogleContactXmlElements::squeeze()
+{
+    if (mElements.isEmpty()) {
+        return;
+    }
+
+    int size = 0;
+    bool shared = true;
+    Q_FOREACH (const Element &element, mElements) {
+        size += element.length;
+        shared = shared && element.buffer.constData() == mElements.first().buffer.constData();
+    }
+    if (shared && mElements.first().buffer.size() == size) {
+        return; // already in a buffer of their own.
+    }
+
+    QByteArray buffer;
+    buffer.reserve(size);
+    Q_FOREACH (const Element &element, mElements) {
+        buffer.append(element.buffer.constData() + element.position, element.length);
+    }
+
+    int position = 0;
+    for (int i = 0; i < mElements.size(); ++i) {
+        Element &element(mElements[i]);
+        element.buffer = buffer;
+        element.position = position;
+        position += element.length;
+    }
+}
+
+QByteArray GoogleContactXmlElements::toByteArray() const
+{
+    int size = 0;
+    Q_FOREACH (const Element &element, mElements) {
+        size += sizeof(quint32) + element.length;
+    }
+
+    QByteArray data;
+    data.reserve(size);
+    Q_FOREACH (const Element &element, mElements) {
+        const quint32 length = qToBigEndian<quint32>(element.length);
+        data.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        data.append(element.buffer.constData() + element.position, element.length);
+    }
+    return data;
+}
+
+GoogleContactXmlElements GoogleContactXmlElements::fromByteArray(const QByteArray &data)
+{
+    // the elements refer to the data rather than copying it.
+    GoogleContactXmlElements elements;
+    int position = 0;
+    while (position + int(sizeof(quint32)) <= data.size()) {
+        const int length = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data.constData() + position));
+        position += sizeof(quint32);
+        if (length < 0 || length > data.size() - position) {
+            break; // truncated or corrupt.
+        }
+        elements.append(data, position, length);
+        position += length;
+    }
+    return elements;
+}
+
 GoogleContactAtom::BatchOperationResponse::BatchOperationResponse()
     : isError(false)
 {
@@ -169,12 +272,12 @@ QMap<QString, GoogleContactAtom::BatchOperationResponse> GoogleContactAtom::batc
     return mBatchOperationResponses;
 }
 
-void GoogleContactAtom::addEntryContact(const QContact &entryContact, const QStringList &unsupportedElements)
+void GoogleContactAtom::addEntryContact(const QContact &entryContact, const GoogleContactXmlElements &unsupportedElements)
 {
     mContactList.append(qMakePair(entryContact, unsupportedElements));
 }
 
-QList<QPair<QContact, QStringList> > GoogleContactAtom::entryContacts() const
+QList<QPair<QContact, GoogleContactXmlElements> > GoogleContactAtom::entryContacts() const
 {
     return mContactList;
 }
@@ -189,6 +292,16 @@ QList<QContact> GoogleContactAtom::deletedEntryContacts() const
     return mDeletedContactList;
 }
 
+void GoogleContactAtom::addEntryPhotoEtag(const QString &contactGuid, const QString &photoEtag)
+{
+    mPhotoEtags.insert(contactGuid, photoEtag);
+}
+
+QMap<QString, QString> GoogleContactAtom::entryPhotoEtags() const
+{
+    return mPhotoEtags;
+}
+
 void GoogleContactAtom::addEntrySystemGroup(const QString &systemGroupId, const QString &systemGroupAtomId)
 {
     mSystemGroupAtomIds.insert(systemGroupId, systemGroupAtomId);
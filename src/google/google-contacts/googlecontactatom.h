@@ -28,12 +28,44 @@
 #include <QMetaEnum>
 #include <QMap>
 #include <QList>
+#include <QVector>
+#include <QByteArray>
 #include <QXmlStreamWriter>
 
 #include <QContact>
 
 USE_CONTACTS_NAMESPACE
 
+// The XML elements of a contact entry which cannot be stored as contact details.
+// They are kept verbatim so that they can be sent back when the contact is upsynced.
+// Elements parsed from a feed refer to the (implicitly shared) feed buffer
+// rather than each being copied out of it; squeeze() copies them into a
+// buffer of their own, for elements which are kept beyond the feed page.
+class GoogleContactXmlElements {
+public:
+    GoogleContactXmlElements();
+
+    bool isEmpty() const;
+    int count() const;
+    QByteArray at(int i) const;
+
+    void append(const QByteArray &buffer, int position, int length);
+    void append(const QByteArray &element);
+    void squeeze();
+
+    // compact form for storage: each element prefixed by its 32-bit big-endian length.
+    QByteArray toByteArray() const;
+    static GoogleContactXmlElements fromByteArray(const QByteArray &data);
+
+private:
+    struct Element {
+        QByteArray buffer;
+        int position;
+        int length;
+    };
+    QVector<Element> mElements;
+};
+
 class GoogleContactAtom {
 public:
     GoogleContactAtom();
@@ -76,10 +108,12 @@ public:
     void setItemsPerPage(int itemsPerPage);
     int itemsPerPage() const;
 
-    void addEntryContact(const QContact &contact, const QStringList &unsupportedElements);
-    QList<QPair<QContact, QStringList> > entryContacts() const;
+    void addEntryContact(const QContact &contact, const GoogleContactXmlElements &unsupportedElements);
+    QList<QPair<QContact, GoogleContactXmlElements> > entryContacts() const;
     void addDeletedEntryContact(const QContact &contact);
     QList<QContact> deletedEntryContacts() const;
+    void addEntryPhotoEtag(const QString &contactGuid, const QString &photoEtag);
+    QMap<QString, QString> entryPhotoEtags() const;
 
     void addEntrySystemGroup(const QString &systemGroupId, const QString &systemGroupAtomId);
     QMap<QString, QString> entrySystemGroups() const;
@@ -127,7 +161,8 @@ private:
     QMap<QString, BatchOperationResponse> mBatchOperationResponses;
 
     QList<QContact> mDeletedContactList;
-    QList<QPair<QContact, QStringList> > mContactList;
+    QList<QPair<QContact, GoogleContactXmlElements> > mContactList;
+    QMap<QString, QString> mPhotoEtags; // contact guid -> photo link etag
 
     QMap<QString, QString> mSystemGroupAtomIds;
 
@@ -20,19 +20,29 @@
  ****************************************************************************/
 
 #include "googlecontactimagedownloader.h"
+#include "socialdavatarscheduler_p.h"
+#include "socialdnetworkaccessmanager_p.h"
 
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include <QNetworkAccessManager>
 
-static const char *IMAGE_DOWNLOADER_TOKEN_KEY = "url";
+static const char *IMAGE_DOWNLOADER_ACCOUNT_ID_KEY = "account_id";
 static const char *IMAGE_DOWNLOADER_IDENTIFIER_KEY = "identifier";
 
-GoogleContactImageDownloader::GoogleContactImageDownloader()
+GoogleContactImageDownloader::GoogleContactImageDownloader(QNetworkAccessManager *networkAccessManager,
+                                                           SocialdAvatarScheduler *scheduler)
     : AbstractImageDownloader()
+    , m_networkAccessManager(networkAccessManager)
+    , m_scheduler(scheduler)
 {
 }
 
+void GoogleContactImageDownloader::setAccessToken(int accountId, const QString &accessToken)
+{
+    m_accessTokens.insert(accountId, accessToken);
+}
+
 QString GoogleContactImageDownloader::staticOutputFile(const QString &identifier, const QUrl &url)
 {
     return makeOutputFile(SocialSyncInterface::Google, SocialSyncInterface::Contacts, identifier, url.toString());
@@ -41,14 +51,19 @@ QString GoogleContactImageDownloader::staticOutputFile(const QString &identifier
 QNetworkReply * GoogleContactImageDownloader::createReply(const QString &url,
                                                           const QVariantMap &metadata)
 {
-    Q_D(AbstractImageDownloader);
-
-    QString accessToken = metadata.value(IMAGE_DOWNLOADER_TOKEN_KEY).toString();
+    int accountId = metadata.value(IMAGE_DOWNLOADER_ACCOUNT_ID_KEY).toInt();
+    QString accessToken = m_accessTokens.value(accountId);
     QNetworkRequest request(url);
     request.setRawHeader("GData-Version", "3.0");
     request.setRawHeader(QString(QLatin1String("Authorization")).toUtf8(),
                          QString(QLatin1String("Bearer ") + accessToken).toUtf8());
-    return d->networkAccessManager->get(request);
+    request.setAttribute(SocialdNetworkAccessManager::RequestPriorityAttribute, SocialdNetworkAccessManager::MediaPriority);
+    QNetworkReply *reply = m_networkAccessManager->get(request);
+    if (reply) {
+        reply->setProperty("accountId", accountId);
+        m_scheduler->watchReply(url, metadata, reply);
+    }
+    return reply;
 }
 
 QString GoogleContactImageDownloader::outputFile(const QString &url, const QVariantMap &data) const
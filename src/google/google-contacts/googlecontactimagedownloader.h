@@ -23,27 +23,35 @@
 #define GOOGLECONTACTIMAGEDOWNLOADER_H
 
 #include <socialcache/abstractimagedownloader.h>
-#include <socialcache/abstractimagedownloader_p.h>
 
 #include <QObject>
 #include <QString>
 #include <QVariantMap>
 #include <QUrl>
+#include <QMap>
 
 class QNetworkReply;
+class QNetworkAccessManager;
+class SocialdAvatarScheduler;
 class GoogleContactImageDownloader: public AbstractImageDownloader
 {
     Q_OBJECT
 
 public:
-    explicit GoogleContactImageDownloader();
+    // the requests are made with the adaptor's network access manager, so
+    // that they are scheduled behind the adaptor's other requests.
+    GoogleContactImageDownloader(QNetworkAccessManager *networkAccessManager, SocialdAvatarScheduler *scheduler);
     static QString staticOutputFile(const QString &identifier, const QUrl &url);
+    // the token is kept out of the metadata, as deferred downloads are saved.
+    void setAccessToken(int accountId, const QString &accessToken);
 protected:
     QNetworkReply * createReply(const QString &url, const QVariantMap &metadata);
     // This is a reimplemented method, used by AbstractImageDownloader
     QString outputFile(const QString &url, const QVariantMap &data) const;
 private:
-    Q_DECLARE_PRIVATE(AbstractImageDownloader)
+    QNetworkAccessManager *m_networkAccessManager;
+    SocialdAvatarScheduler *m_scheduler;
+    QMap<int, QString> m_accessTokens;
 };
 
 #endif // GOOGLECONTACTIMAGEDOWNLOADER_H
@@ -30,19 +30,129 @@
 
 #include <QDateTime>
 
+namespace {
+
+enum AtomElement {
+    UnknownAtomElement = 0,
+    AtomUpdated,
+    AtomCategory,
+    AtomAuthor,
+    AtomOpenSearch,
+    AtomLink,
+    AtomEntry
+};
+
+enum EntryElement {
+    UnknownEntryElement = 0,
+    // contact detail elements, only handled when parsing a feed (not a batch response)
+    EntryContent,
+    EntryUpdated,
+    EntryBirthday,
+    EntryGender,
+    EntryHobby,
+    EntryNickname,
+    EntryOccupation,
+    EntryWebsite,
+    EntryComments,
+    EntryEmail,
+    EntryIm,
+    EntryName,
+    EntryOrganization,
+    EntryPhoneNumber,
+    EntryStructuredPostalAddress,
+    LastDetailElement = EntryStructuredPostalAddress,
+    // elements handled in every entry
+    EntryGroupMembershipInfo,
+    EntryDeleted,
+    EntryBatchId,
+    EntryBatchOperation,
+    EntryBatchStatus,
+    EntryExtendedProperty,
+    EntryLink,
+    EntrySystemGroup,
+    EntryId
+};
+
+struct ElementName {
+    const char *name;
+    int element;
+};
+
+// The element tables must be kept sorted (in byte order) for elementForName().
+// Feed elements are matched by local name, entry elements by qualified name.
+const ElementName AtomElements[] = {
+    { "author", AtomAuthor },
+    { "category", AtomCategory },
+    { "entry", AtomEntry },
+    { "itemsPerPage", AtomOpenSearch },
+    { "link", AtomLink },
+    { "startIndex", AtomOpenSearch },
+    { "totalResults", AtomOpenSearch },
+    { "updated", AtomUpdated }
+};
+
+const ElementName EntryElements[] = {
+    { "app:edited", EntryUpdated },
+    { "batch:id", EntryBatchId },
+    { "batch:operation", EntryBatchOperation },
+    { "batch:status", EntryBatchStatus },
+    { "content", EntryContent },
+    { "gContact:birthday", EntryBirthday },
+    { "gContact:groupMembershipInfo", EntryGroupMembershipInfo },
+    { "gContact:hobby", EntryHobby },
+    { "gContact:nickname", EntryNickname },
+    { "gContact:occupation", EntryOccupation },
+    { "gContact:systemGroup", EntrySystemGroup },
+    { "gContact:website", EntryWebsite },
+    { "gcontact::gender", EntryGender },
+    { "gd:comments", EntryComments },
+    { "gd:deleted", EntryDeleted },
+    { "gd:email", EntryEmail },
+    { "gd:extendedProperty", EntryExtendedProperty },
+    { "gd:im", EntryIm },
+    { "gd:name", EntryName },
+    { "gd:organization", EntryOrganization },
+    { "gd:phoneNumber", EntryPhoneNumber },
+    { "gd:structuredPostalAddress", EntryStructuredPostalAddress },
+    { "id", EntryId },
+    { "link", EntryLink },
+    { "updated", EntryUpdated }
+};
+
+// Binary search comparing the reader's QStringRef in place, so that
+// dispatching an element doesn't allocate a QString for its name.
+template <int N>
+int elementForName(const ElementName (&elements)[N], const QStringRef &name)
+{
+    int lower = 0;
+    int upper = N;
+    while (lower < upper) {
+        const int middle = (lower + upper) / 2;
+        const int result = name.compare(QLatin1String(elements[middle].name));
+        if (result == 0) {
+            return elements[middle].element;
+        } else if (result < 0) {
+            upper = middle;
+        } else {
+            lower = middle + 1;
+        }
+    }
+    return 0;
+}
+
+}
+
 GoogleContactStream::GoogleContactStream(bool response, int accountId, const QString &accountEmail, QObject* parent)
     : QObject(parent)
     , mXmlReader(0)
+    , mCharacterOffset(0)
+    , mBufferPosition(0)
     , mAtom(0)
     , mAccountId(accountId)
+    , mResponse(response)
     , mXmlWriter(0)
     , mAccountEmail(accountEmail)
 {
-    if (response == true) {
-        initResponseFunctionMap();
-    } else {
-        initFunctionMap();
-    }
 }
 
 GoogleContactStream::~GoogleContactStream()
@@ -54,39 +164,51 @@ GoogleContactAtom *GoogleContactStream::parse(const QByteArray &xmlBuffer)
     mXmlReader = new QXmlStreamReader(xmlBuffer);
     mAtom = new GoogleContactAtom;
 
+    // unsupported elements are kept as ranges of the buffer, see handleEntryUnknownElement().
+    // the reader skips any byte order mark, so character offsets start after it.
+    mXmlBuffer = xmlBuffer;
+    mCharacterOffset = 0;
+    mBufferPosition = xmlBuffer.startsWith("\xEF\xBB\xBF") ? 3 : 0;
+
     Q_CHECK_PTR(mXmlReader);
     Q_CHECK_PTR(mAtom);
 
     while (!mXmlReader->atEnd() && !mXmlReader->hasError()) {
         if (mXmlReader->readNextStartElement()) {
-            Handler handler = mAtomFunctionMap.value(mXmlReader->name().toString());
-            if (handler) {
-                (*this.*handler)();
+            switch (elementForName(AtomElements, mXmlReader->name())) {
+            case AtomUpdated:    handleAtomUpdated();    break;
+            case AtomCategory:   handleAtomCategory();   break;
+            case AtomAuthor:     handleAtomAuthor();     break;
+            case AtomOpenSearch: handleAtomOpenSearch(); break;
+            case AtomLink:       handleAtomLink();       break;
+            case AtomEntry:      handleAtomEntry();      break;
+            default: break;
             }
         }
     }
 
     delete mXmlReader;
+    mXmlBuffer.clear();
     return mAtom;
 }
 
-QByteArray GoogleContactStream::encode(const QMultiMap<GoogleContactStream::UpdateType, QPair<QContact, QStringList> > &updates)
+QByteArray GoogleContactStream::encode(const QMultiMap<GoogleContactStream::UpdateType, QPair<QContact, GoogleContactXmlElements> > &updates)
 {
     QByteArray xmlBuffer;
     mXmlWriter = new QXmlStreamWriter(&xmlBuffer);
     startBatchFeed();
 
-    QList<QPair<QContact, QStringList> > removedContacts = updates.values(GoogleContactStream::Remove);
+    QList<QPair<QContact, GoogleContactXmlElements> > removedContacts = updates.values(GoogleContactStream::Remove);
     for (int i = 0; i < removedContacts.size(); ++i) {
         encodeContactUpdate(removedContacts[i].first, removedContacts[i].second, GoogleContactStream::Remove, true); // batchmode = true
     }
 
-    QList<QPair<QContact, QStringList> > addedContacts = updates.values(GoogleContactStream::Add);
+    QList<QPair<QContact, GoogleContactXmlElements> > addedContacts = updates.values(GoogleContactStream::Add);
     for (int i = 0; i < addedContacts.size(); ++i) {
         encodeContactUpdate(addedContacts[i].first, addedContacts[i].second, GoogleContactStream::Add, true); // batchmode = true
     }
 
-    QList<QPair<QContact, QStringList> > modifiedContacts = updates.values(GoogleContactStream::Modify);
+    QList<QPair<QContact, GoogleContactXmlElements> > modifiedContacts = updates.values(GoogleContactStream::Modify);
     for (int i = 0; i < modifiedContacts.size(); ++i) {
         encodeContactUpdate(modifiedContacts[i].first, modifiedContacts[i].second, GoogleContactStream::Modify, true); // batchmode = true
     }
@@ -99,43 +221,26 @@ QByteArray GoogleContactStream::encode(const QMultiMap<GoogleContactStream::Upda
 
 // ----------------------------------------
 
-void GoogleContactStream::initAtomFunctionMap()
+QContactDetail GoogleContactStream::handleEntryDetail(int element)
 {
-    mAtomFunctionMap.insert("updated", &GoogleContactStream::handleAtomUpdated);
-    mAtomFunctionMap.insert("category", &GoogleContactStream::handleAtomCategory);
-    mAtomFunctionMap.insert("author", &GoogleContactStream::handleAtomAuthor);
-    mAtomFunctionMap.insert("totalResults", &GoogleContactStream::handleAtomOpenSearch);
-    mAtomFunctionMap.insert("startIndex", &GoogleContactStream::handleAtomOpenSearch);
-    mAtomFunctionMap.insert("itemsPerPage", &GoogleContactStream::handleAtomOpenSearch);
-    mAtomFunctionMap.insert("link", &GoogleContactStream::handleAtomLink);
-    mAtomFunctionMap.insert("entry", &GoogleContactStream::handleAtomEntry);
-}
-
-void GoogleContactStream::initResponseFunctionMap()
-{
-    initAtomFunctionMap();
-    // TODO: move the batch request response handling stuff here.
-}
-
-void GoogleContactStream::initFunctionMap()
-{
-    initAtomFunctionMap();
-    mContactFunctionMap.insert("content", &GoogleContactStream::handleEntryContent);
-    mContactFunctionMap.insert("updated", &GoogleContactStream::handleEntryUpdated);
-    mContactFunctionMap.insert("app:edited", &GoogleContactStream::handleEntryUpdated);
-    mContactFunctionMap.insert("gContact:birthday", &GoogleContactStream::handleEntryBirthday);
-    mContactFunctionMap.insert("gcontact::gender", &GoogleContactStream::handleEntryGender);
-    mContactFunctionMap.insert("gContact:hobby", &GoogleContactStream::handleEntryHobby);
-    mContactFunctionMap.insert("gContact:nickname", &GoogleContactStream::handleEntryNickname);
-    mContactFunctionMap.insert("gContact:occupation", &GoogleContactStream::handleEntryOccupation);
-    mContactFunctionMap.insert("gContact:website", &GoogleContactStream::handleEntryWebsite);
-    mContactFunctionMap.insert("gd:comments", &GoogleContactStream::handleEntryComments);
-    mContactFunctionMap.insert("gd:email", &GoogleContactStream::handleEntryEmail);
-    mContactFunctionMap.insert("gd:im", &GoogleContactStream::handleEntryIm);
-    mContactFunctionMap.insert("gd:name", &GoogleContactStream::handleEntryName);
-    mContactFunctionMap.insert("gd:organization", &GoogleContactStream::handleEntryOrganization);
-    mContactFunctionMap.insert("gd:phoneNumber", &GoogleContactStream::handleEntryPhoneNumber);
-    mContactFunctionMap.insert("gd:structuredPostalAddress", &GoogleContactStream::handleEntryStructuredPostalAddress);
+    switch (element) {
+    case EntryContent:                 return handleEntryContent();
+    case EntryUpdated:                 return handleEntryUpdated();
+    case EntryBirthday:                return handleEntryBirthday();
+    case EntryGender:                  return handleEntryGender();
+    case EntryHobby:                   return handleEntryHobby();
+    case EntryNickname:                return handleEntryNickname();
+    case EntryOccupation:              return handleEntryOccupation();
+    case EntryWebsite:                 return handleEntryWebsite();
+    case EntryComments:                return handleEntryComments();
+    case EntryEmail:                   return handleEntryEmail();
+    case EntryIm:                      return handleEntryIm();
+    case EntryName:                    return handleEntryName();
+    case EntryOrganization:            return handleEntryOrganization();
+    case EntryPhoneNumber:             return handleEntryPhoneNumber();
+    case EntryStructuredPostalAddress: return handleEntryStructuredPostalAddress();
+    default:                           return QContactDetail();
+    }
 }
 
 // ----------------------------------------
@@ -211,7 +316,8 @@ void GoogleContactStream::handleAtomEntry()
     // the entry will be a contact if this is a response to a "read" request
     QContact entryContact;
     QString contactEtag;
-    QStringList unsupportedElements;
+    QString photoEtag;
+    GoogleContactXmlElements unsupportedElements;
     bool isInGroup = false;
     bool isDeleted = false;
 
@@ -222,37 +328,37 @@ void GoogleContactStream::handleAtomEntry()
 
     while (!((mXmlReader->tokenType() == QXmlStreamReader::EndElement) && (mXmlReader->name() == "entry"))) {
         if (mXmlReader->tokenType() == QXmlStreamReader::StartElement) {
-            DetailHandler handler = mContactFunctionMap.value(mXmlReader->qualifiedName().toString());
-            if (handler) {
-                QContactDetail convertedDetail = (*this.*handler)();
-                if (convertedDetail != QContactDetail()) {
-                    entryContact.saveDetail(&convertedDetail);
-                }
-            } else if (mXmlReader->qualifiedName().toString() == QStringLiteral("gContact:groupMembershipInfo")) {
+            int element = elementForName(EntryElements, mXmlReader->qualifiedName());
+            if (element <= LastDetailElement && mResponse) {
+                // batch responses don't convert contact details.
+                element = UnknownEntryElement;
+            }
+            switch (element) {
+            case EntryGroupMembershipInfo: {
                 isInGroup = true;
-                QString unsupportedElement = handleEntryUnknownElement();
-                if (!unsupportedElement.isEmpty()) {
-                    unsupportedElements.append(unsupportedElement);
-                }
-            } else if (mXmlReader->qualifiedName().toString() == QStringLiteral("gd:deleted")) {
+                handleEntryUnknownElement(&unsupportedElements);
+            } break;
+            case EntryDeleted:
                 isDeleted = true;
-            } else if (mXmlReader->qualifiedName().toString() == QStringLiteral("batch:id")) {
+                break;
+            case EntryBatchId:
                 isBatchOperationResponse = true;
                 handleEntryBatchId(&response);
-            } else if (mXmlReader->qualifiedName().toString() == QStringLiteral("batch:operation")) {
+                break;
+            case EntryBatchOperation:
                 isBatchOperationResponse = true;
                 handleEntryBatchOperation(&response);
-            } else if (mXmlReader->qualifiedName().toString() == QStringLiteral("batch:status")) {
+                break;
+            case EntryBatchStatus:
                 isBatchOperationResponse = true;
                 handleEntryBatchStatus(&response);
-            } else if (mXmlReader->qualifiedName().toString() == QStringLiteral("gd:extendedProperty")) {
+                break;
+            case EntryExtendedProperty: {
                 // It might be an extension property we don't support.
                 // If we don't support it, we store the element text.
-                QString unsupportedElement = handleEntryExtendedProperty();
-                if (!unsupportedElement.isEmpty()) {
-                    unsupportedElements.append(unsupportedElement);
-                }
-            } else if (mXmlReader->qualifiedName().toString() == QStringLiteral("link")) {
+                handleEntryExtendedProperty(&unsupportedElements);
+            } break;
+            case EntryLink: {
                 // There are several possible links:
                 // Avatar Photo link
                 // Self query link
@@ -268,31 +374,36 @@ void GoogleContactStream::handleAtomEntry()
                     }
                 }
                 bool isAvatar = false;
-                QString unsupportedElement = handleEntryLink(&avatar, &isAvatar);
+                // Whether it's an avatar or not, we also store the element text.
+                handleEntryLink(&avatar, &isAvatar, &photoEtag, &unsupportedElements);
                 if (isAvatar) {
                     entryContact.saveDetail(&avatar);
                 }
-
-                // Whether it's an avatar or not, we also store the element text.
-                if (!unsupportedElement.isEmpty()) {
-                    unsupportedElements.append(unsupportedElement);
-                }
-            } else if (mXmlReader->name().toString() == QStringLiteral("entry")) {
-                // read the etag out of the entry.
-                contactEtag = mXmlReader->attributes().value("gd:etag").toString();
-            } else if (mXmlReader->qualifiedName().toString() == QStringLiteral("gContact:systemGroup")) {
+            } break;
+            case EntrySystemGroup:
                 systemGroupId = mXmlReader->attributes().value("id").toString();
-            } else if (mXmlReader->qualifiedName().toString() == QStringLiteral("id")) {
+                break;
+            case EntryId: {
                 // either a contact id or a group id.
                 QContactDetail guidDetail = handleEntryId(&systemGroupAtomId);
                 entryContact.saveDetail(&guidDetail);
-            } else {
-                // This is some XML element which we don't handle.
-                // We should store it, so that we can send it back when we upload changes.
-                QString unsupportedElement = handleEntryUnknownElement();
-                if (!unsupportedElement.isEmpty()) {
-                    unsupportedElements.append(unsupportedElement);
+            } break;
+            case UnknownEntryElement:
+                if (mXmlReader->name() == QLatin1String("entry")) {
+                    // read the etag out of the entry.
+                    contactEtag = mXmlReader->attributes().value("gd:etag").toString();
+                } else {
+                    // This is some XML element which we don't handle.
+                    // We should store it, so that we can send it back when we upload changes.
+                    handleEntryUnknownElement(&unsupportedElements);
+                }
+                break;
+            default: {
+                QContactDetail convertedDetail = handleEntryDetail(element);
+                if (convertedDetail != QContactDetail()) {
+                    entryContact.saveDetail(&convertedDetail);
                 }
+            } break;
             }
         }
         mXmlReader->readNextStartElement();
@@ -318,6 +429,9 @@ void GoogleContactStream::handleAtomEntry()
                 mAtom->addDeletedEntryContact(entryContact);
             } else {
                 mAtom->addEntryContact(entryContact, unsupportedElements);
+                if (!photoEtag.isEmpty()) {
+                    mAtom->addEntryPhotoEtag(entryContact.detail<QContactGuid>().guid(), photoEtag);
+                }
             }
         }
     }
@@ -330,7 +444,8 @@ void GoogleContactStream::handleAtomEntry()
     }
 }
 
-QString GoogleContactStream::handleEntryLink(QContactAvatar *avatar, bool *isAvatar)
+void GoogleContactStream::handleEntryLink(QContactAvatar *avatar, bool *isAvatar, QString *photoEtag,
+                                          GoogleContactXmlElements *unsupportedElements)
 {
     Q_ASSERT(mXmlReader->isStartElement() && mXmlReader->name() == "link");
 
@@ -340,36 +455,60 @@ QString GoogleContactStream::handleEntryLink(QContactAvatar *avatar, bool *isAva
         avatar->setImageUrl(mXmlReader->attributes().value("href").toString());
         avatar->setValue(QContactAvatar__FieldAvatarMetadata, QVariant::fromValue<QString>(QStringLiteral("picture")));
         *isAvatar = true;
+        // the photo etag changes whenever the photo does.
+        *photoEtag = mXmlReader->attributes().value("gd:etag").toString();
     }
 
-    return handleEntryUnknownElement();
+    handleEntryUnknownElement(unsupportedElements);
 }
 
-QString GoogleContactStream::handleEntryExtendedProperty()
+void GoogleContactStream::handleEntryExtendedProperty(GoogleContactXmlElements *unsupportedElements)
 {
     Q_ASSERT(mXmlReader->isStartElement());
-    return handleEntryUnknownElement();
+    handleEntryUnknownElement(unsupportedElements);
 }
 
-QString GoogleContactStream::handleEntryUnknownElement()
+void GoogleContactStream::handleEntryUnknownElement(GoogleContactXmlElements *unsupportedElements)
 {
     Q_ASSERT(mXmlReader->isStartElement());
 
-    QXmlStreamAttributes attributes = mXmlReader->attributes();
-    QString attributesString;
-    for (int i = 0; i < attributes.size(); ++i) {
-        QString extra = QStringLiteral(" %1=\"%2\"")
-            .arg(attributes[i].qualifiedName().toString())
-            .arg(attributes[i].value().toString().toHtmlEscaped());
-        attributesString.append(extra);
+    // The reader is positioned just past the start tag, which begins at the
+    // last '<' before that position (a '<' can't occur within the tag).
+    // The element (including any child elements) is kept as the range of
+    // the feed buffer which ends with its end tag.
+    const int startTagEnd = bufferPosition(mXmlReader->characterOffset());
+    const int start = mXmlBuffer.lastIndexOf('<', startTagEnd - 1);
+    mXmlReader->skipCurrentElement();
+    const int end = bufferPosition(mXmlReader->characterOffset());
+
+    if (start < 0 || end <= start || mXmlBuffer.at(end - 1) != '>') {
+        SOCIALD_LOG_ERROR("unable to retain unsupported element" << mXmlReader->qualifiedName().toString()
+                          << "for account" << mAccountId);
+        return;
     }
 
-    QString unknownElement = QStringLiteral("<%1%2>%3</%1>")
-                                .arg(mXmlReader->qualifiedName().toString())
-                                .arg(attributesString)
-                                .arg(mXmlReader->text().toString());
+    unsupportedElements->append(mXmlBuffer, start, end - start);
+}
 
-    return unknownElement;
+// Returns the position in the (UTF-8 encoded) feed buffer corresponding to the
+// given character offset of the reader.  The offsets must not decrease between
+// calls, as the buffer is scanned incrementally from the previous position.
+int GoogleContactStream::bufferPosition(qint64 characterOffset)
+{
+    const char *data = mXmlBuffer.constData();
+    const int size = mXmlBuffer.size();
+    while (mCharacterOffset < characterOffset && mBufferPosition < size) {
+        const uchar lead = data[mBufferPosition];
+        if (lead >= 0xF0) {
+            // four byte sequences are decoded to a surrogate pair.
+            mBufferPosition += 4;
+            mCharacterOffset += 2;
+        } else {
+            mBufferPosition += lead >= 0xE0 ? 3 : (lead >= 0xC0 ? 2 : 1);
+            mCharacterOffset += 1;
+        }
+    }
+    return qMin(mBufferPosition, size);
 }
 
 void GoogleContactStream::handleEntryBatchStatus(GoogleContactAtom::BatchOperationResponse *response)
@@ -676,7 +815,7 @@ QContactDetail GoogleContactStream::handleEntryUpdated()
 // ----------------------------------------
 
 void GoogleContactStream::encodeContactUpdate(const QContact &qContact,
-                                              const QStringList &unsupportedElements,
+                                              const GoogleContactXmlElements &unsupportedElements,
                                               const GoogleContactStream::UpdateType updateType,
                                               const bool batch)
 {
@@ -1142,25 +1281,31 @@ void GoogleContactStream::encodeFamily(const QContactFamily &family)
     }
 }
 
-void GoogleContactStream::encodeUnknownElements(const QStringList &unknownElements)
+void GoogleContactStream::encodeUnknownElements(const GoogleContactXmlElements &unknownElements)
 {
-    // ugly hack to get the QXmlStreamWriter to write a pre-formatted element...
-    foreach (const QString &unknownElement, unknownElements) {
-        QString concat;
-        concat.append("<?xml version=\"1.0\"?>");
-        concat.append("<container>");
-        concat.append(unknownElement);
-        concat.append("</container>");
-
-        QXmlStreamReader tokenizer(concat);
-        tokenizer.readNextStartElement(); // read past the xml document element start.
-        QString text = tokenizer.readElementText();
-        mXmlWriter->writeStartElement(tokenizer.qualifiedName().toString());
-        mXmlWriter->writeAttributes(tokenizer.attributes());
-        if (!text.isEmpty()) {
-            mXmlWriter->writeCharacters(text);
+    // the elements use the namespace prefixes declared by the feed they were
+    // read from, which are also declared by the feed we write.
+    for (int i = 0; i < unknownElements.count(); ++i) {
+        QXmlStreamReader tokenizer(unknownElements.at(i));
+        tokenizer.setNamespaceProcessing(false);
+        while (!tokenizer.atEnd() && !tokenizer.hasError()) {
+            switch (tokenizer.readNext()) {
+            case QXmlStreamReader::StartElement:
+                mXmlWriter->writeStartElement(tokenizer.qualifiedName().toString());
+                mXmlWriter->writeAttributes(tokenizer.attributes());
+                break;
+            case QXmlStreamReader::Characters:
+                if (!tokenizer.isWhitespace()) {
+                    mXmlWriter->writeCharacters(tokenizer.text().toString());
+                }
+                break;
+            case QXmlStreamReader::EndElement:
+                mXmlWriter->writeEndElement();
+                break;
+            default:
+                break;
+            }
         }
-        mXmlWriter->writeEndElement();
     }
 }
 
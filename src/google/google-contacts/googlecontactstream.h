@@ -74,7 +74,7 @@ public:
     explicit GoogleContactStream(bool response, int accountId, const QString &accountEmail = QString(), QObject* parent = 0);
     ~GoogleContactStream();
 
-    QByteArray encode(const QMultiMap<GoogleContactStream::UpdateType, QPair<QContact, QStringList> > &updates);
+    QByteArray encode(const QMultiMap<GoogleContactStream::UpdateType, QPair<QContact, GoogleContactXmlElements> > &updates);
     GoogleContactAtom* parse(const QByteArray &xmlBuffer);
 
 signals:
@@ -82,10 +82,6 @@ signals:
 
 // Decoding XML stream to QContacts
 private:
-    void initAtomFunctionMap();
-    void initResponseFunctionMap();
-    void initFunctionMap();
-
     // Atom feed elements handler methods
     void handleAtomUpdated();
     void handleAtomCategory();
@@ -120,23 +116,26 @@ private:
     QContactDetail handleEntryId(QString *rawId);
 
     // unknown / unsupported element handler methods
-    QString handleEntryExtendedProperty();
-    QString handleEntryLink(QContactAvatar *avatar, bool *isAvatar);
-    QString handleEntryUnknownElement();
+    void handleEntryExtendedProperty(GoogleContactXmlElements *unsupportedElements);
+    void handleEntryLink(QContactAvatar *avatar, bool *isAvatar, QString *photoEtag,
+                         GoogleContactXmlElements *unsupportedElements);
+    void handleEntryUnknownElement(GoogleContactXmlElements *unsupportedElements);
+    int bufferPosition(qint64 characterOffset);
 
-    typedef void (GoogleContactStream::*Handler)();
-    typedef QContactDetail (GoogleContactStream::*DetailHandler)();
+    QContactDetail handleEntryDetail(int element);
 
-    QMap<QString, GoogleContactStream::Handler> mAtomFunctionMap;
-    QMap<QString, GoogleContactStream::DetailHandler> mContactFunctionMap;
     QXmlStreamReader *mXmlReader;
+    QByteArray mXmlBuffer;
+    qint64 mCharacterOffset;
+    int mBufferPosition;
     GoogleContactAtom *mAtom;
     int mAccountId;
+    bool mResponse;
 
 // Encoding QContacts to XML stream
 private:
     void encodeContactUpdate(const QContact &qContact,
-                             const QStringList &unsupportedElements,
+                             const GoogleContactXmlElements &unsupportedElements,
                              const UpdateType updateType,
                              const bool batch);
     void startBatchFeed();
@@ -164,7 +163,7 @@ private:
     void encodeFamily(const QContactFamily &family);
     void encodeDisplayLabel(const QContactDisplayLabel &displayLabel);
 
-    void encodeUnknownElements(const QStringList &unknownElements);
+    void encodeUnknownElements(const GoogleContactXmlElements &unknownElements);
 
     QXmlStreamWriter *mXmlWriter;
     QList<QContactId> mEncodedContactsWithAvatars;
@@ -25,6 +25,7 @@
 #include "googlecontactimagedownloader.h"
 
 #include "constants_p.h"
+#include "socialdnetworkaccessmanager_p.h"
 #include "trace.h"
 
 #include <twowaycontactsyncadapter_impl.h>
@@ -34,6 +35,7 @@
 #include <QtCore/QUrlQuery>
 #include <QtCore/QFile>
 #include <QtCore/QByteArray>
+#include <QtCore/QDataStream>
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonObject>
 #include <QtCore/QJsonArray>
@@ -53,24 +55,122 @@
 #include <QtContacts/QContactBirthday>
 #include <QtContacts/QContactPhoneNumber>
 #include <QtContacts/QContactEmailAddress>
+#include <QtContacts/QContactTimestamp>
 
 #include <Accounts/Manager>
 #include <Accounts/Account>
 
 #define SOCIALD_GOOGLE_CONTACTS_SYNCTARGET QLatin1String("google")
 #define SOCIALD_GOOGLE_MAX_CONTACT_ENTRY_RESULTS 50
+#define SOCIALD_GOOGLE_UPSYNC_BATCHES_IN_FLIGHT_KEY QStringLiteral("upsync_batches_in_flight")
+#define SOCIALD_GOOGLE_DEFAULT_UPSYNC_BATCHES_IN_FLIGHT 3
+#define SOCIALD_GOOGLE_CONTACTS_CHECKPOINT QStringLiteral("contacts")
+// the checkpoint holds the received pages, so it only grows up to this many
+// pages; a sync interrupted beyond that requests the remaining pages again.
+#define SOCIALD_GOOGLE_CONTACTS_MAX_CHECKPOINT_PAGES 40
+#define SOCIALD_GOOGLE_CONTACTS_STATE_KEY_PREFIX QStringLiteral("contact:")
 
-static const char *IMAGE_DOWNLOADER_TOKEN_KEY = "url";
 static const char *IMAGE_DOWNLOADER_ACCOUNT_ID_KEY = "account_id";
 static const char *IMAGE_DOWNLOADER_IDENTIFIER_KEY = "identifier";
+static const char *IMAGE_DOWNLOADER_ETAG_KEY = "etag";
+
+static void updateLastModified(QDateTime *lastModified, const QContact &contact)
+{
+    QDateTime modified = contact.detail<QContactTimestamp>().lastModified();
+    if (modified.isValid() && (!lastModified->isValid() || modified > *lastModified)) {
+        *lastModified = modified;
+    }
+}
+
+// reads the unsupported elements of every contact, as stored by older versions.
+static QMap<QString, GoogleContactXmlElements> unsupportedElementsFromByteArray(const QByteArray &data)
+{
+    QMap<QString, GoogleContactXmlElements> unsupportedElements;
+    QJsonDocument legacyDoc = QJsonDocument::fromBinaryData(data);
+    if (!legacyDoc.isNull()) {
+        QJsonObject legacyObj = legacyDoc.object();
+        for (QJsonObject::const_iterator it = legacyObj.constBegin(); it != legacyObj.constEnd(); ++it) {
+            GoogleContactXmlElements elements;
+            foreach (const QJsonValue &element, it.value().toArray()) {
+                elements.append(element.toString().toUtf8());
+            }
+            unsupportedElements.insert(it.key(), elements);
+        }
+        return unsupportedElements;
+    }
+
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 count = 0;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString guid;
+        QByteArray elements;
+        stream >> guid >> elements;
+        if (stream.status() == QDataStream::Ok) {
+            unsupportedElements.insert(guid, GoogleContactXmlElements::fromByteArray(elements));
+        }
+    }
+    return unsupportedElements;
+}
+
+static QMap<QString, QString> stringMapFromByteArray(const QByteArray &data)
+{
+    QMap<QString, QString> map;
+    QJsonObject jsonObj = QJsonDocument::fromBinaryData(data).object();
+    for (QJsonObject::const_iterator it = jsonObj.constBegin(); it != jsonObj.constEnd(); ++it) {
+        map.insert(it.key(), it.value().toString());
+    }
+    return map;
+}
+
+static QString contactStateKey(const QString &contactGuid)
+{
+    return SOCIALD_GOOGLE_CONTACTS_STATE_KEY_PREFIX + contactGuid;
+}
+
+static QByteArray contactStateToByteArray(const QString &contactId, const QString &contactEtag,
+                                          const GoogleContactXmlElements &unsupportedElements)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << contactId << contactEtag << unsupportedElements.toByteArray();
+    return data;
+}
+
+static bool contactStateFromByteArray(const QByteArray &data, QString *contactId, QString *contactEtag,
+                                      GoogleContactXmlElements *unsupportedElements)
+{
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_0);
+    QByteArray elements;
+    stream >> *contactId >> *contactEtag >> elements;
+    *unsupportedElements = GoogleContactXmlElements::fromByteArray(elements);
+    return stream.status() == QDataStream::Ok;
+}
 
 GoogleTwoWayContactSyncAdaptor::GoogleTwoWayContactSyncAdaptor(QObject *parent)
     : GoogleDataTypeSyncAdaptor(SocialNetworkSyncAdaptor::Contacts, parent)
     , QtContactsSqliteExtensions::TwoWayContactSyncAdapter(QStringLiteral("google"))
-    , m_workerObject(new GoogleContactImageDownloader())
+    , m_avatarScheduler(new SocialdAvatarScheduler(QLatin1String("google"),
+                                                   SocialNetworkSyncAdaptor::dataTypeName(SocialNetworkSyncAdaptor::Contacts),
+                                                   this))
+    , m_workerObject(new GoogleContactImageDownloader(m_networkAccessManager, m_avatarScheduler))
+    , m_checkpoints(QLatin1String("google"), SocialNetworkSyncAdaptor::dataTypeName(SocialNetworkSyncAdaptor::Contacts))
+    , m_avatarStore(QLatin1String("google"), SocialNetworkSyncAdaptor::dataTypeName(SocialNetworkSyncAdaptor::Contacts))
 {
+    // avatars are downloaded as the scheduler allows.
+    connect(m_avatarScheduler, &SocialdAvatarScheduler::download,
+            m_workerObject, &AbstractImageDownloader::queue);
     connect(m_workerObject, &AbstractImageDownloader::imageDownloaded,
+            m_avatarScheduler, &SocialdAvatarScheduler::downloadFinished);
+    connect(m_avatarScheduler, &SocialdAvatarScheduler::imageDownloaded,
             this, &GoogleTwoWayContactSyncAdaptor::imageDownloaded);
+    connect(m_avatarScheduler, &SocialdAvatarScheduler::started,
+            this, &GoogleTwoWayContactSyncAdaptor::avatarDownloadsStarted);
+    connect(m_avatarScheduler, &SocialdAvatarScheduler::finished,
+            this, &GoogleTwoWayContactSyncAdaptor::avatarDownloadsFinished);
 
     // can sync, enabled
     setInitialActive(true);
@@ -97,6 +197,7 @@ void GoogleTwoWayContactSyncAdaptor::sync(const QString &dataTypeString, int acc
 void GoogleTwoWayContactSyncAdaptor::purgeDataForOldAccount(int oldId, SocialNetworkSyncAdaptor::PurgeMode )
 {
     purgeAccount(oldId);
+    m_checkpoints.removeAll(oldId);
 }
 
 void GoogleTwoWayContactSyncAdaptor::beginSync(int accountId, const QString &accessToken)
@@ -104,7 +205,7 @@ void GoogleTwoWayContactSyncAdaptor::beginSync(int accountId, const QString &acc
     Accounts::Account *account = m_accountManager->account(accountId);
     if (!account) {
         SOCIALD_LOG_ERROR("unable to load Google account" << accountId);
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         return;
     }
 
@@ -116,16 +217,22 @@ void GoogleTwoWayContactSyncAdaptor::beginSync(int accountId, const QString &acc
     account->deleteLater();
     if (emailAddress.isEmpty()) {
         SOCIALD_LOG_ERROR("unable to determine email address for Google account" << accountId);
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         return;
     }
 
     // clear our cache lists if necessary.
     m_localChanges[accountId].clear();
+    m_upsyncBatchesInFlight[accountId] = 0;
+    m_photoEtags[accountId].clear();
     m_remoteAddMods[accountId].clear();
     m_remoteDels[accountId].clear();
     m_accessTokens[accountId] = accessToken;
     m_emailAddresses[accountId] = emailAddress;
+    m_workerObject->setAccessToken(accountId, accessToken);
+
+    // resume the avatar downloads which didn't fit in the previous sync.
+    m_avatarScheduler->restoreDeferred(accountId);
 
     QDateTime remoteSince;
     if (!initSyncAdapter(QString::number(accountId))
@@ -133,7 +240,7 @@ void GoogleTwoWayContactSyncAdaptor::beginSync(int accountId, const QString &acc
             || !readExtraStateData(accountId)) {
         SOCIALD_LOG_ERROR("unable to init sync adapter - aborting sync Google contacts with account" << accountId);
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         return;
     }
 
@@ -154,6 +261,53 @@ void GoogleTwoWayContactSyncAdaptor::beginSync(int accountId, const QString &acc
 void GoogleTwoWayContactSyncAdaptor::determineRemoteChanges(const QDateTime &remoteSince, const QString &accountId)
 {
     int accId = accountId.toInt();
+    if (m_checkpoints.contains(accId, SOCIALD_GOOGLE_CONTACTS_CHECKPOINT)) {
+        QVariantMap cursor = m_checkpoints.cursor(accId, SOCIALD_GOOGLE_CONTACTS_CHECKPOINT);
+        if (cursor.value(QStringLiteral("remoteSince")).toString() == remoteSince.toString(Qt::ISODate)) {
+            // a previous sync was interrupted while receiving the remote changes.
+            // Collect the changes of the pages it received again, then request
+            // the remaining changes.  As the changes are ordered by modification
+            // time, the remaining ones (including any made since the interrupted
+            // sync) are those modified after the last change received; the
+            // boundary is inclusive, as several contacts can share a
+            // modification time.
+            QList<QByteArray> pages = m_checkpoints.pages(accId, SOCIALD_GOOGLE_CONTACTS_CHECKPOINT);
+            bool replayed = !pages.isEmpty();
+            foreach (const QByteArray &page, pages) {
+                if (!replayRemoteChangesPage(accId, page)) {
+                    replayed = false;
+                    break;
+                }
+            }
+
+            if (replayed) {
+                QDateTime lastModified = cursor.value(QStringLiteral("lastModified")).toDateTime();
+                QUrl requestUrl(QStringLiteral("https://www.google.com/m8/feeds/contacts/default/full/"));
+                QUrlQuery urlQuery;
+                // deletions are requested even for a clean sync, as contacts
+                // received before the interruption may have been deleted since.
+                urlQuery.addQueryItem("updated-min", lastModified.toString(Qt::ISODate));
+                urlQuery.addQueryItem("showdeleted", QStringLiteral("true"));
+                urlQuery.addQueryItem("orderby", QStringLiteral("lastmodified"));
+                urlQuery.addQueryItem("sortorder", QStringLiteral("ascending"));
+                urlQuery.addQueryItem("max-results", QString::number(SOCIALD_GOOGLE_MAX_CONTACT_ENTRY_RESULTS));
+                requestUrl.setQuery(urlQuery);
+                SOCIALD_LOG_INFO("resuming Google contact sync with account" << accId << "after" << pages.size() <<
+                                 "pages with changes since" << lastModified.toString(Qt::ISODate));
+                requestData(accId, m_accessTokens[accId], 0, requestUrl.toString(), remoteSince);
+                return;
+            }
+
+            // request all of the remote changes again instead.
+            SOCIALD_LOG_ERROR("unable to read checkpoint of Google contacts for account" << accId << "- not resuming");
+            m_remoteAddMods[accId].clear();
+            m_remoteDels[accId].clear();
+        }
+
+        // the remote changes were stored, or the sync state has been reset since.
+        m_checkpoints.remove(accId, SOCIALD_GOOGLE_CONTACTS_CHECKPOINT);
+    }
+
     requestData(accId, m_accessTokens[accId], 0, QString(), remoteSince);
 }
 
@@ -170,6 +324,9 @@ void GoogleTwoWayContactSyncAdaptor::requestData(int accountId, const QString &a
                 urlQuery.addQueryItem("updated-min", syncTimestamp.toString(Qt::ISODate));
                 urlQuery.addQueryItem("showdeleted", QStringLiteral("true"));
             }
+            // ordered by modification time, so that an interrupted sync can be resumed.
+            urlQuery.addQueryItem("orderby", QStringLiteral("lastmodified"));
+            urlQuery.addQueryItem("sortorder", QStringLiteral("ascending"));
         }
         if (startIndex >= 1) {
             urlQuery.addQueryItem ("start-index", QString::number(startIndex));
@@ -185,6 +342,10 @@ void GoogleTwoWayContactSyncAdaptor::requestData(int accountId, const QString &a
     req.setRawHeader(QString(QLatin1String("Authorization")).toUtf8(),
                      QString(QLatin1String("Bearer ") + accessToken).toUtf8());
 
+    if (isGroupRequest) {
+        req.setAttribute(SocialdNetworkAccessManager::RequestPriorityAttribute, SocialdNetworkAccessManager::MetadataPriority);
+    }
+
     SOCIALD_LOG_TRACE("requesting" << requestUrl << "with start index" << startIndex << "with account" << accountId);
 
     // we're requesting data.  Increment the semaphore so that we know we're still busy.
@@ -208,7 +369,7 @@ void GoogleTwoWayContactSyncAdaptor::requestData(int accountId, const QString &a
     } else {
         SOCIALD_LOG_ERROR("unable to request data from Google account with id" << accountId);
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         decrementSemaphore(accountId);
     }
 }
@@ -229,13 +390,13 @@ void GoogleTwoWayContactSyncAdaptor::groupsFinishedHandler()
         SOCIALD_LOG_ERROR("error occurred when performing groups request for Google account" << accountId);
 
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         decrementSemaphore(accountId);
         return;
     } else if (data.isEmpty()) {
         SOCIALD_LOG_ERROR("no groups data in reply from Google with account" << accountId);
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         decrementSemaphore(accountId);
         return;
     }
@@ -246,7 +407,7 @@ void GoogleTwoWayContactSyncAdaptor::groupsFinishedHandler()
     if (!atom) {
         SOCIALD_LOG_ERROR("unable to parse groups data from reply from Google using account with id" << accountId);
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         decrementSemaphore(accountId);
         return;
     }
@@ -298,13 +459,13 @@ void GoogleTwoWayContactSyncAdaptor::contactsFinishedHandler()
     if (isError) {
         SOCIALD_LOG_ERROR("error occurred when performing contacts request for Google account" << accountId);
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         decrementSemaphore(accountId);
         return;
     } else if (data.isEmpty()) {
         SOCIALD_LOG_ERROR("no contact data in reply from Google with account" << accountId);
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         decrementSemaphore(accountId);
         return;
     }
@@ -315,11 +476,52 @@ void GoogleTwoWayContactSyncAdaptor::contactsFinishedHandler()
     if (!atom) {
         SOCIALD_LOG_ERROR("unable to parse contacts data from reply from Google using account with id" << accountId);
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
+        decrementSemaphore(accountId);
+        return;
+    }
+
+    // only the changes of the page are kept until the last page has been received.
+    QDateTime lastModified;
+    if (!collectRemoteChangesPage(accountId, atom, &lastModified)) {
+        SOCIALD_LOG_ERROR("unable to read state of remote changes - aborting sync Google contacts for account" << accountId);
+        purgeSyncStateData(QString::number(accountId));
+        setAccountError(accountId);
+        delete atom;
         decrementSemaphore(accountId);
         return;
     }
 
+    if (!atom->nextEntriesUrl().isEmpty()) {
+        // request more if they exist.
+        startIndex += SOCIALD_GOOGLE_MAX_CONTACT_ENTRY_RESULTS;
+        SOCIALD_LOG_TRACE("more contact sync information is available server-side; performing another request with account" << accountId);
+        QVariantMap cursor = m_checkpoints.cursor(accountId, SOCIALD_GOOGLE_CONTACTS_CHECKPOINT);
+        if (m_checkpoints.pageCount(accountId, SOCIALD_GOOGLE_CONTACTS_CHECKPOINT) < SOCIALD_GOOGLE_CONTACTS_MAX_CHECKPOINT_PAGES) {
+            cursor.insert(QStringLiteral("remoteSince"), lastSyncTimestamp.toString(Qt::ISODate));
+            if (lastModified.isValid()) {
+                cursor.insert(QStringLiteral("lastModified"), lastModified);
+            }
+            if (cursor.value(QStringLiteral("lastModified")).isValid()) {
+                m_checkpoints.save(accountId, SOCIALD_GOOGLE_CONTACTS_CHECKPOINT, cursor, QList<QByteArray>() << data);
+            }
+        }
+        requestData(accountId, accessToken, startIndex, atom->nextEntriesUrl(), lastSyncTimestamp);
+    } else {
+        // we're finished downloading the remote changes - we should sync local changes up.
+        SOCIALD_LOG_INFO("Google contact sync with account" << accountId <<
+                         "got remote changes: a/m:" << m_remoteAddMods[accountId].size() <<
+                         "r:" << m_remoteDels[accountId].size());
+        continueSync(accountId);
+    }
+
+    delete atom;
+    decrementSemaphore(accountId);
+}
+
+void GoogleTwoWayContactSyncAdaptor::collectRemoteChanges(int accountId, GoogleContactAtom *atom, QDateTime *lastModified,
+                                                          QList<QContact> *remoteAddMods, QList<QContact> *remoteDels)
+{
     SOCIALD_LOG_TRACE("received information about" <<
                       atom->entryContacts().size() << "add/mod contacts and " <<
                       atom->deletedEntryContacts().size() << "del contacts" <<
@@ -332,58 +534,116 @@ void GoogleTwoWayContactSyncAdaptor::contactsFinishedHandler()
     // we also store the etag data out-of-band to avoid spurious contact saves
     // when the etag changes are reported by the remote server.
     // finally, we can set the id of the contact.
-    QList<QPair<QContact, QStringList> > remoteAddModContacts = atom->entryContacts();
+    QList<QPair<QContact, GoogleContactXmlElements> > remoteAddModContacts = atom->entryContacts();
     for (int i = 0; i < remoteAddModContacts.size(); ++i) {
         QContact c = remoteAddModContacts[i].first;
+        updateLastModified(lastModified, c);
+        // the elements are kept until the end of the sync, so they must not keep the page alive.
+        GoogleContactXmlElements unsupportedElements = remoteAddModContacts[i].second;
+        unsupportedElements.squeeze();
         m_unsupportedXmlElements[accountId].insert(
                 c.detail<QContactGuid>().guid(),
-                remoteAddModContacts[i].second);
+                unsupportedElements);
         m_contactEtags[accountId].insert(c.detail<QContactGuid>().guid(), c.detail<QContactOriginMetadata>().id());
+        setContactStateDirty(accountId, c.detail<QContactGuid>().guid());
         c.setId(QContactId::fromString(m_contactIds[accountId].value(c.detail<QContactGuid>().guid())));
-        m_remoteAddMods[accountId].append(c);
+        remoteAddMods->append(c);
+    }
+    // the photo etags tell whether the stored avatars are still current.
+    const QMap<QString, QString> photoEtags = atom->entryPhotoEtags();
+    for (QMap<QString, QString>::const_iterator it = photoEtags.constBegin(); it != photoEtags.constEnd(); ++it) {
+        m_photoEtags[accountId].insert(it.key(), it.value());
     }
     QList<QContact> remoteDelContacts = atom->deletedEntryContacts();
     for (int i = 0; i < remoteDelContacts.size(); ++i) {
         QContact c = remoteDelContacts[i];
+        updateLastModified(lastModified, c);
         c.setId(QContactId::fromString(m_contactIds[accountId].value(c.detail<QContactGuid>().guid())));
         m_contactAvatars[accountId].remove(c.detail<QContactGuid>().guid()); // just in case the avatar was outstanding.
-        m_remoteDels[accountId].append(c);
+        m_avatarStore.release(accountId, c.detail<QContactGuid>().guid());
+        removeContactState(accountId, c.detail<QContactGuid>().guid());
+        remoteDels->append(c);
     }
+}
 
-    if (!atom->nextEntriesUrl().isEmpty()) {
-        // request more if they exist.
-        startIndex += SOCIALD_GOOGLE_MAX_CONTACT_ENTRY_RESULTS;
-        SOCIALD_LOG_TRACE("more contact sync information is available server-side; performing another request with account" << accountId);
-        requestData(accountId, accessToken, startIndex, atom->nextEntriesUrl(), lastSyncTimestamp);
-    } else {
-        // we're finished downloading the remote changes - we should sync local changes up.
-        int addModCount = m_remoteAddMods[accountId].size(), removedCount = m_remoteDels[accountId].size();
-        SOCIALD_LOG_INFO("Google contact sync with account" << accountId <<
-                         "got remote changes: a/m:" << addModCount << "r:" << removedCount);
-        continueSync(accountId, accessToken);
+// collects the remote changes of one page of the contacts feed.  The two-way
+// sync adapter takes the remote changes of a sync in a single call, so they
+// are stored once the last page has been received, but only the changes (not
+// the pages, nor their unsupported elements' feed buffers) are kept until
+// then.  A contact which was changed again while the feed was being paged
+// through replaces its change from the earlier page, as the pages are ordered
+// by modification time.
+bool GoogleTwoWayContactSyncAdaptor::collectRemoteChangesPage(int accountId, GoogleContactAtom *atom,
+                                                              QDateTime *lastModified)
+{
+    // the stored state of the contacts in the page is needed to find their local ids.
+    QStringList contactGuids;
+    typedef QPair<QContact, GoogleContactXmlElements> Entry;
+    foreach (const Entry &entry, atom->entryContacts()) {
+        contactGuids.append(entry.first.detail<QContactGuid>().guid());
+    }
+    foreach (const QContact &c, atom->deletedEntryContacts()) {
+        contactGuids.append(c.detail<QContactGuid>().guid());
+    }
+    if (!loadContactStates(accountId, contactGuids)) {
+        return false;
     }
 
-    delete atom;
-    decrementSemaphore(accountId);
+    QList<QContact> remoteAddMods, remoteDels;
+    collectRemoteChanges(accountId, atom, lastModified, &remoteAddMods, &remoteDels);
+
+    // for each of the addmods, we need to fixup the contact avatars.
+    transformContactAvatars(remoteAddMods, accountId);
+
+    foreach (const QContact &c, remoteAddMods) {
+        const QString guid = c.detail<QContactGuid>().guid();
+        m_remoteDels[accountId].remove(guid);
+        m_remoteAddMods[accountId].insert(guid, c);
+    }
+    foreach (const QContact &c, remoteDels) {
+        const QString guid = c.detail<QContactGuid>().guid();
+        m_remoteAddMods[accountId].remove(guid);
+        m_remoteDels[accountId].insert(guid, c);
+    }
+    return true;
 }
 
-void GoogleTwoWayContactSyncAdaptor::continueSync(int accountId, const QString &accessToken)
+// collects the remote changes of a page received by an interrupted sync.
+bool GoogleTwoWayContactSyncAdaptor::replayRemoteChangesPage(int accountId, const QByteArray &data)
 {
-    // for each of the addmods, we need to fixup the contact avatars.
-    transformContactAvatars(m_remoteAddMods[accountId], accountId, accessToken);
+    GoogleContactStream parser(false, accountId);
+    GoogleContactAtom *atom = parser.parse(data);
+    if (!atom) {
+        SOCIALD_LOG_ERROR("unable to parse checkpoint page of Google account" << accountId);
+        return false;
+    }
+
+    QDateTime lastModified;
+    bool collected = collectRemoteChangesPage(accountId, atom, &lastModified);
+    delete atom;
+    return collected;
+}
 
+void GoogleTwoWayContactSyncAdaptor::continueSync(int accountId)
+{
     // now store the changes locally
-    SOCIALD_LOG_TRACE("storing remote changes locally for account" << accountId);
-    if (!storeRemoteChanges(m_remoteDels[accountId], &m_remoteAddMods[accountId], QString::number(accountId))) {
+    QList<QContact> remoteAddMods = m_remoteAddMods.take(accountId).values();
+    QList<QContact> remoteDels = m_remoteDels.take(accountId).values();
+    SOCIALD_LOG_TRACE("storing" << remoteAddMods.size() << "+" << remoteDels.size() <<
+                      "remote changes locally for account" << accountId);
+    if (!storeRemoteChanges(remoteDels, &remoteAddMods, QString::number(accountId))) {
         SOCIALD_LOG_ERROR("unable to store remote changes locally - aborting sync Google contacts for account" << accountId);
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         // note: don't decrement here - it's done by contactsFinishedHandler().
         return;
     }
 
+    // the remote changes have been stored; they needn't be resumed.
+    m_checkpoints.remove(accountId, SOCIALD_GOOGLE_CONTACTS_CHECKPOINT);
+
     // update our mapping of GUID to QContactId
-    foreach (const QContact &c, m_remoteAddMods[accountId]) {
+    foreach (const QContact &c, remoteAddMods) {
         if (c.id().toString().trimmed().isEmpty()) {
             SOCIALD_LOG_ERROR("no local contact id specified for contact with guid" <<
                               c.detail<QContactGuid>().guid() <<
@@ -392,6 +652,9 @@ void GoogleTwoWayContactSyncAdaptor::continueSync(int accountId, const QString &
             m_contactIds[accountId].insert(c.detail<QContactGuid>().guid(), c.id().toString());
         }
     }
+    // the remote changes needn't be held while the local changes are upsynced.
+    remoteAddMods.clear();
+    remoteDels.clear();
 
     // now determine which local changes need to be upsynced to the remote server
     QSet<QContactDetail::DetailType> ignorableDetailTypes;
@@ -413,7 +676,20 @@ void GoogleTwoWayContactSyncAdaptor::continueSync(int accountId, const QString &
     if (!determineLocalChanges(&localSince, &locallyAdded, &locallyModified, &locallyDeleted, QString::number(accountId), ignorableDetailTypes)) {
         SOCIALD_LOG_ERROR("unable to determine local changes - aborting sync Google contacts for account" << accountId);
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
+        // note: don't decrement here - it's done by contactsFinishedHandler().
+        return;
+    }
+
+    // the etags and unsupported elements of the changed contacts are needed to upsync them.
+    QStringList changedContactGuids;
+    foreach (const QContact &c, locallyModified + locallyDeleted) {
+        changedContactGuids.append(c.detail<QContactGuid>().guid());
+    }
+    if (!loadContactStates(accountId, changedContactGuids)) {
+        SOCIALD_LOG_ERROR("unable to read state of local changes - aborting sync Google contacts for account" << accountId);
+        purgeSyncStateData(QString::number(accountId));
+        setAccountError(accountId);
         // note: don't decrement here - it's done by contactsFinishedHandler().
         return;
     }
@@ -444,6 +720,7 @@ void GoogleTwoWayContactSyncAdaptor::upsyncLocalChanges(const QDateTime &localSi
     foreach (const QContact &c, locallyDeleted) {
         contactUpdatesToPost.append(qMakePair(c, GoogleContactStream::Remove));
         m_contactAvatars[accId].remove(c.detail<QContactGuid>().guid()); // just in case the avatar was outstanding.
+        m_avatarStore.release(accId, c.detail<QContactGuid>().guid());
         alreadyEncoded.append(c.id());
     }
     foreach (const QContact &c, locallyAdded) {
@@ -473,48 +750,62 @@ bool GoogleTwoWayContactSyncAdaptor::testAccountProvenance(const QContact &conta
 
 void GoogleTwoWayContactSyncAdaptor::upsyncLocalChangesList(int accountId)
 {
-    bool postedData = false;
-    if (!m_accountSyncProfile || m_accountSyncProfile->syncDirection() != Buteo::SyncProfile::SYNC_DIRECTION_FROM_REMOTE) {
+    if (failedAccounts().contains(accountId)) {
+        // a previous batch failed, so the sync of this account is being aborted.
+        m_avatarScheduler->setDataComplete(accountId);
+        return;
+    }
+
+    Buteo::SyncProfile *syncProfile = accountSyncProfile(accountId);
+    if (!syncProfile || syncProfile->syncDirection() != Buteo::SyncProfile::SYNC_DIRECTION_FROM_REMOTE) {
         // two-way sync is the default setting.  Upsync the changes.
-        int batchCount = 0;
-        QMultiMap<GoogleContactStream::UpdateType, QPair<QContact, QStringList> > batch;
-        for (int i = m_localChanges[accountId].size() - 1; i >= 0; --i) {
-            QPair<QContact, GoogleContactStream::UpdateType> entry = m_localChanges[accountId].takeAt(i);
-            QStringList extraXmlElements = m_unsupportedXmlElements[accountId].value(entry.first.detail<QContactGuid>().guid());
-            if (entry.second == GoogleContactStream::Add) {
-                // new contacts need to be inserted into the My Contacts group
-                QString myContactsGroupAtomId = m_myContactsGroupAtomIds[accountId];
-                if (myContactsGroupAtomId.isEmpty()) {
-                    SOCIALD_LOG_INFO("skipping upload of locally added contact" << entry.first.id().toString() <<
-                                     "to account" << accountId << "due to unknown My Contacts group atom id");
+        // Several batches are kept in flight, so that the next batch is encoded and
+        // uploaded while the server processes the previous ones.  Each contact is in
+        // at most one batch, so the batches are independent of each other.
+        const int maxBatchesInFlight = qMax(1, syncProfile
+                ? syncProfile->key(SOCIALD_GOOGLE_UPSYNC_BATCHES_IN_FLIGHT_KEY,
+                                   QString::number(SOCIALD_GOOGLE_DEFAULT_UPSYNC_BATCHES_IN_FLIGHT)).toInt()
+                : SOCIALD_GOOGLE_DEFAULT_UPSYNC_BATCHES_IN_FLIGHT);
+        while (m_upsyncBatchesInFlight[accountId] < maxBatchesInFlight && !m_localChanges[accountId].isEmpty()) {
+            int batchCount = 0;
+            QMultiMap<GoogleContactStream::UpdateType, QPair<QContact, GoogleContactXmlElements> > batch;
+            while (batchCount < SOCIALD_GOOGLE_MAX_CONTACT_ENTRY_RESULTS && !m_localChanges[accountId].isEmpty()) {
+                QPair<QContact, GoogleContactStream::UpdateType> entry = m_localChanges[accountId].takeLast();
+                GoogleContactXmlElements extraXmlElements = m_unsupportedXmlElements[accountId].value(entry.first.detail<QContactGuid>().guid());
+                if (entry.second == GoogleContactStream::Add) {
+                    // new contacts need to be inserted into the My Contacts group
+                    QString myContactsGroupAtomId = m_myContactsGroupAtomIds[accountId];
+                    if (myContactsGroupAtomId.isEmpty()) {
+                        SOCIALD_LOG_INFO("skipping upload of locally added contact" << entry.first.id().toString() <<
+                                         "to account" << accountId << "due to unknown My Contacts group atom id");
+                    } else {
+                        extraXmlElements.append(QStringLiteral("<gContact:groupMembershipInfo deleted=\"false\" href=\"%1\"></gContact:groupMembershipInfo>").arg(myContactsGroupAtomId).toUtf8());
+                        batch.insertMulti(entry.second, qMakePair(entry.first, extraXmlElements));
+                        batchCount++;
+                    }
                 } else {
-                    extraXmlElements.append(QStringLiteral("<gContact:groupMembershipInfo deleted=\"false\" href=\"%1\"></gContact:groupMembershipInfo>").arg(myContactsGroupAtomId));
                     batch.insertMulti(entry.second, qMakePair(entry.first, extraXmlElements));
                     batchCount++;
                 }
-            } else {
-                batch.insertMulti(entry.second, qMakePair(entry.first, extraXmlElements));
-                batchCount++;
             }
 
-            if (batchCount == SOCIALD_GOOGLE_MAX_CONTACT_ENTRY_RESULTS || i == 0) {
+            if (batchCount > 0) {
                 GoogleContactStream encoder(false, accountId, m_emailAddresses[accountId]);
                 QByteArray encodedContactUpdates = encoder.encode(batch);
-                SOCIALD_LOG_TRACE("storing a batch of" << batchCount << "local changes to remote server for account" << accountId);
-                batch.clear();
-                batchCount = 0;
+                SOCIALD_LOG_TRACE("storing a batch of" << batchCount << "local changes to remote server for account" << accountId <<
+                                  "with" << m_upsyncBatchesInFlight[accountId] << "batches in flight");
                 storeToRemote(accountId, m_accessTokens[accountId], encodedContactUpdates);
-                postedData = true;
-                break;
             }
         }
     } else {
         SOCIALD_LOG_INFO("skipping upload of local contacts changes due to profile direction setting for account" << accountId);
     }
 
-    if (!postedData) {
+    if (m_upsyncBatchesInFlight[accountId] == 0 && !failedAccounts().contains(accountId)) {
         // nothing left to upsync.  attempt to download any outstanding avatars.
-        queueOutstandingAvatars(accountId, m_accessTokens[accountId]);
+        queueOutstandingAvatars(accountId);
+        // the sync now only waits for the avatars.
+        m_avatarScheduler->setDataComplete(accountId);
     }
 }
 
@@ -530,6 +821,7 @@ void GoogleTwoWayContactSyncAdaptor::storeToRemote(int accountId, const QString
     req.setHeader(QNetworkRequest::ContentLengthHeader, encodedContactUpdates.size());
     req.setRawHeader(QString(QLatin1String("If-Match")).toUtf8(),
                      QString(QLatin1String("*")).toUtf8());
+    req.setAttribute(SocialdNetworkAccessManager::RequestPriorityAttribute, SocialdNetworkAccessManager::UpsyncPriority);
 
     // we're posting data.  Increment the semaphore so that we know we're still busy.
     incrementSemaphore(accountId);
@@ -541,11 +833,13 @@ void GoogleTwoWayContactSyncAdaptor::storeToRemote(int accountId, const QString
         connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(postErrorHandler()));
         connect(reply, SIGNAL(finished()), this, SLOT(postFinishedHandler()));
         m_apiRequestsRemaining[accountId] = m_apiRequestsRemaining[accountId] - 1;
+        m_upsyncBatchesInFlight[accountId] = m_upsyncBatchesInFlight[accountId] + 1;
         setupReplyTimeout(accountId, reply);
     } else {
         SOCIALD_LOG_ERROR("unable to post contacts to Google account with id" << accountId);
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
+        m_localChanges[accountId].clear();
         decrementSemaphore(accountId);
     }
 }
@@ -557,12 +851,14 @@ void GoogleTwoWayContactSyncAdaptor::postFinishedHandler()
     int accountId = reply->property("accountId").toInt();
     reply->deleteLater();
     removeReplyTimeout(accountId, reply);
+    m_upsyncBatchesInFlight[accountId] = m_upsyncBatchesInFlight[accountId] - 1;
 
     if (reply->property("isError").toBool()) {
         SOCIALD_LOG_ERROR("error occurred posting contact data to google with account" << accountId << "," <<
                           "got response:" << QString::fromUtf8(response));
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
+        m_localChanges[accountId].clear();
         decrementSemaphore(accountId);
         return;
     }
@@ -590,19 +886,37 @@ void GoogleTwoWayContactSyncAdaptor::postFinishedHandler()
     if (errorOccurredInBatch) {
         SOCIALD_LOG_ERROR("error occurred during batch operation with Google account" << accountId);
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
+        m_localChanges[accountId].clear();
+        delete atom;
         decrementSemaphore(accountId);
         return;
     }
 
     // update our map of guid to contact id, now that we know which remote GUID was generated for which contactId.
     foreach (const QString &contactId, batchOperationIdsToGuids.keys()) {
-        if (!batchOperationIdsToGuids.value(contactId).isEmpty()) {
-            m_contactIds[accountId].insert(batchOperationIdsToGuids.value(contactId), contactId);
+        const QString guid = batchOperationIdsToGuids.value(contactId);
+        if (!guid.isEmpty()) {
+            m_contactIds[accountId].insert(guid, contactId);
+            m_loadedContactStates[accountId].insert(guid); // a new remote contact has no stored state.
+            setContactStateDirty(accountId, guid);
+        }
+    }
+
+    // and of the etags of the contacts which the server returned, so that they
+    // match the server's version of the contacts even before the next sync.
+    typedef QPair<QContact, GoogleContactXmlElements> Entry;
+    foreach (const Entry &entry, atom->entryContacts()) {
+        const QString guid = entry.first.detail<QContactGuid>().guid();
+        const QString etag = entry.first.detail<QContactOriginMetadata>().id();
+        if (!guid.isEmpty() && !etag.isEmpty()) {
+            m_contactEtags[accountId].insert(guid, etag);
+            setContactStateDirty(accountId, guid);
         }
     }
+    delete atom;
 
-    // continue with more, if there were more than one page of updates to post.
+    // continue with more, if there are more batches of updates to post.
     upsyncLocalChangesList(accountId);
 
     // finished with this request, so decrementing semaphore.
@@ -614,12 +928,12 @@ void GoogleTwoWayContactSyncAdaptor::postErrorHandler()
     sender()->setProperty("isError", QVariant::fromValue<bool>(true));
 }
 
-void GoogleTwoWayContactSyncAdaptor::queueOutstandingAvatars(int accountId, const QString &accessToken)
+void GoogleTwoWayContactSyncAdaptor::queueOutstandingAvatars(int accountId)
 {
     int queuedCount = 0;
     for (QMap<QString, QString>::const_iterator it = m_contactAvatars[accountId].constBegin();
             it != m_contactAvatars[accountId].constEnd(); ++it) {
-        if (!it.value().isEmpty() && queueAvatarForDownload(accountId, accessToken, it.key(), it.value())) {
+        if (!it.value().isEmpty() && queueAvatarForDownload(accountId, it.key(), it.value())) {
             queuedCount++;
         }
     }
@@ -627,7 +941,7 @@ void GoogleTwoWayContactSyncAdaptor::queueOutstandingAvatars(int accountId, cons
     SOCIALD_LOG_DEBUG("queued" << queuedCount << "avatars for download for account" << accountId);
 }
 
-bool GoogleTwoWayContactSyncAdaptor::queueAvatarForDownload(int accountId, const QString &accessToken, const QString &contactGuid, const QString &imageUrl)
+bool GoogleTwoWayContactSyncAdaptor::queueAvatarForDownload(int accountId, const QString &contactGuid, const QString &imageUrl)
 {
     if (m_apiRequestsRemaining[accountId] > 0 && !m_queuedAvatarsForDownload[accountId].contains(contactGuid)) {
         m_apiRequestsRemaining[accountId] = m_apiRequestsRemaining[accountId] - 1;
@@ -635,10 +949,9 @@ bool GoogleTwoWayContactSyncAdaptor::queueAvatarForDownload(int accountId, const
 
         QVariantMap metadata;
         metadata.insert(IMAGE_DOWNLOADER_ACCOUNT_ID_KEY, accountId);
-        metadata.insert(IMAGE_DOWNLOADER_TOKEN_KEY, accessToken);
         metadata.insert(IMAGE_DOWNLOADER_IDENTIFIER_KEY, contactGuid);
-        incrementSemaphore(accountId);
-        m_workerObject->queue(imageUrl, metadata);
+        metadata.insert(IMAGE_DOWNLOADER_ETAG_KEY, m_photoEtags[accountId].value(contactGuid));
+        m_avatarScheduler->enqueue(accountId, imageUrl, metadata);
 
         return true;
     }
@@ -646,13 +959,13 @@ bool GoogleTwoWayContactSyncAdaptor::queueAvatarForDownload(int accountId, const
     return false;
 }
 
-void GoogleTwoWayContactSyncAdaptor::transformContactAvatars(QList<QContact> &remoteContacts, int accountId, const QString &accessToken)
+void GoogleTwoWayContactSyncAdaptor::transformContactAvatars(QList<QContact> &remoteContacts, int accountId)
 {
     // The avatar detail from the remote contact will be of the form:
     // https://www.google.com/m8/feeds/photos/media/user@gmail.com/userId
     // We need to:
-    // 1) transform this to a local filename.
-    // 2) determine if the local file exists.
+    // 1) find the image stored for the contact, if any.
+    // 2) determine from the photo etag whether the stored image is current.
     // 3) if not, trigger downloading the avatar.
 
     for (int i = 0; i < remoteContacts.size(); ++i) {
@@ -674,33 +987,46 @@ void GoogleTwoWayContactSyncAdaptor::transformContactAvatars(QList<QContact> &re
             }
             QString remoteImageUrl = avatar.imageUrl().toString();
             if (!remoteImageUrl.isEmpty() && !avatar.imageUrl().isLocalFile()) {
-                // transform to a local file name.
-                QString localFileName = GoogleContactImageDownloader::staticOutputFile(
-                        contactGuid, remoteImageUrl);
-
-                // and trigger downloading the image, if it doesn't already exist.
-                // this means that we shouldn't download images needlessly after
-                // first sync, but it also means that if it updates/changes on the
-                // server side, we also won't retrieve any updated image.
-                if (QFile::exists(localFileName)) {
-                    QImageReader reader(localFileName);
-                    if (reader.canRead()) {
-                        // avatar image already exists, update the detail in the contact.
-                        avatar.setImageUrl(localFileName);
+                QByteArray photoEtag = m_photoEtags[accountId].value(contactGuid).toUtf8();
+                QString storedImage = m_avatarStore.imageFile(accountId, contactGuid);
+                if (storedImage.isEmpty()) {
+                    // adopt the image downloaded by an older version, if any.  It was
+                    // never refreshed, so we assume it matches the current photo.
+                    QString localFileName = GoogleContactImageDownloader::staticOutputFile(
+                            contactGuid, remoteImageUrl);
+                    if (QFile::exists(localFileName)) {
+                        QImageReader reader(localFileName);
+                        if (reader.canRead()) {
+                            storedImage = m_avatarStore.store(accountId, contactGuid, localFileName,
+                                                              remoteImageUrl, photoEtag);
+                        } else {
+                            // not a valid image file.  Could be artifact from an error.
+                            QFile::remove(localFileName);
+                        }
+                    }
+                    if (!storedImage.isEmpty()) {
+                        avatar.setImageUrl(storedImage);
                         curr.saveDetail(&avatar);
-                    } else {
-                        // not a valid image file.  Could be artifact from an error.
-                        QFile::remove(localFileName);
+                        continue;
                     }
+                } else if (!photoEtag.isEmpty() && m_avatarStore.etag(accountId, contactGuid) == photoEtag) {
+                    // the photo hasn't changed since it was downloaded.
+                    avatar.setImageUrl(storedImage);
+                    curr.saveDetail(&avatar);
+                    continue;
                 }
 
-                if (!QFile::exists(localFileName)) {
+                if (storedImage.isEmpty()) {
                     // temporarily remove the avatar from the contact
-                    m_contactAvatars[accountId].insert(contactGuid, remoteImageUrl);
                     curr.removeDetail(&avatar);
-                    // then trigger the download
-                    queueAvatarForDownload(accountId, accessToken, contactGuid, remoteImageUrl);
+                } else {
+                    // keep the previous image until the new one has been downloaded.
+                    avatar.setImageUrl(storedImage);
+                    curr.saveDetail(&avatar);
                 }
+                m_contactAvatars[accountId].insert(contactGuid, remoteImageUrl);
+                // then trigger the download
+                queueAvatarForDownload(accountId, contactGuid, remoteImageUrl);
             }
         }
     }
@@ -709,9 +1035,7 @@ void GoogleTwoWayContactSyncAdaptor::transformContactAvatars(QList<QContact> &re
 void GoogleTwoWayContactSyncAdaptor::imageDownloaded(const QString &url, const QString &path,
                                                      const QVariantMap &metadata)
 {
-    Q_UNUSED(url)
-
-    // Load finished, update the avatar, decrement semaphore
+    // Load finished, update the avatar
     int accountId = metadata.value(IMAGE_DOWNLOADER_ACCOUNT_ID_KEY).toInt();
     QString contactGuid = metadata.value(IMAGE_DOWNLOADER_IDENTIFIER_KEY).toString();
 
@@ -720,9 +1044,22 @@ void GoogleTwoWayContactSyncAdaptor::imageDownloaded(const QString &url, const Q
         // no longer outstanding.
         m_contactAvatars[accountId].remove(contactGuid);
         m_queuedAvatarsForDownload[accountId].remove(contactGuid);
-        m_downloadedContactAvatars[accountId].insert(contactGuid, path);
+        // an identical image may already be stored for another contact or account.
+        // the reference is committed once the contact has been saved with it.
+        QString storedImage = m_avatarStore.stage(accountId, contactGuid, path, url,
+                                                  metadata.value(IMAGE_DOWNLOADER_ETAG_KEY).toString().toUtf8());
+        m_downloadedContactAvatars[accountId].insert(contactGuid, storedImage.isEmpty() ? path : storedImage);
     }
+}
+
+void GoogleTwoWayContactSyncAdaptor::avatarDownloadsStarted(int accountId)
+{
+    // the sync waits for all of the scheduled avatar downloads.
+    incrementSemaphore(accountId);
+}
 
+void GoogleTwoWayContactSyncAdaptor::avatarDownloadsFinished(int accountId)
+{
     decrementSemaphore(accountId);
 }
 
@@ -779,11 +1116,28 @@ void GoogleTwoWayContactSyncAdaptor::purgeAccount(int pid)
     // artifacts still remain (eg, if msyncd wasn't running at the time that the account
     // was removed, due to a crash, etc) - in which case the cached value would be wrong.
     QString oobScope = QStringLiteral("%1-%2").arg(SOCIALD_GOOGLE_CONTACTS_SYNCTARGET).arg(pid);
+
+    // purge the per-contact OOB keys
+    QStringList oobKeys;
+    if (!d->m_engine->fetchOOBKeys(oobScope, &oobKeys)) {
+        success = false;
+        SOCIALD_LOG_ERROR("error occurred while reading OOB keys for removed Google account" << pid);
+    }
+    foreach (const QString &key, oobKeys) {
+        if (key.startsWith(SOCIALD_GOOGLE_CONTACTS_STATE_KEY_PREFIX)) {
+            purgeKeys.append(key);
+        }
+    }
+
     if (!d->m_engine->removeOOB(oobScope, purgeKeys)) {
         success = false;
         SOCIALD_LOG_ERROR("error occurred while purging OOB data for removed Google account" << pid);
     }
 
+    // the images themselves are removed by the next garbage collection.
+    m_avatarStore.releaseAll(pid);
+    m_avatarScheduler->removeAll(pid);
+
     if (success) {
         SOCIALD_LOG_INFO("purged account" << pid << "and successfully removed" << purgeCount << "contacts");
     }
@@ -808,6 +1162,7 @@ void GoogleTwoWayContactSyncAdaptor::finalize(int accountId)
         // create an update pair from the current mutationPrevRemote version and the new version (with updated avatar).
         QList<QPair<QContact, QContact> > contactAvatarUpdates;
         QMap<int, QContact> prevRemoteMutations;
+        QStringList updatedGuids;
         for (QMap<QString, QString>::const_iterator it = m_downloadedContactAvatars[accountId].constBegin();
                 it != m_downloadedContactAvatars[accountId].constEnd(); ++it) {
             int idx = mprGuidToIndex.value(it.key(), -1);
@@ -827,6 +1182,7 @@ void GoogleTwoWayContactSyncAdaptor::finalize(int accountId)
                 modC.saveDetail(&a);
                 contactAvatarUpdates.append(qMakePair(c, modC));
                 prevRemoteMutations.insert(idx, modC);
+                updatedGuids.append(it.key());
                 break;
             }
         }
@@ -842,19 +1198,38 @@ void GoogleTwoWayContactSyncAdaptor::finalize(int accountId)
                  it != prevRemoteMutations.constEnd(); ++it) {
                 d->m_stateData[QString::number(accountId)].m_mutatedPrevRemote.replace(it.key(), it.value());
             }
+            // the stored images may now replace the previous ones.
+            foreach (const QString &guid, updatedGuids) {
+                m_avatarStore.commit(accountId, guid);
+            }
         } else {
             SOCIALD_LOG_ERROR("finalize: error adding avatars for" << contactAvatarUpdates.size() <<
                               "Google contacts from account" << accountId);
         }
     }
+    m_avatarStore.flush();
 
     if (!storeExtraStateData(accountId) || !storeSyncStateData(QString::number(accountId))) {
         SOCIALD_LOG_ERROR("unable to finalize sync of Google contacts with account" << accountId);
         purgeSyncStateData(QString::number(accountId));
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
     }
 }
 
+void GoogleTwoWayContactSyncAdaptor::setAccountError(int accountId)
+{
+    // the sync of the account is now only waiting for its avatar downloads.
+    GoogleDataTypeSyncAdaptor::setAccountError(accountId);
+    m_avatarScheduler->setDataComplete(accountId);
+}
+
+void GoogleTwoWayContactSyncAdaptor::abortRequests()
+{
+    // the avatar downloads are not tracked by the reply timeouts.
+    GoogleDataTypeSyncAdaptor::abortRequests();
+    m_avatarScheduler->deferAll();
+}
+
 void GoogleTwoWayContactSyncAdaptor::finalCleanup()
 {
     // Synchronously find any contacts which need to be removed,
@@ -967,6 +1342,9 @@ void GoogleTwoWayContactSyncAdaptor::finalCleanup()
             purgeAccount(purgeId);
         }
     }
+
+    // sixth, remove the avatar images which are no longer referenced by any account.
+    m_avatarStore.collectGarbage();
 }
 
 // this function must be called directly after readSyncStateData()
@@ -975,11 +1353,12 @@ bool GoogleTwoWayContactSyncAdaptor::readExtraStateData(int accountId)
     QMap<QString, QVariant> values;
     QStringList keys;
     keys << QStringLiteral("myContactsGroupAtomId")
-         << QStringLiteral("unsupportedElements")
-         << QStringLiteral("contactEtags")
-         << QStringLiteral("contactIds")
          << QStringLiteral("contactAvatars");
-    if (!d->m_engine->fetchOOB(d->m_stateData[QString::number(accountId)].m_oobScope, keys, &values)) {
+    QStringList legacyKeys;
+    legacyKeys << QStringLiteral("unsupportedElements")
+               << QStringLiteral("contactEtags")
+               << QStringLiteral("contactIds");
+    if (!d->m_engine->fetchOOB(d->m_stateData[QString::number(accountId)].m_oobScope, keys + legacyKeys, &values)) {
         SOCIALD_LOG_ERROR("failed to read extra data for" << d->m_syncTarget << "account" << accountId);
         d->clear(QString::number(accountId));
         return false;
@@ -989,58 +1368,37 @@ bool GoogleTwoWayContactSyncAdaptor::readExtraStateData(int accountId)
     QString myContactsGroupAtomId = values.value(QStringLiteral("myContactsGroupAtomId")).toString();
     m_myContactsGroupAtomIds.insert(accountId, myContactsGroupAtomId);
 
-    // m_unsupportedElements
-    QVariant ueValue = values.value(QStringLiteral("unsupportedElements"));
-    QByteArray ueValueBA = ueValue.toByteArray();
-    QJsonObject ueJsonObj = QJsonDocument::fromBinaryData(ueValueBA).object();
-    QStringList contactGuids = ueJsonObj.keys();
-    QMap<QString, QStringList> guidToUnsupportedElements;
-    foreach (const QString &guid, contactGuids) {
-        QVariantList unsupportedElementsVL = ueJsonObj.value(guid).toArray().toVariantList();
-        QStringList unsupportedElements;
-        foreach (const QVariant &v, unsupportedElementsVL) {
-            if (!v.toString().isEmpty()) {
-                unsupportedElements.append(v.toString());
-            }
+    // the per-contact state is loaded as needed during the sync, see loadContactStates().
+    m_unsupportedXmlElements[accountId].clear();
+    m_contactEtags[accountId].clear();
+    m_contactIds[accountId].clear();
+    m_loadedContactStates[accountId].clear();
+    m_dirtyContactStates[accountId].clear();
+    m_removedContactStates[accountId].clear();
+    m_legacyStateKeys[accountId].clear();
+
+    // older versions stored the state of every contact in a single key per datum.
+    // Migrate it, so that it is stored per-contact when this sync completes.
+    foreach (const QString &legacyKey, legacyKeys) {
+        if (!values.value(legacyKey).toByteArray().isEmpty()) {
+            m_legacyStateKeys[accountId].append(legacyKey);
         }
-
-        guidToUnsupportedElements.insert(guid, unsupportedElements);
-    }
-    m_unsupportedXmlElements[accountId] = guidToUnsupportedElements;
-
-    // m_contactEtags
-    QVariant ceValue = values.value(QStringLiteral("contactEtags"));
-    QByteArray ceValueBA = ceValue.toByteArray();
-    QJsonObject ceJsonObj = QJsonDocument::fromBinaryData(ceValueBA).object();
-    contactGuids = ceJsonObj.keys();
-    QMap<QString, QString> guidToContactEtag;
-    foreach (const QString &guid, contactGuids) {
-        guidToContactEtag.insert(guid, ceJsonObj.value(guid).toString());
     }
-    m_contactEtags[accountId] = guidToContactEtag;
-
-    // m_contactIds
-    QVariant ciValue = values.value(QStringLiteral("contactIds"));
-    QByteArray ciValueBA = ciValue.toByteArray();
-    QJsonObject ciJsonObj = QJsonDocument::fromBinaryData(ciValueBA).object();
-    contactGuids = ciJsonObj.keys();
-    QMap<QString, QString> guidToContactId;
-    foreach (const QString &guid, contactGuids) {
-        guidToContactId.insert(guid, ciJsonObj.value(guid).toString());
+    if (!m_legacyStateKeys[accountId].isEmpty()) {
+        m_unsupportedXmlElements[accountId] = unsupportedElementsFromByteArray(values.value(QStringLiteral("unsupportedElements")).toByteArray());
+        m_contactEtags[accountId] = stringMapFromByteArray(values.value(QStringLiteral("contactEtags")).toByteArray());
+        m_contactIds[accountId] = stringMapFromByteArray(values.value(QStringLiteral("contactIds")).toByteArray());
+        QSet<QString> contactGuids = m_contactIds[accountId].keys().toSet();
+        contactGuids.unite(m_contactEtags[accountId].keys().toSet());
+        contactGuids.unite(m_unsupportedXmlElements[accountId].keys().toSet());
+        m_loadedContactStates[accountId] = contactGuids;
+        m_dirtyContactStates[accountId] = contactGuids;
+        SOCIALD_LOG_INFO("migrating state of" << contactGuids.size() << "contacts from account" << accountId);
     }
-    m_contactIds[accountId] = guidToContactId;
 
     // m_contactAvatars
-    QVariant caValue = values.value(QStringLiteral("contactAvatars"));
-    QByteArray caValueBA = caValue.toByteArray();
-    QJsonObject caJsonObj = QJsonDocument::fromBinaryData(caValueBA).object();
-    contactGuids = caJsonObj.keys();
-    QMap<QString, QString> guidToContactAvatar;
-    foreach (const QString &guid, contactGuids) {
-        guidToContactAvatar.insert(guid, caJsonObj.value(guid).toString());
-    }
-    m_contactAvatars[accountId] = guidToContactAvatar;
-    SOCIALD_LOG_INFO("have" << guidToContactAvatar.size() <<
+    m_contactAvatars[accountId] = stringMapFromByteArray(values.value(QStringLiteral("contactAvatars")).toByteArray());
+    SOCIALD_LOG_INFO("have" << m_contactAvatars[accountId].size() <<
                      "outstanding contact avatars to sync from account" << accountId);
 
     // Finally, if we're doing a "clean sync" we should pre-populate our prevRemote
@@ -1071,6 +1429,7 @@ bool GoogleTwoWayContactSyncAdaptor::readExtraStateData(int accountId)
                 prevRemote.append(c);
                 exportedIds.append(c.id());
                 m_contactIds[accountId].insert(c.detail<QContactGuid>().guid(), c.id().toString());
+                setContactStateDirty(accountId, c.detail<QContactGuid>().guid());
             } else {
                 // if any came from the one-way sync adaptor, they will need to mangled to the new form.
                 QStringList accountIds = c.detail<QContactOriginMetadata>().groupId().split(',');
@@ -1087,6 +1446,7 @@ bool GoogleTwoWayContactSyncAdaptor::readExtraStateData(int accountId)
                     prevRemote.append(c);
                     exportedIds.append(c.id());
                     m_contactIds[accountId].insert(newGuid, c.id().toString());
+                    setContactStateDirty(accountId, newGuid);
                 }
             }
         }
@@ -1103,35 +1463,17 @@ bool GoogleTwoWayContactSyncAdaptor::readExtraStateData(int accountId)
 // this function must be called directly before storeSyncStateData()
 bool GoogleTwoWayContactSyncAdaptor::storeExtraStateData(int accountId)
 {
-    // m_myContactsGroupAtomIds
-    QVariant mcghValue(m_myContactsGroupAtomIds[accountId]);
-
-    // m_unsupportedXmlElements
-    QJsonObject ueJsonObj;
-    for (QMap<QString, QStringList>::const_iterator it = m_unsupportedXmlElements[accountId].constBegin();
-            it != m_unsupportedXmlElements[accountId].constEnd(); ++it) {
-        ueJsonObj.insert(it.key(), QJsonValue(QJsonArray::fromStringList(it.value())));
-    }
-    QJsonDocument ueJsonDoc(ueJsonObj);
-    QVariant ueValue(ueJsonDoc.toBinaryData());
+    const QString oobScope = d->m_stateData[QString::number(accountId)].m_oobScope;
 
-    // m_contactEtags
-    QJsonObject ceJsonObj;
-    for (QMap<QString, QString>::const_iterator it = m_contactEtags[accountId].constBegin();
-            it != m_contactEtags[accountId].constEnd(); ++it) {
-        ceJsonObj.insert(it.key(), QJsonValue(it.value()));
+    // the contacts whose state changed without it being loaded (eg, the local ids
+    // found during a clean sync) must have the rest of their stored state read first.
+    if (!loadContactStates(accountId, m_dirtyContactStates[accountId].toList())) {
+        d->clear(QString::number(accountId));
+        return false;
     }
-    QJsonDocument ceJsonDoc(ceJsonObj);
-    QVariant ceValue(ceJsonDoc.toBinaryData());
 
-    // m_contactIds
-    QJsonObject ciJsonObj;
-    for (QMap<QString, QString>::const_iterator it = m_contactIds[accountId].constBegin();
-            it != m_contactIds[accountId].constEnd(); ++it) {
-        ciJsonObj.insert(it.key(), QJsonValue(it.value()));
-    }
-    QJsonDocument ciJsonDoc(ciJsonObj);
-    QVariant ciValue(ciJsonDoc.toBinaryData());
+    // m_myContactsGroupAtomIds
+    QVariant mcghValue(m_myContactsGroupAtomIds[accountId]);
 
     // m_contactAvatars
     QJsonObject caJsonObj;
@@ -1142,18 +1484,95 @@ bool GoogleTwoWayContactSyncAdaptor::storeExtraStateData(int accountId)
     QJsonDocument caJsonDoc(caJsonObj);
     QVariant caValue(caJsonDoc.toBinaryData());
 
-    // store to OOB
+    // only the state of the contacts changed during this sync run is written.
     QMap<QString, QVariant> values;
     values.insert("myContactsGroupAtomId", mcghValue);
-    values.insert("unsupportedElements", ueValue);
-    values.insert("contactEtags", ceValue);
-    values.insert("contactIds", ciValue);
     values.insert("contactAvatars", caValue);
-    if (!d->m_engine->storeOOB(d->m_stateData[QString::number(accountId)].m_oobScope, values)) {
+    foreach (const QString &guid, m_dirtyContactStates[accountId]) {
+        values.insert(contactStateKey(guid), contactStateToByteArray(m_contactIds[accountId].value(guid),
+                                                                     m_contactEtags[accountId].value(guid),
+                                                                     m_unsupportedXmlElements[accountId].value(guid)));
+    }
+    QStringList removedKeys = m_legacyStateKeys[accountId];
+    foreach (const QString &guid, m_removedContactStates[accountId]) {
+        removedKeys.append(contactStateKey(guid));
+    }
+
+    if (!d->m_engine->storeOOB(oobScope, values)
+            || (!removedKeys.isEmpty() && !d->m_engine->removeOOB(oobScope, removedKeys))) {
         SOCIALD_LOG_ERROR("failed to store extra state data for" << d->m_syncTarget << "account" << accountId);
         d->clear(QString::number(accountId));
         return false;
     }
 
+    SOCIALD_LOG_DEBUG("stored state of" << m_dirtyContactStates[accountId].size() <<
+                      "and removed state of" << m_removedContactStates[accountId].size() <<
+                      "contacts for account" << accountId);
+    m_dirtyContactStates[accountId].clear();
+    m_removedContactStates[accountId].clear();
+    m_legacyStateKeys[accountId].clear();
+    return true;
+}
+
+// reads the stored state of the given contacts, unless it has already been read during this sync run.
+bool GoogleTwoWayContactSyncAdaptor::loadContactStates(int accountId, const QStringList &contactGuids)
+{
+    QStringList guids;
+    QStringList keys;
+    foreach (const QString &guid, contactGuids) {
+        if (!guid.isEmpty() && !m_loadedContactStates[accountId].contains(guid)) {
+            guids.append(guid);
+            keys.append(contactStateKey(guid));
+        }
+    }
+    if (keys.isEmpty()) {
+        return true;
+    }
+
+    QMap<QString, QVariant> values;
+    if (!d->m_engine->fetchOOB(d->m_stateData[QString::number(accountId)].m_oobScope, keys, &values)) {
+        SOCIALD_LOG_ERROR("failed to read state of" << keys.size() << "contacts for" << d->m_syncTarget << "account" << accountId);
+        return false;
+    }
+
+    for (int i = 0; i < guids.size(); ++i) {
+        const QString &guid(guids.at(i));
+        m_loadedContactStates[accountId].insert(guid);
+
+        QString contactId, contactEtag;
+        GoogleContactXmlElements unsupportedElements;
+        const QByteArray data = values.value(keys.at(i)).toByteArray();
+        if (data.isEmpty() || !contactStateFromByteArray(data, &contactId, &contactEtag, &unsupportedElements)) {
+            continue;
+        }
+
+        // any state set during this sync run is newer than the stored state.
+        if (!contactId.isEmpty() && !m_contactIds[accountId].contains(guid)) {
+            m_contactIds[accountId].insert(guid, contactId);
+        }
+        if (!contactEtag.isEmpty() && !m_contactEtags[accountId].contains(guid)) {
+            m_contactEtags[accountId].insert(guid, contactEtag);
+        }
+        if (!unsupportedElements.isEmpty() && !m_unsupportedXmlElements[accountId].contains(guid)) {
+            m_unsupportedXmlElements[accountId].insert(guid, unsupportedElements);
+        }
+    }
+
     return true;
 }
+
+void GoogleTwoWayContactSyncAdaptor::setContactStateDirty(int accountId, const QString &contactGuid)
+{
+    m_dirtyContactStates[accountId].insert(contactGuid);
+    m_removedContactStates[accountId].remove(contactGuid);
+}
+
+void GoogleTwoWayContactSyncAdaptor::removeContactState(int accountId, const QString &contactGuid)
+{
+    m_contactIds[accountId].remove(contactGuid);
+    m_contactEtags[accountId].remove(contactGuid);
+    m_unsupportedXmlElements[accountId].remove(contactGuid);
+    m_loadedContactStates[accountId].insert(contactGuid);
+    m_dirtyContactStates[accountId].remove(contactGuid);
+    m_removedContactStates[accountId].insert(contactGuid);
+}
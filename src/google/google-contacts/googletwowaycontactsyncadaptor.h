@@ -24,6 +24,9 @@
 
 #include "googledatatypesyncadaptor.h"
 #include "googlecontactstream.h"
+#include "socialdsynccheckpoints_p.h"
+#include "socialdavatarstore_p.h"
+#include "socialdavatarscheduler_p.h"
 
 #include <twowaycontactsyncadapter.h>
 
@@ -32,10 +35,13 @@
 #include <QDateTime>
 #include <QList>
 #include <QPair>
+#include <QSet>
+#include <QHash>
 
 QTCONTACTS_USE_NAMESPACE
 
 class GoogleContactImageDownloader;
+class GoogleContactAtom;
 class GoogleTwoWayContactSyncAdaptor : public GoogleDataTypeSyncAdaptor, public QtContactsSqliteExtensions::TwoWayContactSyncAdapter
 {
     Q_OBJECT
@@ -63,6 +69,8 @@ protected:
     void beginSync(int accountId, const QString &accessToken);
     void finalize(int accountId);
     void finalCleanup();
+    void setAccountError(int accountId);
+    void abortRequests();
     // implementing TWCSA interface
     bool testAccountProvenance(const QContact &contact, const QString &accountId);
 
@@ -79,19 +87,28 @@ private Q_SLOTS:
     void groupsFinishedHandler();
     void contactsFinishedHandler();
     void imageDownloaded(const QString &url, const QString &path, const QVariantMap &metadata);
+    void avatarDownloadsStarted(int accountId);
+    void avatarDownloadsFinished(int accountId);
 
 private:
-    void continueSync(int accountId, const QString &accessToken);
+    void collectRemoteChanges(int accountId, GoogleContactAtom *atom, QDateTime *lastModified,
+                              QList<QContact> *remoteAddMods, QList<QContact> *remoteDels);
+    bool collectRemoteChangesPage(int accountId, GoogleContactAtom *atom, QDateTime *lastModified);
+    bool replayRemoteChangesPage(int accountId, const QByteArray &data);
+    void continueSync(int accountId);
     void upsyncLocalChangesList(int accountId);
     void storeToRemote(int accountId,
                        const QString &accessToken,
                        const QByteArray &encodedContactUpdates);
-    void queueOutstandingAvatars(int accountId, const QString &accessToken);
-    bool queueAvatarForDownload(int accountId, const QString &accessToken, const QString &contactGuid, const QString &imageUrl);
-    void transformContactAvatars(QList<QContact> &remoteContacts, int accountId, const QString &accessToken);
+    void queueOutstandingAvatars(int accountId);
+    bool queueAvatarForDownload(int accountId, const QString &contactGuid, const QString &imageUrl);
+    void transformContactAvatars(QList<QContact> &remoteContacts, int accountId);
     void downloadContactAvatarImage(int accountId, const QString &accessToken, const QUrl &imageUrl, const QString &filename);
     bool readExtraStateData(int accountId);
     bool storeExtraStateData(int accountId);
+    bool loadContactStates(int accountId, const QStringList &contactGuids);
+    void setContactStateDirty(int accountId, const QString &contactGuid);
+    void removeContactState(int accountId, const QString &contactGuid);
 
 private Q_SLOTS:
     void postFinishedHandler();
@@ -99,23 +116,35 @@ private Q_SLOTS:
 
 private:
     QContactManager m_contactManager;
+    SocialdAvatarScheduler *m_avatarScheduler;
     GoogleContactImageDownloader *m_workerObject;
 
     QMap<int, QString> m_accessTokens;
     QMap<int, QString> m_emailAddresses;
     QMap<int, QString> m_myContactsGroupAtomIds;
-    QMap<int, QList<QContact> > m_remoteDels;
-    QMap<int, QList<QContact> > m_remoteAddMods;
-    QMap<int, QMap<QString, QStringList> > m_unsupportedXmlElements; // contact guid -> elements
+    QMap<int, QMap<QString, GoogleContactXmlElements> > m_unsupportedXmlElements; // contact guid -> elements
     QMap<int, QMap<QString, QString> > m_contactEtags; // contact guid -> contact etag
     QMap<int, QMap<QString, QString> > m_contactIds; // contact guid -> contact id
     QMap<int, QMap<QString, QString> > m_contactAvatars; // contact guid -> remote avatar path
     QMap<int, QList<QPair<QContact, GoogleContactStream::UpdateType> > > m_localChanges;
 
+    // the per-contact state above (ids, etags and elements) is stored in OOB keyed by
+    // contact guid, and only loaded for the contacts which a sync run touches.
+    QMap<int, QSet<QString> > m_loadedContactStates; // contact guids whose stored state has been read
+    QMap<int, QSet<QString> > m_dirtyContactStates; // contact guids whose state must be written
+    QMap<int, QSet<QString> > m_removedContactStates; // contact guids whose state must be removed
+    QMap<int, QStringList> m_legacyStateKeys; // whole-account state keys to remove once migrated
+
     // the following are not preserved across sync runs via OOB.
     QMap<int, int> m_apiRequestsRemaining;
+    QMap<int, int> m_upsyncBatchesInFlight; // batches of local changes posted but not yet responded to
     QMap<int, QMap<QString, QString> > m_queuedAvatarsForDownload; // contact guid -> remote avatar path
     QMap<int, QMap<QString, QString> > m_downloadedContactAvatars; // contact guid -> local file path
+    QMap<int, QMap<QString, QString> > m_photoEtags; // contact guid -> photo etag, for the contacts changed remotely
+    QMap<int, QHash<QString, QContact> > m_remoteAddMods; // contact guid -> remote change, stored once all pages are received
+    QMap<int, QHash<QString, QContact> > m_remoteDels; // contact guid -> remote deletion
+    SocialdSyncCheckpoints m_checkpoints; // the pages received before an interrupted sync
+    SocialdAvatarStore m_avatarStore; // the avatar images of the contacts, shared with other adaptors
 };
 
 #endif // GOOGLETWOWAYCONTACTSYNCADAPTOR_H
@@ -30,6 +30,12 @@
 #include <QtCore/QUrlQuery>
 #include <QtCore/QTimer>
 
+namespace {
+    // the token is refreshed if it expires within this many minutes.
+    static const QString TokenRefreshWindowKey = QStringLiteral("token_refresh_window");
+    const int DefaultTokenRefreshWindow = 15;
+}
+
 GoogleSignonSyncAdaptor::GoogleSignonSyncAdaptor(QObject *parent)
     : GoogleDataTypeSyncAdaptor(SocialNetworkSyncAdaptor::Signon, parent)
 {
@@ -121,6 +127,15 @@ void GoogleSignonSyncAdaptor::lowerCredentialsNeedUpdateFlag(int accountId)
     }
 }
 
+int GoogleSignonSyncAdaptor::tokenRefreshWindow(int accountId) const
+{
+    Buteo::SyncProfile *syncProfile = accountSyncProfile(accountId);
+    int window = syncProfile
+               ? syncProfile->key(TokenRefreshWindowKey, QString::number(DefaultTokenRefreshWindow)).toInt()
+               : DefaultTokenRefreshWindow;
+    return window > 0 ? window : DefaultTokenRefreshWindow;
+}
+
 void GoogleSignonSyncAdaptor::refreshTokens(int accountId)
 {
     Accounts::Account *acc = loadAccount(accountId);
@@ -128,7 +143,8 @@ void GoogleSignonSyncAdaptor::refreshTokens(int accountId)
         return;
     }
 
-    // First perform a "normal" signon.  Then force token expiry.  Then signon to refresh the tokens.
+    // Perform a "normal" signon.  Then force token expiry.  Then signon to refresh the tokens.
+    // signond answers the first signon from its stored session while the token is valid.
     Accounts::Service srv(m_accountManager.service(syncServiceName()));
     acc->selectService(srv);
     SignOn::Identity *identity = acc->credentialsId() > 0 ? SignOn::Identity::existingIdentity(acc->credentialsId()) : 0;
@@ -183,7 +199,27 @@ void GoogleSignonSyncAdaptor::refreshTokens(int accountId)
 void GoogleSignonSyncAdaptor::initialSignonResponse(const SignOn::SessionData &responseData)
 {
     SignOn::AuthSession *session = qobject_cast<SignOn::AuthSession*>(sender());
+    int accountId = session->property("accountId").toInt();
     session->disconnect(this);
+
+    // The ExpiresIn of a stored token is the time it has left.
+    // If the token doesn't expire soon, there is nothing to do.
+    int expiresIn = responseData.getProperty(QStringLiteral("ExpiresIn")).toInt();
+    if (expiresIn > tokenRefreshWindow(accountId) * 60) {
+        SOCIALD_LOG_DEBUG("access token for Google account" << accountId <<
+                          "expires in" << expiresIn << "seconds; not refreshing");
+        SignOn::Identity *identity = m_idents.take(accountId);
+        if (identity) {
+            identity->destroySession(session);
+            identity->deleteLater();
+        } else {
+            session->deleteLater();
+        }
+        lowerCredentialsNeedUpdateFlag(accountId);
+        decrementSemaphore(accountId);
+        return;
+    }
+
     connect(session, SIGNAL(response(SignOn::SessionData)),
             this, SLOT(forceTokenExpiryResponse(SignOn::SessionData)),
             Qt::UniqueConnection);
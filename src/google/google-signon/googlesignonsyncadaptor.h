@@ -67,6 +67,7 @@ private:
     Accounts::Account *loadAccount(int accountId);
     void raiseCredentialsNeedUpdateFlag(int accountId);
     void lowerCredentialsNeedUpdateFlag(int accountId);
+    int tokenRefreshWindow(int accountId) const;
     void refreshTokens(int accountId);
 
     Accounts::Manager m_accountManager;
@@ -56,25 +56,25 @@ void GoogleDataTypeSyncAdaptor::sync(const QString &dataTypeString, int accountI
     if (dataTypeString != SocialNetworkSyncAdaptor::dataTypeName(m_dataType)) {
         SOCIALD_LOG_ERROR("Google" << SocialNetworkSyncAdaptor::dataTypeName(m_dataType) <<
                           "sync adaptor was asked to sync" << dataTypeString);
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         return;
     }
 
     if (clientId().isEmpty()) {
         SOCIALD_LOG_ERROR("client id couldn't be retrieved for Google account" << accountId);
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         return;
     }
 
     if (clientSecret().isEmpty()) {
         SOCIALD_LOG_ERROR("client secret couldn't be retrieved for Google account" << accountId);
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         return;
     }
 
     setStatus(SocialNetworkSyncAdaptor::Busy);
     updateDataForAccount(accountId);
-    SOCIALD_LOG_DEBUG("successfully triggered sync with profile:" << m_accountSyncProfile->name());
+    SOCIALD_LOG_DEBUG("successfully triggered sync with profile:" << accountSyncProfile(accountId)->name());
 }
 
 void GoogleDataTypeSyncAdaptor::updateDataForAccount(int accountId)
@@ -82,7 +82,7 @@ void GoogleDataTypeSyncAdaptor::updateDataForAccount(int accountId)
     Accounts::Account *account = m_accountManager->account(accountId);
     if (!account) {
         SOCIALD_LOG_ERROR("existing account with id" << accountId << "couldn't be retrieved");
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         return;
     }
 
@@ -97,36 +97,17 @@ void GoogleDataTypeSyncAdaptor::finalCleanup()
 
 void GoogleDataTypeSyncAdaptor::errorHandler(QNetworkReply::NetworkError err)
 {
-    // Google sends error code 204 (HTTP code 401) for Unauthorized Error
-    // Note: sometimes it sends it spuriously
-    // For now, don't raise the flag, until we can solve
-    // any API rate limit issues associated with avatars
-    // which might cause this (if multiple accounts are involved).
-    // Another possible cause might be: if the ExpiresIn time
-    // is small (less than 30 seconds, say) it's possible that the
-    // access token will expire _during_ the sync process.
-    // XXX TODO: check expires time, force refresh if < 30.
+    // Google sends error code 204 (HTTP code 401) for Unauthorized Error.
+    // Tokens are refreshed by the Signon adaptor before they expire, so
+    // this means the token was revoked, or the request was rate limited
+    // (which Google also reports this way, eg for avatars of multiple
+    // accounts).  As it may be the latter, don't raise the
+    // CredentialsNeedUpdate flag.
     QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
-    if (err == QNetworkReply::AuthenticationRequiredError) {
-        //int accountId = sender()->property("accountId").toInt();
-        //Account *account = m_accountManager->account(accountId);
-        //if (account->status() == Account::Initialized) {
-        //    setCredentialsNeedUpdate(account);
-        //} else {
-        //    connect(account, SIGNAL(statusChanged()), this, SLOT(accountCredentialsChangeHandler()));
-        //}
-        // instead of triggering CredentialsNeedUpdate, print some debugging.
-        int httpCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        QByteArray jsonBody = reply->readAll();
-        qWarning() << "sociald:Google: would normally set CredentialsNeedUpdate for account"
-                   << reply->property("accountId").toInt() << "but could be spurious\n"
-                   << "    Http code:" << httpCode << "\n"
-                   << "    Json body:\n" << jsonBody << "\n";
-    }
-
     SOCIALD_LOG_ERROR(SocialNetworkSyncAdaptor::dataTypeName(m_dataType) <<
                       "request with account" << sender()->property("accountId").toInt() <<
-                      "experienced error:" << err << "\n" <<
+                      "experienced error:" << err <<
+                      "HTTP:" << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() << "\n" <<
                       QString::fromUtf8(reply->readAll()));
     // set "isError" on the reply so that adapters know to ignore the result in the finished() handler
     reply->setProperty("isError", QVariant::fromValue<bool>(true));
@@ -274,7 +255,7 @@ void GoogleDataTypeSyncAdaptor::signOnError(const SignOn::Error &error)
     account->deleteLater();
 
     // if we couldn't sign in, we can't sync with this account.
-    setStatus(SocialNetworkSyncAdaptor::Error);
+    setAccountError(accountId);
     decrementSemaphore(accountId);
 }
 
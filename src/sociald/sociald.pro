@@ -5,8 +5,12 @@ DEFINES += "CLASSNAME=SocialdPlugin"
 DEFINES += CLASSNAME_H=\\\"socialdplugin.h\\\"
 include($$PWD/../common.pri)
 
-HEADERS += socialdplugin.h
-SOURCES += socialdplugin.cpp
+HEADERS += \
+    socialdplugin.h \
+    socialdsyncorchestrator_p.h
+SOURCES += \
+    socialdplugin.cpp \
+    socialdsyncorchestrator_p.cpp
 
 sociald_sync_profile.path = /etc/buteo/profiles/sync
 sociald_sync_profile.files = $$PWD/sociald.All.xml
@@ -20,6 +20,7 @@
  ****************************************************************************/
 
 #include "socialdplugin.h"
+#include "socialdsyncorchestrator_p.h"
 #include "trace.h"
 
 #include <QCoreApplication>
@@ -32,6 +33,12 @@
 #include <PluginCbInterface.h>
 #include <LogMacros.h>
 
+namespace {
+    // the number of data type syncs (other than Signon syncs) which
+    // may run at the same time during a sync of all data types.
+    static const QString MaxConcurrentSyncsKey = QStringLiteral("max_concurrent_syncs");
+}
+
 extern "C" SocialdPlugin* createPlugin(const QString& pluginName,
                                        const Buteo::SyncProfile& profile,
                                        Buteo::PluginCbInterface *callbackInterface)
@@ -48,6 +55,8 @@ SocialdPlugin::SocialdPlugin(const QString& pluginName,
                              const Buteo::SyncProfile& profile,
                              Buteo::PluginCbInterface *callbackInterface)
     : ClientPlugin(pluginName, profile, callbackInterface)
+    , m_orchestrator(0)
+    , m_abortReason(Buteo::SyncResults::NO_ERROR)
 {
 }
 
@@ -57,6 +66,11 @@ SocialdPlugin::~SocialdPlugin()
 
 bool SocialdPlugin::init()
 {
+    if (!m_orchestrator) {
+        m_orchestrator = new SocialdSyncOrchestrator(this);
+        connect(m_orchestrator, SIGNAL(finished(bool)), this, SLOT(orchestratorFinished(bool)));
+    }
+
     // sociald plugin profiles are either sociald.All.xml or
     // of the form sociald.<provider>.<Datatype>.xml
     QString profile = getProfileName();
@@ -84,14 +98,23 @@ bool SocialdPlugin::uninit()
 
 bool SocialdPlugin::startSync()
 {
+    if (m_orchestrator->isRunning()) {
+        SOCIALD_LOG_DEBUG("previous sync of" << getProfileName() << "is still running");
+        return false;
+    }
+
     QStringList startSyncParams;
     if (!m_dataType.isEmpty() && !m_serviceName.isEmpty()) {
         // trigger sync of specific data type with all accounts.
         startSyncParams.append(QStringLiteral("%1.%2").arg(m_serviceName, m_dataType));
     } else {
         // trigger sync of all known data types with all accounts.
+        // The profiles of each provider are synced in this order,
+        // starting with refreshing its access tokens.
+        startSyncParams << "google.Signon";
         startSyncParams << "google.Calendars";
         startSyncParams << "google.Contacts";
+        startSyncParams << "facebook.Signon";
         startSyncParams << "facebook.Calendars";
         startSyncParams << "facebook.Contacts";
         startSyncParams << "facebook.Images";
@@ -101,23 +124,25 @@ bool SocialdPlugin::startSync()
         startSyncParams << "twitter.Posts";
     }
 
-    foreach (const QString &param, startSyncParams) {
-        QDBusMessage message = QDBusMessage::createMethodCall(
-                "com.meego.msyncd", "/synchronizer", "com.meego.msyncd", "startSync");
-        message.setArguments(QVariantList() << param);
-        QDBusConnection::sessionBus().asyncCall(message);
+    QString maxConcurrentSyncs = profile().key(MaxConcurrentSyncsKey);
+    if (!maxConcurrentSyncs.isEmpty()) {
+        m_orchestrator->setMaxHeavySyncs(maxConcurrentSyncs.toInt());
     }
 
-    // always "succeed" even though the actual sync may fail.
-    updateResults(Buteo::SyncResults(QDateTime::currentDateTime(),
-                                     Buteo::SyncResults::SYNC_RESULT_SUCCESS,
-                                     Buteo::SyncResults::NO_ERROR));
-
+    m_abortReason = Buteo::SyncResults::NO_ERROR;
+    m_orchestrator->start(startSyncParams);
     return true;
 }
 
-void SocialdPlugin::abortSync(Sync::SyncStatus)
+void SocialdPlugin::abortSync(Sync::SyncStatus status)
 {
+    // the syncs we triggered run in their own plugin instances;
+    // the orchestrator asks the sync daemon to abort them, and
+    // reports the result once they have stopped.
+    m_abortReason = status == Sync::SYNC_CONNECTION_ERROR
+                  ? Buteo::SyncResults::CONNECTION_ERROR
+                  : Buteo::SyncResults::ABORTED;
+    m_orchestrator->abort();
 }
 
 bool SocialdPlugin::cleanUp()
@@ -130,12 +155,33 @@ Buteo::SyncResults SocialdPlugin::getSyncResults() const
     return m_syncResults;
 }
 
-void SocialdPlugin::connectivityStateChanged(Sync::ConnectivityType, bool)
+void SocialdPlugin::connectivityStateChanged(Sync::ConnectivityType type, bool state)
 {
-    // TODO, see TransportTracker.cpp:149
-    // Sync::CONNECTIVITY_INTERNET, true|false
-    // Kill all ongoing on false
-    // "Free" single shot sync on wlan?
+    if (type == Sync::CONNECTIVITY_INTERNET && !state) {
+        abortSync(Sync::SYNC_CONNECTION_ERROR);
+    }
+}
+
+void SocialdPlugin::orchestratorFinished(bool succeeded)
+{
+    if (succeeded) {
+        updateResults(Buteo::SyncResults(QDateTime::currentDateTime(),
+                                         Buteo::SyncResults::SYNC_RESULT_SUCCESS,
+                                         Buteo::SyncResults::NO_ERROR));
+        emit success(getProfileName(), QString("%1 update succeeded").arg(getProfileName()));
+        return;
+    }
+
+    SOCIALD_LOG_INFO("failed to sync profiles:" << m_orchestrator->failedProfiles());
+    Buteo::SyncResults::MinorCode reason = m_abortReason == Buteo::SyncResults::NO_ERROR
+                                         ? Buteo::SyncResults::ABORTED
+                                         : m_abortReason;
+    m_abortReason = Buteo::SyncResults::NO_ERROR;
+    updateResults(Buteo::SyncResults(QDateTime::currentDateTime(),
+                                     Buteo::SyncResults::SYNC_RESULT_FAILED,
+                                     reason));
+    emit error(getProfileName(), QString("%1 update failed").arg(getProfileName()),
+               Buteo::SyncResults::SYNC_RESULT_FAILED);
 }
 
 void SocialdPlugin::updateResults(const Buteo::SyncResults &results)
@@ -24,9 +24,12 @@
 
 #include <QString>
 #include <QObject>
+#include <QStringList>
 
 #include "buteosyncfw_p.h"
 
+class SocialdSyncOrchestrator;
+
 #if defined(OUT_OF_PROCESS_PLUGIN)
 #  define SOCIALDPLUGIN_EXPORT Q_DECL_EXPORT
 #else
@@ -52,6 +55,9 @@
        sociald.twitter.Notifications.xml
        sociald.twitter.Posts.xml
 
+   The syncs are run by a SocialdSyncOrchestrator, and the
+   result is only reported once all of them have finished.
+
    Note that it does not extend SocialdButeoPlugin
    (from common.pri) as it uses a different mechanism.
 */
@@ -75,11 +81,16 @@ public:
 public slots:
     void connectivityStateChanged(Sync::ConnectivityType type, bool state);
 
+private slots:
+    void orchestratorFinished(bool succeeded);
+
 private:
     void updateResults(const Buteo::SyncResults &results);
     Buteo::SyncResults m_syncResults;
     QString m_dataType;
     QString m_serviceName;
+    SocialdSyncOrchestrator *m_orchestrator;
+    Buteo::SyncResults::MinorCode m_abortReason;
 };
 
 extern "C" SocialdPlugin* createPlugin(const QString& pluginName,
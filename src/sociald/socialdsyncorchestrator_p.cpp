@@ -0,0 +1,258 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+
+#include "socialdsyncorchestrator_p.h"
+#include "trace.h"
+
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCall>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+
+#include "buteosyncfw_p.h"
+
+namespace {
+    // a sync which has not reported its result by then is assumed to be stuck.
+    const int ProfileSyncTimeout = 30 * 60 * 1000;
+
+    QDBusMessage msyncdMethodCall(const QString &method, const QString &profileName)
+    {
+        QDBusMessage message = QDBusMessage::createMethodCall(
+                "com.meego.msyncd", "/synchronizer", "com.meego.msyncd", method);
+        message.setArguments(QVariantList() << profileName);
+        return message;
+    }
+}
+
+SocialdSyncOrchestrator::SocialdSyncOrchestrator(QObject *parent)
+    : QObject(parent)
+    , m_maxHeavySyncs(2)
+    , m_runningHeavySyncs(0)
+    , m_running(false)
+    , m_aborted(false)
+{
+    QDBusConnection::sessionBus().connect("com.meego.msyncd", "/synchronizer", "com.meego.msyncd",
+                                          "syncStatus", this,
+                                          SLOT(syncStatus(QString,int,QString,int)));
+}
+
+SocialdSyncOrchestrator::~SocialdSyncOrchestrator()
+{
+}
+
+void SocialdSyncOrchestrator::setMaxHeavySyncs(int maxHeavySyncs)
+{
+    m_maxHeavySyncs = qMax(1, maxHeavySyncs);
+}
+
+bool SocialdSyncOrchestrator::isRunning() const
+{
+    return m_running;
+}
+
+QStringList SocialdSyncOrchestrator::failedProfiles() const
+{
+    return m_failedProfiles;
+}
+
+// Profile names are of the form <provider>.<DataType>; the profiles of
+// each provider are synced in the order in which they are given.
+void SocialdSyncOrchestrator::start(const QStringList &profileNames)
+{
+    m_providerSteps.clear();
+    m_failedProfiles.clear();
+    m_runningHeavySyncs = 0;
+    m_running = true;
+    m_aborted = false;
+
+    foreach (const QString &profileName, profileNames) {
+        Step step;
+        step.profileName = profileName;
+        step.heavy = !profileName.endsWith(QStringLiteral(".Signon"));
+        m_providerSteps[profileName.section(QLatin1Char('.'), 0, 0)].append(step);
+    }
+
+    scheduleSteps();
+    finishIfDone();
+}
+
+void SocialdSyncOrchestrator::abort()
+{
+    if (!m_running) {
+        return;
+    }
+
+    m_aborted = true;
+    QMap<QString, QList<Step> >::iterator it = m_providerSteps.begin();
+    while (it != m_providerSteps.end()) {
+        QList<Step> &steps = it.value();
+        while (!steps.isEmpty() && !steps.last().running) {
+            steps.removeLast();
+        }
+        if (steps.isEmpty()) {
+            it = m_providerSteps.erase(it);
+            continue;
+        }
+        // the running sync will report its (aborted) result.
+        SOCIALD_LOG_INFO("aborting sync of" << steps.first().profileName);
+        QDBusConnection::sessionBus().asyncCall(msyncdMethodCall("abortSync", steps.first().profileName));
+        ++it;
+    }
+
+    finishIfDone();
+}
+
+void SocialdSyncOrchestrator::scheduleSteps()
+{
+    foreach (const QString &provider, m_providerSteps.keys()) {
+        const Step &next = m_providerSteps[provider].first();
+        if (next.running || (next.heavy && m_runningHeavySyncs >= m_maxHeavySyncs)) {
+            continue;
+        }
+        startStep(provider);
+    }
+}
+
+void SocialdSyncOrchestrator::startStep(const QString &provider)
+{
+    Step &step = m_providerSteps[provider].first();
+    step.running = true;
+    if (step.heavy) {
+        m_runningHeavySyncs++;
+    }
+
+    step.timer = new QTimer(this);
+    step.timer->setObjectName(step.profileName);
+    step.timer->setSingleShot(true);
+    step.timer->setInterval(ProfileSyncTimeout);
+    connect(step.timer, SIGNAL(timeout()), this, SLOT(profileTimedOut()));
+    step.timer->start();
+
+    SOCIALD_LOG_DEBUG("starting sync of" << step.profileName);
+    QDBusPendingCall call = QDBusConnection::sessionBus().asyncCall(msyncdMethodCall("startSync", step.profileName));
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    watcher->setProperty("profileName", step.profileName);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(startSyncFinished(QDBusPendingCallWatcher*)));
+}
+
+void SocialdSyncOrchestrator::startSyncFinished(QDBusPendingCallWatcher *watcher)
+{
+    QString profileName = watcher->property("profileName").toString();
+    QDBusPendingReply<bool> reply = *watcher;
+    watcher->deleteLater();
+
+    if (runningProvider(profileName).isEmpty()) {
+        // the sync has already reported its result.
+        return;
+    }
+
+    if (reply.isError()) {
+        SOCIALD_LOG_ERROR("unable to start sync of" << profileName << ":" << reply.error().message());
+        finishStep(profileName, false);
+    } else if (!reply.value()) {
+        // e.g. the profile is disabled, or its plugin isn't installed.
+        SOCIALD_LOG_DEBUG("sync of" << profileName << "was not started");
+        finishStep(profileName, true);
+    }
+}
+
+void SocialdSyncOrchestrator::syncStatus(const QString &profileName, int status, const QString &message, int moreDetails)
+{
+    Q_UNUSED(moreDetails)
+
+    if (runningProvider(profileName).isEmpty()) {
+        return;
+    }
+
+    switch (status) {
+        case Sync::SYNC_QUEUED:
+        case Sync::SYNC_STARTED:
+        case Sync::SYNC_PROGRESS:
+        case Sync::SYNC_STOPPING:
+            return;
+        case Sync::SYNC_DONE:
+            finishStep(profileName, true);
+            return;
+        default:
+            SOCIALD_LOG_INFO("sync of" << profileName << "failed with status" << status << ":" << message);
+            finishStep(profileName, false);
+            return;
+    }
+}
+
+void SocialdSyncOrchestrator::profileTimedOut()
+{
+    QString profileName = sender()->objectName();
+    SOCIALD_LOG_ERROR("sync of" << profileName << "did not finish in time");
+    QDBusConnection::sessionBus().asyncCall(msyncdMethodCall("abortSync", profileName));
+    finishStep(profileName, false);
+}
+
+void SocialdSyncOrchestrator::finishStep(const QString &profileName, bool success)
+{
+    QString provider = runningProvider(profileName);
+    if (provider.isEmpty()) {
+        return;
+    }
+
+    QList<Step> &steps = m_providerSteps[provider];
+    Step step = steps.takeFirst();
+    if (steps.isEmpty()) {
+        m_providerSteps.remove(provider);
+    }
+    if (step.heavy) {
+        m_runningHeavySyncs--;
+    }
+    step.timer->deleteLater();
+    if (!success) {
+        m_failedProfiles.append(profileName);
+    }
+
+    if (!m_aborted) {
+        scheduleSteps();
+    }
+    finishIfDone();
+}
+
+void SocialdSyncOrchestrator::finishIfDone()
+{
+    if (!m_running || !m_providerSteps.isEmpty()) {
+        return;
+    }
+
+    m_running = false;
+    emit finished(!m_aborted && m_failedProfiles.isEmpty());
+}
+
+QString SocialdSyncOrchestrator::runningProvider(const QString &profileName) const
+{
+    QString provider = profileName.section(QLatin1Char('.'), 0, 0);
+    QMap<QString, QList<Step> >::const_iterator it = m_providerSteps.constFind(provider);
+    if (it == m_providerSteps.constEnd()
+            || !it.value().first().running
+            || it.value().first().profileName != profileName) {
+        return QString();
+    }
+    return provider;
+}
@@ -0,0 +1,98 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+
+#ifndef SOCIALD_SYNCORCHESTRATOR_P_H
+#define SOCIALD_SYNCORCHESTRATOR_P_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMap>
+#include <QTimer>
+
+class QDBusPendingCallWatcher;
+
+/*
+ * Runs the syncs of a set of sync profiles via the sync daemon, and
+ * waits for the result of each before reporting the overall result.
+ *
+ * The profiles of each provider are synced one after the other, in the
+ * order given (so the access tokens can be refreshed by the provider's
+ * Signon profile before its data types are synced), while the profiles
+ * of different providers run in parallel.  At most maxHeavySyncs
+ * profiles which are not Signon profiles run at the same time, so that
+ * a sync of all data types does not have every sync plugin downloading
+ * and parsing large payloads at once.
+ *
+ * The profiles are the template profiles of each data type, whose sync
+ * plugin syncs every account of the data type itself (see the
+ * multi_account_sync key), so the reported status of a template profile
+ * covers all of its accounts.
+ */
+class SocialdSyncOrchestrator : public QObject
+{
+    Q_OBJECT
+
+public:
+    SocialdSyncOrchestrator(QObject *parent = 0);
+    ~SocialdSyncOrchestrator();
+
+    void setMaxHeavySyncs(int maxHeavySyncs);
+    void start(const QStringList &profileNames);
+    void abort();
+
+    bool isRunning() const;
+    QStringList failedProfiles() const;
+
+Q_SIGNALS:
+    void finished(bool success);
+
+private Q_SLOTS:
+    void syncStatus(const QString &profileName, int status, const QString &message, int moreDetails);
+    void startSyncFinished(QDBusPendingCallWatcher *watcher);
+    void profileTimedOut();
+
+private:
+    struct Step {
+        Step() : heavy(false), running(false), timer(0) {}
+        QString profileName;
+        bool heavy;
+        bool running;
+        QTimer *timer;
+    };
+
+    void scheduleSteps();
+    void startStep(const QString &provider);
+    void finishStep(const QString &profileName, bool success);
+    void finishIfDone();
+    QString runningProvider(const QString &profileName) const;
+
+    QMap<QString, QList<Step> > m_providerSteps; // provider -> remaining steps, the first may be running
+    QStringList m_failedProfiles;
+    int m_maxHeavySyncs;
+    int m_runningHeavySyncs;
+    bool m_running;
+    bool m_aborted;
+};
+
+#endif // SOCIALD_SYNCORCHESTRATOR_P_H
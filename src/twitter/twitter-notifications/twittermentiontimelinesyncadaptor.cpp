@@ -32,10 +32,20 @@
 #define SOCIALD_TWITTER_MENTIONS_ID_PREFIX QLatin1String("twitter-mentions-")
 #define SOCIALD_TWITTER_MENTIONS_GROUPNAME QLatin1String("sociald-sync-twitter-mentions")
 
+namespace {
+    // only the text, time and author names of the mentions are read,
+    // and the API doesn't support selecting fields.
+    const SocialdFieldProjection::Entry FieldProjection[] = {
+        { "mentions_timeline", "include_entities", "false" },
+        { 0, 0, 0 }
+    };
+}
+
 // currently, we integrate with the device notifications via nemo-qml-plugin-notification
 
 TwitterMentionTimelineSyncAdaptor::TwitterMentionTimelineSyncAdaptor(QObject *parent)
     : TwitterDataTypeSyncAdaptor(SocialNetworkSyncAdaptor::Notifications, parent)
+    , m_fieldProjection(FieldProjection)
 {
     // can sync, enabled
     setInitialActive(true);
@@ -71,6 +81,7 @@ void TwitterMentionTimelineSyncAdaptor::requestNotifications(int accountId, cons
     if (!sinceTweetId.isEmpty()) {
         queryItems.append(QPair<QString, QString>(QString(QLatin1String("since_id")), sinceTweetId));
     }
+    m_fieldProjection.apply(QStringLiteral("mentions_timeline"), &queryItems);
     QString baseUrl = QLatin1String("https://api.twitter.com/1.1/statuses/mentions_timeline.json");
     QUrl url(baseUrl);
     QUrlQuery query(url);
@@ -138,8 +149,8 @@ void TwitterMentionTimelineSyncAdaptor::finishedHandler()
             QString userScreenName = user.value(QLatin1String("screen_name")).toString();
 
             // check to see if we need to post it to the notifications feed
-            int sinceSpan = m_accountSyncProfile
-                          ? m_accountSyncProfile->key(Buteo::KEY_SYNC_SINCE_DAYS_PAST, QStringLiteral("7")).toInt()
+            int sinceSpan = accountSyncProfile(accountId)
+                          ? accountSyncProfile(accountId)->key(Buteo::KEY_SYNC_SINCE_DAYS_PAST, QStringLiteral("7")).toInt()
                           : 7;
             if (lastSync.isValid() && createdTime < lastSync) {
                 SOCIALD_LOG_DEBUG("notification for account" << accountId << "came after last sync:" << createdTime << ":" << text);
@@ -23,6 +23,7 @@
 #define TWITTERMENTIONTIMELINESYNCADAPTOR_H
 
 #include "twitterdatatypesyncadaptor.h"
+#include "socialdfieldprojection_p.h"
 
 #include <QtCore/QObject>
 #include <QtCore/QString>
@@ -58,6 +59,8 @@ private Q_SLOTS:
 private:
     Notification * createNotification(int accountId);
     Notification * findNotification(int accountId);
+
+    SocialdFieldProjection m_fieldProjection;
 };
 
 #endif // TWITTERMENTIONTIMELINESYNCADAPTOR_H
@@ -20,14 +20,26 @@
  ****************************************************************************/
 
 #include "twitterhometimelinesyncadaptor.h"
+#include "socialdjsonstreamparser_p.h"
+#include "socialdnetworkaccessmanager_p.h"
 #include "trace.h"
 
 #include <QtCore/QPair>
 #include <QtCore/QJsonValue>
 #include <QtCore/QUrlQuery>
 
+namespace {
+    // the API doesn't support selecting fields.  The tweets' entities are
+    // needed (for images and urls), so only the "me" request is trimmed.
+    const SocialdFieldProjection::Entry FieldProjection[] = {
+        { "verify_credentials", "include_entities", "false" },
+        { 0, 0, 0 }
+    };
+}
+
 TwitterHomeTimelineSyncAdaptor::TwitterHomeTimelineSyncAdaptor(QObject *parent)
     : TwitterDataTypeSyncAdaptor(SocialNetworkSyncAdaptor::Posts, parent)
+    , m_fieldProjection(FieldProjection)
 {
     setInitialActive(m_db.isValid());
 }
@@ -64,6 +76,7 @@ void TwitterHomeTimelineSyncAdaptor::requestMe(int accountId, const QString &oau
 {
     QList<QPair<QString, QString> > queryItems;
     queryItems.append(QPair<QString, QString>(QString(QLatin1String("skip_status")), QString(QLatin1String("true"))));
+    m_fieldProjection.apply(QStringLiteral("verify_credentials"), &queryItems);
     QString baseUrl = QLatin1String("https://api.twitter.com/1.1/account/verify_credentials.json");
     QUrl url(baseUrl);
     QUrlQuery query(url);
@@ -74,6 +87,7 @@ void TwitterHomeTimelineSyncAdaptor::requestMe(int accountId, const QString &oau
     nreq.setRawHeader("Authorization", authorizationHeader(
             accountId, oauthToken, oauthTokenSecret,
             QLatin1String("GET"), baseUrl, queryItems).toLatin1());
+    nreq.setAttribute(SocialdNetworkAccessManager::RequestPriorityAttribute, SocialdNetworkAccessManager::MetadataPriority);
     QNetworkReply *reply = m_networkAccessManager->get(nreq);
     
     if (reply) {
@@ -125,6 +139,10 @@ void TwitterHomeTimelineSyncAdaptor::requestPosts(int accountId, const QString &
         connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsHandler(QList<QSslError>)));
         connect(reply, SIGNAL(finished()), this, SLOT(finishedPostsHandler()));
 
+        // the timeline is a top-level array; handle each tweet as it arrives.
+        SocialdJsonStreamParser *parser = new SocialdJsonStreamParser(reply, QString());
+        connect(parser, SIGNAL(elementParsed(QJsonObject)), this, SLOT(postParsedHandler(QJsonObject)));
+
         // we're requesting data.  Increment the semaphore so that we know we're still busy.
         incrementSemaphore(accountId);
         setupReplyTimeout(accountId, reply);
@@ -169,99 +187,115 @@ void TwitterHomeTimelineSyncAdaptor::finishedPostsHandler()
 {
     QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
     int accountId = reply->property("accountId").toInt();
-    QDateTime lastSync = lastSyncTimestamp(QLatin1String("twitter"),
-                                           SocialNetworkSyncAdaptor::dataTypeName(SocialNetworkSyncAdaptor::Posts),
-                                           accountId);
-    QByteArray replyData = reply->readAll();
+
+    // the tweets have already been converted by postParsedHandler() as they arrived,
+    // but they only replace the stored tweets if the whole reply was received.
+    bool ok = false;
+    SocialdJsonStreamParser *parser = SocialdJsonStreamParser::parser(reply);
+    parser->finish(&ok);
+    bool isError = reply->property("isError").toBool();
+    QList<PendingPost> pendingPosts = m_pendingPosts.take(accountId);
     disconnect(reply);
     reply->deleteLater();
     removeReplyTimeout(accountId, reply);
 
-    bool ok = false;
-    QJsonArray tweets = parseJsonArrayReplyData(replyData, &ok);
-    if (ok) {
-        if (!tweets.size()) {
+    if (ok && !isError) {
+        if (pendingPosts.isEmpty()) {
             SOCIALD_LOG_DEBUG("no feed posts received for account" << accountId);
-            decrementSemaphore(accountId);
-            return;
+        } else {
+            m_db.removePosts(accountId); // purge old tweets.
+            foreach (const PendingPost &post, pendingPosts) {
+                m_db.addTwitterPost(post.postId, post.name, post.body, post.timestamp, post.icon, post.images,
+                                    post.screenName, post.retweeter, consumerKey(), consumerSecret(), accountId);
+            }
         }
+    } else {
+        // error occurred during request.
+        SOCIALD_LOG_ERROR("unable to parse event feed data from request with account" << accountId);
+    }
 
-        m_db.removePosts(accountId); // purge old tweets.
+    // we're finished this request.  Decrement our busy semaphore.
+    decrementSemaphore(accountId);
+}
 
-        foreach (const QJsonValue &tweetValue, tweets) {
-            // these are the fields we eventually need to fill out:
-            QList<QPair<QString, SocialPostImage::ImageType> > imageList;
-            QString retweeter;
+void TwitterHomeTimelineSyncAdaptor::postParsedHandler(const QJsonObject &tweetObject)
+{
+    SocialdJsonStreamParser *parser = qobject_cast<SocialdJsonStreamParser*>(sender());
+    QNetworkReply *reply = parser->reply();
+    int accountId = reply->property("accountId").toInt();
 
-            // grab the data from the current post
-            QJsonObject tweet = tweetValue.toObject();
+    // these are the fields we eventually need to fill out:
+    QList<QPair<QString, SocialPostImage::ImageType> > imageList;
+    QString retweeter;
 
-            // Just to be sure to get the time of the current (re)tweet
-            QDateTime eventTimestamp = parseTwitterDateTime(tweet.value(QLatin1String("created_at")).toString());
+    // grab the data from the current post
+    QJsonObject tweet = tweetObject;
 
-            // We should get data for the retweeted tweet instead of
-            // getting the (often partial) retweeted tweet.
-            if (tweet.contains(QLatin1String("retweeted_status"))) {
-                retweeter = tweet.value(QLatin1String("user")).toObject().value("name").toString();
-                tweet = tweet.value(QLatin1String("retweeted_status")).toObject();
-            }
+    // Just to be sure to get the time of the current (re)tweet
+    QDateTime eventTimestamp = parseTwitterDateTime(tweet.value(QLatin1String("created_at")).toString());
 
-            QString postId = tweet.value(QLatin1String("id_str")).toString();
-            QString body = tweet.value(QLatin1String("text")).toString();
-            QJsonObject user = tweet.value(QLatin1String("user")).toObject();
-            QString name = user.value("name").toString();
-            QString screenName = user.value("screen_name").toString();
-            QString icon = user.value(QLatin1String("profile_image_url")).toString();
-
-            // Twitter does some HTML substitutions in their content
-            // in JSON feeds, to prevent issues with JSONP formatting.
-            body.replace(QStringLiteral("&lt;"), QStringLiteral("<"));
-            body.replace(QStringLiteral("&gt;"), QStringLiteral(">"));
-            body.replace(QStringLiteral("&amp;"), QStringLiteral("&"));
-
-            QJsonObject entities = tweet.value(QLatin1String("entities")).toObject();
-            QJsonArray mediaList = entities.value(QLatin1String("media")).toArray();
-            if (!mediaList.isEmpty()) {
-                foreach (const QJsonValue &mediaValue, mediaList) {
-                    QJsonObject mediaObject = mediaValue.toObject();
-                    if (mediaObject.contains(QLatin1String("media_url_https"))) {
-                        QString imageUrl = mediaObject.value(QLatin1String("media_url_https")).toString();
-                        imageList.append(qMakePair<QString, SocialPostImage::ImageType>(imageUrl, SocialPostImage::Photo));
-                    }
-                }
-            }
+    // We should get data for the retweeted tweet instead of
+    // getting the (often partial) retweeted tweet.
+    if (tweet.contains(QLatin1String("retweeted_status"))) {
+        retweeter = tweet.value(QLatin1String("user")).toObject().value("name").toString();
+        tweet = tweet.value(QLatin1String("retweeted_status")).toObject();
+    }
 
-            QJsonArray urlList = entities.value(QLatin1String("urls")).toArray();
-            foreach (const QJsonValue &urlValue, urlList) {
-                // Right now, we use a slightly inefficient algorithm, that is error-proof
-                // we just replace the old URL by the new one
-                QJsonObject urlObject = urlValue.toObject();
-                QString shortUrl = urlObject.value(QLatin1String("url")).toString();
-                QString expandedUrl = urlObject.value(QLatin1String("expanded_url")).toString();
-                body.replace(shortUrl, expandedUrl);
+    QString postId = tweet.value(QLatin1String("id_str")).toString();
+    QString body = tweet.value(QLatin1String("text")).toString();
+    QJsonObject user = tweet.value(QLatin1String("user")).toObject();
+    QString name = user.value("name").toString();
+    QString screenName = user.value("screen_name").toString();
+    QString icon = user.value(QLatin1String("profile_image_url")).toString();
+
+    // Twitter does some HTML substitutions in their content
+    // in JSON feeds, to prevent issues with JSONP formatting.
+    body.replace(QStringLiteral("&lt;"), QStringLiteral("<"));
+    body.replace(QStringLiteral("&gt;"), QStringLiteral(">"));
+    body.replace(QStringLiteral("&amp;"), QStringLiteral("&"));
+
+    QJsonObject entities = tweet.value(QLatin1String("entities")).toObject();
+    QJsonArray mediaList = entities.value(QLatin1String("media")).toArray();
+    if (!mediaList.isEmpty()) {
+        foreach (const QJsonValue &mediaValue, mediaList) {
+            QJsonObject mediaObject = mediaValue.toObject();
+            if (mediaObject.contains(QLatin1String("media_url_https"))) {
+                QString imageUrl = mediaObject.value(QLatin1String("media_url_https")).toString();
+                imageList.append(qMakePair<QString, SocialPostImage::ImageType>(imageUrl, SocialPostImage::Photo));
             }
+        }
+    }
+
+    QJsonArray urlList = entities.value(QLatin1String("urls")).toArray();
+    foreach (const QJsonValue &urlValue, urlList) {
+        // Right now, we use a slightly inefficient algorithm, that is error-proof
+        // we just replace the old URL by the new one
+        QJsonObject urlObject = urlValue.toObject();
+        QString shortUrl = urlObject.value(QLatin1String("url")).toString();
+        QString expandedUrl = urlObject.value(QLatin1String("expanded_url")).toString();
+        body.replace(shortUrl, expandedUrl);
+    }
 
 
-            // We always purge, so even if we've synced it in the past, we need it.
-            // Check to see if we need to post it to the events feed
-            int sinceSpan = m_accountSyncProfile
-                          ? m_accountSyncProfile->key(Buteo::KEY_SYNC_SINCE_DAYS_PAST, QStringLiteral("7")).toInt()
-                          : 7;
-            if (eventTimestamp.daysTo(QDateTime::currentDateTime()) > sinceSpan) {
-                SOCIALD_LOG_DEBUG("tweet for account" << accountId <<
-                                  "is more than" << sinceSpan << "days old:" <<
-                                  eventTimestamp.toString(Qt::ISODate) << body);
-            } else {
-                m_db.addTwitterPost(postId, name, body, eventTimestamp, icon, imageList,
-                                    screenName, retweeter, consumerKey(), consumerSecret(), accountId);
-            }
-        }
+    // We always purge, so even if we've synced it in the past, we need it.
+    // Check to see if we need to post it to the events feed
+    int sinceSpan = accountSyncProfile(accountId)
+                  ? accountSyncProfile(accountId)->key(Buteo::KEY_SYNC_SINCE_DAYS_PAST, QStringLiteral("7")).toInt()
+                  : 7;
+    if (eventTimestamp.daysTo(QDateTime::currentDateTime()) > sinceSpan) {
+        SOCIALD_LOG_DEBUG("tweet for account" << accountId <<
+                          "is more than" << sinceSpan << "days old:" <<
+                          eventTimestamp.toString(Qt::ISODate) << body);
     } else {
-        // error occurred during request.
-        SOCIALD_LOG_ERROR("unable to parse event feed data from request with account" << accountId << "," <<
-                          "got:" << QString::fromLatin1(replyData.constData()));
+        PendingPost post;
+        post.postId = postId;
+        post.name = name;
+        post.body = body;
+        post.timestamp = eventTimestamp;
+        post.icon = icon;
+        post.images = imageList;
+        post.screenName = screenName;
+        post.retweeter = retweeter;
+        m_pendingPosts[accountId].append(post);
     }
-
-    // we're finished this request.  Decrement our busy semaphore.
-    decrementSemaphore(accountId);
 }
@@ -23,12 +23,14 @@
 #define TWITTERHOMETIMELINESYNCADAPTOR_H
 
 #include "twitterdatatypesyncadaptor.h"
+#include "socialdfieldprojection_p.h"
 
 #include <QtCore/QObject>
 #include <QtCore/QString>
 #include <QtCore/QDateTime>
 #include <QtCore/QVariantMap>
 #include <QtCore/QList>
+#include <QtCore/QPair>
 #include <QtCore/QStringList>
 #include <QtCore/QMap>
 #include <QtNetwork/QNetworkReply>
@@ -60,12 +62,26 @@ private:
 private Q_SLOTS:
     void finishedMeHandler();
     void finishedPostsHandler();
+    void postParsedHandler(const QJsonObject &tweetObject);
 
 private:
+    struct PendingPost {
+        QString postId;
+        QString name;
+        QString body;
+        QDateTime timestamp;
+        QString icon;
+        QList<QPair<QString, SocialPostImage::ImageType> > images;
+        QString screenName;
+        QString retweeter;
+    };
+
     TwitterPostsDatabase m_db;
+    QMap<int, QList<PendingPost> > m_pendingPosts; // stored once the reply has been validated
     QMap<int, QString> m_accountProfileImage;
     QStringList m_selfTuids; // twitter user id strings of "me" objects
     QMap<QString, QString> m_selfTScreenNames; // map of user id string to screen name
+    SocialdFieldProjection m_fieldProjection;
 };
 
 #endif // TWITTERHOMETIMELINESYNCADAPTOR_H
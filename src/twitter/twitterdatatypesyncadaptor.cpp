@@ -63,19 +63,19 @@ void TwitterDataTypeSyncAdaptor::sync(const QString &dataTypeString, int account
     if (dataTypeString != SocialNetworkSyncAdaptor::dataTypeName(m_dataType)) {
         SOCIALD_LOG_ERROR("Twitter" << SocialNetworkSyncAdaptor::dataTypeName(m_dataType) <<
                           "sync adaptor was asked to sync" << dataTypeString);
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         return;
     }
 
     if (consumerKey().isEmpty() || consumerSecret().isEmpty()) {
         SOCIALD_LOG_ERROR("secrets could not be retrieved for twitter account" << accountId);
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         return;
     }
 
     setStatus(SocialNetworkSyncAdaptor::Busy);
     updateDataForAccount(accountId);
-    SOCIALD_LOG_DEBUG("successfully triggered sync with profile:" << m_accountSyncProfile->name());
+    SOCIALD_LOG_DEBUG("successfully triggered sync with profile:" << accountSyncProfile(accountId)->name());
 }
 
 void TwitterDataTypeSyncAdaptor::updateDataForAccount(int accountId)
@@ -83,7 +83,7 @@ void TwitterDataTypeSyncAdaptor::updateDataForAccount(int accountId)
     Accounts::Account *account = m_accountManager->account(accountId);
     if (!account) {
         SOCIALD_LOG_ERROR("existing account with id" << accountId << "couldn't be retrieved");
-        setStatus(SocialNetworkSyncAdaptor::Error);
+        setAccountError(accountId);
         decrementSemaphore(accountId);
         return;
     }
@@ -378,7 +378,7 @@ void TwitterDataTypeSyncAdaptor::signOnError(const SignOn::Error &error)
     account->deleteLater();
 
     // if we couldn't sign in, we can't sync with this account.
-    setStatus(SocialNetworkSyncAdaptor::Error);
+    setAccountError(accountId);
     decrementSemaphore(accountId);
 }
 
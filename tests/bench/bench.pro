@@ -0,0 +1,15 @@
+TARGET = tst_bench
+
+include(../tst_common.pri)
+
+include($$PWD/../../src/facebook/facebook-common.pri)
+include($$PWD/../../src/facebook/facebook-contacts/facebook-contacts.pri)
+include($$PWD/../../src/google/google-common.pri)
+include($$PWD/../../src/google/google-calendars/google-calendars.pri)
+include($$PWD/../../src/google/google-contacts/google-contacts.pri)
+include($$PWD/../../src/twitter/twitter-common.pri)
+include($$PWD/../../src/twitter/twitter-posts/twitter-posts.pri)
+
+SOURCES += \
+    tst_bench.cpp \
+    tst_benchnetworkstubs_p.cpp
@@ -0,0 +1,586 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+#define QT_STATICPLUGIN
+
+#include <QtGlobal>
+#include <QTest>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkReply>
+
+#include <QtContacts/QContact>
+#include <QtContacts/QContactNote>
+
+#include "constants_p.h"
+#include <qtcontacts-extensions_impl.h>
+#include <qcontactoriginmetadata_impl.h>
+
+#include "facebookcontactsyncadaptor.h"
+#include "googlecalendarsyncadaptor.h"
+#include "googlecontactstream.h"
+#include "googlecontactatom.h"
+#include "twitterhometimelinesyncadaptor.h"
+#include "socialdjsonstreamparser_p.h"
+
+/*
+ *  Benchmarks of the parsing and conversion functions which dominate the
+ *  cpu time of syncs of large accounts, with generated data of 100, 1k,
+ *  10k and 50k records.
+ *
+ *  Besides the usual QTest output, the results are written as a JSON
+ *  array to the file named by the SOCIALD_BENCH_RESULTS environment
+ *  variable (tst_bench.json in the working directory by default).
+ */
+class tst_bench : public QObject
+{
+    Q_OBJECT
+
+public:
+    tst_bench();
+    virtual ~tst_bench();
+
+public slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+private slots:
+    void googleContactStreamParse_data();
+    void googleContactStreamParse();
+    void googleContactStreamEncode_data();
+    void googleContactStreamEncode();
+    void googleCalendarJsonToKCal_data();
+    void googleCalendarJsonToKCal();
+    void googleCalendarKCalToJson_data();
+    void googleCalendarKCalToJson();
+    void facebookParseContactDetails_data();
+    void facebookParseContactDetails();
+    void facebookRemoteContactDiffersFromLocal_data();
+    void facebookRemoteContactDiffersFromLocal();
+    void twitterTimelineParse_data();
+    void twitterTimelineParse();
+    void twitterAuthorizationHeader_data();
+    void twitterAuthorizationHeader();
+
+private:
+    void recordCounts();
+    void addResult(int records, qint64 nsecs, int iterations);
+
+    QJsonArray m_results;
+};
+
+// --------------------------------
+
+class BenchFacebookContactSyncAdaptor : public FacebookContactSyncAdaptor
+{
+public:
+    BenchFacebookContactSyncAdaptor(QObject *parent) : FacebookContactSyncAdaptor(parent) {}
+    QContact doParseContactDetails(const QJsonObject &blobDetails, int accountId, bool *needsSaving)
+        { return parseContactDetails(blobDetails, accountId, needsSaving); }
+    bool doRemoteContactDiffersFromLocal(const QContact &remoteContact, const QContact &localContact) const
+        { return remoteContactDiffersFromLocal(remoteContact, localContact); }
+};
+
+class BenchGoogleCalendarSyncAdaptor : public GoogleCalendarSyncAdaptor
+{
+public:
+    static QJsonObject doKCalToJson(KCalCore::Event::Ptr event, KCalCore::ICalFormat &icalFormat)
+        { return kCalToJson(event, icalFormat); }
+    static void doJsonToKCal(const QJsonObject &json, KCalCore::Event::Ptr event, KCalCore::ICalFormat &icalFormat)
+        { jsonToKCal(json, event, icalFormat); }
+};
+
+class BenchTwitterSyncAdaptor : public TwitterHomeTimelineSyncAdaptor
+{
+public:
+    BenchTwitterSyncAdaptor(QObject *parent) : TwitterHomeTimelineSyncAdaptor(parent) {}
+    QString doAuthorizationHeader(int accountId, const QString &oauthToken, const QString &oauthTokenSecret,
+                                  const QString &requestMethod, const QString &requestUrl,
+                                  const QList<QPair<QString, QString> > &parameters)
+        { return authorizationHeader(accountId, oauthToken, oauthTokenSecret, requestMethod, requestUrl, parameters); }
+};
+
+// the stream parser reads from a reply, but the benchmark feeds it directly.
+class BenchNetworkReply : public QNetworkReply
+{
+public:
+    BenchNetworkReply() { open(QIODevice::ReadOnly); }
+    void abort() {}
+protected:
+    qint64 readData(char *, qint64) { return 0; }
+};
+
+// --------------------------------
+
+static QByteArray createGoogleContactsFeed(int records)
+{
+    QByteArray retn;
+    retn.reserve(records * 1400 + 1024);
+    retn += "<?xml version='1.0' encoding='UTF-8'?>\n"
+            "<feed xmlns='http://www.w3.org/2005/Atom' xmlns:openSearch='http://a9.com/-/spec/opensearch/1.1/'"
+            " xmlns:app='http://www.w3.org/2007/app' xmlns:gContact='http://schemas.google.com/contact/2008'"
+            " xmlns:batch='http://schemas.google.com/gdata/batch' xmlns:gd='http://schemas.google.com/g/2005'"
+            " gd:etag='W/\"benchfeed\"'>\n"
+            "<id>bench@example.com</id>\n"
+            "<updated>2014-06-01T10:00:00.000Z</updated>\n"
+            "<category scheme='http://schemas.google.com/g/2005#kind' term='http://schemas.google.com/contact/2008#contact'/>\n"
+            "<title>Bench Person's Contacts</title>\n"
+            "<author><name>Bench Person</name><email>bench@example.com</email></author>\n";
+    retn += QString::fromLatin1("<openSearch:totalResults>%1</openSearch:totalResults>\n"
+                                "<openSearch:startIndex>1</openSearch:startIndex>\n"
+                                "<openSearch:itemsPerPage>%1</openSearch:itemsPerPage>\n").arg(records).toUtf8();
+
+    for (int i = 0; i < records; ++i) {
+        retn += QString::fromLatin1(
+            "<entry gd:etag='\"Qn8-benchetag%1\"'>\n"
+            "  <id>http://www.google.com/m8/feeds/contacts/bench%40example.com/base/bench%1</id>\n"
+            "  <updated>2014-06-01T10:00:00.000Z</updated>\n"
+            "  <app:edited>2014-06-01T10:00:00.000Z</app:edited>\n"
+            "  <category scheme='http://schemas.google.com/g/2005#kind' term='http://schemas.google.com/contact/2008#contact'/>\n"
+            "  <title>Bench Contact%1</title>\n"
+            "  <link rel='http://schemas.google.com/contacts/2008/rel#photo' type='image/*'"
+            " href='https://www.google.com/m8/feeds/photos/media/bench%40example.com/bench%1'/>\n"
+            "  <link rel='self' type='application/atom+xml'"
+            " href='https://www.google.com/m8/feeds/contacts/bench%40example.com/full/bench%1'/>\n"
+            "  <link rel='edit' type='application/atom+xml'"
+            " href='https://www.google.com/m8/feeds/contacts/bench%40example.com/full/bench%1'/>\n"
+            "  <gd:name><gd:fullName>Bench Contact%1</gd:fullName><gd:givenName>Bench</gd:givenName>"
+            "<gd:familyName>Contact%1</gd:familyName></gd:name>\n"
+            "  <gd:email rel='http://schemas.google.com/g/2005#home' address='bench.contact%1@example.com' primary='true'/>\n"
+            "  <gd:phoneNumber rel='http://schemas.google.com/g/2005#mobile'>+61 400 %1</gd:phoneNumber>\n"
+            "  <gd:structuredPostalAddress rel='http://schemas.google.com/g/2005#home'>"
+            "<gd:street>%1 Bench Street</gd:street><gd:city>Benchville</gd:city>"
+            "<gd:postcode>4000</gd:postcode><gd:country>Australia</gd:country></gd:structuredPostalAddress>\n"
+            "  <gContact:website href='http://bench%1.example.com/' rel='home-page'/>\n"
+            "  <gContact:groupMembershipInfo deleted='false'"
+            " href='http://www.google.com/m8/feeds/groups/bench%40example.com/base/6'/>\n"
+            "  <gd:extendedProperty name='bench-property' value='%1'/>\n"
+            "</entry>\n").arg(i).toUtf8();
+    }
+
+    retn += "</feed>\n";
+    return retn;
+}
+
+static QList<QJsonObject> createGoogleCalendarEvents(int records)
+{
+    QList<QJsonObject> retn;
+    const QDateTime base(QDate(2014, 6, 1), QTime(10, 0), Qt::UTC);
+    for (int i = 0; i < records; ++i) {
+        QJsonObject event;
+        event.insert(QStringLiteral("kind"), QStringLiteral("calendar#event"));
+        event.insert(QStringLiteral("id"), QStringLiteral("benchevent%1").arg(i));
+        event.insert(QStringLiteral("status"), QStringLiteral("confirmed"));
+        event.insert(QStringLiteral("summary"), QStringLiteral("Bench event %1").arg(i));
+        event.insert(QStringLiteral("description"), QStringLiteral("The description of bench event %1").arg(i));
+        event.insert(QStringLiteral("location"), QStringLiteral("Meeting room %1").arg(i % 20));
+        event.insert(QStringLiteral("sequence"), i % 3);
+
+        QJsonObject start, end;
+        if (i % 10 == 9) {
+            start.insert(QStringLiteral("date"), base.date().addDays(i % 365).toString(QStringLiteral("yyyy-MM-dd")));
+            end.insert(QStringLiteral("date"), base.date().addDays(i % 365 + 1).toString(QStringLiteral("yyyy-MM-dd")));
+        } else {
+            const QDateTime startTime = base.addSecs(3600 * (i % 8760));
+            start.insert(QStringLiteral("dateTime"), startTime.toString(Qt::ISODate));
+            start.insert(QStringLiteral("timeZone"), QStringLiteral("Australia/Brisbane"));
+            end.insert(QStringLiteral("dateTime"), startTime.addSecs(3600).toString(Qt::ISODate));
+            end.insert(QStringLiteral("timeZone"), QStringLiteral("Australia/Brisbane"));
+        }
+        event.insert(QStringLiteral("start"), start);
+        event.insert(QStringLiteral("end"), end);
+
+        if (i % 5 == 0) {
+            QJsonArray recurrence;
+            recurrence.append(QStringLiteral("RRULE:FREQ=WEEKLY;COUNT=10"));
+            recurrence.append(QStringLiteral("EXDATE:%1").arg(base.date().addDays(7).toString(QStringLiteral("yyyy-MM-dd"))));
+            event.insert(QStringLiteral("recurrence"), recurrence);
+        }
+        retn.append(event);
+    }
+    return retn;
+}
+
+static QList<QJsonObject> createFacebookFriends(int records)
+{
+    QList<QJsonObject> retn;
+    for (int i = 0; i < records; ++i) {
+        const QString id = QString::number(900000000 + i);
+        QJsonObject pictureData;
+        pictureData.insert(QStringLiteral("is_silhouette"), i % 4 == 0);
+        pictureData.insert(QStringLiteral("url"), QStringLiteral("https://graph.facebook.com/%1/picture").arg(id));
+        QJsonObject picture;
+        picture.insert(QStringLiteral("data"), pictureData);
+        QJsonObject cover;
+        cover.insert(QStringLiteral("source"), QStringLiteral("https://graph.facebook.com/%1/cover").arg(id));
+
+        QJsonObject friendObject;
+        friendObject.insert(QStringLiteral("id"), id);
+        friendObject.insert(QStringLiteral("name"), QStringLiteral("Bench Friend%1").arg(i));
+        friendObject.insert(QStringLiteral("first_name"), QStringLiteral("Bench"));
+        friendObject.insert(QStringLiteral("last_name"), QStringLiteral("Friend%1").arg(i));
+        friendObject.insert(QStringLiteral("link"), QStringLiteral("https://www.facebook.com/benchfriend%1").arg(i));
+        friendObject.insert(QStringLiteral("website"), QStringLiteral("http://friend%1.example.com/").arg(i));
+        friendObject.insert(QStringLiteral("picture"), picture);
+        friendObject.insert(QStringLiteral("cover"), cover);
+        friendObject.insert(QStringLiteral("birthday"), QStringLiteral("%1/%2/1980").arg(i % 12 + 1, 2, 10, QLatin1Char('0'))
+                                                                           .arg(i % 28 + 1, 2, 10, QLatin1Char('0')));
+        friendObject.insert(QStringLiteral("bio"), QStringLiteral("An ordinary, average, bench friend."));
+        friendObject.insert(QStringLiteral("gender"), i % 2 ? QStringLiteral("female") : QStringLiteral("male"));
+        retn.append(friendObject);
+    }
+    return retn;
+}
+
+static QByteArray createTwitterTimeline(int records)
+{
+    QJsonArray retn;
+    for (int i = 0; i < records; ++i) {
+        QJsonObject user;
+        user.insert(QStringLiteral("name"), QStringLiteral("Bench User%1").arg(i % 100));
+        user.insert(QStringLiteral("screen_name"), QStringLiteral("benchuser%1").arg(i % 100));
+        user.insert(QStringLiteral("profile_image_url"), QStringLiteral("http://pbs.twimg.com/profile_images/%1/bench.png").arg(i % 100));
+
+        QJsonObject url;
+        url.insert(QStringLiteral("url"), QStringLiteral("http://t.co/bench%1").arg(i));
+        url.insert(QStringLiteral("expanded_url"), QStringLiteral("http://example.com/bench/%1").arg(i));
+        QJsonArray urls;
+        urls.append(url);
+        QJsonObject entities;
+        entities.insert(QStringLiteral("urls"), urls);
+        entities.insert(QStringLiteral("media"), QJsonArray());
+
+        QJsonObject tweet;
+        tweet.insert(QStringLiteral("created_at"), QStringLiteral("Sun Jun 01 10:00:00 +0000 2014"));
+        tweet.insert(QStringLiteral("id_str"), QString::number(480000000000000000LL + i));
+        tweet.insert(QStringLiteral("text"), QStringLiteral("Bench tweet %1 &amp; a \"quoted\" link http://t.co/bench%1").arg(i));
+        tweet.insert(QStringLiteral("user"), user);
+        tweet.insert(QStringLiteral("entities"), entities);
+        retn.append(tweet);
+    }
+    return QJsonDocument(retn).toJson(QJsonDocument::Compact);
+}
+
+// --------------------------------
+
+tst_bench::tst_bench()
+{
+}
+
+tst_bench::~tst_bench()
+{
+}
+
+void tst_bench::initTestCase()
+{
+}
+
+void tst_bench::cleanupTestCase()
+{
+    QString fileName = QString::fromLocal8Bit(qgetenv("SOCIALD_BENCH_RESULTS"));
+    if (fileName.isEmpty()) {
+        fileName = QStringLiteral("tst_bench.json");
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "unable to write benchmark results to" << fileName;
+        return;
+    }
+    file.write(QJsonDocument(m_results).toJson());
+}
+
+void tst_bench::recordCounts()
+{
+    QTest::addColumn<int>("records");
+    QTest::newRow("100") << 100;
+    QTest::newRow("1k") << 1000;
+    QTest::newRow("10k") << 10000;
+    QTest::newRow("50k") << 50000;
+}
+
+void tst_bench::addResult(int records, qint64 nsecs, int iterations)
+{
+    if (iterations == 0) {
+        return;
+    }
+
+    QJsonObject result;
+    result.insert(QStringLiteral("benchmark"), QString::fromLatin1(QTest::currentTestFunction()));
+    result.insert(QStringLiteral("records"), records);
+    result.insert(QStringLiteral("iterations"), iterations);
+    result.insert(QStringLiteral("nsecsPerIteration"), static_cast<double>(nsecs) / iterations);
+    result.insert(QStringLiteral("nsecsPerRecord"), static_cast<double>(nsecs) / iterations / records);
+    m_results.append(result);
+}
+
+// --------------------------------
+
+void tst_bench::googleContactStreamParse_data()
+{
+    recordCounts();
+}
+
+void tst_bench::googleContactStreamParse()
+{
+    QFETCH(int, records);
+    const QByteArray feed = createGoogleContactsFeed(records);
+
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        GoogleContactStream parser(false, 1);
+        GoogleContactAtom *atom = parser.parse(feed);
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+        QCOMPARE(atom->entryContacts().size(), records);
+        delete atom;
+    }
+    addResult(records, elapsed, iterations);
+}
+
+void tst_bench::googleContactStreamEncode_data()
+{
+    recordCounts();
+}
+
+void tst_bench::googleContactStreamEncode()
+{
+    QFETCH(int, records);
+    GoogleContactStream parser(false, 1);
+    GoogleContactAtom *atom = parser.parse(createGoogleContactsFeed(records));
+    QMultiMap<GoogleContactStream::UpdateType, QPair<QContact, GoogleContactXmlElements> > updates;
+    typedef QPair<QContact, GoogleContactXmlElements> Entry;
+    foreach (const Entry &entry, atom->entryContacts()) {
+        updates.insert(GoogleContactStream::Modify, entry);
+    }
+    delete atom;
+    QCOMPARE(updates.size(), records);
+
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        GoogleContactStream encoder(false, 1, QStringLiteral("bench@example.com"));
+        QByteArray encoded = encoder.encode(updates);
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+        QVERIFY(!encoded.isEmpty());
+    }
+    addResult(records, elapsed, iterations);
+}
+
+void tst_bench::googleCalendarJsonToKCal_data()
+{
+    recordCounts();
+}
+
+void tst_bench::googleCalendarJsonToKCal()
+{
+    QFETCH(int, records);
+    const QList<QJsonObject> events = createGoogleCalendarEvents(records);
+    KCalCore::ICalFormat icalFormat;
+
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        foreach (const QJsonObject &json, events) {
+            KCalCore::Event::Ptr event(new KCalCore::Event);
+            BenchGoogleCalendarSyncAdaptor::doJsonToKCal(json, event, icalFormat);
+        }
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    addResult(records, elapsed, iterations);
+}
+
+void tst_bench::googleCalendarKCalToJson_data()
+{
+    recordCounts();
+}
+
+void tst_bench::googleCalendarKCalToJson()
+{
+    QFETCH(int, records);
+    KCalCore::ICalFormat icalFormat;
+    QList<KCalCore::Event::Ptr> events;
+    foreach (const QJsonObject &json, createGoogleCalendarEvents(records)) {
+        KCalCore::Event::Ptr event(new KCalCore::Event);
+        BenchGoogleCalendarSyncAdaptor::doJsonToKCal(json, event, icalFormat);
+        events.append(event);
+    }
+
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        foreach (KCalCore::Event::Ptr event, events) {
+            QJsonDocument(BenchGoogleCalendarSyncAdaptor::doKCalToJson(event, icalFormat)).toJson();
+        }
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    addResult(records, elapsed, iterations);
+}
+
+void tst_bench::facebookParseContactDetails_data()
+{
+    recordCounts();
+}
+
+void tst_bench::facebookParseContactDetails()
+{
+    QFETCH(int, records);
+    const QList<QJsonObject> friends = createFacebookFriends(records);
+    BenchFacebookContactSyncAdaptor adaptor(this);
+
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        foreach (const QJsonObject &friendObject, friends) {
+            bool needsSaving = false;
+            adaptor.doParseContactDetails(friendObject, 1, &needsSaving);
+        }
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    addResult(records, elapsed, iterations);
+}
+
+void tst_bench::facebookRemoteContactDiffersFromLocal_data()
+{
+    recordCounts();
+}
+
+void tst_bench::facebookRemoteContactDiffersFromLocal()
+{
+    QFETCH(int, records);
+    BenchFacebookContactSyncAdaptor adaptor(this);
+    QList<QPair<QContact, QContact> > contacts;
+    foreach (const QJsonObject &friendObject, createFacebookFriends(records)) {
+        bool needsSaving = false;
+        QContact remote = adaptor.doParseContactDetails(friendObject, 1, &needsSaving);
+        QContact local = remote;
+        if (contacts.size() % 2) {
+            // half of the contacts have been changed remotely.
+            QContactNote note = remote.detail<QContactNote>();
+            note.setNote(QStringLiteral("A changed bio."));
+            remote.saveDetail(&note);
+        }
+        contacts.append(qMakePair(remote, local));
+    }
+
+    qint64 elapsed = 0;
+    int iterations = 0;
+    int changed = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        changed = 0;
+        for (int i = 0; i < contacts.size(); ++i) {
+            if (adaptor.doRemoteContactDiffersFromLocal(contacts.at(i).first, contacts.at(i).second)) {
+                ++changed;
+            }
+        }
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    QCOMPARE(changed, records / 2);
+    addResult(records, elapsed, iterations);
+}
+
+void tst_bench::twitterTimelineParse_data()
+{
+    recordCounts();
+}
+
+void tst_bench::twitterTimelineParse()
+{
+    QFETCH(int, records);
+    const QByteArray timeline = createTwitterTimeline(records);
+    const int chunkSize = 16384; // roughly what arrives per readyRead()
+
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        BenchNetworkReply reply;
+        SocialdJsonStreamParser *parser = new SocialdJsonStreamParser(&reply, QString());
+        for (int offset = 0; offset < timeline.size(); offset += chunkSize) {
+            parser->addData(timeline.mid(offset, chunkSize));
+        }
+        bool ok = false;
+        parser->finish(&ok);
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+        QVERIFY(ok);
+        QCOMPARE(parser->elementCount(), records);
+    }
+    addResult(records, elapsed, iterations);
+}
+
+void tst_bench::twitterAuthorizationHeader_data()
+{
+    recordCounts();
+}
+
+void tst_bench::twitterAuthorizationHeader()
+{
+    QFETCH(int, records);
+    BenchTwitterSyncAdaptor adaptor(this);
+    QList<QPair<QString, QString> > parameters;
+    parameters.append(qMakePair(QStringLiteral("count"), QStringLiteral("200")));
+    parameters.append(qMakePair(QStringLiteral("since_id"), QStringLiteral("480000000000000000")));
+    parameters.append(qMakePair(QStringLiteral("include_entities"), QStringLiteral("true")));
+
+    // one signed request per record, as for paged requests or upsyncs.
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < records; ++i) {
+            adaptor.doAuthorizationHeader(1, QStringLiteral("benchOauthToken"), QStringLiteral("benchOauthTokenSecret"),
+                                          QStringLiteral("GET"), QStringLiteral("https://api.twitter.com/1.1/statuses/home_timeline.json"),
+                                          parameters);
+        }
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    addResult(records, elapsed, iterations);
+}
+
+// --------------------------------
+
+QTEST_MAIN(tst_bench)
+#include "tst_bench.moc"
@@ -23,36 +23,477 @@
 #include "socialdnetworkaccessmanager_p.h"
 
 #include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QTimer>
+#include <QUrlQuery>
+
+#include <string.h>
 
 /*
  *  This implementation overrides the networking classes for testing purposes.
- *  The unit test for each social network should provide an implementation of
- *  TestNetworkReply::generateData() in order to return the required data.
+ *  Requests are answered from the replayed fixtures (see TestNetworkReplay)
+ *  if any match, and otherwise the unit test for each social network should
+ *  provide an implementation of TestNetworkReply::generateData() in order to
+ *  return the required data.
  */
 
+struct TestNetworkReplay::State
+{
+    State() : served(0), unmatched(0)
+    {
+        bool ok = false;
+        int value = qgetenv("SOCIALD_TEST_CHUNK_SIZE").toInt(&ok);
+        if (ok) delivery.chunkSize = value;
+        value = qgetenv("SOCIALD_TEST_LATENCY").toInt(&ok);
+        if (ok) delivery.latency = value;
+        value = qgetenv("SOCIALD_TEST_BANDWIDTH").toInt(&ok);
+        if (ok) delivery.bytesPerSecond = value;
+
+        recordDirectory = QString::fromLocal8Bit(qgetenv("SOCIALD_TEST_RECORD"));
+        const QString fixtureDirectory = QString::fromLocal8Bit(qgetenv("SOCIALD_TEST_FIXTURES"));
+        if (!fixtureDirectory.isEmpty() && !readFixtures(fixtureDirectory, &fixtures)) {
+            qWarning() << "unable to load test fixtures from" << fixtureDirectory;
+        }
+    }
+
+    QList<Fixture> fixtures;
+    QString recordDirectory;
+    QJsonArray recorded;
+    Delivery delivery;
+    int served;
+    int unmatched;
+};
+
+TestNetworkReplay::State &TestNetworkReplay::state()
+{
+    static State retn;
+    return retn;
+}
+
+bool TestNetworkReplay::readFixtures(const QString &directory, QList<Fixture> *fixtures)
+{
+    QFile index(QDir(directory).filePath(QStringLiteral("fixtures.json")));
+    if (!index.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(index.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || !document.isArray()) {
+        qWarning() << "invalid fixture index" << index.fileName() << error.errorString();
+        return false;
+    }
+
+    QList<Fixture> loaded;
+    foreach (const QJsonValue &value, document.array()) {
+        const QJsonObject object = value.toObject();
+        Fixture fixture;
+        fixture.method = object.value(QStringLiteral("method")).toString(QStringLiteral("GET")).toLatin1();
+        fixture.url = QRegularExpression(object.value(QStringLiteral("url")).toString());
+        fixture.fileName = QDir(directory).filePath(object.value(QStringLiteral("file")).toString());
+        fixture.status = object.value(QStringLiteral("status")).toInt(200);
+        const QJsonObject headers = object.value(QStringLiteral("headers")).toObject();
+        for (QJsonObject::const_iterator it = headers.constBegin(); it != headers.constEnd(); ++it) {
+            fixture.headers.append(qMakePair(it.key().toLatin1(), it.value().toString().toLatin1()));
+        }
+        if (!fixture.url.isValid()) {
+            qWarning() << "invalid fixture url pattern" << fixture.url.pattern() << fixture.url.errorString();
+            return false;
+        }
+        loaded.append(fixture);
+    }
+
+    fixtures->append(loaded);
+    return true;
+}
+
+bool TestNetworkReplay::loadFixtures(const QString &directory)
+{
+    return readFixtures(directory, &state().fixtures);
+}
+
+void TestNetworkReplay::setRecordDirectory(const QString &directory)
+{
+    State &s(state());
+    s.recordDirectory = directory;
+    s.recorded = QJsonArray();
+}
+
+void TestNetworkReplay::clear()
+{
+    State &s(state());
+    s.fixtures.clear();
+    s.recordDirectory.clear();
+    s.recorded = QJsonArray();
+    s.delivery = Delivery();
+    s.served = 0;
+    s.unmatched = 0;
+}
+
+void TestNetworkReplay::setDelivery(const Delivery &delivery)
+{
+    state().delivery = delivery;
+}
+
+TestNetworkReplay::Delivery TestNetworkReplay::delivery()
+{
+    return state().delivery;
+}
+
+int TestNetworkReplay::servedRequests()
+{
+    return state().served;
+}
+
+int TestNetworkReplay::unmatchedRequests()
+{
+    return state().unmatched;
+}
+
+bool TestNetworkReplay::match(const QByteArray &method, const QUrl &url, int *status,
+                              QList<QPair<QByteArray, QByteArray> > *headers, QByteArray *body)
+{
+    State &s(state());
+    const QString urlString = url.toString(QUrl::FullyEncoded);
+
+    // successive requests for the same pattern get successive fixtures.
+    Fixture *found = 0;
+    for (int i = 0; i < s.fixtures.size(); ++i) {
+        Fixture &fixture(s.fixtures[i]);
+        if (fixture.method == method && fixture.url.match(urlString).hasMatch()) {
+            found = &fixture;
+            if (fixture.served == 0) {
+                break;
+            }
+        }
+    }
+
+    if (!found) {
+        s.unmatched += 1;
+        return false;
+    }
+
+    QFile file(found->fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "unable to read test fixture" << found->fileName;
+        s.unmatched += 1;
+        return false;
+    }
+
+    found->served += 1;
+    s.served += 1;
+    *status = found->status;
+    *headers = found->headers;
+    *body = file.readAll();
+    return true;
+}
+
+void TestNetworkReplay::record(const QByteArray &method, const QUrl &url, int status,
+                               const QList<QPair<QByteArray, QByteArray> > &headers,
+                               const QByteArray &body)
+{
+    State &s(state());
+    QDir directory(s.recordDirectory);
+    if (!directory.mkpath(QStringLiteral("."))) {
+        qWarning() << "unable to create record directory" << s.recordDirectory;
+        return;
+    }
+
+    // don't put credentials into the recorded patterns.
+    QString pattern = QRegularExpression::escape(url.toString(QUrl::RemoveQuery | QUrl::FullyEncoded));
+    const QUrlQuery query(url);
+    if (!query.isEmpty()) {
+        QStringList items;
+        typedef QPair<QString, QString> QueryItem;
+        foreach (const QueryItem &item, query.queryItems(QUrl::FullyEncoded)) {
+            const bool secret = item.first == QLatin1String("access_token")
+                             || item.first == QLatin1String("oauth_token");
+            items.append(QRegularExpression::escape(item.first) + QLatin1Char('=')
+                         + (secret ? QStringLiteral("[^&]*") : QRegularExpression::escape(item.second)));
+        }
+        pattern += QStringLiteral("\\?") + items.join(QLatin1Char('&'));
+    }
+
+    const QString fileName = QStringLiteral("%1.body").arg(s.recorded.size() + 1, 4, 10, QLatin1Char('0'));
+    QFile file(directory.filePath(fileName));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "unable to write test fixture" << file.fileName();
+        return;
+    }
+    file.write(body);
+    file.close();
+
+    QJsonObject headerObject;
+    typedef QPair<QByteArray, QByteArray> Header;
+    foreach (const Header &header, headers) {
+        if (qstricmp(header.first.constData(), "Set-Cookie") != 0) {
+            headerObject.insert(QString::fromLatin1(header.first), QString::fromLatin1(header.second));
+        }
+    }
+
+    QJsonObject object;
+    object.insert(QStringLiteral("method"), QString::fromLatin1(method));
+    object.insert(QStringLiteral("url"), QLatin1Char('^') + pattern + QLatin1Char('$'));
+    object.insert(QStringLiteral("status"), status);
+    object.insert(QStringLiteral("headers"), headerObject);
+    object.insert(QStringLiteral("file"), fileName);
+    s.recorded.append(object);
+
+    QFile index(directory.filePath(QStringLiteral("fixtures.json")));
+    if (!index.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "unable to write fixture index" << index.fileName();
+        return;
+    }
+    index.write(QJsonDocument(s.recorded).toJson());
+}
+
+// --------------------------------
+
+TestNetworkReply::TestNetworkReply(QObject *parent)
+    : QNetworkReply(parent)
+    , m_readOffset(0)
+    , m_pendingOffset(0)
+    , m_aborted(false)
+    , m_delivery(TestNetworkReplay::delivery())
+    , m_recordedReply(0)
+{
+}
+
+void TestNetworkReply::abort()
+{
+    if (isFinished()) {
+        return;
+    }
+
+    m_aborted = true;
+    if (m_recordedReply) {
+        m_recordedReply->disconnect(this);
+        m_recordedReply->abort();
+        m_recordedReply->deleteLater();
+        m_recordedReply = 0;
+    }
+
+    setError(QNetworkReply::OperationCanceledError, QStringLiteral("Operation canceled"));
+    setFinished(true);
+    emit error(QNetworkReply::OperationCanceledError);
+    emit finished();
+}
+
+qint64 TestNetworkReply::readData(char *buf, qint64 sz)
+{
+    const qint64 count = qMin<qint64>(sz, m_readAllData.size() - m_readOffset);
+    if (count <= 0) {
+        return 0;
+    }
+
+    memcpy(buf, m_readAllData.constData() + m_readOffset, count);
+    m_readOffset += count;
+
+    // drop the consumed data once it makes up most of the buffer.
+    if (m_readOffset == m_readAllData.size()) {
+        m_readAllData.clear();
+        m_readOffset = 0;
+    } else if (m_readOffset > m_readAllData.size() / 2) {
+        m_readAllData.remove(0, m_readOffset);
+        m_readOffset = 0;
+    }
+
+    return count;
+}
+
+void TestNetworkReply::setStatus(int status)
+{
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, status);
+    if (status < 400) {
+        return;
+    }
+
+    QNetworkReply::NetworkError code = QNetworkReply::UnknownContentError;
+    switch (status) {
+        case 400: code = QNetworkReply::ProtocolInvalidOperationError; break;
+        case 401: code = QNetworkReply::AuthenticationRequiredError; break;
+        case 403: code = QNetworkReply::ContentAccessDenied; break;
+        case 404: code = QNetworkReply::ContentNotFoundError; break;
+        case 409: code = QNetworkReply::ContentConflictError; break;
+        case 410: code = QNetworkReply::ContentGoneError; break;
+        default: code = status >= 500 ? QNetworkReply::UnknownServerError : QNetworkReply::UnknownContentError; break;
+    }
+    setError(code, QStringLiteral("HTTP status %1").arg(status));
+}
+
+void TestNetworkReply::deliver(const QByteArray &body)
+{
+    m_pendingData = body;
+    m_pendingOffset = 0;
+    open(QIODevice::ReadOnly);
+
+    qint64 delay = m_delivery.latency;
+    const int chunk = m_delivery.chunkSize > 0 ? qMin(m_delivery.chunkSize, body.size()) : body.size();
+    if (m_delivery.bytesPerSecond > 0) {
+        delay += static_cast<qint64>(chunk) * 1000 / m_delivery.bytesPerSecond;
+    }
+    QTimer::singleShot(static_cast<int>(delay), this, SLOT(deliverChunk()));
+}
+
+void TestNetworkReply::deliverChunk()
+{
+    if (m_aborted) {
+        return;
+    }
+
+    const int remaining = m_pendingData.size() - m_pendingOffset;
+    const int chunk = m_delivery.chunkSize > 0 ? qMin(m_delivery.chunkSize, remaining) : remaining;
+    if (chunk > 0) {
+        m_readAllData.append(m_pendingData.constData() + m_pendingOffset, chunk);
+        m_pendingOffset += chunk;
+        emit downloadProgress(m_pendingOffset, m_pendingData.size());
+        emit readyRead();
+        if (m_aborted) {
+            return; // aborted by a readyRead() handler.
+        }
+    }
+
+    if (m_pendingOffset < m_pendingData.size()) {
+        const int next = m_delivery.chunkSize > 0
+                       ? qMin(m_delivery.chunkSize, m_pendingData.size() - m_pendingOffset)
+                       : m_pendingData.size() - m_pendingOffset;
+        const qint64 delay = m_delivery.bytesPerSecond > 0
+                           ? static_cast<qint64>(next) * 1000 / m_delivery.bytesPerSecond
+                           : 0;
+        QTimer::singleShot(static_cast<int>(delay), this, SLOT(deliverChunk()));
+        return;
+    }
+
+    m_pendingData.clear();
+    m_pendingOffset = 0;
+    setFinished(true);
+    if (error() != QNetworkReply::NoError) {
+        emit error(error());
+    }
+    emit finished();
+}
+
+void TestNetworkReply::recordedReadyRead()
+{
+    const QByteArray data = m_recordedReply->readAll();
+    m_recordedData.append(data);
+    m_readAllData.append(data);
+    emit downloadProgress(m_recordedData.size(),
+                          m_recordedReply->header(QNetworkRequest::ContentLengthHeader).toLongLong());
+    emit readyRead();
+}
+
+void TestNetworkReply::recordedFinished()
+{
+    QNetworkReply *recorded = m_recordedReply;
+    m_recordedReply = 0;
+    recorded->deleteLater();
+
+    const QByteArray data = recorded->readAll();
+    m_recordedData.append(data);
+    m_readAllData.append(data);
+
+    const int status = recorded->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, status);
+    typedef QPair<QByteArray, QByteArray> Header;
+    foreach (const Header &header, recorded->rawHeaderPairs()) {
+        setRawHeader(header.first, header.second);
+    }
+    if (recorded->error() != QNetworkReply::NoError) {
+        setError(recorded->error(), recorded->errorString());
+    }
+
+    TestNetworkReplay::record(property("method").toByteArray(), url(), status,
+                              recorded->rawHeaderPairs(), m_recordedData);
+    m_recordedData.clear();
+
+    setFinished(true);
+    if (!data.isEmpty()) {
+        emit readyRead();
+    }
+    if (error() != QNetworkReply::NoError) {
+        emit error(error());
+    }
+    emit finished();
+}
+
+// --------------------------------
+
+namespace {
+    QByteArray operationName(QNetworkAccessManager::Operation op, const QNetworkRequest &req)
+    {
+        switch (op) {
+            case QNetworkAccessManager::HeadOperation:   return QByteArrayLiteral("HEAD");
+            case QNetworkAccessManager::GetOperation:    return QByteArrayLiteral("GET");
+            case QNetworkAccessManager::PutOperation:    return QByteArrayLiteral("PUT");
+            case QNetworkAccessManager::PostOperation:   return QByteArrayLiteral("POST");
+            case QNetworkAccessManager::DeleteOperation: return QByteArrayLiteral("DELETE");
+            default: break;
+        }
+        return req.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray();
+    }
+}
+
 SocialdNetworkAccessManager::SocialdNetworkAccessManager(QObject *parent)
     : QNetworkAccessManager(parent)
+    , m_scheduler(0)
+{
+}
+
+void SocialdNetworkAccessManager::commitValidators(QNetworkReply *)
 {
+    // the test replies are never conditional.
 }
 
 QNetworkReply *SocialdNetworkAccessManager::createRequest(QNetworkAccessManager::Operation op,
                                                           const QNetworkRequest &req,
                                                           QIODevice *outgoingData)
 {
-    Q_UNUSED(op)
-    Q_UNUSED(outgoingData)
+    // the requests of the sync adaptors under test are not queued, but
+    // tst_common runs the scheduler over createNetworkRequest().
+    return createNetworkRequest(op, req, outgoingData);
+}
 
-    QString generator; // TODO: create generator from request, if we want to test different branches.
+QNetworkReply *SocialdNetworkAccessManager::createNetworkRequest(QNetworkAccessManager::Operation op,
+                                                                 const QNetworkRequest &req,
+                                                                 QIODevice *outgoingData)
+{
+    const QByteArray method = operationName(op, req);
 
     // construct a test reply, which will contain the expected data and trigger finished()
     TestNetworkReply *retn = new TestNetworkReply(this);
     retn->setOperation(op);
     retn->setRequest(req);
     retn->setUrl(req.url());
-    retn->m_readAllData = TestNetworkReply::generateData(req.url(), generator);
-    retn->open(QIODevice::ReadOnly);
-    retn->setFinished(true);
-    QTimer::singleShot(100, retn, SIGNAL(finished()));
+    retn->setProperty("method", method);
+
+    if (!TestNetworkReplay::state().recordDirectory.isEmpty()) {
+        // perform the request for real, and record the response.
+        retn->m_recordedReply = QNetworkAccessManager::createRequest(op, req, outgoingData);
+        connect(retn->m_recordedReply, SIGNAL(readyRead()), retn, SLOT(recordedReadyRead()));
+        connect(retn->m_recordedReply, SIGNAL(finished()), retn, SLOT(recordedFinished()));
+        retn->open(QIODevice::ReadOnly);
+        return retn;
+    }
+
+    int status = 200;
+    QList<QPair<QByteArray, QByteArray> > headers;
+    QByteArray body;
+    if (TestNetworkReplay::match(method, req.url(), &status, &headers, &body)) {
+        retn->setStatus(status);
+        typedef QPair<QByteArray, QByteArray> Header;
+        foreach (const Header &header, headers) {
+            retn->setRawHeader(header.first, header.second);
+        }
+    } else {
+        QString generator; // TODO: create generator from request, if we want to test different branches.
+        body = TestNetworkReply::generateData(req.url(), generator);
+    }
+
+    retn->deliver(body);
     return retn;
 }
@@ -23,40 +23,127 @@
 #define SOCIALD_TESTS_NETWORKSTUBS_P_H
 
 #include <QByteArray>
+#include <QList>
+#include <QPair>
 #include <QNetworkReply>
+#include <QRegularExpression>
 #include <QUrl>
 #include <QString>
 #include <QtDebug>
 
 #include "socialdnetworkaccessmanager_p.h"
 
+/*
+ *  Replays recorded network traffic to the sync adaptors under test.
+ *
+ *  A fixture directory contains the recorded response bodies, and a
+ *  fixtures.json index which maps requests to them:
+ *
+ *    [ { "method": "GET",
+ *        "url": "^https://graph\\.facebook\\.com/me/friends\\?access_token=[^&]*$",
+ *        "status": 200,
+ *        "headers": { "Content-Type": "application/json" },
+ *        "file": "0001.body" }, ... ]
+ *
+ *  The url is a regular expression matched against the full request url.
+ *  If several fixtures match a request, they are served in index order
+ *  (eg, successive pages of the same collection), and the last one is
+ *  served again once all of them have been used.  Requests which match
+ *  no fixture are answered by the TestNetworkReply::generateData()
+ *  implementation of the test.
+ *
+ *  In record mode, requests are performed over the real network and the
+ *  responses are written to the record directory as fixtures.  Access
+ *  tokens are replaced by wildcards in the recorded url patterns.
+ *
+ *  Every response body (fixture or generated) is delivered according to
+ *  the current Delivery: after the given latency, in chunks of the given
+ *  size, no faster than the given bandwidth.  All of this is driven by
+ *  timers, so that a replayed sync is deterministic and can be timed.
+ *
+ *  The SOCIALD_TEST_FIXTURES and SOCIALD_TEST_RECORD environment
+ *  variables select a fixture directory to replay or record for the
+ *  whole test run, and SOCIALD_TEST_CHUNK_SIZE, SOCIALD_TEST_LATENCY
+ *  and SOCIALD_TEST_BANDWIDTH (bytes per second) set the delivery.
+ */
+class TestNetworkReplay
+{
+public:
+    struct Delivery {
+        Delivery() : latency(100), chunkSize(0), bytesPerSecond(0) {}
+        int latency;        // ms before the first byte is delivered
+        int chunkSize;      // bytes per readyRead(), or 0 for the whole body
+        int bytesPerSecond; // bandwidth limit, or 0 for unlimited
+    };
+
+    static bool loadFixtures(const QString &directory);
+    static void setRecordDirectory(const QString &directory);
+    static void clear();
+
+    static void setDelivery(const Delivery &delivery);
+    static Delivery delivery();
+
+    static int servedRequests();
+    static int unmatchedRequests();
+
+private:
+    struct Fixture {
+        Fixture() : status(200), served(0) {}
+        QByteArray method;
+        QRegularExpression url;
+        QString fileName;
+        int status;
+        QList<QPair<QByteArray, QByteArray> > headers;
+        int served;
+    };
+
+    struct State;
+    static State &state();
+    static bool readFixtures(const QString &directory, QList<Fixture> *fixtures);
+    static bool match(const QByteArray &method, const QUrl &url, int *status,
+                      QList<QPair<QByteArray, QByteArray> > *headers, QByteArray *body);
+    static void record(const QByteArray &method, const QUrl &url, int status,
+                       const QList<QPair<QByteArray, QByteArray> > &headers,
+                       const QByteArray &body);
+    friend class SocialdNetworkAccessManager;
+    friend class TestNetworkReply;
+};
+
 class TestNetworkReply : public QNetworkReply
 {
     Q_OBJECT
 
 public:
     bool isSequential() const { return true; }
-    void abort() { qWarning() << "TNR::abort"; }
-    qint64 bytesAvailable() const { return m_readAllData.size() + QIODevice::bytesAvailable(); }
+    void abort();
+    qint64 bytesAvailable() const { return m_readAllData.size() - m_readOffset + QIODevice::bytesAvailable(); }
     qint64 size() const { return bytesAvailable(); }
-    bool atEnd() const { return m_readAllData.size() == 0; }
+    bool atEnd() const { return m_readOffset == m_readAllData.size(); }
     bool canReadLine() const { return !atEnd(); }
-    qint64 readData(char *buf, qint64 sz) {
-        qint64 i = 0;
-        while (!m_readAllData.isEmpty() && i++ < sz) {
-            *buf++ = m_readAllData.at(0);
-            m_readAllData.remove(0,1);
-        }
-        return i;
-    }
+    qint64 readData(char *buf, qint64 sz);
 
 protected:
-    TestNetworkReply(QObject *parent = 0) : QNetworkReply(parent) {}
+    TestNetworkReply(QObject *parent = 0);
+
+private Q_SLOTS:
+    void deliverChunk();
+    void recordedReadyRead();
+    void recordedFinished();
 
 private:
+    void deliver(const QByteArray &body);
+    void setStatus(int status);
     static QByteArray generateData(const QUrl &requestUrl, const QString &generator);
-    QByteArray m_readAllData;
+
+    QByteArray m_readAllData;   // delivered, but not yet read
+    int m_readOffset;
+    QByteArray m_pendingData;   // not yet delivered
+    int m_pendingOffset;
+    bool m_aborted;
+    TestNetworkReplay::Delivery m_delivery;
+    QNetworkReply *m_recordedReply;
+    QByteArray m_recordedData;
     friend class SocialdNetworkAccessManager;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,6 +1,8 @@
 TEMPLATE = subdirs
 
 SUBDIRS = \
+    bench \
+    tst_common \
     tst_facebook \
     tst_google \
     tst_twitter
@@ -0,0 +1,796 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+#include <QtGlobal>
+#include <QTest>
+#include <QSignalSpy>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTemporaryDir>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+
+#include "socialdjsonstreamparser_p.h"
+#include "socialdtimeoutwheel_p.h"
+#include "socialdnetworkscheduler_p.h"
+#include "socialdsynccheckpoints_p.h"
+#include "socialdavatarstore_p.h"
+#include "socialdavatarscheduler_p.h"
+#include "networkstubs_p.h"
+
+#include <utime.h>
+
+/*
+ *  Unit tests of the components in src/common which don't depend on
+ *  a sync adaptor, driven directly with generated input.
+ */
+class tst_common : public QObject
+{
+    Q_OBJECT
+
+public:
+    tst_common();
+    virtual ~tst_common();
+
+public slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup();
+
+private slots:
+    void jsonStreamParser_data();
+    void jsonStreamParser();
+    void timeoutWheelEndpoint();
+    void timeoutWheelDeadline();
+    void timeoutWheelExpiry();
+    void networkScheduler();
+    void syncCheckpoints();
+    void avatarStore();
+    void avatarSchedulerWindow();
+    void avatarSchedulerThrottling();
+    void avatarSchedulerDeferAll();
+};
+
+// a reply without data of its own; the tests feed the data to the parser,
+// or finish it with the response which the component under test handles.
+class CommonNetworkReply : public QNetworkReply
+{
+public:
+    CommonNetworkReply(const QUrl &url = QUrl()) { setUrl(url); open(QIODevice::ReadOnly); }
+    void abort() {}
+    void fail() { setError(QNetworkReply::UnknownNetworkError, QStringLiteral("failed")); }
+    void finish(int status, const QByteArray &header = QByteArray(), const QByteArray &value = QByteArray())
+    {
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, status);
+        if (!header.isEmpty()) {
+            setRawHeader(header, value);
+        }
+        setFinished(true);
+        emit finished();
+    }
+protected:
+    qint64 readData(char *, qint64) { return 0; }
+};
+
+// records the order in which the queued replies are started, and the
+// largest number of them which were in flight at once.
+class StartRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    StartRecorder() : inFlight(0), maximumInFlight(0), mediaInFlight(0), maximumMediaInFlight(0), finishedCount(0) {}
+    void watch(QNetworkReply *reply, const QString &name)
+    {
+        reply->setProperty("name", name);
+        connect(reply, SIGNAL(started()), this, SLOT(replyStarted()));
+        connect(reply, SIGNAL(finished()), this, SLOT(replyFinished()));
+    }
+public Q_SLOTS:
+    void replyStarted()
+    {
+        const QString name = sender()->property("name").toString();
+        order.append(name);
+        maximumInFlight = qMax(maximumInFlight, ++inFlight);
+        if (name.startsWith(QLatin1String("media"))) {
+            maximumMediaInFlight = qMax(maximumMediaInFlight, ++mediaInFlight);
+        }
+    }
+    void replyFinished()
+    {
+        --inFlight;
+        if (sender()->property("name").toString().startsWith(QLatin1String("media"))) {
+            --mediaInFlight;
+        }
+        ++finishedCount;
+    }
+public:
+    QStringList order;
+    int inFlight;
+    int maximumInFlight;
+    int mediaInFlight;
+    int maximumMediaInFlight;
+    int finishedCount;
+};
+
+static QString syncDatabaseFile(const QString &fileName)
+{
+    return QString::fromLatin1("%1/%2/%3").arg(QString::fromLatin1(PRIVILEGED_DATA_DIR))
+                                          .arg(QString::fromLatin1(SYNC_DATABASE_DIR))
+                                          .arg(fileName);
+}
+
+// --------------------------------
+
+tst_common::tst_common()
+{
+}
+
+tst_common::~tst_common()
+{
+}
+
+void tst_common::initTestCase()
+{
+}
+
+void tst_common::cleanupTestCase()
+{
+}
+
+void tst_common::init()
+{
+}
+
+void tst_common::cleanup()
+{
+    TestNetworkReplay::clear();
+}
+
+// --------------------------------
+
+// feeds the input to a stream parser as a first chunk of the given size,
+// followed by chunks of chunkSize bytes.
+static bool streamParse(const QByteArray &input, const QString &arrayKey, int firstChunk, int chunkSize,
+                        QJsonArray *elements, QJsonObject *envelope)
+{
+    CommonNetworkReply reply;
+    SocialdJsonStreamParser *parser = new SocialdJsonStreamParser(&reply, arrayKey);
+    QSignalSpy spy(parser, SIGNAL(elementParsed(QJsonObject)));
+
+    parser->addData(input.left(firstChunk));
+    for (int offset = firstChunk; offset < input.size(); offset += chunkSize) {
+        parser->addData(input.mid(offset, chunkSize));
+    }
+
+    bool ok = false;
+    *envelope = parser->finish(&ok);
+    for (int i = 0; i < spy.count(); ++i) {
+        elements->append(spy.at(i).first().toJsonObject());
+    }
+    return ok;
+}
+
+void tst_common::jsonStreamParser_data()
+{
+    QTest::addColumn<QByteArray>("input");
+    QTest::addColumn<QString>("arrayKey");
+    QTest::addColumn<QByteArray>("elements");
+    QTest::addColumn<QByteArray>("envelope"); // ignored unless ok
+    QTest::addColumn<bool>("ok");
+
+    QTest::newRow("graph page")
+            << QByteArray("{\"data\":[{\"id\":\"1\",\"name\":\"a\"},{\"id\":\"2\"}],"
+                          "\"paging\":{\"next\":\"https://graph.facebook.com/next\"}}")
+            << QStringLiteral("data")
+            << QByteArray("[{\"id\":\"1\",\"name\":\"a\"},{\"id\":\"2\"}]")
+            << QByteArray("{\"data\":[],\"paging\":{\"next\":\"https://graph.facebook.com/next\"}}")
+            << true;
+    QTest::newRow("whitespace")
+            << QByteArray("{ \"data\" : [ { \"id\" : \"1\" } ,\n { \"id\" : \"2\" } ] ,\n \"paging\" : { } }\n")
+            << QStringLiteral("data")
+            << QByteArray("[{\"id\":\"1\"},{\"id\":\"2\"}]")
+            << QByteArray("{\"data\":[],\"paging\":{}}")
+            << true;
+    QTest::newRow("escaped strings")
+            << QByteArray("{\"data\":[{\"id\":\"1\",\"name\":\"}{ \\\"]\\\" \\\\\"},{\"id\":\"2\",\"name\":\"\\u007b\"}]}")
+            << QStringLiteral("data")
+            << QByteArray("[{\"id\":\"1\",\"name\":\"}{ \\\"]\\\" \\\\\"},{\"id\":\"2\",\"name\":\"{\"}]")
+            << QByteArray("{\"data\":[]}")
+            << true;
+    QTest::newRow("escaped keys")
+            << QByteArray("{\"da\\\"ta\":[{\"id\":\"x\"}],\"data\":[{\"id\":\"1\"}],\"x\\\\\":\"data\"}")
+            << QStringLiteral("data")
+            << QByteArray("[{\"id\":\"1\"}]")
+            << QByteArray("{\"da\\\"ta\":[{\"id\":\"x\"}],\"data\":[],\"x\\\\\":\"data\"}")
+            << true;
+    QTest::newRow("nested array key")
+            << QByteArray("{\"data\":[{\"id\":\"1\",\"data\":[{\"id\":\"2\"}],\"paging\":{}}],\"paging\":{}}")
+            << QStringLiteral("data")
+            << QByteArray("[{\"id\":\"1\",\"data\":[{\"id\":\"2\"}],\"paging\":{}}]")
+            << QByteArray("{\"data\":[],\"paging\":{}}")
+            << true;
+    QTest::newRow("top-level array")
+            << QByteArray("[{\"id\":\"1\",\"text\":\"[{\"},{\"id\":\"2\"}]")
+            << QString()
+            << QByteArray("[{\"id\":\"1\",\"text\":\"[{\"},{\"id\":\"2\"}]")
+            << QByteArray("{}")
+            << true;
+    QTest::newRow("empty array")
+            << QByteArray("{\"data\":[]}")
+            << QStringLiteral("data")
+            << QByteArray("[]")
+            << QByteArray("{\"data\":[]}")
+            << true;
+    QTest::newRow("missing array")
+            << QByteArray("{\"error\":{\"message\":\"Invalid token\",\"code\":190}}")
+            << QStringLiteral("data")
+            << QByteArray("[]")
+            << QByteArray("{\"error\":{\"message\":\"Invalid token\",\"code\":190}}")
+            << true;
+    QTest::newRow("truncated element")
+            << QByteArray("{\"data\":[{\"id\":\"1\"},{\"id\":")
+            << QStringLiteral("data")
+            << QByteArray("[{\"id\":\"1\"}]")
+            << QByteArray()
+            << false;
+    QTest::newRow("truncated envelope")
+            << QByteArray("{\"data\":[{\"id\":\"1\"}],\"paging\":{\"next\":\"htt")
+            << QStringLiteral("data")
+            << QByteArray("[{\"id\":\"1\"}]")
+            << QByteArray()
+            << false;
+    QTest::newRow("malformed element")
+            << QByteArray("{\"data\":[{\"id\":\"1\"},{\"id\":\"2\" \"name\":\"b\"}]}")
+            << QStringLiteral("data")
+            << QByteArray("[{\"id\":\"1\"}]")
+            << QByteArray()
+            << false;
+    QTest::newRow("malformed envelope")
+            << QByteArray("{\"data\":[{\"id\":\"1\"}],\"paging\":}")
+            << QStringLiteral("data")
+            << QByteArray("[{\"id\":\"1\"}]")
+            << QByteArray()
+            << false;
+}
+
+void tst_common::jsonStreamParser()
+{
+    QFETCH(QByteArray, input);
+    QFETCH(QString, arrayKey);
+    QFETCH(QByteArray, elements);
+    QFETCH(QByteArray, envelope);
+    QFETCH(bool, ok);
+
+    const QJsonArray expectedElements = QJsonDocument::fromJson(elements).array();
+    const QJsonObject expectedEnvelope = ok ? QJsonDocument::fromJson(envelope).object() : QJsonObject();
+
+    // a chunk boundary at every position, inside strings, escapes and keys.
+    for (int split = 0; split <= input.size(); ++split) {
+        QJsonArray parsedElements;
+        QJsonObject parsedEnvelope;
+        bool parsedOk = streamParse(input, arrayKey, split, input.size(), &parsedElements, &parsedEnvelope);
+        QVERIFY2(parsedOk == ok, qPrintable(QStringLiteral("chunk boundary at %1").arg(split)));
+        QVERIFY2(parsedElements == expectedElements, qPrintable(QStringLiteral("chunk boundary at %1").arg(split)));
+        QVERIFY2(parsedEnvelope == expectedEnvelope, qPrintable(QStringLiteral("chunk boundary at %1").arg(split)));
+    }
+
+    // and one byte at a time.
+    QJsonArray parsedElements;
+    QJsonObject parsedEnvelope;
+    QCOMPARE(streamParse(input, arrayKey, 0, 1, &parsedElements, &parsedEnvelope), ok);
+    QCOMPARE(parsedElements, expectedElements);
+    QCOMPARE(parsedEnvelope, expectedEnvelope);
+}
+
+// --------------------------------
+
+void tst_common::timeoutWheelEndpoint()
+{
+    // path segments which look like identifiers are replaced.
+    CommonNetworkReply calendarReply(QUrl(QStringLiteral(
+            "https://www.googleapis.com/calendar/v3/calendars/test.person@example.com/events?pageToken=abc")));
+    QCOMPARE(SocialdTimeoutWheel::endpoint(&calendarReply),
+             QStringLiteral("www.googleapis.com/calendar/*/calendars/*/events"));
+    CommonNetworkReply albumsReply(QUrl(QStringLiteral("https://graph.facebook.com/me/albums?access_token=x")));
+    QCOMPARE(SocialdTimeoutWheel::endpoint(&albumsReply), QStringLiteral("graph.facebook.com/me/albums"));
+    CommonNetworkReply photosReply(QUrl(QStringLiteral("https://graph.facebook.com/4000001/photos")));
+    QCOMPARE(SocialdTimeoutWheel::endpoint(&photosReply), QStringLiteral("graph.facebook.com/*/photos"));
+}
+
+void tst_common::timeoutWheelDeadline()
+{
+    const QUrl url(QStringLiteral("https://deadline.timeoutwheel.test/items"));
+    const QString endpoint(QStringLiteral("deadline.timeoutwheel.test/items"));
+    QFile::remove(syncDatabaseFile(QStringLiteral("latencies.ini")));
+
+    {
+        SocialdTimeoutWheel wheel;
+        QCOMPARE(wheel.deadline(endpoint), 60000); // until enough latencies are known
+
+        // a failed reply is not a latency sample.
+        for (int i = 0; i < 5; ++i) {
+            CommonNetworkReply reply(url);
+            if (i == 0) {
+                reply.fail();
+            }
+            wheel.arm(1, &reply);
+            QCOMPARE(wheel.outstanding(), 1);
+            wheel.disarm(&reply);
+            QCOMPARE(wheel.outstanding(), 0);
+        }
+        QCOMPARE(wheel.deadline(endpoint), 60000);
+
+        // the fifth sample sets the deadline, which is at least the minimum.
+        CommonNetworkReply reply(url);
+        wheel.arm(1, &reply);
+        wheel.disarm(&reply);
+        QCOMPARE(wheel.deadline(endpoint), 10000);
+    }
+
+    // the samples are kept for the next sync.
+    SocialdTimeoutWheel wheel;
+    QCOMPARE(wheel.deadline(endpoint), 10000);
+    QCOMPARE(wheel.deadline(QStringLiteral("other.timeoutwheel.test/items")), 60000);
+
+    QFile::remove(syncDatabaseFile(QStringLiteral("latencies.ini")));
+}
+
+void tst_common::timeoutWheelExpiry()
+{
+    const QUrl url(QStringLiteral("https://expiry.timeoutwheel.test/items"));
+    const QString endpoint(QStringLiteral("expiry.timeoutwheel.test/items"));
+    QFile::remove(syncDatabaseFile(QStringLiteral("latencies.ini")));
+
+    SocialdTimeoutWheel wheel;
+    for (int i = 0; i < 5; ++i) {
+        CommonNetworkReply reply(url);
+        wheel.arm(1, &reply);
+        wheel.disarm(&reply);
+    }
+    QCOMPARE(wheel.deadline(endpoint), 10000);
+
+    qRegisterMetaType<QNetworkReply*>();
+    QSignalSpy spy(&wheel, SIGNAL(timedOut(QNetworkReply*,int)));
+    CommonNetworkReply expiring(url);
+    CommonNetworkReply disarmed(url);
+    CommonNetworkReply *deleted = new CommonNetworkReply(url);
+    wheel.arm(7, &expiring);
+    wheel.arm(7, &disarmed);
+    wheel.arm(7, deleted);
+    QCOMPARE(wheel.outstanding(), 3);
+    QCOMPARE(wheel.replies().size(), 3);
+    wheel.disarm(&disarmed);
+    delete deleted;
+    QCOMPARE(wheel.outstanding(), 1);
+
+    QTest::qWait(8000);
+    QCOMPARE(spy.count(), 0);
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 8000);
+    QCOMPARE(spy.at(0).at(0).value<QNetworkReply*>(), static_cast<QNetworkReply*>(&expiring));
+    QCOMPARE(spy.at(0).at(1).toInt(), 7);
+    QCOMPARE(wheel.outstanding(), 0);
+
+    // the timeout says nothing about the latency of the endpoint.
+    QCOMPARE(wheel.deadline(endpoint), 10000);
+
+    QFile::remove(syncDatabaseFile(QStringLiteral("latencies.ini")));
+}
+
+void tst_common::networkScheduler()
+{
+    // every reply of the fake host is delivered (empty) after the latency.
+    TestNetworkReplay::Delivery delivery;
+    delivery.latency = 200;
+    TestNetworkReplay::setDelivery(delivery);
+
+    SocialdNetworkAccessManager manager;
+    SocialdNetworkScheduler *scheduler = new SocialdNetworkScheduler(&manager);
+    StartRecorder recorder;
+    QList<QNetworkReply*> replies;
+
+    // queue the requests as the adaptors do, setting the accountId afterwards.
+    struct Request {
+        const char *name;
+        int accountId;
+        SocialdNetworkAccessManager::RequestPriority priority;
+    } requests[] = {
+        { "media0", 1, SocialdNetworkAccessManager::MediaPriority },
+        { "media1", 1, SocialdNetworkAccessManager::MediaPriority },
+        { "media2", 1, SocialdNetworkAccessManager::MediaPriority },
+        { "media3", 1, SocialdNetworkAccessManager::MediaPriority },
+        { "data1-0", 1, SocialdNetworkAccessManager::DataPriority },
+        { "data1-1", 1, SocialdNetworkAccessManager::DataPriority },
+        { "data1-2", 1, SocialdNetworkAccessManager::DataPriority },
+        { "data2-0", 2, SocialdNetworkAccessManager::DataPriority },
+        { "data2-1", 2, SocialdNetworkAccessManager::DataPriority },
+        { "data2-2", 2, SocialdNetworkAccessManager::DataPriority },
+        { "metadata", 2, SocialdNetworkAccessManager::MetadataPriority }
+    };
+    for (unsigned int i = 0; i < sizeof(requests) / sizeof(requests[0]); ++i) {
+        QNetworkRequest request(QUrl(QStringLiteral("https://host.scheduler.test/%1")
+                                     .arg(QLatin1String(requests[i].name))));
+        request.setAttribute(SocialdNetworkAccessManager::RequestPriorityAttribute, requests[i].priority);
+        QNetworkReply *reply = scheduler->enqueue(QNetworkAccessManager::GetOperation, request, 0);
+        reply->setProperty("accountId", requests[i].accountId);
+        recorder.watch(reply, QLatin1String(requests[i].name));
+        replies.append(reply);
+    }
+    QCOMPARE(recorder.order, QStringList());
+
+    // the first dispatch fills the host's capacity for data, taking turns
+    // between the accounts, and leaves none for the media downloads.
+    QTRY_COMPARE(recorder.order.size(), 6);
+    QCOMPARE(recorder.order, QStringList() << QStringLiteral("metadata")
+                                           << QStringLiteral("data1-0") << QStringLiteral("data2-0")
+                                           << QStringLiteral("data1-1") << QStringLiteral("data2-1")
+                                           << QStringLiteral("data1-2"));
+
+    QTRY_COMPARE_WITH_TIMEOUT(recorder.finishedCount, replies.size(), 10000);
+    QCOMPARE(recorder.order.mid(6), QStringList() << QStringLiteral("data2-2")
+                                                  << QStringLiteral("media0") << QStringLiteral("media1")
+                                                  << QStringLiteral("media2") << QStringLiteral("media3"));
+    QCOMPARE(recorder.maximumInFlight, 6);
+    QCOMPARE(recorder.maximumMediaInFlight, 2);
+    QCOMPARE(TestNetworkReplay::unmatchedRequests(), replies.size());
+
+    qDeleteAll(replies);
+}
+
+void tst_common::syncCheckpoints()
+{
+    const QString key(QStringLiteral("album/1")); // keys may contain a group separator
+    const QString otherKey(QStringLiteral("album/2"));
+    QVariantMap cursor;
+    cursor.insert(QStringLiteral("pageToken"), QStringLiteral("page3"));
+    QVariantMap otherCursor;
+    otherCursor.insert(QStringLiteral("until"), 1400000000);
+
+    {
+        SocialdSyncCheckpoints checkpoints(QStringLiteral("tstcommon"), QStringLiteral("Checkpoints"));
+        checkpoints.removeAll(5);
+        checkpoints.removeAll(6);
+        QVERIFY(!checkpoints.contains(5, key));
+
+        // pages are appended, the cursor is replaced.
+        QVariantMap firstCursor;
+        firstCursor.insert(QStringLiteral("pageToken"), QStringLiteral("page2"));
+        QVERIFY(checkpoints.save(5, key, firstCursor, QList<QByteArray>() << "page one" << QByteArray()));
+        QVERIFY(checkpoints.save(5, key, cursor, QList<QByteArray>() << "page three"));
+        QVERIFY(checkpoints.save(5, otherKey, otherCursor));
+        QVERIFY(checkpoints.save(6, key, otherCursor, QList<QByteArray>() << "other account"));
+    }
+
+    // and survive the process.
+    SocialdSyncCheckpoints checkpoints(QStringLiteral("tstcommon"), QStringLiteral("Checkpoints"));
+    QStringList keys = checkpoints.keys(5);
+    keys.sort();
+    QCOMPARE(keys, QStringList() << key << otherKey);
+    QVERIFY(checkpoints.contains(5, key));
+    QCOMPARE(checkpoints.cursor(5, key), cursor);
+    QCOMPARE(checkpoints.pageCount(5, key), 3);
+    QCOMPARE(checkpoints.pages(5, key), QList<QByteArray>() << "page one" << QByteArray() << "page three");
+    QCOMPARE(checkpoints.cursor(5, otherKey), otherCursor);
+    QCOMPARE(checkpoints.pageCount(5, otherKey), 0);
+    QCOMPARE(checkpoints.pages(5, otherKey), QList<QByteArray>());
+
+    // data which was written after the last successful save is ignored,
+    // and overwritten by the next save.
+    const QString pagesFile = syncDatabaseFile(QStringLiteral("checkpoints/%1.pages").arg(QString::fromLatin1(
+            QCryptographicHash::hash(QByteArray("tstcommon-Checkpoints/5/") + key.toUtf8(),
+                                     QCryptographicHash::Sha1).toHex())));
+    QFile file(pagesFile);
+    QVERIFY(file.open(QIODevice::Append));
+    file.write("left behind by an interrupted save");
+    file.close();
+    QCOMPARE(checkpoints.pages(5, key), QList<QByteArray>() << "page one" << QByteArray() << "page three");
+    QVERIFY(checkpoints.save(5, key, cursor, QList<QByteArray>() << "page four"));
+    QCOMPARE(checkpoints.pages(5, key), QList<QByteArray>() << "page one" << QByteArray() << "page three" << "page four");
+
+    checkpoints.remove(5, key);
+    QVERIFY(!checkpoints.contains(5, key));
+    QVERIFY(!QFile::exists(pagesFile));
+    QCOMPARE(checkpoints.pages(5, key), QList<QByteArray>());
+    QCOMPARE(checkpoints.keys(5), QStringList() << otherKey);
+
+    // the checkpoints of other accounts are kept.
+    checkpoints.removeAll(5);
+    QCOMPARE(checkpoints.keys(5), QStringList());
+    QCOMPARE(checkpoints.pages(6, key), QList<QByteArray>() << "other account");
+    checkpoints.removeAll(6);
+    QCOMPARE(checkpoints.keys(6), QStringList());
+}
+
+// writes a downloaded avatar image.
+static QString writeDownload(const QTemporaryDir &directory, const QString &fileName, const QByteArray &content)
+{
+    QFile file(directory.path() + QLatin1Char('/') + fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return QString();
+    }
+    file.write(content);
+    return file.fileName();
+}
+
+// makes an image older than the garbage collection grace period.
+static bool age(const QString &path)
+{
+    struct utimbuf times;
+    times.actime = times.modtime = QDateTime::currentDateTimeUtc().addSecs(-2 * 3600).toMSecsSinceEpoch() / 1000;
+    return utime(QFile::encodeName(path).constData(), &times) == 0;
+}
+
+void tst_common::avatarStore()
+{
+    QTemporaryDir downloads;
+    QVERIFY(downloads.isValid());
+    SocialdAvatarStore store(QStringLiteral("tstcommon"), QStringLiteral("Avatars"));
+    store.releaseAll(1);
+    store.flush();
+
+    // identical images are stored once.
+    const QString firstDownload = writeDownload(downloads, QStringLiteral("first.jpg"), "image A");
+    const QString secondDownload = writeDownload(downloads, QStringLiteral("second.jpg"), "image A");
+    const QString imageA = store.store(1, QStringLiteral("contact/1"), firstDownload,
+                                       QStringLiteral("https://avatars.test/1"), "\"etag1\"");
+    QVERIFY(!imageA.isEmpty());
+    QCOMPARE(store.store(1, QStringLiteral("contact/2"), secondDownload, QStringLiteral("https://avatars.test/2")), imageA);
+    QVERIFY(QFile::exists(imageA));
+    QVERIFY(!QFile::exists(firstDownload));
+    QVERIFY(!QFile::exists(secondDownload));
+    QCOMPARE(store.imageFile(1, QStringLiteral("contact/1")), imageA);
+    QCOMPARE(store.imageFile(1, QStringLiteral("contact/2")), imageA);
+    QCOMPARE(store.sourceUrl(1, QStringLiteral("contact/1")), QStringLiteral("https://avatars.test/1"));
+    QCOMPARE(store.etag(1, QStringLiteral("contact/1")), QByteArray("\"etag1\""));
+
+    QNetworkRequest request(QUrl(QStringLiteral("https://avatars.test/1")));
+    store.prepareRequest(1, QStringLiteral("contact/1"), &request);
+    QCOMPARE(request.rawHeader("If-None-Match"), QByteArray("\"etag1\""));
+
+    // the references are only written by flush().
+    {
+        SocialdAvatarStore other(QStringLiteral("tstcommon"), QStringLiteral("Avatars"));
+        QCOMPARE(other.imageFile(1, QStringLiteral("contact/1")), QString());
+    }
+    store.flush();
+    {
+        SocialdAvatarStore other(QStringLiteral("tstcommon"), QStringLiteral("Avatars"));
+        QCOMPARE(other.imageFile(1, QStringLiteral("contact/1")), imageA);
+    }
+
+    // a staged image replaces the previous one once it is committed.
+    const QString imageB = store.stage(1, QStringLiteral("contact/1"),
+                                       writeDownload(downloads, QStringLiteral("third.jpg"), "image B"),
+                                       QStringLiteral("https://avatars.test/1b"), "\"etag2\"");
+    QVERIFY(!imageB.isEmpty() && imageB != imageA);
+    QCOMPARE(store.imageFile(1, QStringLiteral("contact/1")), imageA);
+    QCOMPARE(store.etag(1, QStringLiteral("contact/1")), QByteArray("\"etag1\""));
+    store.commit(1, QStringLiteral("contact/1"));
+    QCOMPARE(store.imageFile(1, QStringLiteral("contact/1")), imageB);
+    QCOMPARE(store.sourceUrl(1, QStringLiteral("contact/1")), QStringLiteral("https://avatars.test/1b"));
+    QCOMPARE(store.etag(1, QStringLiteral("contact/1")), QByteArray("\"etag2\""));
+
+    // a 304 response keeps the image.
+    QVERIFY(store.revalidate(1, QStringLiteral("contact/1"), QStringLiteral("https://avatars.test/1c")));
+    QCOMPARE(store.sourceUrl(1, QStringLiteral("contact/1")), QStringLiteral("https://avatars.test/1c"));
+    QVERIFY(!store.revalidate(1, QStringLiteral("contact/3"), QStringLiteral("https://avatars.test/3")));
+
+    // images which are only referenced by a staged image are kept, as are
+    // recently stored images, but unreferenced images are removed.
+    const QString imageC = store.stage(1, QStringLiteral("contact/3"),
+                                       writeDownload(downloads, QStringLiteral("fourth.jpg"), "image C"),
+                                       QStringLiteral("https://avatars.test/3"));
+    const QString imageD = store.store(1, QStringLiteral("contact/4"),
+                                       writeDownload(downloads, QStringLiteral("fifth.jpg"), "image D"),
+                                       QStringLiteral("https://avatars.test/4"));
+    store.release(1, QStringLiteral("contact/2"));
+    store.release(1, QStringLiteral("contact/4"));
+    QCOMPARE(store.imageFile(1, QStringLiteral("contact/2")), QString());
+    QVERIFY(age(imageA));
+    QVERIFY(age(imageB));
+    QVERIFY(age(imageC));
+    store.collectGarbage();
+    QVERIFY(!QFile::exists(imageA));
+    QVERIFY(QFile::exists(imageB));
+    QVERIFY(QFile::exists(imageC));
+    QVERIFY(QFile::exists(imageD));
+
+    store.releaseAll(1);
+    QVERIFY(age(imageD));
+    store.collectGarbage();
+    QVERIFY(!QFile::exists(imageB));
+    QVERIFY(!QFile::exists(imageC));
+    QVERIFY(!QFile::exists(imageD));
+}
+
+// the metadata which the sync adaptor passes with a download.
+static QVariantMap avatarMetadata(int contact)
+{
+    QVariantMap retn;
+    retn.insert(QStringLiteral("contact"), contact);
+    return retn;
+}
+
+void tst_common::avatarSchedulerWindow()
+{
+    SocialdAvatarScheduler scheduler(QStringLiteral("tstcommon"), QStringLiteral("AvatarWindow"));
+    scheduler.removeAll(1);
+    QSignalSpy downloads(&scheduler, SIGNAL(download(QString,QVariantMap)));
+    QSignalSpy downloaded(&scheduler, SIGNAL(imageDownloaded(QString,QString,QVariantMap)));
+    QSignalSpy started(&scheduler, SIGNAL(started(int)));
+    QSignalSpy finished(&scheduler, SIGNAL(finished(int)));
+
+    for (int i = 0; i < 5; ++i) {
+        scheduler.enqueue(1, QStringLiteral("https://avatars.test/%1").arg(i), avatarMetadata(i));
+    }
+    scheduler.enqueue(1, QStringLiteral("https://avatars.test/0"), avatarMetadata(0)); // already queued
+    QCOMPARE(started.count(), 1);
+    QCOMPARE(started.at(0).at(0).toInt(), 1);
+    QVERIFY(scheduler.isActive(1));
+
+    // the initial window is two downloads.
+    QTRY_COMPARE(downloads.count(), 2);
+    QTest::qWait(100);
+    QCOMPARE(downloads.count(), 2);
+
+    // a window of successful downloads grows the window by one.
+    for (int i = 0; i < 2; ++i) {
+        const QString url = downloads.at(i).at(0).toString();
+        const QVariantMap metadata = downloads.at(i).at(1).toMap();
+        CommonNetworkReply reply((QUrl(url)));
+        scheduler.watchReply(url, metadata, &reply);
+        reply.finish(200, "ETag", "\"avatar\"");
+        scheduler.downloadFinished(url, QStringLiteral("/tmp/avatar%1").arg(i), metadata);
+    }
+    QCOMPARE(downloaded.count(), 2);
+    QCOMPARE(downloaded.at(0).at(0).toString(), QStringLiteral("https://avatars.test/0"));
+    QCOMPARE(downloaded.at(0).at(1).toString(), QStringLiteral("/tmp/avatar0"));
+    const QVariantMap metadata = downloaded.at(0).at(2).toMap();
+    QCOMPARE(metadata.value(QStringLiteral("contact")).toInt(), 0);
+    QCOMPARE(metadata.value(SOCIALD_AVATAR_STATUS_KEY).toInt(), 200);
+    QCOMPARE(metadata.value(SOCIALD_AVATAR_ETAG_KEY).toByteArray(), QByteArray("\"avatar\""));
+    QCOMPARE(metadata.size(), 4);
+
+    QTRY_COMPARE(downloads.count(), 5);
+    QCOMPARE(finished.count(), 0);
+    for (int i = 2; i < 5; ++i) {
+        scheduler.downloadFinished(downloads.at(i).at(0).toString(), QString(), downloads.at(i).at(1).toMap());
+    }
+    QCOMPARE(downloaded.count(), 5);
+    QCOMPARE(finished.count(), 1);
+    QCOMPARE(finished.at(0).at(0).toInt(), 1);
+    QVERIFY(!scheduler.isActive(1));
+    QCOMPARE(started.count(), 1);
+}
+
+void tst_common::avatarSchedulerThrottling()
+{
+    SocialdAvatarScheduler scheduler(QStringLiteral("tstcommon"), QStringLiteral("AvatarThrottling"));
+    scheduler.removeAll(1);
+    QSignalSpy downloads(&scheduler, SIGNAL(download(QString,QVariantMap)));
+    QSignalSpy downloaded(&scheduler, SIGNAL(imageDownloaded(QString,QString,QVariantMap)));
+    QSignalSpy finished(&scheduler, SIGNAL(finished(int)));
+
+    for (int i = 0; i < 3; ++i) {
+        scheduler.enqueue(1, QStringLiteral("https://avatars.test/%1").arg(i), avatarMetadata(i));
+    }
+    QTRY_COMPARE(downloads.count(), 2);
+    const QString throttledUrl = downloads.at(0).at(0).toString();
+    const QVariantMap throttledMetadata = downloads.at(0).at(1).toMap();
+
+    CommonNetworkReply succeeded((QUrl(downloads.at(1).at(0).toString())));
+    scheduler.watchReply(downloads.at(1).at(0).toString(), downloads.at(1).at(1).toMap(), &succeeded);
+    succeeded.finish(200);
+    scheduler.downloadFinished(downloads.at(1).at(0).toString(), QString(), downloads.at(1).at(1).toMap());
+
+    // a throttled download is retried after the backoff, with a halved window.
+    CommonNetworkReply throttled((QUrl(throttledUrl)));
+    scheduler.watchReply(throttledUrl, throttledMetadata, &throttled);
+    throttled.finish(429, "Retry-After", "1");
+    scheduler.downloadFinished(throttledUrl, QString(), throttledMetadata);
+    QCOMPARE(downloaded.count(), 1);
+
+    QTest::qWait(500);
+    QCOMPARE(downloads.count(), 2);
+    QTRY_COMPARE_WITH_TIMEOUT(downloads.count(), 3, 3000);
+    QCOMPARE(downloads.at(2).at(0).toString(), throttledUrl);
+    QTest::qWait(100);
+    QCOMPARE(downloads.count(), 3);
+
+    CommonNetworkReply retried((QUrl(throttledUrl)));
+    scheduler.watchReply(throttledUrl, throttledMetadata, &retried);
+    retried.finish(200);
+    scheduler.downloadFinished(throttledUrl, QString(), throttledMetadata);
+    QTRY_COMPARE(downloads.count(), 4);
+    QCOMPARE(downloads.at(3).at(0).toString(), QStringLiteral("https://avatars.test/2"));
+    scheduler.downloadFinished(downloads.at(3).at(0).toString(), QString(), downloads.at(3).at(1).toMap());
+    QCOMPARE(downloaded.count(), 3);
+    QCOMPARE(finished.count(), 1);
+}
+
+void tst_common::avatarSchedulerDeferAll()
+{
+    QStringList urls;
+    {
+        SocialdAvatarScheduler scheduler(QStringLiteral("tstcommon"), QStringLiteral("AvatarDefer"));
+        scheduler.removeAll(1);
+        QSignalSpy downloads(&scheduler, SIGNAL(download(QString,QVariantMap)));
+        QSignalSpy downloaded(&scheduler, SIGNAL(imageDownloaded(QString,QString,QVariantMap)));
+        QSignalSpy started(&scheduler, SIGNAL(started(int)));
+        QSignalSpy finished(&scheduler, SIGNAL(finished(int)));
+
+        for (int i = 0; i < 3; ++i) {
+            urls.append(QStringLiteral("https://avatars.test/%1").arg(i));
+            scheduler.enqueue(1, urls.last(), avatarMetadata(i));
+        }
+        QTRY_COMPARE(downloads.count(), 2);
+
+        // the queued and in-flight downloads are deferred to the next sync.
+        scheduler.deferAll();
+        QCOMPARE(finished.count(), 1);
+        QVERIFY(!scheduler.isActive(1));
+
+        // as are those queued by the handlers which still run.
+        urls.append(QStringLiteral("https://avatars.test/3"));
+        scheduler.enqueue(1, urls.last(), avatarMetadata(3));
+        QCOMPARE(started.count(), 1);
+        QVERIFY(!scheduler.isActive(1));
+
+        // the abandoned downloads are not reported.
+        scheduler.downloadFinished(downloads.at(0).at(0).toString(), QString(), downloads.at(0).at(1).toMap());
+        QCOMPARE(downloaded.count(), 0);
+        QTest::qWait(100);
+        QCOMPARE(downloads.count(), 2);
+    }
+
+    SocialdAvatarScheduler scheduler(QStringLiteral("tstcommon"), QStringLiteral("AvatarDefer"));
+    QSignalSpy downloads(&scheduler, SIGNAL(download(QString,QVariantMap)));
+    QSignalSpy finished(&scheduler, SIGNAL(finished(int)));
+    scheduler.restoreDeferred(1);
+    QVERIFY(scheduler.isActive(1));
+
+    QStringList restoredUrls;
+    while (restoredUrls.size() < urls.size()) {
+        QTRY_VERIFY(downloads.count() > restoredUrls.size());
+        const int i = restoredUrls.size();
+        const QString url = downloads.at(i).at(0).toString();
+        const QVariantMap metadata = downloads.at(i).at(1).toMap();
+        QCOMPARE(metadata.value(QStringLiteral("contact")).toInt(), urls.indexOf(url));
+        restoredUrls.append(url);
+        scheduler.downloadFinished(url, QString(), metadata);
+    }
+    restoredUrls.sort();
+    QCOMPARE(restoredUrls, urls);
+    QCOMPARE(finished.count(), 1);
+
+    // nothing is left for the sync after that.
+    scheduler.restoreDeferred(1);
+    QVERIFY(!scheduler.isActive(1));
+}
+
+// --------------------------------
+
+QTEST_MAIN(tst_common)
+#include "tst_common.moc"
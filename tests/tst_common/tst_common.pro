@@ -0,0 +1,15 @@
+TARGET = tst_common
+
+include(../tst_common.pri)
+
+# the scheduler is not part of the test builds of the adaptors, see src/common.pri.
+HEADERS += \
+    $$PWD/../../src/common/socialdnetworkscheduler_p.h \
+    $$PWD/../../src/common/socialdvalidatorcache_p.h
+SOURCES += \
+    $$PWD/../../src/common/socialdnetworkscheduler_p.cpp \
+    $$PWD/../../src/common/socialdvalidatorcache_p.cpp
+
+SOURCES += \
+    tst_common.cpp \
+    tst_commonnetworkstubs_p.cpp
@@ -0,0 +1,36 @@
+/****************************************************************************
+ **
+ ** Copyright (C) 2013-2014 Jolla Ltd.
+ ** Contact: Chris Adams <chris.adams@jollamobile.com>
+ **
+ ** This program/library is free software; you can redistribute it and/or
+ ** modify it under the terms of the GNU Lesser General Public License
+ ** version 2.1 as published by the Free Software Foundation.
+ **
+ ** This program/library is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ ** Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program/library; if not, write to the Free
+ ** Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ **
+ ****************************************************************************/
+
+#include "networkstubs_p.h"
+
+QByteArray TestNetworkReply::generateData(const QUrl &requestUrl, const QString &generator)
+{
+    Q_UNUSED(generator);
+
+    // the scheduler tests only observe the order in which requests are started.
+    if (requestUrl.host().endsWith(QLatin1String(".scheduler.test"))) {
+        return QByteArray();
+    }
+
+    // the other common components are tested directly, so no requests are expected.
+    qWarning() << Q_FUNC_INFO << "no test data function exists for:" << requestUrl.host() << requestUrl.path();
+    return QByteArray();
+}
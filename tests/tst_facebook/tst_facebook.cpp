@@ -23,6 +23,12 @@
 
 #include <QtGlobal>
 #include <QTest>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkReply>
 
 #include <QtContacts/QContactManager>
 #include <QtContacts/QContactDetailFilter>
@@ -46,6 +52,8 @@
 #include "facebooknotificationsyncadaptor.h"
 #include "facebookpostsyncadaptor.h"
 
+#include "networkstubs_p.h"
+
 class tst_facebook : public QObject
 {
     Q_OBJECT
@@ -65,8 +73,10 @@ private slots:
     void calendars();
     void contacts();
     void images();
+    void imagesFieldProjection();
     void notifications();
     void posts();
+    void networkReplay();
 
 private:
     QContactManager m_manager;
@@ -89,6 +99,51 @@ public:
     bool m_doFinalCleanup;
 };
 
+class TestFacebookImageSyncAdaptor : public FacebookImageSyncAdaptor
+{
+    Q_OBJECT
+public:
+    TestFacebookImageSyncAdaptor(QObject *parent)
+        : FacebookImageSyncAdaptor(parent), m_finalized(false) {}
+    void doBeginSync(int accountId, const QString &accessToken) { beginSync(accountId, accessToken); }
+    void doPurge(int accountId) { purgeDataForOldAccount(accountId, SocialNetworkSyncAdaptor::SyncPurge); }
+    QJsonObject project(const QString &endpoint, const QJsonObject &object) const
+        { return fieldProjection().project(endpoint, object); }
+protected:
+    void finalize(int accountId) { FacebookImageSyncAdaptor::finalize(accountId); m_finalized = true; }
+public:
+    bool m_finalized;
+};
+
+// writes the fixtures.json index and the response bodies of a replay.
+static bool writeFixtures(const QString &directory, const QJsonArray &index, const QMap<QString, QByteArray> &bodies)
+{
+    QFile indexFile(directory + QStringLiteral("/fixtures.json"));
+    if (!indexFile.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    indexFile.write(QJsonDocument(index).toJson());
+    indexFile.close();
+
+    for (QMap<QString, QByteArray>::const_iterator it = bodies.constBegin(); it != bodies.constEnd(); ++it) {
+        QFile body(directory + QLatin1Char('/') + it.key());
+        if (!body.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        body.write(it.value());
+    }
+    return true;
+}
+
+static QJsonObject fixture(const QString &method, const QString &url, const QString &file)
+{
+    QJsonObject retn;
+    retn.insert(QStringLiteral("method"), method);
+    retn.insert(QStringLiteral("url"), url);
+    retn.insert(QStringLiteral("file"), file);
+    return retn;
+}
+
 // --------------------------------
 
 tst_facebook::tst_facebook()
@@ -113,6 +168,7 @@ void tst_facebook::init()
 
 void tst_facebook::cleanup()
 {
+    TestNetworkReplay::clear();
 }
 
 // --------------------------------
@@ -253,6 +309,141 @@ void tst_facebook::images()
     QSKIP("TODO: write unit tests for this");
 }
 
+void tst_facebook::imagesFieldProjection()
+{
+    // the replies only contain the fields which the adaptor requests, so
+    // every field which its handlers store must survive the projection.
+    QScopedPointer<TestFacebookImageSyncAdaptor> fbImgSa(new TestFacebookImageSyncAdaptor(this));
+    fbImgSa->doPurge(7357);
+
+    const QString createdTime = QStringLiteral("2014-01-01T10:00:00+0000");
+    const QString updatedTime = QStringLiteral("2014-01-02T10:00:00+0000");
+    const QString thumbnailUrl = QStringLiteral("https://scontent.example.com/s320x320/5000001.jpg");
+    const QString imageUrl = QStringLiteral("https://scontent.example.com/o/5000001.jpg");
+
+    // the complete objects, as returned without a fields selector.
+    QJsonObject from;
+    from.insert(QStringLiteral("id"), QStringLiteral("123456789"));
+    from.insert(QStringLiteral("name"), QStringLiteral("Test Person"));
+
+    QJsonObject album;
+    album.insert(QStringLiteral("id"), QStringLiteral("4000001"));
+    album.insert(QStringLiteral("from"), from);
+    album.insert(QStringLiteral("name"), QStringLiteral("Holiday"));
+    album.insert(QStringLiteral("link"), QStringLiteral("https://www.facebook.com/album.php?fbid=4000001"));
+    album.insert(QStringLiteral("cover_photo"), QStringLiteral("5000001"));
+    album.insert(QStringLiteral("privacy"), QStringLiteral("friends"));
+    album.insert(QStringLiteral("type"), QStringLiteral("normal"));
+    album.insert(QStringLiteral("can_upload"), false);
+    album.insert(QStringLiteral("count"), 1);
+    album.insert(QStringLiteral("created_time"), createdTime);
+    album.insert(QStringLiteral("updated_time"), updatedTime);
+
+    QJsonObject original, thumbnail;
+    original.insert(QStringLiteral("width"), 2048);
+    original.insert(QStringLiteral("height"), 1536);
+    original.insert(QStringLiteral("source"), imageUrl);
+    thumbnail.insert(QStringLiteral("width"), 320);
+    thumbnail.insert(QStringLiteral("height"), 240);
+    thumbnail.insert(QStringLiteral("source"), thumbnailUrl);
+    QJsonObject albumSummary;
+    albumSummary.insert(QStringLiteral("id"), QStringLiteral("4000001"));
+    albumSummary.insert(QStringLiteral("name"), QStringLiteral("Holiday"));
+
+    QJsonObject photo;
+    photo.insert(QStringLiteral("id"), QStringLiteral("5000001"));
+    photo.insert(QStringLiteral("from"), from);
+    photo.insert(QStringLiteral("album"), albumSummary);
+    photo.insert(QStringLiteral("name"), QStringLiteral("On the beach"));
+    photo.insert(QStringLiteral("picture"), QStringLiteral("https://scontent.example.com/s130x130/5000001.jpg"));
+    photo.insert(QStringLiteral("source"), imageUrl);
+    photo.insert(QStringLiteral("width"), 2048);
+    photo.insert(QStringLiteral("height"), 1536);
+    photo.insert(QStringLiteral("images"), QJsonArray() << original << thumbnail);
+    photo.insert(QStringLiteral("link"), QStringLiteral("https://www.facebook.com/photo.php?fbid=5000001"));
+    photo.insert(QStringLiteral("icon"), QStringLiteral("https://static.example.com/icon.gif"));
+    photo.insert(QStringLiteral("created_time"), createdTime);
+    photo.insert(QStringLiteral("updated_time"), updatedTime);
+
+    QJsonObject user;
+    user.insert(QStringLiteral("id"), QStringLiteral("123456789"));
+    user.insert(QStringLiteral("name"), QStringLiteral("Test Person"));
+    user.insert(QStringLiteral("first_name"), QStringLiteral("Test"));
+    user.insert(QStringLiteral("last_name"), QStringLiteral("Person"));
+    user.insert(QStringLiteral("gender"), QStringLiteral("male"));
+    user.insert(QStringLiteral("locale"), QStringLiteral("en_US"));
+    user.insert(QStringLiteral("timezone"), 10);
+    user.insert(QStringLiteral("updated_time"), updatedTime);
+
+    // the replies, with the fields selectors applied.
+    QJsonObject albums;
+    albums.insert(QStringLiteral("data"), QJsonArray() << fbImgSa->project(QStringLiteral("albums"), album));
+    QJsonObject photos;
+    photos.insert(QStringLiteral("data"), QJsonArray() << fbImgSa->project(QStringLiteral("photos"), photo));
+    const QByteArray photosBody = QJsonDocument(photos).toJson(QJsonDocument::Compact);
+    const QByteArray userBody = QJsonDocument(fbImgSa->project(QStringLiteral("me"), user)).toJson(QJsonDocument::Compact);
+
+    // the user and the photos are requested in one batch, unless the
+    // user was stored by a previous run.
+    QJsonObject userResponse, photosResponse;
+    userResponse.insert(QStringLiteral("code"), 200);
+    userResponse.insert(QStringLiteral("body"), QString::fromUtf8(userBody));
+    photosResponse.insert(QStringLiteral("code"), 200);
+    photosResponse.insert(QStringLiteral("body"), QString::fromUtf8(photosBody));
+
+    QMap<QString, QByteArray> bodies;
+    bodies.insert(QStringLiteral("albums.body"), QJsonDocument(albums).toJson(QJsonDocument::Compact));
+    bodies.insert(QStringLiteral("batch.body"), QJsonDocument(QJsonArray() << userResponse << photosResponse).toJson(QJsonDocument::Compact));
+    bodies.insert(QStringLiteral("photos.body"), photosBody);
+    bodies.insert(QStringLiteral("me.body"), userBody);
+    QJsonArray index;
+    index.append(fixture(QStringLiteral("GET"), QStringLiteral("^https://graph\\.facebook\\.com/me/albums\\?.*$"), QStringLiteral("albums.body")));
+    index.append(fixture(QStringLiteral("POST"), QStringLiteral("^https://graph\\.facebook\\.com/$"), QStringLiteral("batch.body")));
+    index.append(fixture(QStringLiteral("GET"), QStringLiteral("^https://graph\\.facebook\\.com/4000001/photos\\?.*$"), QStringLiteral("photos.body")));
+    index.append(fixture(QStringLiteral("GET"), QStringLiteral("^https://graph\\.facebook\\.com/me\\?.*$"), QStringLiteral("me.body")));
+
+    QTemporaryDir fixtures;
+    QVERIFY(fixtures.isValid());
+    QVERIFY(writeFixtures(fixtures.path(), index, bodies));
+    QVERIFY(TestNetworkReplay::loadFixtures(fixtures.path()));
+
+    fbImgSa->doBeginSync(7357, QStringLiteral("testAccessToken"));
+    QTRY_VERIFY_WITH_TIMEOUT(fbImgSa->m_finalized, 10000);
+    QCOMPARE(TestNetworkReplay::unmatchedRequests(), 0);
+
+    const QDateTime expectedCreatedTime = QDateTime::fromString(createdTime, Qt::ISODate);
+    const QDateTime expectedUpdatedTime = QDateTime::fromString(updatedTime, Qt::ISODate);
+    QVERIFY(expectedCreatedTime.isValid());
+    QVERIFY(expectedUpdatedTime.isValid());
+
+    FacebookImagesDatabase db;
+    FacebookUser::ConstPtr storedUser = db.user(QStringLiteral("123456789"));
+    QVERIFY(!storedUser.isNull());
+    QCOMPARE(storedUser->userName(), QStringLiteral("Test Person"));
+    QCOMPARE(storedUser->updatedTime(), expectedUpdatedTime);
+
+    FacebookAlbum::ConstPtr storedAlbum = db.album(QStringLiteral("4000001"));
+    QVERIFY(!storedAlbum.isNull());
+    QCOMPARE(storedAlbum->fbUserId(), QStringLiteral("123456789"));
+    QCOMPARE(storedAlbum->albumName(), QStringLiteral("Holiday"));
+    QCOMPARE(storedAlbum->createdTime(), expectedCreatedTime);
+    QCOMPARE(storedAlbum->updatedTime(), expectedUpdatedTime);
+    QCOMPARE(storedAlbum->imageCount(), 1);
+
+    FacebookImage::ConstPtr storedImage = db.image(QStringLiteral("5000001"));
+    QVERIFY(!storedImage.isNull());
+    QCOMPARE(storedImage->fbAlbumId(), QStringLiteral("4000001"));
+    QCOMPARE(storedImage->imageName(), QStringLiteral("On the beach"));
+    QCOMPARE(storedImage->createdTime(), expectedCreatedTime);
+    QCOMPARE(storedImage->updatedTime(), expectedUpdatedTime);
+    QCOMPARE(storedImage->width(), 2048);
+    QCOMPARE(storedImage->height(), 1536);
+    QCOMPARE(storedImage->thumbnailUrl(), thumbnailUrl);
+    QCOMPARE(storedImage->imageUrl(), imageUrl);
+
+    fbImgSa->doPurge(7357);
+}
+
 void tst_facebook::notifications()
 {
     QScopedPointer<FacebookNotificationSyncAdaptor> fbNotSa(new FacebookNotificationSyncAdaptor(this));
@@ -264,6 +455,64 @@ void tst_facebook::posts()
     QSKIP("we no longer sync posts");
 }
 
+void tst_facebook::networkReplay()
+{
+    QTemporaryDir fixtures;
+    QVERIFY(fixtures.isValid());
+    QFile index(fixtures.path() + QStringLiteral("/fixtures.json"));
+    QVERIFY(index.open(QIODevice::WriteOnly));
+    index.write("[ { \"method\": \"GET\", \"url\": \"^https://graph\\\\.facebook\\\\.com/me/albums\\\\?access_token=[^&]*$\", \"file\": \"first.body\" },\n"
+                "  { \"method\": \"GET\", \"url\": \"^https://graph\\\\.facebook\\\\.com/me/albums\\\\?access_token=[^&]*$\", \"file\": \"second.body\","
+                "    \"status\": 400 } ]");
+    index.close();
+    QFile first(fixtures.path() + QStringLiteral("/first.body"));
+    QVERIFY(first.open(QIODevice::WriteOnly));
+    first.write(QByteArray(100000, 'x'));
+    first.close();
+    QFile second(fixtures.path() + QStringLiteral("/second.body"));
+    QVERIFY(second.open(QIODevice::WriteOnly));
+    second.write("{}");
+    second.close();
+    QVERIFY(TestNetworkReplay::loadFixtures(fixtures.path()));
+
+    TestNetworkReplay::Delivery delivery;
+    delivery.latency = 10;
+    delivery.chunkSize = 4096;
+    TestNetworkReplay::setDelivery(delivery);
+
+    SocialdNetworkAccessManager qnam;
+    const QUrl albumsUrl(QStringLiteral("https://graph.facebook.com/me/albums?access_token=testAccessToken"));
+
+    // the recorded body is delivered in chunks.
+    QNetworkReply *reply = qnam.get(QNetworkRequest(albumsUrl));
+    QSignalSpy readyReadSpy(reply, SIGNAL(readyRead()));
+    QSignalSpy finishedSpy(reply, SIGNAL(finished()));
+    QTRY_COMPARE(finishedSpy.count(), 1);
+    QCOMPARE(readyReadSpy.count(), (100000 + 4095) / 4096);
+    QCOMPARE(reply->readAll(), QByteArray(100000, 'x'));
+    QCOMPARE(reply->error(), QNetworkReply::NoError);
+    reply->deleteLater();
+
+    // the second request for the same pattern gets the next fixture.
+    reply = qnam.get(QNetworkRequest(albumsUrl));
+    QSignalSpy secondFinishedSpy(reply, SIGNAL(finished()));
+    QTRY_COMPARE(secondFinishedSpy.count(), 1);
+    QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 400);
+    QCOMPARE(reply->error(), QNetworkReply::ProtocolInvalidOperationError);
+    reply->deleteLater();
+
+    // unmatched requests fall back to the generated data.
+    reply = qnam.get(QNetworkRequest(QUrl(QStringLiteral("https://graph.facebook.com/me"))));
+    QSignalSpy generatedFinishedSpy(reply, SIGNAL(finished()));
+    QTRY_COMPARE(generatedFinishedSpy.count(), 1);
+    QCOMPARE(QJsonDocument::fromJson(reply->readAll()).object().value(QStringLiteral("id")).toString(),
+             QStringLiteral("123456789"));
+    reply->deleteLater();
+
+    QCOMPARE(TestNetworkReplay::servedRequests(), 2);
+    QCOMPARE(TestNetworkReplay::unmatchedRequests(), 1);
+}
+
 // --------------------------------
 
 QTEST_MAIN(tst_facebook)
@@ -23,6 +23,12 @@
 
 #include <QtGlobal>
 #include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QSettings>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 
 #include "constants_p.h"
 #include <qtcontacts-extensions_impl.h>
@@ -30,6 +36,10 @@
 
 #include "googlecalendarsyncadaptor.h"
 #include "googletwowaycontactsyncadaptor.h"
+#include "googlecontactstream.h"
+#include "googlecontactatom.h"
+
+#include "networkstubs_p.h"
 
 class tst_google : public QObject
 {
@@ -48,9 +58,150 @@ public slots:
 
 private slots:
     void calendars();
+    void calendarsFieldProjection();
+    void calendarBatchResponse_data();
+    void calendarBatchResponse();
+    void calendarUpsyncBatch();
     void contacts();
+    void contactXmlElements();
+};
+
+// --------------------------------
+
+class TestGoogleCalendarSyncAdaptor : public GoogleCalendarSyncAdaptor
+{
+    Q_OBJECT
+public:
+    TestGoogleCalendarSyncAdaptor(QObject *parent)
+        : GoogleCalendarSyncAdaptor(parent), m_finished(false) {}
+    void doBeginSync(int accountId, const QString &accessToken) { openStorage(); beginSync(accountId, accessToken); }
+    void doPurge(int accountId) { purgeDataForOldAccount(accountId, SocialNetworkSyncAdaptor::CleanUpPurge); }
+    QJsonObject project(const QString &endpoint, const QJsonObject &object) const
+        { return fieldProjection().project(endpoint, object); }
+    static void doJsonToKCal(const QJsonObject &json, KCalCore::Event::Ptr event, KCalCore::ICalFormat &icalFormat)
+        { jsonToKCal(json, event, icalFormat); }
+    static QMap<int, QPair<int, QByteArray> > doParseBatchResponse(const QByteArray &contentType, const QByteArray &data)
+        { return parseBatchResponse(contentType, data); }
+    void doUpsyncBatch(int accountId, const QString &calendarId, const QStringList &kcalEventIds, const QStringList &eventIds)
+    {
+        QList<UpsyncChange> changes;
+        for (int i = 0; i < kcalEventIds.size(); ++i) {
+            UpsyncChange change = { UpsyncModify, kcalEventIds.at(i), eventIds.at(i), QByteArray("{}") };
+            changes.append(change);
+        }
+        openStorage();
+        upsyncBatch(accountId, QStringLiteral("testAccessToken"), calendarId, changes);
+    }
+protected:
+    void finalCleanup() { GoogleCalendarSyncAdaptor::finalCleanup(); m_finished = true; }
+public:
+    bool m_finished;
 };
 
+// writes the fixtures.json index and the response bodies of a replay.
+static bool writeFixtures(const QString &directory, const QJsonArray &index, const QMap<QString, QByteArray> &bodies)
+{
+    QFile indexFile(directory + QStringLiteral("/fixtures.json"));
+    if (!indexFile.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    indexFile.write(QJsonDocument(index).toJson());
+    indexFile.close();
+
+    for (QMap<QString, QByteArray>::const_iterator it = bodies.constBegin(); it != bodies.constEnd(); ++it) {
+        QFile body(directory + QLatin1Char('/') + it.key());
+        if (!body.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        body.write(it.value());
+    }
+    return true;
+}
+
+static QJsonObject fixture(const QString &url, const QString &file)
+{
+    QJsonObject retn;
+    retn.insert(QStringLiteral("method"), QStringLiteral("GET"));
+    retn.insert(QStringLiteral("url"), url);
+    retn.insert(QStringLiteral("file"), file);
+    return retn;
+}
+
+// one part of a multipart/mixed batch response.
+static QByteArray batchPart(const QByteArray &boundary, int item, int status, const QByteArray &body,
+                            const QByteArray &newline)
+{
+    QByteArray reason = status == 200 ? "OK" : (status == 204 ? "No Content" : "Error");
+    QByteArray retn = "--" + boundary + newline
+                    + "Content-Type: application/http" + newline
+                    + "Content-ID: <response-item-" + QByteArray::number(item) + ">" + newline
+                    + newline
+                    + "HTTP/1.1 " + QByteArray::number(status) + ' ' + reason + newline;
+    if (!body.isEmpty()) {
+        retn += "Content-Type: application/json; charset=UTF-8" + newline
+              + "Content-Length: " + QByteArray::number(body.size()) + newline;
+    }
+    retn += newline + body + newline;
+    return retn;
+}
+
+static QJsonObject calendarListEntry(const QString &id, const QString &summary, const QString &color,
+                                     const QString &accessRole)
+{
+    QJsonObject retn;
+    retn.insert(QStringLiteral("kind"), QStringLiteral("calendar#calendarListEntry"));
+    retn.insert(QStringLiteral("etag"), QStringLiteral("\"1400000000000000\""));
+    retn.insert(QStringLiteral("id"), id);
+    retn.insert(QStringLiteral("summary"), summary);
+    retn.insert(QStringLiteral("timeZone"), QStringLiteral("Australia/Brisbane"));
+    retn.insert(QStringLiteral("colorId"), QStringLiteral("14"));
+    retn.insert(QStringLiteral("backgroundColor"), color);
+    retn.insert(QStringLiteral("foregroundColor"), QStringLiteral("#000000"));
+    retn.insert(QStringLiteral("selected"), true);
+    retn.insert(QStringLiteral("accessRole"), accessRole);
+    retn.insert(QStringLiteral("defaultReminders"), QJsonArray());
+    return retn;
+}
+
+static QJsonObject eventTime(const QString &member, const QString &value)
+{
+    QJsonObject retn;
+    retn.insert(member, value);
+    if (member == QLatin1String("dateTime")) {
+        retn.insert(QStringLiteral("timeZone"), QStringLiteral("Australia/Brisbane"));
+    }
+    return retn;
+}
+
+static QJsonObject event(const QString &id, const QString &status, const QString &summary,
+                         const QJsonObject &start, const QJsonObject &end)
+{
+    QJsonObject creator;
+    creator.insert(QStringLiteral("email"), QStringLiteral("test.person@example.com"));
+    creator.insert(QStringLiteral("self"), true);
+
+    QJsonObject retn;
+    retn.insert(QStringLiteral("kind"), QStringLiteral("calendar#event"));
+    retn.insert(QStringLiteral("etag"), QStringLiteral("\"2800000000000000\""));
+    retn.insert(QStringLiteral("id"), id);
+    retn.insert(QStringLiteral("status"), status);
+    retn.insert(QStringLiteral("htmlLink"), QStringLiteral("https://www.google.com/calendar/event?eid=%1").arg(id));
+    retn.insert(QStringLiteral("created"), QStringLiteral("2014-06-01T09:00:00.000Z"));
+    retn.insert(QStringLiteral("updated"), QStringLiteral("2014-06-01T09:30:00.000Z"));
+    retn.insert(QStringLiteral("summary"), summary);
+    retn.insert(QStringLiteral("description"), QStringLiteral("The description of %1").arg(summary));
+    retn.insert(QStringLiteral("location"), QStringLiteral("Meeting room 4"));
+    retn.insert(QStringLiteral("creator"), creator);
+    retn.insert(QStringLiteral("organizer"), creator);
+    retn.insert(QStringLiteral("start"), start);
+    retn.insert(QStringLiteral("end"), end);
+    retn.insert(QStringLiteral("iCalUID"), id + QStringLiteral("@google.com"));
+    retn.insert(QStringLiteral("sequence"), 2);
+    retn.insert(QStringLiteral("locked"), true);
+    retn.insert(QStringLiteral("reminders"), QJsonObject());
+    return retn;
+}
+
 // --------------------------------
 
 tst_google::tst_google()
@@ -75,6 +226,7 @@ void tst_google::init()
 
 void tst_google::cleanup()
 {
+    TestNetworkReplay::clear();
 }
 
 // --------------------------------
@@ -85,12 +237,403 @@ void tst_google::calendars()
     QSKIP("TODO: write unit tests for this");
 }
 
+void tst_google::calendarsFieldProjection()
+{
+    // the replies only contain the fields which the adaptor requests, so
+    // every field which its handlers store must survive the projection.
+    const int accountId = 7357;
+    const QString calendarId = QStringLiteral("test.person@example.com");
+    QScopedPointer<TestGoogleCalendarSyncAdaptor> ggCalSa(new TestGoogleCalendarSyncAdaptor(this));
+    ggCalSa->doPurge(accountId);
+    ggCalSa->m_finished = false;
+
+    // the complete replies, as returned without a fields selector.  Both
+    // lists have two pages, so that the page tokens must be selected too.
+    QJsonObject calendarsPage1, calendarsPage2;
+    calendarsPage1.insert(QStringLiteral("kind"), QStringLiteral("calendar#calendarList"));
+    calendarsPage1.insert(QStringLiteral("etag"), QStringLiteral("\"p1\""));
+    calendarsPage1.insert(QStringLiteral("nextPageToken"), QStringLiteral("calendarsPage2"));
+    calendarsPage1.insert(QStringLiteral("items"), QJsonArray()
+            << calendarListEntry(QStringLiteral("holidays@group.v.calendar.google.com"), QStringLiteral("Holidays"),
+                                 QStringLiteral("#16a765"), QStringLiteral("reader")));
+    calendarsPage2.insert(QStringLiteral("kind"), QStringLiteral("calendar#calendarList"));
+    calendarsPage2.insert(QStringLiteral("etag"), QStringLiteral("\"p2\""));
+    calendarsPage2.insert(QStringLiteral("nextSyncToken"), QStringLiteral("calendarListSyncToken"));
+    calendarsPage2.insert(QStringLiteral("items"), QJsonArray()
+            << calendarListEntry(calendarId, QStringLiteral("Test Person"),
+                                 QStringLiteral("#9fc6e7"), QStringLiteral("owner")));
+
+    QJsonObject recurring = event(QStringLiteral("recurringevent"), QStringLiteral("confirmed"), QStringLiteral("Weekly meeting"),
+                                  eventTime(QStringLiteral("dateTime"), QStringLiteral("2014-06-02T10:00:00+10:00")),
+                                  eventTime(QStringLiteral("dateTime"), QStringLiteral("2014-06-02T11:00:00+10:00")));
+    recurring.insert(QStringLiteral("recurrence"), QJsonArray() << QStringLiteral("RRULE:FREQ=WEEKLY;COUNT=10"));
+    QJsonObject allDay = event(QStringLiteral("alldayevent"), QStringLiteral("confirmed"), QStringLiteral("Conference"),
+                               eventTime(QStringLiteral("date"), QStringLiteral("2014-06-10")),
+                               eventTime(QStringLiteral("date"), QStringLiteral("2014-06-12")));
+    QJsonObject cancelled = event(QStringLiteral("cancelledevent"), QStringLiteral("cancelled"), QStringLiteral("Cancelled"),
+                                  eventTime(QStringLiteral("date"), QStringLiteral("2014-06-20")),
+                                  eventTime(QStringLiteral("date"), QStringLiteral("2014-06-21")));
+
+    QJsonObject eventsPage1, eventsPage2;
+    eventsPage1.insert(QStringLiteral("kind"), QStringLiteral("calendar#events"));
+    eventsPage1.insert(QStringLiteral("summary"), QStringLiteral("Test Person"));
+    eventsPage1.insert(QStringLiteral("timeZone"), QStringLiteral("Australia/Brisbane"));
+    eventsPage1.insert(QStringLiteral("updated"), QStringLiteral("2014-06-01T09:30:00.000Z"));
+    eventsPage1.insert(QStringLiteral("nextPageToken"), QStringLiteral("eventsPage2"));
+    eventsPage1.insert(QStringLiteral("items"), QJsonArray() << recurring);
+    eventsPage2 = eventsPage1;
+    eventsPage2.remove(QStringLiteral("nextPageToken"));
+    eventsPage2.insert(QStringLiteral("nextSyncToken"), QStringLiteral("eventsSyncToken"));
+    eventsPage2.insert(QStringLiteral("items"), QJsonArray() << allDay << cancelled);
+
+    // the pages of each list are served in order.
+    QMap<QString, QByteArray> bodies;
+    bodies.insert(QStringLiteral("calendars1.body"), QJsonDocument(ggCalSa->project(QStringLiteral("calendarList"), calendarsPage1)).toJson());
+    bodies.insert(QStringLiteral("calendars2.body"), QJsonDocument(ggCalSa->project(QStringLiteral("calendarList"), calendarsPage2)).toJson());
+    bodies.insert(QStringLiteral("events1.body"), QJsonDocument(ggCalSa->project(QStringLiteral("events"), eventsPage1)).toJson());
+    bodies.insert(QStringLiteral("events2.body"), QJsonDocument(ggCalSa->project(QStringLiteral("events"), eventsPage2)).toJson());
+    const QString calendarsUrl = QStringLiteral("^https://www\\.googleapis\\.com/calendar/v3/users/me/calendarList\\?.*$");
+    const QString eventsUrl = QStringLiteral("^https://www\\.googleapis\\.com/calendar/v3/calendars/[^/]*/events\\?.*$");
+    QJsonArray index;
+    index.append(fixture(calendarsUrl, QStringLiteral("calendars1.body")));
+    index.append(fixture(calendarsUrl, QStringLiteral("calendars2.body")));
+    index.append(fixture(eventsUrl, QStringLiteral("events1.body")));
+    index.append(fixture(eventsUrl, QStringLiteral("events2.body")));
+
+    QTemporaryDir fixtures;
+    QVERIFY(fixtures.isValid());
+    QVERIFY(writeFixtures(fixtures.path(), index, bodies));
+    QVERIFY(TestNetworkReplay::loadFixtures(fixtures.path()));
+
+    ggCalSa->doBeginSync(accountId, QStringLiteral("testAccessToken"));
+    QTRY_VERIFY_WITH_TIMEOUT(ggCalSa->m_finished, 10000);
+    QCOMPARE(TestNetworkReplay::servedRequests(), 4);
+    QCOMPARE(TestNetworkReplay::unmatchedRequests(), 0);
+
+    // only the calendar which the user owns is stored.
+    mKCal::ExtendedCalendar::Ptr calendar(new mKCal::ExtendedCalendar(QLatin1String("UTC")));
+    mKCal::ExtendedStorage::Ptr storage = mKCal::ExtendedCalendar::defaultStorage(calendar);
+    QVERIFY(storage->open());
+    mKCal::Notebook::Ptr googleNotebook;
+    foreach (mKCal::Notebook::Ptr notebook, storage->notebooks()) {
+        if (notebook->pluginName().startsWith(QStringLiteral("google-"))
+                && notebook->account() == QString::number(accountId)) {
+            QVERIFY(googleNotebook.isNull());
+            googleNotebook = notebook;
+        }
+    }
+    QVERIFY(!googleNotebook.isNull());
+    QCOMPARE(googleNotebook->pluginName(), QStringLiteral("google-") + calendarId);
+    QCOMPARE(googleNotebook->name(), QStringLiteral("Test Person"));
+    QCOMPARE(googleNotebook->color(), QStringLiteral("#9fc6e7"));
+
+    // the cancelled event is not stored.
+    storage->loadNotebookIncidences(googleNotebook->uid());
+    KCalCore::Incidence::List incidences;
+    storage->allIncidences(&incidences, googleNotebook->uid());
+    QCOMPARE(incidences.size(), 2);
+    KCalCore::Event::Ptr storedRecurring, storedAllDay;
+    foreach (KCalCore::Incidence::Ptr incidence, incidences) {
+        const QString gcalId = incidence->customProperty("jolla-sociald", "gcal-id");
+        if (gcalId == QLatin1String("recurringevent")) {
+            storedRecurring = calendar->event(incidence->uid());
+        } else if (gcalId == QLatin1String("alldayevent")) {
+            storedAllDay = calendar->event(incidence->uid());
+        }
+    }
+    QVERIFY(!storedRecurring.isNull());
+    QVERIFY(!storedAllDay.isNull());
+
+    QCOMPARE(storedRecurring->summary(), QStringLiteral("Weekly meeting"));
+    QCOMPARE(storedRecurring->description(), QStringLiteral("The description of Weekly meeting"));
+    QCOMPARE(storedRecurring->location(), QStringLiteral("Meeting room 4"));
+    QCOMPARE(storedRecurring->dtStart().toUtc().dateTime(), QDateTime(QDate(2014, 6, 2), QTime(0, 0), Qt::UTC));
+    QCOMPARE(storedRecurring->dtEnd().toUtc().dateTime(), QDateTime(QDate(2014, 6, 2), QTime(1, 0), Qt::UTC));
+    QVERIFY(!storedRecurring->allDay());
+    QVERIFY(storedRecurring->recurs());
+    QCOMPARE(storedRecurring->recurrence()->duration(), 10);
+
+    QCOMPARE(storedAllDay->summary(), QStringLiteral("Conference"));
+    QVERIFY(storedAllDay->allDay());
+    QCOMPARE(storedAllDay->dtStart().date(), QDate(2014, 6, 10));
+    QVERIFY(!storedAllDay->recurs());
+    storage->close();
+
+    // the event list's sync token and update time are kept for the next sync.
+    QSettings gcalSettings(QString::fromLatin1("%1/%2/gcal.ini").arg(QString::fromLatin1(PRIVILEGED_DATA_DIR))
+                                                                .arg(QString::fromLatin1(SYNC_DATABASE_DIR)),
+                           QSettings::IniFormat);
+    gcalSettings.beginGroup(QString::fromLatin1("%1-syncTokens").arg(accountId));
+    QCOMPARE(gcalSettings.value(calendarId).toString(), QStringLiteral("eventsSyncToken"));
+    gcalSettings.endGroup();
+    GoogleCalendarDatabase idDb;
+    QCOMPARE(idDb.lastUpdateTime(calendarId, accountId), QStringLiteral("2014-06-01T09:30:00.000Z"));
+
+    // the members which are not persisted by the storage are checked on
+    // the conversion of the projected event.
+    KCalCore::ICalFormat icalFormat;
+    KCalCore::Event::Ptr converted(new KCalCore::Event);
+    TestGoogleCalendarSyncAdaptor::doJsonToKCal(
+            ggCalSa->project(QStringLiteral("events"), eventsPage1).value(QStringLiteral("items")).toArray().first().toObject(),
+            converted, icalFormat);
+    QCOMPARE(converted->revision(), 2);
+    QVERIFY(converted->isReadOnly());
+
+    ggCalSa->doPurge(accountId);
+}
+
+void tst_google::calendarBatchResponse_data()
+{
+    QTest::addColumn<QByteArray>("contentType");
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<QList<int> >("items");
+    QTest::addColumn<QList<int> >("statuses");
+    QTest::addColumn<QList<QByteArray> >("bodies");
+
+    const QByteArray boundary("batch_abc");
+    const QByteArray contentType("multipart/mixed; boundary=batch_abc");
+    const QByteArray event0("{\"id\":\"event0\"}");
+    const QByteArray event2("{\"id\":\"event2\"}");
+    const QByteArray conflict("{\"error\":{\"code\":409,\"message\":\"Conflict\"}}");
+
+    QTest::newRow("crlf")
+            << contentType
+            << batchPart(boundary, 0, 200, event0, "\r\n") + batchPart(boundary, 1, 204, QByteArray(), "\r\n")
+               + "--" + boundary + "--\r\n"
+            << (QList<int>() << 0 << 1)
+            << (QList<int>() << 200 << 204)
+            << (QList<QByteArray>() << event0 << QByteArray());
+    QTest::newRow("lf")
+            << contentType
+            << batchPart(boundary, 0, 200, event0, "\n") + batchPart(boundary, 1, 204, QByteArray(), "\n")
+               + "--" + boundary + "--\n"
+            << (QList<int>() << 0 << 1)
+            << (QList<int>() << 200 << 204)
+            << (QList<QByteArray>() << event0 << QByteArray());
+    QTest::newRow("quoted boundary")
+            << QByteArray("multipart/mixed; boundary=\"batch_abc\"; charset=UTF-8")
+            << batchPart(boundary, 0, 200, event0, "\r\n") + "--" + boundary + "--\r\n"
+            << (QList<int>() << 0)
+            << (QList<int>() << 200)
+            << (QList<QByteArray>() << event0);
+    QTest::newRow("missing part")
+            << contentType
+            << batchPart(boundary, 0, 200, event0, "\r\n") + batchPart(boundary, 2, 200, event2, "\r\n")
+               + "--" + boundary + "--\r\n"
+            << (QList<int>() << 0 << 2)
+            << (QList<int>() << 200 << 200)
+            << (QList<QByteArray>() << event0 << event2);
+    QTest::newRow("non-2xx part")
+            << contentType
+            << batchPart(boundary, 0, 409, conflict, "\r\n") + batchPart(boundary, 1, 200, event0, "\r\n")
+               + "--" + boundary + "--\r\n"
+            << (QList<int>() << 0 << 1)
+            << (QList<int>() << 409 << 200)
+            << (QList<QByteArray>() << conflict << event0);
+    QTest::newRow("out of order")
+            << contentType
+            << batchPart(boundary, 2, 200, event2, "\r\n") + batchPart(boundary, 0, 200, event0, "\r\n")
+               + batchPart(boundary, 1, 204, QByteArray(), "\r\n") + "--" + boundary + "--\r\n"
+            << (QList<int>() << 0 << 1 << 2)
+            << (QList<int>() << 200 << 204 << 200)
+            << (QList<QByteArray>() << event0 << QByteArray() << event2);
+    QTest::newRow("no boundary")
+            << QByteArray("multipart/mixed")
+            << batchPart(boundary, 0, 200, event0, "\r\n") + "--" + boundary + "--\r\n"
+            << QList<int>()
+            << QList<int>()
+            << QList<QByteArray>();
+}
+
+void tst_google::calendarBatchResponse()
+{
+    QFETCH(QByteArray, contentType);
+    QFETCH(QByteArray, data);
+    QFETCH(QList<int>, items);
+    QFETCH(QList<int>, statuses);
+    QFETCH(QList<QByteArray>, bodies);
+
+    const QMap<int, QPair<int, QByteArray> > results = TestGoogleCalendarSyncAdaptor::doParseBatchResponse(contentType, data);
+    QCOMPARE(results.keys(), items);
+    for (int i = 0; i < items.size(); ++i) {
+        QCOMPARE(results.value(items.at(i)).first, statuses.at(i));
+        QCOMPARE(results.value(items.at(i)).second, bodies.at(i));
+    }
+}
+
+void tst_google::calendarUpsyncBatch()
+{
+    // the responses to a batch of modifications are applied to the events
+    // given by their Content-IDs, regardless of the order of the parts.
+    const int accountId = 7357;
+    const QString calendarId = QStringLiteral("test.person@example.com");
+    QScopedPointer<TestGoogleCalendarSyncAdaptor> ggCalSa(new TestGoogleCalendarSyncAdaptor(this));
+    ggCalSa->doPurge(accountId);
+    ggCalSa->m_finished = false;
+
+    QStringList kcalEventIds;
+    QStringList eventIds;
+    {
+        mKCal::ExtendedCalendar::Ptr calendar(new mKCal::ExtendedCalendar(QLatin1String("UTC")));
+        mKCal::ExtendedStorage::Ptr storage = mKCal::ExtendedCalendar::defaultStorage(calendar);
+        QVERIFY(storage->open());
+        mKCal::Notebook::Ptr notebook(new mKCal::Notebook);
+        notebook->setIsReadOnly(false);
+        notebook->setName(QStringLiteral("Test Person"));
+        notebook->setPluginName(QStringLiteral("google-") + calendarId);
+        notebook->setAccount(QString::number(accountId));
+        QVERIFY(storage->addNotebook(notebook));
+        for (int i = 0; i < 4; ++i) {
+            KCalCore::Event::Ptr event(new KCalCore::Event);
+            event->setSummary(QStringLiteral("local %1").arg(i));
+            event->setDtStart(KDateTime(QDate(2014, 6, 2 + i), QTime(10, 0), KDateTime::UTC));
+            event->setDtEnd(KDateTime(QDate(2014, 6, 2 + i), QTime(11, 0), KDateTime::UTC));
+            event->setCustomProperty("jolla-sociald", "gcal-id", QStringLiteral("event%1").arg(i));
+            QVERIFY(calendar->addEvent(event, notebook->uid()));
+            kcalEventIds.append(event->uid());
+            eventIds.append(QStringLiteral("event%1").arg(i));
+        }
+        QVERIFY(storage->save());
+        storage->close();
+    }
+
+    // item 1 is missing from the response and item 3 failed.
+    QJsonObject start, end;
+    start.insert(QStringLiteral("dateTime"), QStringLiteral("2014-07-01T10:00:00Z"));
+    end.insert(QStringLiteral("dateTime"), QStringLiteral("2014-07-01T11:00:00Z"));
+    QJsonObject server0, server2;
+    server0.insert(QStringLiteral("id"), QStringLiteral("event0"));
+    server0.insert(QStringLiteral("summary"), QStringLiteral("server 0"));
+    server0.insert(QStringLiteral("start"), start);
+    server0.insert(QStringLiteral("end"), end);
+    server2 = server0;
+    server2.insert(QStringLiteral("id"), QStringLiteral("event2"));
+    server2.insert(QStringLiteral("summary"), QStringLiteral("server 2"));
+    const QByteArray boundary("batch_upsync");
+    QMap<QString, QByteArray> bodies;
+    bodies.insert(QStringLiteral("batch.body"),
+                  batchPart(boundary, 3, 409, "{\"error\":{\"code\":409,\"message\":\"Conflict\"}}", "\n")
+                  + batchPart(boundary, 2, 200, QJsonDocument(server2).toJson(QJsonDocument::Compact), "\n")
+                  + batchPart(boundary, 0, 200, QJsonDocument(server0).toJson(QJsonDocument::Compact), "\n")
+                  + "--" + boundary + "--\n");
+    QJsonObject batchFixture;
+    batchFixture.insert(QStringLiteral("method"), QStringLiteral("POST"));
+    batchFixture.insert(QStringLiteral("url"), QStringLiteral("^https://www\\.googleapis\\.com/batch/calendar/v3$"));
+    batchFixture.insert(QStringLiteral("file"), QStringLiteral("batch.body"));
+    QJsonObject headers;
+    headers.insert(QStringLiteral("Content-Type"), QStringLiteral("multipart/mixed; boundary=\"batch_upsync\""));
+    batchFixture.insert(QStringLiteral("headers"), headers);
+
+    QTemporaryDir fixtures;
+    QVERIFY(fixtures.isValid());
+    QVERIFY(writeFixtures(fixtures.path(), QJsonArray() << batchFixture, bodies));
+    QVERIFY(TestNetworkReplay::loadFixtures(fixtures.path()));
+
+    ggCalSa->doUpsyncBatch(accountId, calendarId, kcalEventIds, eventIds);
+    QTRY_VERIFY_WITH_TIMEOUT(ggCalSa->m_finished, 10000);
+    QCOMPARE(TestNetworkReplay::servedRequests(), 1);
+    QCOMPARE(TestNetworkReplay::unmatchedRequests(), 0);
+
+    mKCal::ExtendedCalendar::Ptr calendar(new mKCal::ExtendedCalendar(QLatin1String("UTC")));
+    mKCal::ExtendedStorage::Ptr storage = mKCal::ExtendedCalendar::defaultStorage(calendar);
+    QVERIFY(storage->open());
+    QStringList summaries;
+    foreach (const QString &kcalEventId, kcalEventIds) {
+        storage->load(kcalEventId);
+        KCalCore::Event::Ptr event = calendar->event(kcalEventId);
+        QVERIFY(!event.isNull());
+        summaries.append(event->summary());
+    }
+    QCOMPARE(summaries, QStringList() << QStringLiteral("server 0") << QStringLiteral("local 1")
+                                      << QStringLiteral("server 2") << QStringLiteral("local 3"));
+    QCOMPARE(calendar->event(kcalEventIds.at(2))->dtStart().toUtc().dateTime(),
+             QDateTime(QDate(2014, 7, 1), QTime(10, 0), Qt::UTC));
+    storage->close();
+
+    ggCalSa->doPurge(accountId);
+}
+
 void tst_google::contacts()
 {
     QScopedPointer<GoogleTwoWayContactSyncAdaptor> ggConSa(new GoogleTwoWayContactSyncAdaptor(this));
     QSKIP("TODO: write unit tests for this");
 }
 
+void tst_google::contactXmlElements()
+{
+    // the elements which can't be stored as details are kept as they were
+    // in the feed, including any child elements, whatever characters
+    // (multi-byte, or decoded to surrogate pairs) precede them.
+    const QByteArray title("<title>Zo\xC3\xAB \xF0\x9F\x98\x80 Person</title>");
+    const QByteArray photoLink("<link rel='http://schemas.google.com/contacts/2008/rel#photo' type='image/*'"
+                               " href='https://www.google.com/m8/feeds/photos/media/test%40example.com/contact1'"
+                               " gd:etag='\"photo1\"'/>");
+    const QByteArray extendedProperty("<gd:extendedProperty name='\xF0\x9F\x98\x80'>"
+                                      "<info>nested &amp; text \xC3\x85</info></gd:extendedProperty>");
+    const QByteArray group("<gContact:groupMembershipInfo deleted='false'"
+                           " href='http://www.google.com/m8/feeds/groups/test%40example.com/base/6'/>");
+    const QByteArray userDefinedField("<gContact:userDefinedField key='\xC3\x9C' value='\xF0\x9F\x98\x80\xF0\x9F\x98\x80'/>");
+    const QByteArray relation("<gContact:relation rel='spouse'>\xC3\x85lice</gContact:relation>");
+
+    const QByteArray feed = QByteArray("\xEF\xBB\xBF<?xml version='1.0' encoding='UTF-8'?>\n"
+            "<feed xmlns='http://www.w3.org/2005/Atom' xmlns:openSearch='http://a9.com/-/spec/opensearch/1.1/'"
+            " xmlns:gContact='http://schemas.google.com/contact/2008' xmlns:gd='http://schemas.google.com/g/2005'>\n"
+            "<id>test.person@example.com</id>\n"
+            "<title>Zo\xC3\xAB's \xF0\x9F\x98\x80 Contacts</title>\n"
+            "<entry gd:etag='\"etag1\"'>\n"
+            "  <id>http://www.google.com/m8/feeds/contacts/test%40example.com/base/contact1</id>\n"
+            "  ") + title + "\n"
+            "  " + photoLink + "\n"
+            "  <gd:name><gd:fullName>Zo\xC3\xAB Person</gd:fullName></gd:name>\n"
+            "  " + extendedProperty + "\n"
+            "  " + group + "\n"
+            "  " + userDefinedField + "\n"
+            "</entry>\n"
+            "<entry gd:etag='\"etag2\"'>\n"
+            "  <id>http://www.google.com/m8/feeds/contacts/test%40example.com/base/contact2</id>\n"
+            "  " + relation + "\n"
+            "  " + group + "\n"
+            "</entry>\n"
+            "</feed>\n";
+
+    GoogleContactStream parser(false, 7357);
+    QScopedPointer<GoogleContactAtom> atom(parser.parse(feed));
+    const QList<QPair<QContact, GoogleContactXmlElements> > entries = atom->entryContacts();
+    QCOMPARE(entries.size(), 2);
+
+    const QList<QByteArray> expected = QList<QByteArray>() << title << photoLink << extendedProperty
+                                                           << group << userDefinedField;
+    GoogleContactXmlElements elements = entries.at(0).second;
+    QCOMPARE(elements.count(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+        QCOMPARE(elements.at(i), expected.at(i));
+    }
+    QCOMPARE(entries.at(1).second.count(), 2);
+    QCOMPARE(entries.at(1).second.at(0), relation);
+    QCOMPARE(entries.at(1).second.at(1), group);
+    QCOMPARE(atom->entryContacts().at(0).first.detail<QContactAvatar>().imageUrl(),
+             QUrl(QStringLiteral("https://www.google.com/m8/feeds/photos/media/test%40example.com/contact1")));
+
+    // squeezing copies the elements out of the feed, without changing them.
+    elements.squeeze();
+    QCOMPARE(elements.count(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+        QCOMPARE(elements.at(i), expected.at(i));
+    }
+
+    // and the compact form restores the same elements.
+    const QByteArray compact = elements.toByteArray();
+    GoogleContactXmlElements restored = GoogleContactXmlElements::fromByteArray(compact);
+    QCOMPARE(restored.count(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+        QCOMPARE(restored.at(i), expected.at(i));
+    }
+
+    // a truncated element is dropped.
+    QCOMPARE(GoogleContactXmlElements::fromByteArray(compact.left(compact.size() - 1)).count(), expected.size() - 1);
+    QVERIFY(GoogleContactXmlElements::fromByteArray(QByteArray()).isEmpty());
+}
+
 // --------------------------------
 
 QTEST_MAIN(tst_google)